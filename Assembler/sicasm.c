@@ -0,0 +1,716 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "../Common/batch.h"
+#include "../Common/cache.h"
+#include "../Common/csect.h"
+#include "../Common/handoff.h"
+#include "../Common/incremental.h"
+#include "../Common/macro.h"
+#include "../Common/objimage.h"
+#include "../Common/onepass.h"
+#include "../Common/parallel.h"
+#include "../Common/pool.h"
+#include "../Common/program.h"
+#include "../Common/protocol.h"
+#include "../Common/stats.h"
+
+// Function to print how the assembler is invoked
+void printUsage(const char *name) {
+    fprintf(stderr, "Usage: %s [options] [source]\n", name);
+    fprintf(stderr, "       %s --batch [-j threads] [-O dir] [-l list] [source|dir]...\n", name);
+    fprintf(stderr, "  source               SIC source program, - for stdin (default: source.txt)\n");
+    fprintf(stderr, "  -o <file>            Object program to write, - for stdout alone (no LOCCTR table; default: object_program.txt)\n");
+    fprintf(stderr, "  -d, --debug-files    Also write intermediate.txt, symtab.txt and optab.txt\n");
+    fprintf(stderr, "  -q, --quiet          Do not print the LOCCTR table\n");
+    fprintf(stderr, "  -j <threads>         Threads for a large source, its control sections, or a batch (default: 1, or one per processor)\n");
+    fprintf(stderr, "  -b, --batch          Assemble many sources in parallel, each into <name>.obj\n");
+    fprintf(stderr, "  -O <dir>             Batch output directory (default: next to each source)\n");
+    fprintf(stderr, "  -l <file>            Batch sources listed in a file, one per line\n");
+    fprintf(stderr, "  --connect <socket>   Assemble on a running sicasmd instead of in this process\n");
+    fprintf(stderr, "  -1, --one-pass       Assemble in a single pass, streaming the source (no LOCCTR table)\n");
+    fprintf(stderr, "  --pipeline           One pass on reader, assembler and emitter threads, overlapping input and output\n");
+    fprintf(stderr, "  --binary             Write the object program in binary, as code segments\n");
+    fprintf(stderr, "  --image              Write the object program as one binary memory image, to be mapped\n");
+    fprintf(stderr, "  -w, --watch          Assemble again, incrementally, every time the source is saved\n");
+    fprintf(stderr, "  --cache <dir>        Replay unchanged sources from an assembly cache, and store new ones (default: $SICASM_CACHE)\n");
+    fprintf(stderr, "  --cache-size <MB>    Size the cache is kept under (default: the last size given, or 256)\n");
+    fprintf(stderr, "  --cache-stats        Print the hits, misses and size of the cache and exit\n");
+    fprintf(stderr, "  --stats[=json|text]  Print per-phase times, counters and peak sizes to stderr\n");
+    fprintf(stderr, "  -h, --help           Show this message\n");
+}
+
+// Where the object program goes: a file that replaces the old one only
+// once it is complete, or stdout for -o -. Stdout gets it through a
+// temporary file, copied out only after a run that succeeded, so a failed
+// run writes nothing there either (and memory stays the same whatever the
+// size of the program).
+typedef struct {
+    int to_stdout;
+    atomic_file file;
+    FILE *stream;
+} object_target;
+
+// Function to open the object program at path, - for stdout
+int openObjectTarget(object_target *target, const char *path) {
+    memset(target, 0, sizeof(*target));
+    target->to_stdout = !strcmp(path, "-");
+    if (target->to_stdout) {
+        target->stream = tmpfile();
+        if (!target->stream) {
+            perror("tmpfile");
+            return -1;
+        }
+        return 0;
+    }
+    if (openAtomicFile(&target->file, path) != 0) {
+        return -1;
+    }
+    target->stream = target->file.file;
+    return 0;
+}
+
+// Function to copy the finished object program from its temporary file to stdout
+static int copyToStdout(FILE *stream) {
+    char buffer[64 * 1024];
+    if (fflush(stream) != 0 || fseek(stream, 0, SEEK_SET) != 0) return -1;
+    size_t count;
+    while ((count = fread(buffer, 1, sizeof(buffer), stream)) > 0) {
+        if (fwrite(buffer, 1, count, stdout) != count) return -1;
+    }
+    return ferror(stream) || fflush(stdout) != 0 ? -1 : 0;
+}
+
+// Function to finish the object program after a run that ended with status
+int closeObjectTarget(object_target *target, int status) {
+    if (target->to_stdout) {
+        if (status == 0 && copyToStdout(target->stream) != 0) {
+            perror("stdout");
+            status = -1;
+        }
+        fclose(target->stream);
+        return status;
+    }
+    if (status == 0) return commitAtomicFile(&target->file);
+    discardAtomicFile(&target->file);
+    return status;
+}
+
+// Function to assemble one source on the daemon listening at socket_path
+int runClientMode(const char *socket_path, const char *source_path, const char *object_path, int quiet) {
+    source_buffer source;
+    if (openSourceBuffer(&source, source_path) != 0) {
+        return EXIT_FAILURE;
+    }
+
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, socket_path, sizeof(address.sun_path) - 1);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0) {
+        perror(socket_path);
+        if (fd >= 0) close(fd);
+        closeSourceBuffer(&source);
+        return EXIT_FAILURE;
+    }
+
+    sic_options options = {!quiet};
+    sic_result result;
+    int status = sendAssembleRequest(fd, source.data, source.size, &options);
+    if (status == 0) status = receiveAssembleResult(fd, &result);
+    close(fd);
+    closeSourceBuffer(&source);
+    if (status != 0) {
+        fprintf(stderr, "Error: No reply from the daemon.\n");
+        return EXIT_FAILURE;
+    }
+
+    // Same output as assembling in this process
+    if (result.diagnostics_size > 0) fwrite(result.diagnostics, 1, result.diagnostics_size, stderr);
+    if (result.listing_size > 0) fwrite(result.listing, 1, result.listing_size, stdout);
+    if (result.status == 0) {
+        object_target target;
+        if (openObjectTarget(&target, object_path) != 0) {
+            sic_free_result(&result);
+            return EXIT_FAILURE;
+        }
+        if (result.object_size > 0) fwrite(result.object_program, 1, result.object_size, target.stream);
+        if (closeObjectTarget(&target, ferror(target.stream) ? -1 : 0) != 0) {
+            sic_free_result(&result);
+            return EXIT_FAILURE;
+        }
+        if (!target.to_stdout) printf("Object program generated successfully!\n");
+    }
+
+    status = result.status;
+    sic_free_result(&result);
+    return status == 0 ? 0 : EXIT_FAILURE;
+}
+
+// An object program on its way to a file: the H / T / E records go straight
+// to it, or are kept in memory to be converted to a binary form ('b', 'i')
+typedef struct {
+    FILE *file;
+    char format;
+    char *text;
+    size_t text_size;
+    FILE *records;
+} object_output;
+
+// Function to get the stream the assembler writes the object program to
+FILE *beginObjectOutput(object_output *output, FILE *file, char format) {
+    memset(output, 0, sizeof(*output));
+    output->file = file;
+    output->format = format;
+    output->records = format == 't' ? file : open_memstream(&output->text, &output->text_size);
+    if (!output->records) perror("open_memstream");
+    return output->records;
+}
+
+// Function to finish the object program once the assembler is done with
+// status, converting the records if needed
+int endObjectOutput(object_output *output, int status) {
+    if (output->format != 't') {
+        if (output->records && fclose(output->records) != 0) status = -1;
+        if (status == 0) {
+            status = convertObjectProgram(output->text, output->text_size, output->format, output->file, stderr);
+        }
+        free(output->text);
+    }
+    return status;
+}
+
+// Function to assemble a source made of control sections, each into an
+// object program of its own, written one after another in source order
+int runSectionMode(const source_buffer *source, const char *object_path, int thread_count, FILE *listing,
+                   FILE *diagnostics, int *line_count) {
+    object_target target;
+    if (openObjectTarget(&target, object_path) != 0) {
+        return -1;
+    }
+
+    int status = assembleControlSections(source->data, source->size, thread_count, target.stream, listing,
+                                         diagnostics, line_count);
+    return closeObjectTarget(&target, status);
+}
+
+// Function to assemble a source in two passes over the in-memory program
+int runTwoPassMode(const source_buffer *source, const char *object_path, int thread_count, char format,
+                   int debug_files, FILE *listing, FILE *diagnostics, int *line_count) {
+    // Pass 1: assign addresses and build SYMTAB / OPTAB in memory
+    // (with -j, chunks of a large source are assembled on several threads)
+    program prog;
+    initProgram(&prog);
+    setDiagnostics(&prog, diagnostics);
+    int status = runParallelPass1(&prog, source->data, source->size, thread_count);
+    *line_count = prog.line_count;
+    if (status != 0) {
+        freeProgram(&prog);
+        return -1;
+    }
+
+    if (listing) {
+        printListing(&prog, listing);
+    }
+
+    // The text files pass 1 used to hand over to pass 2 are only written on request
+    if (debug_files) {
+        if (writeIntermediateFile(&prog, "intermediate.txt") != 0 ||
+            writeSymtabToFile(&prog, "symtab.txt") != 0 ||
+            writeOptabToFile(&prog, "optab.txt") != 0) {
+            freeProgram(&prog);
+            return -1;
+        }
+    }
+
+    // Pass 2: generate the object program straight from the in-memory program;
+    // it replaces the old one only once it is complete
+    object_target target;
+    if (openObjectTarget(&target, object_path) != 0) {
+        freeProgram(&prog);
+        return -1;
+    }
+    object_output object;
+    FILE *output = beginObjectOutput(&object, target.stream, format);
+    status = output ? runParallelPass2(&prog, output, thread_count) : -1;
+    status = closeObjectTarget(&target, endObjectOutput(&object, status));
+    freeProgram(&prog);
+    return status;
+}
+
+// The LOCCTR table and messages of a run that is going to be cached: they
+// are kept in memory, to be stored with the object program, then printed
+typedef struct {
+    FILE *listing;
+    FILE *diagnostics;
+    char *listing_text;
+    size_t listing_size;
+    char *diagnostics_text;
+    size_t diagnostics_size;
+} captured_output;
+
+// Function to start capturing the output of a run (the listing only when printed)
+int beginCapture(captured_output *captured, int quiet) {
+    memset(captured, 0, sizeof(*captured));
+    captured->diagnostics = open_memstream(&captured->diagnostics_text, &captured->diagnostics_size);
+    if (!quiet) captured->listing = open_memstream(&captured->listing_text, &captured->listing_size);
+    if (!captured->diagnostics || (!quiet && !captured->listing)) {
+        perror("open_memstream");
+        if (captured->diagnostics) fclose(captured->diagnostics);
+        if (captured->listing) fclose(captured->listing);
+        free(captured->diagnostics_text);
+        free(captured->listing_text);
+        return -1;
+    }
+    return 0;
+}
+
+// Function to print the captured output; on success the run is stored in
+// the cache, with the object program and debug files read back from the
+// files it just wrote
+void finishCapture(captured_output *captured, int status, assembly_cache *cache, cache_key key,
+                   const char *object_path, int debug_files, int line_count) {
+    if (captured->listing) fclose(captured->listing);
+    fclose(captured->diagnostics);
+    if (captured->diagnostics_size > 0) fwrite(captured->diagnostics_text, 1, captured->diagnostics_size, stderr);
+    if (captured->listing_size > 0) fwrite(captured->listing_text, 1, captured->listing_size, stdout);
+
+    static const char *const debug_paths[] = {"intermediate.txt", "symtab.txt", "optab.txt"};
+    source_buffer files[4];
+    memset(files, 0, sizeof(files));
+    int file_count = debug_files ? 4 : 1;
+    for (int i = 0; status == 0 && i < file_count; i++) {
+        status = openSourceBuffer(&files[i], i == 0 ? object_path : debug_paths[i - 1]);
+    }
+
+    if (status == 0) {
+        cache_entry entry;
+        memset(&entry, 0, sizeof(entry));
+        entry.parts[CACHE_LISTING] = captured->listing_text;
+        entry.part_sizes[CACHE_LISTING] = captured->listing_size;
+        entry.parts[CACHE_DIAGNOSTICS] = captured->diagnostics_text;
+        entry.part_sizes[CACHE_DIAGNOSTICS] = captured->diagnostics_size;
+        static const cache_part file_parts[] = {CACHE_OBJECT, CACHE_INTERMEDIATE, CACHE_SYMTAB, CACHE_OPTAB};
+        for (int i = 0; i < file_count; i++) {
+            entry.parts[file_parts[i]] = files[i].data;
+            entry.part_sizes[file_parts[i]] = files[i].size;
+        }
+        entry.line_count = line_count;
+        storeCache(cache, key, &entry);
+    }
+
+    for (int i = 0; i < file_count; i++) {
+        closeSourceBuffer(&files[i]);
+    }
+    free(captured->listing_text);
+    free(captured->diagnostics_text);
+}
+
+// Function to replay an assembly found in the cache: its messages, LOCCTR
+// table, debug files and object program, as the assembly wrote them
+int replayCachedAssembly(const cache_entry *entry, const char *object_path, int debug_files) {
+    if (entry->part_sizes[CACHE_DIAGNOSTICS] > 0) fwrite(entry->parts[CACHE_DIAGNOSTICS], 1, entry->part_sizes[CACHE_DIAGNOSTICS], stderr);
+    if (entry->part_sizes[CACHE_LISTING] > 0) fwrite(entry->parts[CACHE_LISTING], 1, entry->part_sizes[CACHE_LISTING], stdout);
+    if (debug_files &&
+        (writeCachePart(entry, CACHE_INTERMEDIATE, "intermediate.txt") != 0 ||
+         writeCachePart(entry, CACHE_SYMTAB, "symtab.txt") != 0 ||
+         writeCachePart(entry, CACHE_OPTAB, "optab.txt") != 0)) {
+        return -1;
+    }
+    return writeCachePart(entry, CACHE_OBJECT, object_path);
+}
+
+// Function to assemble a source in a single pass. A source read from stdin
+// is streamed a block at a time, and the object program can go to stdout
+// (once the pass has succeeded).
+// pipelined splits the streaming into reader, assembler and emitter threads.
+int runOnePassMode(const char *source_path, const char *object_path, char format, int pipelined) {
+    object_target target;
+    if (openObjectTarget(&target, object_path) != 0) {
+        return EXIT_FAILURE;
+    }
+    object_output object;
+    FILE *output = beginObjectOutput(&object, target.stream, format);
+
+    program prog;
+    initProgram(&prog);
+    int status = -1;
+    if (!output) {
+        // Nothing to assemble into
+    } else if (pipelined) {
+        int fd = strcmp(source_path, "-") ? open(source_path, O_RDONLY | O_CLOEXEC) : STDIN_FILENO;
+        if (fd < 0) {
+            perror(source_path);
+        } else {
+            status = runPipelinedOnePass(&prog, fd, output);
+            if (fd != STDIN_FILENO) close(fd);
+        }
+    } else if (!strcmp(source_path, "-")) {
+        status = runStreamingOnePass(&prog, STDIN_FILENO, output);
+    } else {
+        source_buffer source;
+        status = openSourceBuffer(&source, source_path);
+        if (status == 0) {
+            status = runOnePass(&prog, source.data, source.size, output);
+            closeSourceBuffer(&source);
+        }
+    }
+    freeProgram(&prog);
+    status = closeObjectTarget(&target, endObjectOutput(&object, status));
+    if (status != 0) {
+        return EXIT_FAILURE;
+    }
+
+    // stdout holds the object program itself
+    if (!target.to_stdout) {
+        printf("Object program generated successfully!\n");
+    }
+    return 0;
+}
+
+// Function to assemble a batch of sources and print the throughput
+int runBatchMode(char **paths, int path_count, const char *list_path, const char *output_dir, int thread_count,
+                 const char *cache_dir, uint64_t cache_size) {
+    batch jobs;
+    initBatch(&jobs, output_dir);
+
+    // Unchanged sources are copied out of the cache instead of being assembled
+    assembly_cache cache;
+    if (cache_dir) {
+        if (openCache(&cache, cache_dir, cache_size) != 0) {
+            return EXIT_FAILURE;
+        }
+        jobs.cache = &cache;
+    }
+
+    int status = list_path ? addBatchList(&jobs, list_path) : 0;
+    for (int i = 0; status == 0 && i < path_count; i++) {
+        status = addBatchPath(&jobs, paths[i]);
+    }
+    if (status != 0) {
+        if (cache_dir) closeCache(&cache);
+        freeBatch(&jobs);
+        return EXIT_FAILURE;
+    }
+
+    batch_stats stats;
+    status = runBatch(&jobs, thread_count, &stats);
+    if (cache_dir) closeCache(&cache);
+
+    double seconds = stats.seconds > 0 ? stats.seconds : 1e-9;
+    printf("Assembled %d files (%d failed), %lld lines in %.3f s on %d threads\n",
+           stats.files, stats.failed, stats.lines, stats.seconds, thread_count);
+    printf("%.0f files/s, %.0f lines/s\n", stats.files / seconds, stats.lines / seconds);
+    if (cache_dir) {
+        printf("%d of them copied out of the cache\n", stats.cached);
+    }
+
+    freeBatch(&jobs);
+    return status == 0 ? 0 : EXIT_FAILURE;
+}
+
+// Function to assemble a source (again) and report how much was redone
+int assembleWatched(incremental_assembly *inc, source_buffer *sources, int *current,
+                    const char *source_path, const char *object_path) {
+    // The previous text stays alive until the new one has been assembled
+    int next = !*current;
+    if (readSourceBuffer(&sources[next], source_path) != 0) {
+        return -1;
+    }
+
+    int status = assembleIncremental(inc, sources[next].data, sources[next].size);
+    closeSourceBuffer(&sources[*current]);
+    *current = next;
+    if (status != 0) {
+        printf("Assembly failed.\n");
+        fflush(stdout);
+        return -1;
+    }
+
+    // Only the changed bytes are written when the file holds the previous run
+    int written = writeIncrementalObject(inc, object_path, 1);
+    printf("Assembled %d lines in %.3f ms (%s: %d lines laid out, %d encoded, %d records)\n",
+           inc->stats.line_count, inc->stats.seconds * 1e3, inc->stats.full ? "full" : "incremental",
+           inc->stats.relaid_lines, inc->stats.encoded_lines, inc->stats.emitted_records);
+    fflush(stdout);
+    return written;
+}
+
+// Function to watch a source and assemble it every time it is saved
+int runWatchMode(const char *source_path, const char *object_path) {
+    // Editors often save by renaming a new file over the old one, so the
+    // directory is watched for the name instead of the file itself
+    char directory[PATH_MAX];
+    const char *name = strrchr(source_path, '/');
+    if (name) {
+        size_t length = name == source_path ? 1 : (size_t)(name - source_path);
+        if (length >= sizeof(directory)) length = sizeof(directory) - 1;
+        memcpy(directory, source_path, length);
+        directory[length] = '\0';
+        name++;
+    } else {
+        strcpy(directory, ".");
+        name = source_path;
+    }
+
+    int fd = inotify_init1(IN_CLOEXEC);
+    if (fd < 0 || inotify_add_watch(fd, directory, IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+        perror(directory);
+        if (fd >= 0) close(fd);
+        return EXIT_FAILURE;
+    }
+
+    incremental_assembly inc;
+    source_buffer sources[2];
+    int current = 0;
+    initIncremental(&inc);
+    memset(sources, 0, sizeof(sources));
+
+    printf("Watching %s, writing %s.\n", source_path, object_path);
+    assembleWatched(&inc, sources, &current, source_path, object_path);
+
+    char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    for (;;) {
+        ssize_t count = read(fd, events, sizeof(events));
+        if (count <= 0) break;
+
+        // One assembly for all the events of a save
+        int changed = 0;
+        for (char *p = events; p < events + count;) {
+            const struct inotify_event *event = (const struct inotify_event *)p;
+            if (event->len > 0 && !strcmp(event->name, name)) changed = 1;
+            p += sizeof(struct inotify_event) + event->len;
+        }
+        if (changed) {
+            assembleWatched(&inc, sources, &current, source_path, object_path);
+        }
+    }
+
+    perror("inotify");
+    closeSourceBuffer(&sources[current]);
+    freeIncremental(&inc);
+    close(fd);
+    return EXIT_FAILURE;
+}
+
+int main(int argc, char *argv[]) {
+    const char *source_path = "source.txt";
+    const char *object_path = "object_program.txt";
+    int debug_files = 0;
+    int quiet = 0;
+    int watch = 0;
+    int one_pass = 0;
+    int pipelined = 0;
+    char object_format = 't';
+    int stats = 0;
+    int stats_json = 0;
+
+    // Batch mode options; batch sources are collected in place after argv[0]
+    char **paths = argv + 1;
+    int batch_mode = 0;
+    int thread_count = 0;
+    const char *output_dir = NULL;
+    const char *list_path = NULL;
+    int path_count = 0;
+
+    // Daemon to assemble on
+    const char *socket_path = NULL;
+
+    // Assembly cache, shared by every run pointing at the same directory
+    const char *cache_dir = getenv("SICASM_CACHE");
+    uint64_t cache_size = 0;
+    int cache_stats = 0;
+
+    // Parse the command line options
+    for (int i = 1; i < argc; i++) {
+        int stats_option = parseStatsOption(argv[i], &stats_json);
+        if (stats_option < 0) {
+            return EXIT_FAILURE;
+        } else if (stats_option > 0) {
+            stats = 1;
+        } else if (!strcmp(argv[i], "-d") || !strcmp(argv[i], "--debug-files")) {
+            debug_files = 1;
+        } else if (!strcmp(argv[i], "-q") || !strcmp(argv[i], "--quiet")) {
+            quiet = 1;
+        } else if (!strcmp(argv[i], "-w") || !strcmp(argv[i], "--watch")) {
+            watch = 1;
+        } else if (!strcmp(argv[i], "-1") || !strcmp(argv[i], "--one-pass")) {
+            one_pass = 1;
+        } else if (!strcmp(argv[i], "--pipeline")) {
+            one_pass = 1;
+            pipelined = 1;
+        } else if (!strcmp(argv[i], "--binary")) {
+            object_format = 'b';
+        } else if (!strcmp(argv[i], "--image")) {
+            object_format = 'i';
+        } else if (!strcmp(argv[i], "-o") && i + 1 < argc) {
+            object_path = argv[++i];
+        } else if (!strcmp(argv[i], "-b") || !strcmp(argv[i], "--batch")) {
+            batch_mode = 1;
+        } else if (!strcmp(argv[i], "-j") && i + 1 < argc) {
+            thread_count = atoi(argv[++i]);
+            if (thread_count < 1) thread_count = 1;
+        } else if (!strcmp(argv[i], "-O") && i + 1 < argc) {
+            output_dir = argv[++i];
+        } else if (!strcmp(argv[i], "-l") && i + 1 < argc) {
+            list_path = argv[++i];
+        } else if (!strcmp(argv[i], "--connect") && i + 1 < argc) {
+            socket_path = argv[++i];
+        } else if (!strcmp(argv[i], "--cache") && i + 1 < argc) {
+            cache_dir = argv[++i];
+        } else if (!strcmp(argv[i], "--cache-size") && i + 1 < argc) {
+            cache_size = strtoull(argv[++i], NULL, 10) << 20;
+        } else if (!strcmp(argv[i], "--cache-stats")) {
+            cache_stats = 1;
+        } else if (!strcmp(argv[i], "-h") || !strcmp(argv[i], "--help")) {
+            printUsage(argv[0]);
+            return 0;
+        } else if (argv[i][0] == '-' && argv[i][1]) {
+            fprintf(stderr, "Error: Unknown option '%s'.\n", argv[i]);
+            printUsage(argv[0]);
+            return EXIT_FAILURE;
+        } else {
+            source_path = argv[i];
+            paths[path_count++] = argv[i];
+        }
+    }
+
+    if (stats && enableStats() != 0) {
+        return EXIT_FAILURE;
+    }
+
+    if (cache_dir && !cache_dir[0]) cache_dir = NULL;
+    if (cache_stats) {
+        if (!cache_dir) {
+            fprintf(stderr, "Error: --cache-stats needs --cache or SICASM_CACHE.\n");
+            return EXIT_FAILURE;
+        }
+        return printCacheStats(cache_dir, stdout) == 0 ? 0 : EXIT_FAILURE;
+    }
+
+    if (object_format != 't' && (batch_mode || watch || socket_path)) {
+        fprintf(stderr, "Error: --binary and --image do not apply to --batch, --watch or --connect.\n");
+        return EXIT_FAILURE;
+    }
+
+    // With -o - stdout holds only the object program
+    int to_stdout = !strcmp(object_path, "-");
+    if (to_stdout && watch) {
+        fprintf(stderr, "Error: --watch writes a file; -o - does not apply to it.\n");
+        return EXIT_FAILURE;
+    }
+    if (to_stdout) quiet = 1;
+
+    if (batch_mode) {
+        if (thread_count == 0) thread_count = getProcessorCount();
+        int status = runBatchMode(paths, path_count, list_path, output_dir, thread_count, cache_dir, cache_size);
+        if (stats) printStats(stderr, stats_json);
+        return status;
+    }
+    if (watch) {
+        return runWatchMode(source_path, object_path);
+    }
+    if (socket_path) {
+        return runClientMode(socket_path, source_path, object_path, quiet);
+    }
+    if (one_pass) {
+        int status = runOnePassMode(source_path, object_path, object_format, pipelined);
+        if (stats) printStats(stderr, stats_json);
+        return status;
+    }
+
+    // The source is memory-mapped and the lines refer into it, so it stays
+    // open until pass 2 is done
+    source_buffer source;
+    if (openSourceBuffer(&source, source_path) != 0) {
+        return EXIT_FAILURE;
+    }
+
+    // A source assembled before with the same options is replayed from the
+    // cache; otherwise the output of the run is captured to be stored
+    assembly_cache cache;
+    cache_key key;
+    captured_output captured;
+    int capturing = 0;
+    if (cache_dir && !to_stdout) {
+        if (openCache(&cache, cache_dir, cache_size) != 0) {
+            closeSourceBuffer(&source);
+            return EXIT_FAILURE;
+        }
+        char options[64];
+        snprintf(options, sizeof(options), CACHE_ASSEMBLY_OPTIONS, object_format, !quiet, debug_files);
+        key = getCacheKey(source.data, source.size, options);
+
+        cache_entry entry;
+        if (lookupCache(&cache, key, &entry)) {
+            int status = replayCachedAssembly(&entry, object_path, debug_files);
+            releaseCacheEntry(&entry);
+            closeCache(&cache);
+            closeSourceBuffer(&source);
+            if (stats) printStats(stderr, stats_json);
+            if (status != 0) {
+                return EXIT_FAILURE;
+            }
+            printf("Object program generated successfully!\n");
+            return 0;
+        }
+        capturing = beginCapture(&captured, quiet) == 0;
+    }
+
+    FILE *listing = capturing ? captured.listing : quiet ? NULL : stdout;
+    FILE *diagnostics = capturing ? captured.diagnostics : stderr;
+    int line_count = 0;
+    int status = 0;
+
+    // Macro calls are expanded in memory, and both passes read the expanded
+    // source in place of the file (the cache key stays the file itself)
+    if (hasMacros(source.data, source.size)) {
+        source_buffer expanded;
+        status = expandMacros(source.data, source.size, &expanded, diagnostics);
+        if (status == 0) {
+            closeSourceBuffer(&source);
+            source = expanded;
+        }
+    }
+
+    // Every control section is assembled on its own, and they are linked later
+    int sections = hasControlSections(source.data, source.size);
+    if (status == 0 && sections && (debug_files || object_format != 't')) {
+        fprintf(diagnostics, "Error: -d, --binary and --image do not apply to control sections.\n");
+        status = -1;
+    }
+
+    if (status == 0 && sections) {
+        status = runSectionMode(&source, object_path, thread_count, listing, diagnostics, &line_count);
+    } else if (status == 0) {
+        status = runTwoPassMode(&source, object_path, thread_count, object_format, debug_files, listing,
+                                diagnostics, &line_count);
+    }
+    if (capturing) {
+        finishCapture(&captured, status, &cache, key, object_path, debug_files, line_count);
+    }
+    if (cache_dir && !to_stdout) {
+        closeCache(&cache);
+    }
+    closeSourceBuffer(&source);
+
+    if (stats) {
+        printStats(stderr, stats_json);
+    }
+
+    if (status != 0) {
+        return EXIT_FAILURE;
+    }
+
+    if (!to_stdout) printf("Object program generated successfully!\n");
+    return 0;
+}
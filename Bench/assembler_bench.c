@@ -0,0 +1,330 @@
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+
+#include "../Common/program.h"
+#include "../Common/scan.h"
+
+// Benchmark for the assembler, one phase at a time, on a source such as
+// one written by Tools/gen_sic. Prints the time and lines/s of every
+// phase and the peak RSS. With -b the results are compared against a
+// file of baselines (and a phase slower than the tolerance is a
+// regression); -s stores them in that file instead.
+//
+//   gcc -O2 assembler_bench.c ../Common/*.c -o assembler_bench -lpthread
+//   ./assembler_bench [-r repeats] [-b baselines] [-s] [-k key] [-t tolerance%] source
+//
+// Phases:
+//   tokenize  splitting every line into fields (block scanner)
+//   layout    the pass 1 loop without labels: tokenize, look the mnemonic
+//             up and assign addresses
+//   symtab    defining every label in the SYMTAB
+//   optab     looking every mnemonic up in the OPTAB again, on its own
+//   resolve   pass 2 encoding, which resolves every operand symbol
+//   emit      laying the encoded code out in H / T / E records in memory
+//   total     runPass1 and runPass2 to /dev/null, as sicasm runs them
+
+#define PHASE_COUNT 7
+static const char *const phase_names[PHASE_COUNT] = {
+    "tokenize", "layout", "symtab", "optab", "resolve", "emit", "total",
+};
+
+// A label defined on a line, kept for the symtab phase
+typedef struct {
+    int line;
+    source_view name;
+} line_label;
+
+// Function to get the current time in seconds
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Function to get the peak resident set size in KB
+static long getPeakRss(void) {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+// Function to run every phase once over the text, storing their times.
+// Returns the number of lines, or -1 if the source does not assemble.
+static long runPhases(const char *text, size_t size, double *seconds) {
+    source_scanner scanner;
+    source_fields fields;
+    long line_count = 0;
+    double start = now();
+
+    // tokenize
+    initSourceScanner(&scanner, text, 0, size);
+    while (scanSourceLine(&scanner, &fields)) {
+        if (fields.mnemonic.length > 0 || fields.label.length > 0) line_count++;
+    }
+    seconds[0] = now() - start;
+
+    // layout
+    program prog;
+    initProgram(&prog);
+    prog.text = text;
+    prog.text_size = size;
+    line_label *labels = NULL;
+    int label_count = 0, label_capacity = 0, locctr = 0;
+
+    start = now();
+    initSourceScanner(&scanner, text, 0, size);
+    while (scanSourceLine(&scanner, &fields)) {
+        if (fields.mnemonic.length == 0 && fields.label.length == 0) continue;
+        source_line *line = addAddressedLine(&prog, &fields, &locctr);
+        if (!line) return -1;
+        if (fields.label.length > 0) {
+            if (label_count == label_capacity) {
+                label_capacity = label_capacity ? 2 * label_capacity : 1024;
+                line_label *grown = realloc(labels, label_capacity * sizeof(line_label));
+                if (!grown) return -1;
+                labels = grown;
+            }
+            labels[label_count].line = prog.line_count - 1;
+            labels[label_count++].name = fields.label;
+        }
+    }
+    prog.end_address = locctr;
+    seconds[1] = now() - start;
+
+    // symtab
+    start = now();
+    for (int i = 0; i < label_count; i++) {
+        source_line *line = &prog.lines[labels[i].line];
+        defineLabel(&prog, line, labels[i].name, line->locctr);
+    }
+    seconds[2] = now() - start;
+    free(labels);
+
+    // optab
+    int unknown = 0;
+    start = now();
+    for (int i = 0; i < prog.line_count; i++) {
+        source_view mnemonic = prog.lines[i].mnemonic;
+        unknown += searchOptab(text + mnemonic.offset, mnemonic.length) == -1;
+    }
+    seconds[3] = now() - start;
+
+    // resolve: the code of every line, one after the other
+    unsigned char *code = malloc(4 * (size_t)prog.line_count + 64);
+    int *code_sizes = malloc(prog.line_count * sizeof(int) + 1);
+    size_t code_size = 0, code_capacity = 4 * (size_t)prog.line_count + 64;
+    int errors = 0;
+    if (!code || !code_sizes) return -1;
+
+    start = now();
+    for (int i = 0; i < prog.line_count; i++) {
+        const source_line *line = &prog.lines[i];
+        unsigned char buffer[MAX_CODE_LENGTH];
+        unsigned char *line_code = buffer;
+        int line_size = hasObjectCode(line) ? encodeLineCode(&prog, line, &line_code, &errors) : 0;
+        if (code_size + line_size > code_capacity) {
+            while (code_size + line_size > code_capacity) code_capacity *= 2;
+            unsigned char *grown = realloc(code, code_capacity);
+            if (!grown) return -1;
+            code = grown;
+        }
+        memcpy(code + code_size, line_code, line_size);
+        code_size += line_size;
+        code_sizes[i] = line_size;
+        if (line_code != buffer) free(line_code);
+    }
+    seconds[4] = now() - start;
+
+    // emit
+    pass2_state state;
+    initPass2(&prog, &state, NULL);
+    int program_length = prog.end_address - prog.start_address;
+    size_t offset = 0;
+
+    start = now();
+    for (int i = 0; i < prog.line_count; i++) {
+        emitCode(&prog, &state, &prog.lines[i], code + offset, code_sizes[i], program_length);
+        offset += code_sizes[i];
+    }
+    if (finishPass2(&state) != 0) errors++;
+    seconds[5] = now() - start;
+    free(state.writer.buffer.data);
+    free(code);
+    free(code_sizes);
+    freeProgram(&prog);
+
+    // total
+    FILE *null_file = fopen("/dev/null", "w");
+    if (!null_file) return -1;
+    initProgram(&prog);
+    setDiagnostics(&prog, null_file);
+    start = now();
+    if (runPass1(&prog, text, size) != 0 || runPass2(&prog, null_file) != 0) errors++;
+    fflush(null_file);
+    seconds[6] = now() - start;
+    freeProgram(&prog);
+    fclose(null_file);
+
+    if (errors || unknown) {
+        fprintf(stderr, "Error: The source has errors (%d) or unknown mnemonics (%d).\n", errors, unknown);
+        return -1;
+    }
+    return line_count;
+}
+
+// Baselines are kept as lines of "<key> <phase> <value>": lines/s for a
+// phase, KB for "rss"
+typedef struct {
+    char key[64];
+    char phase[16];
+    double value;
+} baseline_entry;
+
+// Function to read a baselines file (a missing file has no entries)
+static int readBaselines(const char *path, baseline_entry **entries) {
+    FILE *file = fopen(path, "r");
+    int count = 0, capacity = 0;
+    *entries = NULL;
+    if (!file) return 0;
+
+    baseline_entry entry;
+    while (fscanf(file, "%63s %15s %lf", entry.key, entry.phase, &entry.value) == 3) {
+        if (count == capacity) {
+            capacity = capacity ? 2 * capacity : 32;
+            baseline_entry *grown = realloc(*entries, capacity * sizeof(baseline_entry));
+            if (!grown) break;
+            *entries = grown;
+        }
+        (*entries)[count++] = entry;
+    }
+    fclose(file);
+    return count;
+}
+
+// Function to find the baseline of a phase, returns 0 if there is none
+static double findBaseline(const baseline_entry *entries, int count, const char *key, const char *phase) {
+    for (int i = 0; i < count; i++) {
+        if (!strcmp(entries[i].key, key) && !strcmp(entries[i].phase, phase)) return entries[i].value;
+    }
+    return 0;
+}
+
+// Function to store the results of key, keeping the baselines of other keys
+static int saveBaselines(const char *path, const baseline_entry *entries, int count, const char *key,
+                         const double *lines_per_second, long rss) {
+    FILE *file = fopen(path, "w");
+    if (!file) {
+        perror("Error opening baselines file for writing");
+        return -1;
+    }
+    for (int i = 0; i < count; i++) {
+        if (strcmp(entries[i].key, key) != 0) {
+            fprintf(file, "%s %s %.0f\n", entries[i].key, entries[i].phase, entries[i].value);
+        }
+    }
+    for (int p = 0; p < PHASE_COUNT; p++) {
+        fprintf(file, "%s %s %.0f\n", key, phase_names[p], lines_per_second[p]);
+    }
+    fprintf(file, "%s rss %ld\n", key, rss);
+    return fclose(file) == 0 ? 0 : -1;
+}
+
+// Function to get the key of a source: its file name without the directory and extension
+static void makeKey(const char *path, char *key, size_t size) {
+    const char *name = strrchr(path, '/');
+    name = name ? name + 1 : path;
+    snprintf(key, size, "%s", name);
+    char *dot = strrchr(key, '.');
+    if (dot && dot != key) *dot = '\0';
+}
+
+int main(int argc, char *argv[]) {
+    const char *path = NULL, *baselines_path = NULL;
+    char key[64] = "";
+    int repeats = 5, save = 0;
+    double tolerance = 20;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-r") && i + 1 < argc) repeats = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-b") && i + 1 < argc) baselines_path = argv[++i];
+        else if (!strcmp(argv[i], "-k") && i + 1 < argc) snprintf(key, sizeof(key), "%s", argv[++i]);
+        else if (!strcmp(argv[i], "-t") && i + 1 < argc) tolerance = atof(argv[++i]);
+        else if (!strcmp(argv[i], "-s")) save = 1;
+        else path = argv[i];
+    }
+    if (!path || repeats <= 0 || (save && !baselines_path)) {
+        fprintf(stderr, "Usage: %s [-r repeats] [-b baselines] [-s] [-k key] [-t tolerance%%] source\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (!key[0]) makeKey(path, key, sizeof(key));
+
+    source_buffer source;
+    if (openSourceBuffer(&source, path) != 0) {
+        return EXIT_FAILURE;
+    }
+
+    // The best time of every phase over the repeats
+    double best[PHASE_COUNT];
+    long line_count = 0;
+    for (int r = 0; r < repeats; r++) {
+        double seconds[PHASE_COUNT];
+        line_count = runPhases(source.data, source.size, seconds);
+        if (line_count < 0) {
+            closeSourceBuffer(&source);
+            return EXIT_FAILURE;
+        }
+        for (int p = 0; p < PHASE_COUNT; p++) {
+            if (r == 0 || seconds[p] < best[p]) best[p] = seconds[p];
+        }
+    }
+    long rss = getPeakRss();
+
+    baseline_entry *entries = NULL;
+    int entry_count = baselines_path ? readBaselines(baselines_path, &entries) : 0;
+    int regressions = 0;
+
+    printf("%s: %ld lines, %.1f MB, best of %d\n", key, line_count, source.size / 1e6, repeats);
+    printf("%-10s %10s %12s %12s %8s\n", "phase", "ms", "Mlines/s", "baseline", "change");
+    double lines_per_second[PHASE_COUNT];
+    for (int p = 0; p < PHASE_COUNT; p++) {
+        lines_per_second[p] = best[p] > 0 ? line_count / best[p] : 0;
+        printf("%-10s %10.3f %12.2f", phase_names[p], best[p] * 1e3, lines_per_second[p] / 1e6);
+
+        double baseline = findBaseline(entries, entry_count, key, phase_names[p]);
+        if (baseline > 0 && !save) {
+            double change = (lines_per_second[p] / baseline - 1) * 100;
+            int regressed = change < -tolerance;
+            regressions += regressed;
+            printf(" %12.2f %+7.1f%%%s", baseline / 1e6, change, regressed ? "  REGRESSION" : "");
+        }
+        printf("\n");
+    }
+
+    printf("peak RSS   %10ld KB", rss);
+    double baseline_rss = findBaseline(entries, entry_count, key, "rss");
+    if (baseline_rss > 0 && !save) {
+        double change = (rss / baseline_rss - 1) * 100;
+        int regressed = change > tolerance;
+        regressions += regressed;
+        printf(" (baseline %.0f KB, %+.1f%%)%s", baseline_rss, change, regressed ? "  REGRESSION" : "");
+    }
+    printf("\n");
+
+    int status = 0;
+    if (save) {
+        status = saveBaselines(baselines_path, entries, entry_count, key, lines_per_second, rss);
+        if (status == 0) printf("Baselines of %s saved to %s\n", key, baselines_path);
+    } else if (regressions) {
+        printf("%d regression(s) over %.0f%%\n", regressions, tolerance);
+        status = -1;
+    }
+
+    free(entries);
+    closeSourceBuffer(&source);
+    return status == 0 ? 0 : EXIT_FAILURE;
+}
@@ -0,0 +1,156 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../Common/incremental.h"
+#include "../Common/program.h"
+
+// Benchmark for incremental re-assembly: assembles a source once, then
+// makes random single-line edits (operands changed to another label, which
+// patches the object program in place, and WORD lines inserted or removed,
+// which move everything after them) and times every update. With -v each
+// update is checked against a from-scratch assembly of the same text.
+//
+//   gcc -O2 incremental_bench.c ../Common/*.c -o incremental_bench -lpthread
+//   ./incremental_bench [-v] source.txt [edits]
+
+// Function to assemble text from scratch into an in-memory object program
+static int assembleFromScratch(const char *text, size_t size, char **object, size_t *object_size) {
+    program prog;
+    initProgram(&prog);
+    FILE *out = open_memstream(object, object_size);
+    int status = out ? runPass1(&prog, text, size) : -1;
+    if (status == 0) status = runPass2(&prog, out);
+    if (out) fclose(out);
+    freeProgram(&prog);
+    return status;
+}
+
+// Function to find the line that starts at or before position
+static size_t findLineStart(const char *text, size_t position) {
+    while (position > 0 && text[position - 1] != '\n') position--;
+    return position;
+}
+
+// Function to pick a random instruction that refers to a symbol
+static const source_line *pickInstruction(const program *prog) {
+    for (int tries = 0; tries < 1000; tries++) {
+        const source_line *line = &prog->lines[rand() % prog->line_count];
+        if (line->operand_id != -1 && line->opcode_id != OP_END) return line;
+    }
+    return NULL;
+}
+
+int main(int argc, char *argv[]) {
+    int verify = argc > 1 && !strcmp(argv[1], "-v");
+    if (argc < 2 + verify) {
+        fprintf(stderr, "Usage: %s [-v] source [edits]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    int edits = argc > 2 + verify ? atoi(argv[2 + verify]) : 1000;
+
+    source_buffer source;
+    if (openSourceBuffer(&source, argv[1 + verify]) != 0) {
+        return EXIT_FAILURE;
+    }
+
+    // Two copies of the text: the one the last run refers to, and the edited one
+    size_t capacity = source.size + 64 * (size_t)edits + 4096;
+    char *texts[2] = {malloc(capacity), malloc(capacity)};
+    size_t size = source.size;
+    if (!texts[0] || !texts[1]) {
+        fprintf(stderr, "Error: Out of memory.\n");
+        return EXIT_FAILURE;
+    }
+    memcpy(texts[0], source.data, size);
+    closeSourceBuffer(&source);
+
+    incremental_assembly inc;
+    initIncremental(&inc);
+    if (assembleIncremental(&inc, texts[0], size) != 0 || !inc.valid) {
+        fprintf(stderr, "Error: The source has to assemble without messages.\n");
+        return EXIT_FAILURE;
+    }
+    printf("full      %8d lines %10.3f ms\n", inc.stats.line_count, inc.stats.seconds * 1e3);
+
+    // Labels and instructions to edit are picked from the current program
+    const program *prog = &inc.prog;
+    if (prog->symtab.size == 0 || pickInstruction(prog) == NULL) {
+        fprintf(stderr, "Error: The source has no instructions with symbol operands.\n");
+        return EXIT_FAILURE;
+    }
+
+    double seconds[2] = {0, 0};
+    int counts[2] = {0, 0}, full_runs = 0, mismatches = 0;
+    int inserted = 0;
+    size_t inserted_at = 0;
+    srand(12345);
+
+    for (int e = 0; e < edits; e++) {
+        const char *text = texts[e & 1];
+        char *next = texts[(e + 1) & 1];
+        int kind = e % 4 == 3;
+        size_t new_size;
+
+        if (!kind) {
+            // Point a random instruction at a random label
+            const source_line *line = pickInstruction(prog);
+            const char *label = getSymbolName(&prog->symtab, rand() % prog->symtab.size);
+            size_t begin = line->operand.offset, end = begin + line->operand.length;
+            size_t length = strlen(label);
+            memcpy(next, text, begin);
+            memcpy(next + begin, label, length);
+            memcpy(next + begin + length, text + end, size - end);
+            new_size = size - (end - begin) + length;
+            if (inserted && begin < inserted_at) inserted_at += new_size - size;
+        } else if (!inserted) {
+            // Insert a WORD line before a random instruction
+            const source_line *line = pickInstruction(prog);
+            static const char word[] = "         WORD    7\n";
+            size_t at = findLineStart(text, line->mnemonic.offset);
+            memcpy(next, text, at);
+            memcpy(next + at, word, sizeof(word) - 1);
+            memcpy(next + at + sizeof(word) - 1, text + at, size - at);
+            new_size = size + sizeof(word) - 1;
+            inserted = 1;
+            inserted_at = at;
+        } else {
+            // And remove it again
+            size_t length = strchr(text + inserted_at, '\n') + 1 - (text + inserted_at);
+            memcpy(next, text, inserted_at);
+            memcpy(next + inserted_at, text + inserted_at + length, size - inserted_at - length);
+            new_size = size - length;
+            inserted = 0;
+        }
+
+        size = new_size;
+        if (assembleIncremental(&inc, next, size) != 0) {
+            fprintf(stderr, "Error: Edit %d does not assemble.\n", e);
+            return EXIT_FAILURE;
+        }
+        seconds[kind] += inc.stats.seconds;
+        counts[kind]++;
+        full_runs += inc.stats.full;
+
+        if (verify) {
+            char *object = NULL;
+            size_t object_size = 0;
+            assembleFromScratch(next, size, &object, &object_size);
+            if (object_size != inc.object.size || memcmp(object, inc.object.data, object_size) != 0) {
+                if (mismatches++ == 0) fprintf(stderr, "Error: Edit %d differs from a full assembly.\n", e);
+            }
+            free(object);
+        }
+    }
+
+    if (counts[0]) printf("operand   %8d edits %10.3f ms per edit\n", counts[0], seconds[0] / counts[0] * 1e3);
+    if (counts[1]) printf("insert    %8d edits %10.3f ms per edit\n", counts[1], seconds[1] / counts[1] * 1e3);
+    printf("full runs %8d\n", full_runs);
+    if (verify) printf("mismatches %7d\n", mismatches);
+
+    free(texts[0]);
+    free(texts[1]);
+    freeIncremental(&inc);
+    return mismatches ? EXIT_FAILURE : 0;
+}
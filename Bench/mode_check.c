@@ -0,0 +1,467 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <limits.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+// Differential check of the assembly modes of sicasm: every source is
+// assembled two-pass, the reference, and again with -j, --one-pass and
+// --pipeline (from a file and from stdin to stdout), through a cache (a
+// miss, then a hit) and in watch mode (the source, then an edit of it,
+// then the source again). The exit status, object program and messages of
+// every run must match the reference; a source with errors must fail the
+// same way in every mode. With -g, sources written by gen_sic are checked
+// as well. The exit status is 1 when any run differs.
+//
+//   gcc -O2 mode_check.c -o mode_check
+//   ./mode_check [-a sicasm] [-g gen_sic] [-n lines] [-j threads] [source]...
+
+#define WATCH_TIMEOUT 30    // Seconds watch mode gets for one assembly
+
+// gen_sic options of the generated sources (after -n and before -o)
+static const char *const gen_options[][7] = {
+    {"-s", "1", NULL},
+    {"-f", "60", "-x", "30", "-s", "2", NULL},
+    {"-l", "80", "-d", "50", "-m", "10,40,40,10", NULL},
+};
+
+#define GEN_SOURCES (int)(sizeof(gen_options) / sizeof(gen_options[0]))
+
+// Sources a mode leaves to two-pass assembly, by the message it stops with
+static const struct {
+    const char *message;
+    const char *reason;
+} mode_limits[] = {
+    {"Error: SIC/XE addressing needs both passes", "SIC/XE needs both passes"},
+    {"Error: Control sections are only assembled by sicasm", "control sections"},
+};
+
+#define MODE_LIMITS (int)(sizeof(mode_limits) / sizeof(mode_limits[0]))
+
+static const char *sicasm_path = "../Assembler/sicasm";
+static char thread_option[16] = "4";
+static char temp_dir[] = "/tmp/mode_check.XXXXXX";
+static int run_count = 0, mismatch_count = 0;
+
+// A whole file read into memory
+typedef struct {
+    char *data;
+    size_t size;
+} file_data;
+
+// What one run left behind: its exit status, object program and messages
+typedef struct {
+    int status;
+    file_data object;
+    file_data messages;
+} run_result;
+
+// Function to read a whole file; a missing file reads as empty
+static file_data readFile(const char *path) {
+    file_data file = {NULL, 0};
+    FILE *in = fopen(path, "rb");
+    if (!in) return file;
+
+    size_t capacity = 0;
+    for (;;) {
+        if (file.size == capacity) {
+            capacity = capacity ? capacity * 2 : 64 * 1024;
+            char *data = realloc(file.data, capacity);
+            if (!data) {
+                fprintf(stderr, "Error: Out of memory.\n");
+                exit(EXIT_FAILURE);
+            }
+            file.data = data;
+        }
+        size_t count = fread(file.data + file.size, 1, capacity - file.size, in);
+        if (count == 0) break;
+        file.size += count;
+    }
+    fclose(in);
+    return file;
+}
+
+static int sameData(const file_data *a, const file_data *b) {
+    return a->size == b->size && (a->size == 0 || memcmp(a->data, b->data, a->size) == 0);
+}
+
+static void freeRun(run_result *run) {
+    free(run->object.data);
+    free(run->messages.data);
+    memset(run, 0, sizeof(*run));
+}
+
+// Function to name a file in the temporary directory
+static const char *tempPath(char *buffer, const char *name) {
+    snprintf(buffer, PATH_MAX, "%s/%s", temp_dir, name);
+    return buffer;
+}
+
+// Function to start a tool with its stdin (NULL for none), stdout and stderr
+// redirected to files; returns its pid, or -1
+static pid_t startTool(char *const args[], const char *in, const char *out, const char *err) {
+    pid_t pid = fork();
+    if (pid != 0) return pid;
+
+    int fd_in = open(in ? in : "/dev/null", O_RDONLY);
+    int fd_out = open(out, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    int fd_err = open(err, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd_in < 0 || fd_out < 0 || fd_err < 0) _exit(127);
+    dup2(fd_in, STDIN_FILENO);
+    dup2(fd_out, STDOUT_FILENO);
+    dup2(fd_err, STDERR_FILENO);
+    execv(args[0], args);
+    perror(args[0]);
+    _exit(127);
+}
+
+// Function to run a tool to the end, returns its exit status (-1 when it was killed)
+static int runTool(char *const args[], const char *in, const char *out, const char *err) {
+    pid_t pid = startTool(args, in, out, err);
+    int status;
+    if (pid < 0 || waitpid(pid, &status, 0) != pid) return -1;
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+// Function to assemble source with options (a NULL-terminated list) into
+// the object program object, "-" for stdout; with from_stdin the source
+// is given on stdin as "-"
+static void assemble(const char *source, const char *const *options, int from_stdin, const char *object,
+                     run_result *run) {
+    char out[PATH_MAX], err[PATH_MAX];
+    const char *args[16];
+    int count = 0;
+    args[count++] = sicasm_path;
+    args[count++] = "-q";
+    while (*options) args[count++] = *options++;
+    args[count++] = from_stdin ? "-" : source;
+    args[count++] = "-o";
+    args[count++] = object;
+    args[count] = NULL;
+
+    if (strcmp(object, "-") != 0) unlink(object);
+    run->status = runTool((char *const *)args, from_stdin ? source : NULL, tempPath(out, "stdout"),
+                          tempPath(err, "stderr"));
+    run->object = readFile(strcmp(object, "-") != 0 ? object : out);
+    run->messages = readFile(err);
+}
+
+// Function to compare a run with the two-pass reference, unless problem
+// already says what went wrong; the run is freed
+static void compareRun(const char *source, const char *mode, run_result *run, const run_result *reference,
+                       const char *problem) {
+    if (!problem && run->status != reference->status) problem = "exit status differs";
+    if (!problem && !sameData(&run->messages, &reference->messages)) problem = "messages differ";
+    if (!problem && reference->status == 0 && !sameData(&run->object, &reference->object)) {
+        problem = "object program differs";
+    }
+
+    // A mode that does not take the source, and says so first, is no mismatch
+    for (int i = 0; problem && run->status != 0 && i < MODE_LIMITS; i++) {
+        size_t length = strlen(mode_limits[i].message);
+        if (run->messages.size >= length && !memcmp(run->messages.data, mode_limits[i].message, length)) {
+            printf("%-32s %-22s skipped (%s)\n", source, mode, mode_limits[i].reason);
+            freeRun(run);
+            return;
+        }
+    }
+
+    run_count++;
+    if (problem) mismatch_count++;
+    printf("%-32s %-22s %s\n", source, mode, problem ? problem : "ok");
+    fflush(stdout);
+    freeRun(run);
+}
+
+static int removeEntry(const char *path, const struct stat *info, int type, struct FTW *ftw) {
+    (void)info;
+    (void)type;
+    (void)ftw;
+    return remove(path);
+}
+
+// Function to remove a directory and everything in it
+static void removeTree(const char *path) {
+    nftw(path, removeEntry, 16, FTW_DEPTH | FTW_PHYS);
+}
+
+// Function to count the assemblies watch mode reported on its stdout; *failed
+// is set when the last of them failed
+static int countWatchRuns(const char *path, int *failed) {
+    file_data out = readFile(path);
+    int runs = 0;
+    for (size_t i = 0; i < out.size; i++) {
+        if (i > 0 && out.data[i - 1] != '\n') continue;
+        const char *line = out.data + i;
+        size_t rest = out.size - i;
+        if (rest >= 10 && !memcmp(line, "Assembled ", 10)) {
+            runs++;
+            *failed = 0;
+        } else if (rest >= 16 && !memcmp(line, "Assembly failed.", 16)) {
+            runs++;
+            *failed = 1;
+        }
+    }
+    free(out.data);
+    return runs;
+}
+
+// Function to save text as path the way editors do: a new file renamed over it
+static int saveFile(const char *path, const char *text, size_t size) {
+    char temp[PATH_MAX];
+    snprintf(temp, sizeof(temp), "%s.new", path);
+    FILE *out = fopen(temp, "wb");
+    if (!out) return -1;
+    int status = fwrite(text, 1, size, out) == size ? 0 : -1;
+    if (fclose(out) != 0) status = -1;
+    return status == 0 ? rename(temp, path) : -1;
+}
+
+// Function to wait until watch mode has reported runs assemblies, then take
+// the result of the last one: the messages after offset *seen in its stderr
+static int waitForWatch(pid_t pid, int runs, const char *out, const char *err, const char *object, size_t *seen,
+                        run_result *run) {
+    int failed = 0;
+    struct timespec pause = {0, 10 * 1000 * 1000};
+    for (int waited = 0; countWatchRuns(out, &failed) < runs; waited++) {
+        if (waited >= WATCH_TIMEOUT * 100 || waitpid(pid, NULL, WNOHANG) != 0) return -1;
+        nanosleep(&pause, NULL);
+    }
+
+    file_data messages = readFile(err);
+    size_t start = *seen < messages.size ? *seen : messages.size;
+    run->status = failed ? EXIT_FAILURE : 0;
+    run->messages.size = messages.size - start;
+    run->messages.data = malloc(run->messages.size + 1);
+    if (run->messages.data) memcpy(run->messages.data, messages.data + start, run->messages.size);
+    *seen = messages.size;
+    free(messages.data);
+    run->object = failed ? (file_data){NULL, 0} : readFile(object);
+    return 0;
+}
+
+// Function to find an edit for watch mode: the unlabeled line nearest the
+// middle of text, which is left out. Returns its offset and sets *length,
+// or returns -1 when the source has none.
+static long findEditLine(const file_data *text, size_t *length) {
+    for (size_t i = text->size / 2; i < text->size; i++) {
+        if (i > 0 && text->data[i - 1] != '\n') continue;
+        if (text->data[i] != ' ' && text->data[i] != '\t') continue;
+        const char *end = memchr(text->data + i, '\n', text->size - i);
+        if (!end) return -1;
+        // END closes the program; what follows it is not assembled
+        const char *word = text->data + i + strspn(text->data + i, " \t");
+        if (word < end && !strncmp(word, "END", 3)) return -1;
+        *length = end - (text->data + i) + 1;
+        return i;
+    }
+    return -1;
+}
+
+// Function to check watch mode on source: the first assembly, an edit that
+// leaves a line out (assembled incrementally) and the source saved again
+static void checkWatchMode(const char *source, const run_result *reference) {
+    char watched[PATH_MAX], object[PATH_MAX], out[PATH_MAX], err[PATH_MAX];
+    tempPath(watched, "watched.asm");
+    tempPath(object, "watched.obj");
+    tempPath(out, "watch.out");
+    tempPath(err, "watch.err");
+
+    // Nothing of the last source's watch may be mistaken for this one's
+    file_data text = readFile(source);
+    unlink(object);
+    unlink(out);
+    unlink(err);
+    if (saveFile(watched, text.data ? text.data : "", text.size) != 0) {
+        perror(watched);
+        free(text.data);
+        return;
+    }
+
+    const char *args[] = {sicasm_path, "--watch", "-q", watched, "-o", object, NULL};
+    pid_t pid = startTool((char *const *)args, NULL, out, err);
+    size_t seen = 0;
+    run_result run;
+    memset(&run, 0, sizeof(run));
+    const char *problem = NULL;
+    if (pid < 0 || waitForWatch(pid, 1, out, err, object, &seen, &run) != 0) {
+        problem = "no assembly reported";
+        pid = -1;
+    }
+    compareRun(source, "--watch", &run, reference, problem);
+
+    size_t length;
+    long edit = findEditLine(&text, &length);
+    if (pid > 0 && edit >= 0) {
+        // The edit is compared with a two-pass assembly of the edited text
+        char edited[PATH_MAX], edited_object[PATH_MAX];
+        char *next = malloc(text.size);
+        if (!next) {
+            fprintf(stderr, "Error: Out of memory.\n");
+            exit(EXIT_FAILURE);
+        }
+        memcpy(next, text.data, edit);
+        memcpy(next + edit, text.data + edit + length, text.size - edit - length);
+        FILE *file = fopen(tempPath(edited, "edited.asm"), "wb");
+        if (file) {
+            fwrite(next, 1, text.size - length, file);
+            fclose(file);
+        }
+        run_result edited_reference;
+        const char *no_options[] = {NULL};
+        assemble(edited, no_options, 0, tempPath(edited_object, "edited.obj"), &edited_reference);
+
+        memset(&run, 0, sizeof(run));
+        if (saveFile(watched, next, text.size - length) != 0 ||
+            waitForWatch(pid, 2, out, err, object, &seen, &run) != 0) {
+            problem = "no assembly reported";
+        }
+        compareRun(source, "--watch (edited)", &run, &edited_reference, problem);
+        freeRun(&edited_reference);
+        free(next);
+
+        memset(&run, 0, sizeof(run));
+        if (!problem && (saveFile(watched, text.data ? text.data : "", text.size) != 0 ||
+                         waitForWatch(pid, 3, out, err, object, &seen, &run) != 0)) {
+            problem = "no assembly reported";
+        }
+        compareRun(source, "--watch (restored)", &run, reference, problem);
+    }
+
+    if (pid > 0) {
+        kill(pid, SIGTERM);
+        waitpid(pid, NULL, 0);
+    }
+    free(text.data);
+}
+
+// Function to get the hits counted in the cache in dir, or -1
+static int getCacheHits(const char *dir) {
+    char out[PATH_MAX], err[PATH_MAX];
+    const char *args[] = {sicasm_path, "--cache", dir, "--cache-stats", NULL};
+    if (runTool((char *const *)args, NULL, tempPath(out, "stdout"), tempPath(err, "stderr")) != 0) return -1;
+
+    file_data stats = readFile(out);
+    int hits = -1;
+    for (size_t i = 0; i < stats.size; i++) {
+        if ((i == 0 || stats.data[i - 1] == '\n') && stats.size - i > 5 && !memcmp(stats.data + i, "hits ", 5)) {
+            hits = atoi(stats.data + i + 5);
+        }
+    }
+    free(stats.data);
+    return hits;
+}
+
+// Function to check every mode on one source against its two-pass assembly
+static void checkSource(const char *source) {
+    char object[PATH_MAX], reference_object[PATH_MAX], cache[PATH_MAX];
+    tempPath(object, "object.txt");
+    tempPath(cache, "cache");
+
+    run_result reference, run;
+    const char *no_options[] = {NULL};
+    assemble(source, no_options, 0, tempPath(reference_object, "reference.txt"), &reference);
+    printf("%-32s %-22s status %d, %zu bytes of object program\n", source, "two-pass", reference.status,
+           reference.object.size);
+
+    const char *threaded[] = {"-j", thread_option, NULL};
+    assemble(source, threaded, 0, object, &run);
+    compareRun(source, "-j", &run, &reference, NULL);
+
+    const char *one_pass[] = {"--one-pass", NULL};
+    assemble(source, one_pass, 0, object, &run);
+    compareRun(source, "--one-pass", &run, &reference, NULL);
+    assemble(source, one_pass, 1, "-", &run);
+    compareRun(source, "--one-pass - -o -", &run, &reference, NULL);
+
+    const char *pipeline[] = {"--pipeline", NULL};
+    assemble(source, pipeline, 0, object, &run);
+    compareRun(source, "--pipeline", &run, &reference, NULL);
+    assemble(source, pipeline, 1, "-", &run);
+    compareRun(source, "--pipeline - -o -", &run, &reference, NULL);
+
+    // A new cache for every source: the first run misses and stores, the second hits
+    removeTree(cache);
+    const char *cached[] = {"--cache", cache, NULL};
+    assemble(source, cached, 0, object, &run);
+    compareRun(source, "--cache (miss)", &run, &reference, NULL);
+    assemble(source, cached, 0, object, &run);
+    // Failed runs are never stored, so they miss again
+    int hits = getCacheHits(cache);
+    compareRun(source, "--cache (hit)", &run, &reference, hits != (reference.status == 0) ? "not a cache hit" : NULL);
+
+    checkWatchMode(source, &reference);
+    freeRun(&reference);
+}
+
+int main(int argc, char *argv[]) {
+    const char *gen_path = NULL;
+    const char *lines = "20000";
+    int first = 1;
+    for (; first < argc && argv[first][0] == '-' && argv[first][1] != '\0'; first++) {
+        const char *option = argv[first];
+        if (first + 1 >= argc) break;
+        if (!strcmp(option, "-a")) {
+            sicasm_path = argv[++first];
+        } else if (!strcmp(option, "-g")) {
+            gen_path = argv[++first];
+        } else if (!strcmp(option, "-n")) {
+            lines = argv[++first];
+        } else if (!strcmp(option, "-j")) {
+            snprintf(thread_option, sizeof(thread_option), "%s", argv[++first]);
+        } else {
+            break;
+        }
+    }
+    if (first < argc && argv[first][0] == '-') {
+        fprintf(stderr, "Usage: %s [-a sicasm] [-g gen_sic] [-n lines] [-j threads] [source]...\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (first == argc && !gen_path) {
+        fprintf(stderr, "Error: No sources; give some, or -g to generate them.\n");
+        return EXIT_FAILURE;
+    }
+    if (access(sicasm_path, X_OK) != 0) {
+        perror(sicasm_path);
+        return EXIT_FAILURE;
+    }
+    if (!mkdtemp(temp_dir)) {
+        perror(temp_dir);
+        return EXIT_FAILURE;
+    }
+
+    for (int i = first; i < argc; i++) {
+        checkSource(argv[i]);
+    }
+
+    for (int i = 0; gen_path && i < GEN_SOURCES; i++) {
+        char source[PATH_MAX], name[32], out[PATH_MAX], err[PATH_MAX];
+        snprintf(name, sizeof(name), "gen_%d.asm", i + 1);
+        const char *args[16];
+        int count = 0;
+        args[count++] = gen_path;
+        args[count++] = "-n";
+        args[count++] = lines;
+        for (int j = 0; gen_options[i][j]; j++) args[count++] = gen_options[i][j];
+        args[count++] = "-o";
+        args[count++] = tempPath(source, name);
+        args[count] = NULL;
+        if (runTool((char *const *)args, NULL, tempPath(out, "stdout"), tempPath(err, "stderr")) != 0) {
+            fprintf(stderr, "Error: %s could not write %s.\n", gen_path, source);
+            mismatch_count++;
+            continue;
+        }
+        checkSource(source);
+    }
+
+    removeTree(temp_dir);
+    printf("%d runs, %d differ from two-pass\n", run_count, mismatch_count);
+    return mismatch_count ? EXIT_FAILURE : 0;
+}
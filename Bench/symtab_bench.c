@@ -0,0 +1,82 @@
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../Common/symtab.h"
+
+// Micro-benchmark for the SYMTAB: measures insert, hit lookup and miss
+// lookup throughput for N generated labels.
+//
+//   gcc -O2 symtab_bench.c ../Common/symtab.c ../Common/stats.c -o symtab_bench -lpthread
+//   ./symtab_bench [labels]
+
+// Function to get the current time in seconds
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Function to print one benchmark result line
+static void report(const char *name, int count, double seconds) {
+    printf("%-10s %10d ops %10.3f ms %10.2f Mops/s\n", name, count, seconds * 1e3, count / seconds / 1e6);
+}
+
+int main(int argc, char *argv[]) {
+    int count = argc > 1 ? atoi(argv[1]) : 1000000;
+    if (count <= 0) {
+        fprintf(stderr, "Error: Label count must be positive.\n");
+        return EXIT_FAILURE;
+    }
+
+    // Generate the labels up front so only the table is timed
+    char *names = malloc((size_t)count * 16);
+    int *lengths = malloc(count * sizeof(int));
+    if (!names || !lengths) {
+        fprintf(stderr, "Error: Out of memory.\n");
+        return EXIT_FAILURE;
+    }
+    for (int i = 0; i < count; i++) {
+        lengths[i] = snprintf(names + (size_t)i * 16, 16, "L%X", (unsigned int)i * 2654435761u);
+    }
+
+    symtab table;
+    initSymtab(&table);
+
+    // Insert every label
+    double start = now();
+    for (int i = 0; i < count; i++) {
+        addToSymtab(&table, names + (size_t)i * 16, lengths[i], i);
+    }
+    report("insert", count, now() - start);
+
+    // Look every label up again
+    long checksum = 0;
+    start = now();
+    for (int i = 0; i < count; i++) {
+        checksum += searchSymtab(&table, names + (size_t)i * 16, lengths[i]);
+    }
+    report("lookup", count, now() - start);
+
+    // Look up labels that are not in the table
+    for (int i = 0; i < count; i++) {
+        names[(size_t)i * 16] = 'M';
+    }
+    int misses = 0;
+    start = now();
+    for (int i = 0; i < count; i++) {
+        misses += searchSymtab(&table, names + (size_t)i * 16, lengths[i]) == -1;
+    }
+    report("miss", count, now() - start);
+
+    printf("symbols: %d, slots: %d, arena: %zu bytes, checksum: %ld, misses: %d\n",
+           table.size, table.slot_count, table.arena_size, checksum, misses);
+
+    freeSymtab(&table);
+    free(names);
+    free(lengths);
+    return 0;
+}
@@ -0,0 +1,98 @@
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../Common/scan.h"
+#include "../Common/source.h"
+
+// Benchmark for the source tokenizer: tokenizes a source file with the
+// line-at-a-time tokenizer and with the block scanner using every kernel
+// the CPU has, checks that all of them find the same fields and prints
+// their throughput.
+//
+//   gcc -O2 tokenizer_bench.c ../Common/scan.c ../Common/source.c ../Common/stats.c -o tokenizer_bench -lpthread
+//   ./tokenizer_bench source.txt [repeats]
+
+// Function to get the current time in seconds
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Function to print one benchmark result line
+static void report(const char *name, size_t bytes, long lines, double seconds) {
+    printf("%-10s %10ld lines %10.3f ms %10.1f MB/s\n", name, lines, seconds * 1e3, bytes / seconds / 1e6);
+}
+
+// Function to compare two tokenized lines
+static int sameFields(const source_fields *a, const source_fields *b) {
+    return a->line.offset == b->line.offset && a->line.length == b->line.length &&
+           a->label.length == b->label.length && (!a->label.length || a->label.offset == b->label.offset) &&
+           a->mnemonic.length == b->mnemonic.length && (!a->mnemonic.length || a->mnemonic.offset == b->mnemonic.offset) &&
+           a->operand.length == b->operand.length && (!a->operand.length || a->operand.offset == b->operand.offset);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s source [repeats]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    int repeats = argc > 2 ? atoi(argv[2]) : 10;
+    if (repeats <= 0) repeats = 1;
+
+    source_buffer source;
+    if (openSourceBuffer(&source, argv[1]) != 0) {
+        return EXIT_FAILURE;
+    }
+
+    // Line-at-a-time tokenizer, also the reference for the fields
+    long line_count = 0, fields_sum = 0;
+    double start = now();
+    for (int r = 0; r < repeats; r++) {
+        source_fields fields;
+        size_t position = 0;
+        while (position < source.size) {
+            position = tokenizeSourceLine(source.data, source.size, position, &fields);
+            fields_sum += fields.mnemonic.length;
+            if (r == 0) line_count++;
+        }
+    }
+    report("line", source.size * (size_t)repeats, line_count, now() - start);
+
+    static const scan_kernel kernels[] = {SCAN_SCALAR, SCAN_SSE2, SCAN_AVX2};
+    int status = 0;
+    for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++) {
+        if (selectScanKernel(kernels[k]) != 0) continue;
+
+        // Every line has to match the reference tokenizer
+        source_scanner scanner;
+        source_fields expected, fields;
+        size_t position = 0;
+        initSourceScanner(&scanner, source.data, 0, source.size);
+        while (scanSourceLine(&scanner, &fields)) {
+            position = tokenizeSourceLine(source.data, source.size, position, &expected);
+            if (!sameFields(&expected, &fields)) {
+                fprintf(stderr, "Error: %s kernel differs on line: %.*s\n", getScanKernelName(),
+                        expected.line.length, source.data + expected.line.offset);
+                status = EXIT_FAILURE;
+                break;
+            }
+        }
+
+        long sum = 0;
+        start = now();
+        for (int r = 0; r < repeats; r++) {
+            initSourceScanner(&scanner, source.data, 0, source.size);
+            while (scanSourceLine(&scanner, &fields)) sum += fields.mnemonic.length;
+        }
+        report(getScanKernelName(), source.size * (size_t)repeats, line_count, now() - start);
+        if (sum != fields_sum) status = EXIT_FAILURE;
+    }
+
+    closeSourceBuffer(&source);
+    return status;
+}
@@ -0,0 +1,324 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "batch.h"
+#include "cache.h"
+#include "csect.h"
+#include "handoff.h"
+#include "macro.h"
+#include "pool.h"
+#include "program.h"
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// ------x--------x----------x------------x------ BATCH ----------------x------------x----------------x-----------x
+
+// Function to initialise an empty batch
+void initBatch(batch *jobs, const char *output_dir) {
+    memset(jobs, 0, sizeof(*jobs));
+    jobs->output_dir = output_dir;
+}
+
+// Function to release the memory held by a batch
+void freeBatch(batch *jobs) {
+    for (int i = 0; i < jobs->job_count; i++) {
+        free(jobs->jobs[i].source_path);
+        free(jobs->jobs[i].object_path);
+        free(jobs->jobs[i].diagnostics);
+    }
+    free(jobs->jobs);
+    initBatch(jobs, NULL);
+}
+
+// Function to get the object program path of a source: its name with the
+// extension replaced by .obj, in the output directory or next to the source
+static char *getObjectPath(const batch *jobs, const char *source_path, int source_length) {
+    int name_start = source_length;
+    while (name_start > 0 && source_path[name_start - 1] != '/') name_start--;
+
+    int name_end = source_length;
+    for (int i = source_length - 1; i > name_start; i--) {
+        if (source_path[i] == '.') {
+            name_end = i;
+            break;
+        }
+    }
+
+    const char *dir = jobs->output_dir ? jobs->output_dir : source_path;
+    int dir_length = jobs->output_dir ? (int)strlen(jobs->output_dir) : name_start;
+    int needs_slash = jobs->output_dir && dir_length > 0 && dir[dir_length - 1] != '/';
+
+    char *path = malloc(dir_length + needs_slash + (name_end - name_start) + sizeof(".obj"));
+    if (!path) return NULL;
+    sprintf(path, "%.*s%s%.*s.obj", dir_length, dir, needs_slash ? "/" : "",
+            name_end - name_start, source_path + name_start);
+    return path;
+}
+
+// Function to append one source file to the batch
+static int addBatchSource(batch *jobs, const char *path, int length) {
+    if (jobs->job_count == jobs->job_capacity) {
+        int new_capacity = jobs->job_capacity ? jobs->job_capacity * 2 : 64;
+        batch_job *new_jobs = realloc(jobs->jobs, new_capacity * sizeof(batch_job));
+        if (!new_jobs) {
+            fprintf(stderr, "Error: Out of memory.\n");
+            return -1;
+        }
+        jobs->jobs = new_jobs;
+        jobs->job_capacity = new_capacity;
+    }
+
+    batch_job *job = &jobs->jobs[jobs->job_count];
+    memset(job, 0, sizeof(*job));
+    job->source_path = strndup(path, length);
+    job->object_path = getObjectPath(jobs, path, length);
+    if (!job->source_path || !job->object_path) {
+        fprintf(stderr, "Error: Out of memory.\n");
+        free(job->source_path);
+        free(job->object_path);
+        return -1;
+    }
+
+    jobs->job_count++;
+    return 0;
+}
+
+// Function to check whether a directory entry is a source file: object
+// programs written by an earlier batch and hidden files are skipped
+static int isBatchSource(const char *dir, const char *name, char *path, size_t path_size) {
+    size_t length = strlen(name);
+    if (name[0] == '.') return 0;
+    if (length > 4 && !strcmp(name + length - 4, ".obj")) return 0;
+
+    struct stat info;
+    snprintf(path, path_size, "%s/%s", dir, name);
+    return stat(path, &info) == 0 && S_ISREG(info.st_mode);
+}
+
+// Function to add every source file of a directory, sorted by name so the
+// batch order does not depend on the file system
+static int addBatchDirectory(batch *jobs, const char *dir) {
+    struct dirent **names;
+    int count = scandir(dir, &names, NULL, alphasort);
+    if (count < 0) {
+        perror(dir);
+        return -1;
+    }
+
+    int status = 0;
+    for (int i = 0; i < count; i++) {
+        char path[4096];
+        if (status == 0 && isBatchSource(dir, names[i]->d_name, path, sizeof(path))) {
+            status = addBatchSource(jobs, path, strlen(path));
+        }
+        free(names[i]);
+    }
+    free(names);
+    return status;
+}
+
+// Function to add a source file, or every file of a directory
+int addBatchPath(batch *jobs, const char *path) {
+    struct stat info;
+    if (stat(path, &info) == 0 && S_ISDIR(info.st_mode)) {
+        return addBatchDirectory(jobs, path);
+    }
+    return addBatchSource(jobs, path, strlen(path));
+}
+
+// Function to add every path listed in a file
+int addBatchList(batch *jobs, const char *list_path) {
+    source_buffer list;
+    if (openSourceBuffer(&list, list_path) != 0) {
+        return -1;
+    }
+
+    int status = 0;
+    size_t position = 0;
+    while (status == 0 && position < list.size) {
+        source_view line;
+        position = nextLine(list.data, list.size, position, &line);
+
+        // Surrounding blanks are not part of the path
+        while (line.length > 0 && (list.data[line.offset] == ' ' || list.data[line.offset] == '\t')) {
+            line.offset++;
+            line.length--;
+        }
+        while (line.length > 0 && (list.data[line.offset + line.length - 1] == ' ' ||
+                                   list.data[line.offset + line.length - 1] == '\t')) {
+            line.length--;
+        }
+        if (line.length == 0) continue;
+
+        char *path = strndup(list.data + line.offset, line.length);
+        status = path ? addBatchPath(jobs, path) : -1;
+        free(path);
+    }
+
+    closeSourceBuffer(&list);
+    return status;
+}
+
+// Function to assemble a source file that is open into its object program
+static int assembleOpenSource(batch_job *job, const source_buffer *source, FILE *diagnostics) {
+    // A source of control sections is assembled section by section, on this job's thread
+    if (hasControlSections(source->data, source->size)) {
+        atomic_file object_file;
+        int status = openAtomicFile(&object_file, job->object_path);
+        if (status != 0) {
+            fprintf(diagnostics, "Error: Cannot open '%s' for writing.\n", job->object_path);
+        } else if (assembleControlSections(source->data, source->size, 1, object_file.file, NULL, diagnostics,
+                                           &job->line_count) != 0) {
+            discardAtomicFile(&object_file);
+            status = -1;
+        } else {
+            status = commitAtomicFile(&object_file);
+        }
+        return status;
+    }
+
+    program prog;
+    initProgram(&prog);
+    setDiagnostics(&prog, diagnostics);
+
+    int status = runPass1(&prog, source->data, source->size);
+    job->line_count = prog.line_count;
+
+    // Jobs sharing the output directory each replace their object program at once
+    if (status == 0) {
+        atomic_file object_file;
+        if (openAtomicFile(&object_file, job->object_path) != 0) {
+            fprintf(diagnostics, "Error: Cannot open '%s' for writing.\n", job->object_path);
+            status = -1;
+        } else if (runPass2(&prog, object_file.file) != 0) {
+            discardAtomicFile(&object_file);
+            status = -1;
+        } else {
+            status = commitAtomicFile(&object_file);
+        }
+    }
+
+    freeProgram(&prog);
+    return status;
+}
+
+// Function to store a finished job in the cache, with the object program
+// read back from the file it just wrote
+static void storeBatchJob(assembly_cache *cache, cache_key key, batch_job *job, FILE *diagnostics) {
+    source_buffer object;
+    if (openSourceBuffer(&object, job->object_path) != 0) {
+        return;
+    }
+
+    // The warnings are in the job's buffer once its stream is flushed
+    cache_entry entry;
+    memset(&entry, 0, sizeof(entry));
+    fflush(diagnostics);
+    if (diagnostics != stderr) {
+        entry.parts[CACHE_DIAGNOSTICS] = job->diagnostics;
+        entry.part_sizes[CACHE_DIAGNOSTICS] = job->diagnostics_size;
+    }
+    entry.parts[CACHE_OBJECT] = object.data;
+    entry.part_sizes[CACHE_OBJECT] = object.size;
+    entry.line_count = job->line_count;
+    storeCache(cache, key, &entry);
+    closeSourceBuffer(&object);
+}
+
+// Function to assemble one source file into its object program, or to copy
+// it out of the cache when the source was assembled before
+static int assembleBatchSource(const batch *jobs, batch_job *job, FILE *diagnostics) {
+    source_buffer source;
+    if (openSourceBuffer(&source, job->source_path) != 0) {
+        fprintf(diagnostics, "Error: Cannot read the source program.\n");
+        return -1;
+    }
+
+    // A job writes what sicasm -q writes, so they share their entries
+    cache_key key;
+    if (jobs->cache) {
+        char options[64];
+        snprintf(options, sizeof(options), CACHE_ASSEMBLY_OPTIONS, 't', 0, 0);
+        key = getCacheKey(source.data, source.size, options);
+
+        cache_entry entry;
+        if (lookupCache(jobs->cache, key, &entry)) {
+            if (entry.part_sizes[CACHE_DIAGNOSTICS] > 0) fwrite(entry.parts[CACHE_DIAGNOSTICS], 1, entry.part_sizes[CACHE_DIAGNOSTICS], diagnostics);
+            job->line_count = entry.line_count;
+            job->cached = 1;
+            int status = writeCachePart(&entry, CACHE_OBJECT, job->object_path);
+            if (status != 0) fprintf(diagnostics, "Error: Cannot open '%s' for writing.\n", job->object_path);
+            releaseCacheEntry(&entry);
+            closeSourceBuffer(&source);
+            return status;
+        }
+    }
+
+    // Macro calls are expanded in memory before pass 1
+    int status = 0;
+    if (hasMacros(source.data, source.size)) {
+        source_buffer expanded;
+        status = expandMacros(source.data, source.size, &expanded, diagnostics);
+        if (status == 0) {
+            closeSourceBuffer(&source);
+            source = expanded;
+        }
+    }
+
+    if (status == 0) status = assembleOpenSource(job, &source, diagnostics);
+    if (status == 0 && jobs->cache) {
+        storeBatchJob(jobs->cache, key, job, diagnostics);
+    }
+    closeSourceBuffer(&source);
+    return status;
+}
+
+// Function run by the thread pool for every job
+static void runBatchJob(void *context, int index) {
+    batch *jobs = context;
+    batch_job *job = &jobs->jobs[index];
+
+    // Diagnostics are kept with the job so jobs running at the same time
+    // do not interleave their messages
+    FILE *diagnostics = open_memstream(&job->diagnostics, &job->diagnostics_size);
+    job->status = assembleBatchSource(jobs, job, diagnostics ? diagnostics : stderr);
+    if (diagnostics) fclose(diagnostics);
+}
+
+// Function to assemble every job of the batch
+int runBatch(batch *jobs, int thread_count, batch_stats *stats) {
+    struct timespec start, end;
+    memset(stats, 0, sizeof(*stats));
+
+    if (jobs->output_dir && makeDirectories(jobs->output_dir) != 0) {
+        return -1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (runThreadPool(thread_count, jobs->job_count, runBatchJob, jobs) != 0) {
+        return -1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    // Report in batch order, whatever order the jobs finished in
+    for (int i = 0; i < jobs->job_count; i++) {
+        const batch_job *job = &jobs->jobs[i];
+        if (job->diagnostics_size > 0) {
+            fprintf(stderr, "%s:\n%.*s", job->source_path, (int)job->diagnostics_size, job->diagnostics);
+        }
+        stats->files++;
+        stats->lines += job->line_count;
+        if (job->status != 0) stats->failed++;
+        if (job->cached) stats->cached++;
+    }
+    stats->seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    return stats->failed ? -1 : 0;
+}
+
+// ------x--------x----------x------------x------ BATCH ----------------x------------x----------------x-----------x
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
@@ -0,0 +1,63 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stddef.h>
+
+#include "cache.h"
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// ------x--------x----------x------------x------ BATCH ----------------x------------x----------------x-----------x
+
+// One source program of a batch. Every job is assembled with its own
+// program (lines, SYMTAB, OPTAB ids), so jobs share no state and the
+// object program of a file does not depend on how the jobs were scheduled.
+typedef struct {
+    char *source_path;
+    char *object_path;
+    int status;             // 0 when the object program was written
+    int line_count;
+    int cached;             // 1 when the object program was copied out of the cache
+
+    // Errors and warnings of the job, printed in batch order at the end
+    char *diagnostics;
+    size_t diagnostics_size;
+} batch_job;
+
+typedef struct {
+    batch_job *jobs;
+    int job_count;
+    int job_capacity;
+
+    // Directory the object programs are written to (NULL: next to the source)
+    const char *output_dir;
+
+    // Cache unchanged sources are copied out of (NULL: every source is assembled)
+    assembly_cache *cache;
+} batch;
+
+// Totals of a batch run
+typedef struct {
+    int files;
+    int failed;
+    int cached;
+    long long lines;
+    double seconds;
+} batch_stats;
+
+void initBatch(batch *jobs, const char *output_dir);
+void freeBatch(batch *jobs);
+
+// Function to add a source file, or every file of a directory (in name order)
+int addBatchPath(batch *jobs, const char *path);
+
+// Function to add every path listed in a file, one per line ("-" for stdin)
+int addBatchList(batch *jobs, const char *list_path);
+
+// Function to assemble every job on thread_count threads, then print the
+// diagnostics of the jobs in the order they were added
+int runBatch(batch *jobs, int thread_count, batch_stats *stats);
+
+// ------x--------x----------x------------x------ BATCH ----------------x------------x----------------x-----------x
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+
+#endif
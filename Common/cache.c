@@ -0,0 +1,483 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "cache.h"
+#include "handoff.h"
+#include "intermediate.h"
+#include "objimage.h"
+#include "stats.h"
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// ------x--------x----------x------------x------ ASSEMBLY CACHE ----------------x------------x----------------x----x
+
+// Odd constants the hash mixes in, so that runs of zero bytes still change its state
+#define HASH_SECRET_0 0xa0761d6478bd642full
+#define HASH_SECRET_1 0xe7037ed1a0b428dbull
+#define HASH_SECRET_2 0x8ebc6af09c88c6e3ull
+#define HASH_SECRET_3 0x589965cc75374cc3ull
+
+// Temporary files older than this were left by a job that died, and are removed
+#define STALE_TEMP_SECONDS 3600
+
+// Function to multiply two words and fold the 128-bit product into one
+static inline uint64_t mixHash(uint64_t a, uint64_t b) {
+    __uint128_t product = (__uint128_t)a * b;
+    return (uint64_t)product ^ (uint64_t)(product >> 64);
+}
+
+static inline uint64_t rotateLeft(uint64_t word, int bits) {
+    return (word << bits) | (word >> (64 - bits));
+}
+
+static inline uint64_t readWord(const char *p) {
+    uint64_t word;
+    memcpy(&word, p, sizeof(word));
+    return word;
+}
+
+// Function to hash 16 bytes into both halves of the state. The old state
+// is also kept rotated, so a product of zero does not wipe it out.
+static inline void hashBlock(uint64_t state[2], uint64_t x, uint64_t y) {
+    uint64_t a = state[0], b = state[1];
+    state[0] = mixHash(x ^ a ^ HASH_SECRET_0, y ^ HASH_SECRET_1) ^ rotateLeft(a, 23);
+    state[1] = mixHash(y ^ b ^ HASH_SECRET_2, x ^ HASH_SECRET_3) ^ rotateLeft(b, 41);
+}
+
+// Function to hash bytes into 128 bits, 16 bytes a step with one multiply per
+// half. It is made to tell sources apart, not to stand up to an attacker.
+static void hashBytes(uint64_t state[2], const char *text, size_t size) {
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        hashBlock(state, readWord(text + i), readWord(text + i + 8));
+    }
+
+    // The last bytes are zero-padded, and the length tells the padding apart
+    char tail[16] = {0};
+    memcpy(tail, text + i, size - i);
+    hashBlock(state, readWord(tail), readWord(tail + 8));
+    hashBlock(state, size, ~(uint64_t)size);
+}
+
+// Function to get the key of a source assembled with options
+cache_key getCacheKey(const char *text, size_t size, const char *options) {
+    char prefix[256];
+    int length = snprintf(prefix, sizeof(prefix), "sicasm %d.%d.%d %s", CACHE_VERSION, INTERMEDIATE_VERSION,
+                          OBJECT_IMAGE_VERSION, options);
+    if (length >= (int)sizeof(prefix)) length = sizeof(prefix) - 1;
+
+    uint64_t state[2] = {0, 0};
+    hashBytes(state, prefix, length);
+    hashBytes(state, text, size);
+
+    cache_key key;
+    key.words[0] = state[0];
+    key.words[1] = state[1];
+    return key;
+}
+
+// Function to get the path of an entry: <dir>/<2 hex digits>/<30 hex digits>
+static char *getEntryPath(const assembly_cache *cache, cache_key key) {
+    char hex[33];
+    snprintf(hex, sizeof(hex), "%016llx%016llx", (unsigned long long)key.words[0], (unsigned long long)key.words[1]);
+
+    char *path = malloc(strlen(cache->dir) + sizeof(hex) + 2);
+    if (path) sprintf(path, "%s/%.2s/%s", cache->dir, hex, hex + 2);
+    return path;
+}
+
+// Totals of a cache, kept in <dir>/stats as one "name value" line each
+typedef struct {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t stores;
+    uint64_t evictions;
+    uint64_t cleanups;
+    uint64_t size;          // Bytes of all entries, recounted by every cleanup
+    uint64_t max_size;
+} cache_totals;
+
+static const struct {
+    const char *name;
+    size_t offset;
+} total_fields[] = {
+    {"hits", offsetof(cache_totals, hits)},
+    {"misses", offsetof(cache_totals, misses)},
+    {"stores", offsetof(cache_totals, stores)},
+    {"evictions", offsetof(cache_totals, evictions)},
+    {"cleanups", offsetof(cache_totals, cleanups)},
+    {"size", offsetof(cache_totals, size)},
+    {"max_size", offsetof(cache_totals, max_size)},
+};
+
+#define TOTAL_FIELDS (int)(sizeof(total_fields) / sizeof(total_fields[0]))
+
+static uint64_t *getTotalField(cache_totals *totals, int field) {
+    return (uint64_t *)((char *)totals + total_fields[field].offset);
+}
+
+// Function to read the totals of a cache; a missing file is a new cache
+static int readTotals(const char *dir, cache_totals *totals) {
+    memset(totals, 0, sizeof(*totals));
+    char *path = joinPath(dir, "stats");
+    FILE *file = path ? fopen(path, "r") : NULL;
+    free(path);
+    if (!file) return errno == ENOENT ? 0 : -1;
+
+    char name[32];
+    unsigned long long value;
+    while (fscanf(file, "%31s %llu", name, &value) == 2) {
+        for (int i = 0; i < TOTAL_FIELDS; i++) {
+            if (!strcmp(name, total_fields[i].name)) *getTotalField(totals, i) = value;
+        }
+    }
+    fclose(file);
+    return 0;
+}
+
+// Function to open the cache in dir
+int openCache(assembly_cache *cache, const char *dir, uint64_t max_size) {
+    memset(cache, 0, sizeof(*cache));
+    if (makeDirectories(dir) != 0) {
+        return -1;
+    }
+    cache->dir = strdup(dir);
+    if (!cache->dir) {
+        fprintf(stderr, "Error: Out of memory.\n");
+        return -1;
+    }
+    cache->max_size = max_size;
+
+    // The limit is this run's, else the one kept in the stats file, else the default
+    cache_totals totals;
+    uint64_t limit = max_size;
+    if (!limit && readTotals(dir, &totals) == 0) limit = totals.max_size;
+    if (!limit) limit = CACHE_DEFAULT_MAX_SIZE;
+    cache->max_entry_size = limit / 100 * CACHE_TRIM_PERCENT;
+    return 0;
+}
+
+// Function to check a mapped entry and point the parts of entry into it
+static int readEntry(cache_entry *entry, cache_key key) {
+    const cache_entry_header *header = entry->mapping;
+    if (entry->mapping_size < sizeof(*header) || memcmp(header->magic, CACHE_MAGIC, 4) != 0 ||
+        header->version != CACHE_VERSION || memcmp(&header->key, &key, sizeof(key)) != 0) {
+        return -1;
+    }
+
+    // A torn or truncated file is caught by its size
+    size_t offset = sizeof(*header);
+    for (int i = 0; i < CACHE_PARTS; i++) {
+        if (header->part_sizes[i] > entry->mapping_size - offset) return -1;
+        entry->parts[i] = (const char *)entry->mapping + offset;
+        entry->part_sizes[i] = header->part_sizes[i];
+        offset += header->part_sizes[i];
+    }
+    entry->line_count = header->line_count;
+    return offset == entry->mapping_size ? 0 : -1;
+}
+
+// Function to look an entry up
+int lookupCache(assembly_cache *cache, cache_key key, cache_entry *entry) {
+    memset(entry, 0, sizeof(*entry));
+    char *path = getEntryPath(cache, key);
+    int fd = path ? open(path, O_RDONLY | O_CLOEXEC) : -1;
+
+    struct stat info;
+    int hit = 0;
+    if (fd >= 0 && fstat(fd, &info) == 0 && info.st_size > 0) {
+        entry->mapping_size = info.st_size;
+        entry->mapping = mmap(NULL, entry->mapping_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (entry->mapping == MAP_FAILED) {
+            entry->mapping = NULL;
+        } else if (readEntry(entry, key) == 0) {
+            hit = 1;
+        } else {
+            // Not an entry of this assembler: it is stored again after this run
+            unlink(path);
+        }
+    }
+
+    // The modification time orders entries for eviction; a cache
+    // this user cannot write is still read
+    if (hit) futimens(fd, NULL);
+    if (fd >= 0) close(fd);
+    free(path);
+
+    if (!hit) {
+        releaseCacheEntry(entry);
+        __atomic_fetch_add(&cache->misses, 1, __ATOMIC_RELAXED);
+        STATS_COUNT(COUNTER_CACHE_MISSES, 1);
+        return 0;
+    }
+    __atomic_fetch_add(&cache->hits, 1, __ATOMIC_RELAXED);
+    STATS_COUNT(COUNTER_CACHE_HITS, 1);
+    return 1;
+}
+
+// Function to release an entry found in the cache
+void releaseCacheEntry(cache_entry *entry) {
+    if (entry->mapping) munmap(entry->mapping, entry->mapping_size);
+    memset(entry, 0, sizeof(*entry));
+}
+
+// Function to store an entry
+void storeCache(assembly_cache *cache, cache_key key, const cache_entry *entry) {
+    char *path = getEntryPath(cache, key);
+    if (!path) {
+        fprintf(stderr, "Error: Out of memory.\n");
+        return;
+    }
+
+    // The directory of the entry is the path up to its last slash
+    char *slash = strrchr(path, '/');
+    *slash = '\0';
+    int status = makeDirectories(path);
+    *slash = '/';
+
+    cache_entry_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CACHE_MAGIC, 4);
+    header.version = CACHE_VERSION;
+    header.key = key;
+    header.line_count = entry->line_count;
+    int64_t size = sizeof(header);
+    for (int i = 0; i < CACHE_PARTS; i++) {
+        header.part_sizes[i] = entry->part_sizes[i];
+        size += entry->part_sizes[i];
+    }
+
+    // An entry the next cleanup would have to remove at once is not stored
+    if ((uint64_t)size > cache->max_entry_size) {
+        free(path);
+        return;
+    }
+
+    atomic_file file;
+    if (status == 0) status = openAtomicFile(&file, path);
+    if (status == 0) {
+        fwrite(&header, sizeof(header), 1, file.file);
+        for (int i = 0; i < CACHE_PARTS; i++) {
+            if (entry->part_sizes[i] > 0) fwrite(entry->parts[i], 1, entry->part_sizes[i], file.file);
+        }
+
+        // Another job may have stored the same entry meanwhile; its bytes are replaced
+        struct stat info;
+        if (stat(path, &info) == 0) size -= info.st_size;
+        status = ferror(file.file) ? -1 : 0;
+        if (status == 0) {
+            status = commitAtomicFile(&file);
+        } else {
+            discardAtomicFile(&file);
+        }
+    }
+
+    if (status == 0) {
+        __atomic_fetch_add(&cache->stores, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&cache->stored_bytes, size, __ATOMIC_RELAXED);
+    } else {
+        fprintf(stderr, "Warning: Cannot store the assembly in the cache '%s'.\n", cache->dir);
+    }
+    free(path);
+}
+
+// Function to write one part of an entry to a file
+int writeCachePart(const cache_entry *entry, cache_part part, const char *path) {
+    atomic_file file;
+    if (openAtomicFile(&file, path) != 0) {
+        return -1;
+    }
+    if (entry->part_sizes[part] > 0) fwrite(entry->parts[part], 1, entry->part_sizes[part], file.file);
+    if (ferror(file.file)) {
+        perror(path);
+        discardAtomicFile(&file);
+        return -1;
+    }
+    return commitAtomicFile(&file);
+}
+
+// Function to replace the totals of a cache; readers never see half a file
+static int writeTotals(const char *dir, cache_totals *totals) {
+    char *path = joinPath(dir, "stats");
+    atomic_file file;
+    if (!path || openAtomicFile(&file, path) != 0) {
+        free(path);
+        return -1;
+    }
+    for (int i = 0; i < TOTAL_FIELDS; i++) {
+        fprintf(file.file, "%s %llu\n", total_fields[i].name, (unsigned long long)*getTotalField(totals, i));
+    }
+    free(path);
+    return commitAtomicFile(&file);
+}
+
+// One entry seen by a cleanup
+typedef struct {
+    char *path;
+    struct timespec used;
+    uint64_t size;
+} cache_file;
+
+typedef struct {
+    cache_file *files;
+    int count;
+    int capacity;
+    uint64_t size;
+} cache_scan;
+
+static int compareUse(const void *a, const void *b) {
+    const struct timespec *x = &((const cache_file *)a)->used;
+    const struct timespec *y = &((const cache_file *)b)->used;
+    if (x->tv_sec != y->tv_sec) return x->tv_sec < y->tv_sec ? -1 : 1;
+    return x->tv_nsec < y->tv_nsec ? -1 : x->tv_nsec > y->tv_nsec;
+}
+
+// Function to list the entries of one subdirectory, removing stale temporary files
+static int scanSubdirectory(cache_scan *scan, const char *dir) {
+    DIR *handle = opendir(dir);
+    if (!handle) return 0;
+
+    int status = 0;
+    time_t now = time(NULL);
+    struct dirent *item;
+    while (status == 0 && (item = readdir(handle)) != NULL) {
+        if (item->d_name[0] == '.') continue;
+        char *path = joinPath(dir, item->d_name);
+        struct stat info;
+        if (!path || stat(path, &info) != 0 || !S_ISREG(info.st_mode)) {
+            free(path);
+            continue;
+        }
+
+        size_t length = strlen(item->d_name);
+        if (length > 4 && !strcmp(item->d_name + length - 4, ".tmp")) {
+            if (now - info.st_mtime > STALE_TEMP_SECONDS) unlink(path);
+            free(path);
+            continue;
+        }
+
+        if (scan->count == scan->capacity) {
+            int new_capacity = scan->capacity ? scan->capacity * 2 : 1024;
+            cache_file *files = realloc(scan->files, new_capacity * sizeof(cache_file));
+            if (!files) {
+                free(path);
+                status = -1;
+                break;
+            }
+            scan->files = files;
+            scan->capacity = new_capacity;
+        }
+        cache_file *file = &scan->files[scan->count++];
+        file->path = path;
+        file->used = info.st_mtim;
+        file->size = info.st_size;
+        scan->size += info.st_size;
+    }
+    closedir(handle);
+    return status;
+}
+
+// Function to remove the entries used least recently until the cache is
+// back under its trim size; the size of the cache is recounted on the way
+static int trimCache(const char *dir, cache_totals *totals) {
+    cache_scan scan;
+    memset(&scan, 0, sizeof(scan));
+
+    DIR *handle = opendir(dir);
+    if (!handle) {
+        perror(dir);
+        return -1;
+    }
+    int status = 0;
+    struct dirent *item;
+    while (status == 0 && (item = readdir(handle)) != NULL) {
+        if (strlen(item->d_name) != 2 || item->d_name[0] == '.') continue;
+        char *subdir = joinPath(dir, item->d_name);
+        status = subdir ? scanSubdirectory(&scan, subdir) : -1;
+        free(subdir);
+    }
+    closedir(handle);
+
+    if (status == 0) {
+        qsort(scan.files, scan.count, sizeof(cache_file), compareUse);
+        uint64_t target = totals->max_size / 100 * CACHE_TRIM_PERCENT;
+        for (int i = 0; i < scan.count && scan.size > target; i++) {
+            if (unlink(scan.files[i].path) == 0 || errno == ENOENT) {
+                scan.size -= scan.files[i].size;
+                totals->evictions++;
+            }
+        }
+        totals->size = scan.size;
+        totals->cleanups++;
+    } else {
+        fprintf(stderr, "Error: Out of memory.\n");
+    }
+
+    for (int i = 0; i < scan.count; i++) {
+        free(scan.files[i].path);
+    }
+    free(scan.files);
+    return status;
+}
+
+// Function to add the counts of this run to the stats file and trim the cache
+int closeCache(assembly_cache *cache) {
+    if (!cache->dir) return 0;
+
+    // Runs sharing the cache take turns at the totals and at cleaning up
+    char *lock_path = joinPath(cache->dir, "lock");
+    int fd = lock_path ? open(lock_path, O_RDWR | O_CREAT | O_CLOEXEC, 0666) : -1;
+    int status = fd >= 0 && flock(fd, LOCK_EX) == 0 ? 0 : -1;
+    if (status != 0) perror(lock_path ? lock_path : cache->dir);
+    free(lock_path);
+
+    cache_totals totals;
+    if (status == 0) status = readTotals(cache->dir, &totals);
+    if (status == 0) {
+        totals.hits += cache->hits;
+        totals.misses += cache->misses;
+        totals.stores += cache->stores;
+        int64_t size = (int64_t)totals.size + cache->stored_bytes;
+        totals.size = size > 0 ? size : 0;
+
+        // A limit given to this run is kept for the runs that do not give one
+        if (cache->max_size) totals.max_size = cache->max_size;
+        if (!totals.max_size) totals.max_size = CACHE_DEFAULT_MAX_SIZE;
+        if (totals.size > totals.max_size) status = trimCache(cache->dir, &totals);
+        if (writeTotals(cache->dir, &totals) != 0) status = -1;
+    }
+
+    if (fd >= 0) close(fd);
+    free(cache->dir);
+    memset(cache, 0, sizeof(*cache));
+    return status;
+}
+
+// Function to print the totals of a cache
+int printCacheStats(const char *dir, FILE *out) {
+    cache_totals totals;
+    if (readTotals(dir, &totals) != 0) {
+        perror(dir);
+        return -1;
+    }
+    uint64_t lookups = totals.hits + totals.misses;
+    fprintf(out, "%-22s %s\n", "cache", dir);
+    for (int i = 0; i < TOTAL_FIELDS; i++) {
+        fprintf(out, "%-22s %12llu\n", total_fields[i].name, (unsigned long long)*getTotalField(&totals, i));
+    }
+    fprintf(out, "%-22s %12.1f %%\n", "hit_rate", lookups ? 100.0 * totals.hits / lookups : 0.0);
+    return 0;
+}
+
+// ------x--------x----------x------------x------ ASSEMBLY CACHE ----------------x------------x----------------x----x
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
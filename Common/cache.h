@@ -0,0 +1,124 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// ------x--------x----------x------------x------ ASSEMBLY CACHE ----------------x------------x----------------x----x
+
+// An on-disk cache of finished assemblies, shared by every job that points
+// at the same directory. An entry is found by a 128-bit hash of the source
+// bytes, the assembler version and the options that change the output; it
+// holds everything the run wrote, so a hit replays the run without
+// assembling anything. Entries live in <dir>/<first 2 hex digits>/<rest of
+// the key>, each written under a temporary name and renamed into place, so
+// jobs sharing the cache only ever see whole entries. Totals are kept in
+// <dir>/stats, updated under a lock by every run, and the entries used
+// least recently are removed once the cache grows past its size limit.
+//
+// Layout of an entry:
+//
+//   cache_entry_header
+//   char[part_sizes[0]] ... char[part_sizes[CACHE_PARTS - 1]]   every part in turn
+
+#define CACHE_MAGIC "SICC"
+
+// Bumped whenever the assembler writes something else for the same source
+// and options, so entries of older assemblers are never hit
+#define CACHE_VERSION 4
+
+// Default size limit, in bytes
+#define CACHE_DEFAULT_MAX_SIZE (256ull << 20)
+
+// Options of an assembly by sicasm (object format, listing printed, debug
+// files written), which batch jobs share
+#define CACHE_ASSEMBLY_OPTIONS "format=%c listing=%d debug=%d"
+
+// A full cache is trimmed to this part of its limit, so that a few more
+// entries fit before the next scan
+#define CACHE_TRIM_PERCENT 80
+
+// What a run wrote, one part per output; unused parts are empty
+typedef enum {
+    CACHE_OBJECT,           // The object program, in the requested format
+    CACHE_LISTING,          // The LOCCTR table printed to stdout
+    CACHE_DIAGNOSTICS,      // Warnings printed to stderr (failed runs are never stored)
+    CACHE_INTERMEDIATE,     // intermediate.txt or intermediate.bin
+    CACHE_SYMTAB,           // symtab.txt
+    CACHE_OPTAB,            // optab.txt
+    CACHE_PARTS
+} cache_part;
+
+typedef struct {
+    uint64_t words[2];
+} cache_key;
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    cache_key key;
+    int32_t line_count;
+    uint32_t reserved;
+    uint64_t part_sizes[CACHE_PARTS];
+} cache_entry_header;
+
+// One entry: found in the cache (its parts point into the mapped file), or
+// filled in by the caller to be stored
+typedef struct {
+    const char *parts[CACHE_PARTS];
+    size_t part_sizes[CACHE_PARTS];
+    int line_count;
+
+    void *mapping;
+    size_t mapping_size;
+} cache_entry;
+
+// A cache opened by a run. Hits and misses are counted in the process and
+// added to the stats file when the cache is closed.
+typedef struct {
+    char *dir;
+    uint64_t max_size;
+    uint64_t max_entry_size;    // Larger entries are not stored: the trim size of the limit
+
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t stores;
+    int64_t stored_bytes;   // Bytes added, less the bytes of entries replaced
+} assembly_cache;
+
+// Function to open (creating it if needed) the cache in dir, with max_size
+// bytes as its limit (0 for the default)
+int openCache(assembly_cache *cache, const char *dir, uint64_t max_size);
+
+// Function to add the counts of this run to the stats file and, when the
+// cache has grown past its limit, remove the entries used least recently
+int closeCache(assembly_cache *cache);
+
+// Function to get the key of a source assembled with options, a short
+// string naming the tool and every option that changes what it writes
+cache_key getCacheKey(const char *text, size_t size, const char *options);
+
+// Function to look an entry up, returns 1 on a hit (the entry must then be
+// released) and 0 on a miss. A hit marks the entry as just used.
+int lookupCache(assembly_cache *cache, cache_key key, cache_entry *entry);
+
+// Function to release an entry found in the cache
+void releaseCacheEntry(cache_entry *entry);
+
+// Function to store an entry; a cache that cannot be written is reported
+// but is not an error of the run. An entry larger than the trim size of the
+// limit is not stored, since the next cleanup would remove it.
+void storeCache(assembly_cache *cache, cache_key key, const cache_entry *entry);
+
+// Function to write one part of an entry to a file, atomically
+int writeCachePart(const cache_entry *entry, cache_part part, const char *path);
+
+// Function to print the totals of the cache in dir
+int printCacheStats(const char *dir, FILE *out);
+
+// ------x--------x----------x------------x------ ASSEMBLY CACHE ----------------x------------x----------------x----x
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+
+#endif
@@ -0,0 +1,378 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "csect.h"
+#include "output.h"
+#include "pool.h"
+#include "program.h"
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// ------x--------x----------x------------x------ CONTROL SECTIONS ----------------x------------x--------------x---x
+
+// One control section: the lines from its CSECT (or the start of the
+// source) up to the next CSECT, assembled into a program of its own. Its
+// object program, listing and messages are kept in memory until every
+// section is done, to be written in source order.
+typedef struct {
+    const char *text;
+    size_t size;
+    program prog;
+    int entry_address;      // Entry point of the E record, -1 for a bare E
+    int status;
+
+    char *object;
+    size_t object_size;
+    char *listing;
+    size_t listing_size;
+    char *diagnostics;
+    size_t diagnostics_size;
+    FILE *diagnostics_file;
+} control_section;
+
+// Sections shared by the jobs of both passes
+typedef struct {
+    control_section *sections;
+    int with_listing;
+} section_jobs;
+
+// Function to check whether a source is made of control sections
+int hasControlSections(const char *text, size_t size) {
+    size_t next;
+    return findDirectiveLine(text, size, 0, "CSECT", &next) < size ||
+           findDirectiveLine(text, size, 0, "EXTDEF", &next) < size ||
+           findDirectiveLine(text, size, 0, "EXTREF", &next) < size;
+}
+
+// Function to get the next symbol of a comma-separated operand (EXTDEF,
+// EXTREF) from *position on, returns 0 after the last one
+static int nextListSymbol(const char *text, source_view list, int *position, source_view *symbol) {
+    while (*position < list.length) {
+        const char *chars = text + list.offset;
+        const char *comma = memchr(chars + *position, ',', list.length - *position);
+        int end = comma ? comma - chars : list.length;
+        symbol->offset = list.offset + *position;
+        symbol->length = end - *position;
+        *position = end + 1;
+        if (symbol->length > 0) return 1;
+    }
+    return 0;
+}
+
+// Function to check the EXTDEF and EXTREF symbols of a section: every
+// EXTDEF symbol is defined in it, and no EXTREF symbol is
+static int checkSectionSymbols(program *prog) {
+    int status = 0;
+    for (int i = 0; i < prog->line_count; i++) {
+        const source_line *line = &prog->lines[i];
+        if (line->opcode_id != OP_EXTDEF) continue;
+
+        source_view symbol;
+        int position = 0;
+        while (nextListSymbol(prog->text, line->operand, &position, &symbol)) {
+            if (lookupSymbol(prog, symbol) == -1) {
+                fprintf(getDiagnostics(prog), "Error: EXTDEF symbol '%.*s' is not defined in the section.\n",
+                        symbol.length, prog->text + symbol.offset);
+                status = -1;
+            }
+        }
+    }
+
+    for (int i = 0; i < prog->external.size; i++) {
+        const char *name = getSymbolName(&prog->external, i);
+        if (searchSymtab(&prog->symtab, name, strlen(name)) != -1) {
+            fprintf(getDiagnostics(prog), "Error: EXTREF symbol '%s' is also defined in the section.\n", name);
+            status = -1;
+        }
+    }
+    return status;
+}
+
+// Function to run pass 1 on one section
+static void assembleSectionPass1(void *context, int job) {
+    control_section *section = &((section_jobs *)context)->sections[job];
+
+    // Messages stay with the section; without memory for them they go straight to stderr
+    section->diagnostics_file = open_memstream(&section->diagnostics, &section->diagnostics_size);
+    initProgram(&section->prog);
+    section->prog.is_section = 1;
+    setDiagnostics(&section->prog, section->diagnostics_file);
+
+    section->status = runPass1(&section->prog, section->text, section->size);
+    if (section->status == 0) section->status = checkSectionSymbols(&section->prog);
+}
+
+// Function to append the D records (EXTDEF symbols and their addresses) and
+// the R records (EXTREF symbols) of a section
+static void appendLinkRecords(const program *prog, output_buffer *out) {
+    int count = 0;
+    for (int i = 0; i < prog->line_count; i++) {
+        const source_line *line = &prog->lines[i];
+        if (line->opcode_id != OP_EXTDEF) continue;
+
+        // D^name^address, up to MAX_DEFINE_RECORD_SYMBOLS pairs per record
+        source_view symbol;
+        int position = 0;
+        while (nextListSymbol(prog->text, line->operand, &position, &symbol)) {
+            if (count > 0 && count % MAX_DEFINE_RECORD_SYMBOLS == 0) appendChar(out, '\n');
+            if (count % MAX_DEFINE_RECORD_SYMBOLS == 0) appendChar(out, 'D');
+            appendChar(out, '^');
+            appendField(out, prog->text + symbol.offset, symbol.length, 6);
+            appendChar(out, '^');
+            appendHex(out, lookupSymbol(prog, symbol), 6);
+            count++;
+        }
+    }
+    if (count > 0) appendChar(out, '\n');
+
+    // R^name, up to MAX_REFER_RECORD_SYMBOLS names per record
+    for (int i = 0; i < prog->external.size; i++) {
+        if (i % MAX_REFER_RECORD_SYMBOLS == 0) appendChar(out, 'R');
+        const char *name = getSymbolName(&prog->external, i);
+        appendChar(out, '^');
+        appendField(out, name, strlen(name), 6);
+        if (i % MAX_REFER_RECORD_SYMBOLS == MAX_REFER_RECORD_SYMBOLS - 1 || i == prog->external.size - 1) {
+            appendChar(out, '\n');
+        }
+    }
+}
+
+// Function to find where the address of the operand sits in the object
+// code of line index: returns its length in half-bytes (the field ends
+// with the instruction, 1 byte in, or is the whole word of a WORD), or 0
+// when the address is relative to the PC or the base register, or the
+// line has none
+static int getAddressField(const program *prog, int index, source_view *symbol) {
+    const source_line *line = &prog->lines[index];
+    if (isSymbolWord(prog->text, line)) {
+        *symbol = line->operand;
+        return 6;
+    }
+    if (line->opcode_id == -1 || optab[line->opcode_id].format != 3) return 0;
+
+    // The operand symbol, as pass 1 resolved it
+    if (line->format != 0) {
+        xe_operand operand;
+        parseXeOperand(prog->text, line->operand, &operand);
+        if (operand.is_constant) return 0;
+        *symbol = operand.value;
+    } else {
+        *symbol = line->operand;
+        const char *comma = memchr(prog->text + symbol->offset, ',', symbol->length);
+        if (comma) symbol->length = comma - (prog->text + symbol->offset);
+        if (symbol->length == 0) return 0;
+    }
+
+    // Format 4 has a 20-bit address, SIC (and n = i = 0) a 15-bit one after
+    // the index bit, and a format 3 instruction without b or p a 12-bit one
+    if (line->format == 4) return 5;
+    if (line->format == 0) return 4;
+    if (!(prog->code.flags[index] & LINE_CODE_RESOLVED)) return 0;
+    uint32_t word = prog->code.word[index];
+    if ((word & 0x30000) == 0) return 4;
+    return (word & 0x6000) == 0 ? 3 : 0;
+}
+
+// Function to append the M records of a section: an address field that
+// holds an EXTREF symbol gets its address added by the loader, one that
+// holds a symbol of the section gets the address the section is loaded at
+static void appendModificationRecords(const program *prog, output_buffer *out) {
+    const source_line *first = &prog->lines[0];
+    const char *section_name = first->opcode_id == OP_START || first->opcode_id == OP_CSECT ?
+                               getLineLabel(prog, first) : "";
+
+    for (int i = 0; i < prog->line_count; i++) {
+        source_view symbol;
+        int half_bytes = getAddressField(prog, i, &symbol);
+        if (half_bytes == 0) continue;
+
+        const char *name;
+        int name_length;
+        if (lookupSymbol(prog, symbol) != -1) {
+            name = section_name;
+            name_length = strlen(section_name);
+        } else if (isExternalSymbol(prog, symbol)) {
+            name = prog->text + symbol.offset;
+            name_length = symbol.length;
+        } else {
+            continue;   // Undefined, pass 2 reported it
+        }
+
+        // M^address^half-bytes[^+symbol]; a section without a name is relocated by its load address
+        appendBytes(out, "M^", 2);
+        appendHex(out, prog->lines[i].locctr + (half_bytes == 6 ? 0 : 1), 6);
+        appendChar(out, '^');
+        appendHex(out, half_bytes, 2);
+        if (name_length > 0) {
+            appendBytes(out, "^+", 2);
+            appendBytes(out, name, name_length);
+        }
+        appendChar(out, '\n');
+    }
+}
+
+// Function to write the object program of a section: H, D, R, T, M and E records
+static int writeSectionObject(const program *prog, FILE *object_file, int entry_address) {
+    pass2_state state;
+    initPass2(prog, &state, object_file);
+
+    int length = prog->end_address - prog->start_address;
+    for (int i = 0; i < prog->line_count; i++) {
+        emitLineAt(prog, &state, i, length);
+
+        // The first line writes the header record, the D and R records follow it
+        if (i == 0) appendLinkRecords(prog, &state.writer.buffer);
+    }
+
+    breakTextRecord(&state.writer);
+    appendModificationRecords(prog, &state.writer.buffer);
+    state.entry_address = entry_address;
+    return finishPass2(&state);
+}
+
+// Function to run pass 2 on one section, and to format its listing
+static void assembleSectionPass2(void *context, int job) {
+    section_jobs *jobs = context;
+    control_section *section = &jobs->sections[job];
+    if (section->prog.line_count == 0) return;
+
+    if (jobs->with_listing) {
+        FILE *listing = open_memstream(&section->listing, &section->listing_size);
+        if (listing) {
+            printListing(&section->prog, listing);
+            fclose(listing);
+        }
+    }
+
+    FILE *object_file = open_memstream(&section->object, &section->object_size);
+    if (!object_file) {
+        fprintf(getDiagnostics(&section->prog), "Error: Out of memory.\n");
+        section->status = -1;
+        return;
+    }
+    section->status = writeSectionObject(&section->prog, object_file, section->entry_address);
+    if (fclose(object_file) != 0) section->status = -1;
+}
+
+// Function to split a source at every CSECT line; the first section is
+// whatever comes before the first CSECT. Returns the number of sections.
+static int splitSections(const char *text, size_t size, control_section **sections) {
+    int count = 1;
+    int capacity = 16;
+    *sections = calloc(capacity, sizeof(control_section));
+    if (!*sections) return -1;
+    (*sections)[0].text = text;
+
+    size_t position = 0;
+    size_t line;
+    while ((line = findDirectiveLine(text, size, position, "CSECT", &position)) < size) {
+        if (count == capacity) {
+            control_section *grown = realloc(*sections, capacity * 2 * sizeof(control_section));
+            if (!grown) return -1;
+            memset(grown + capacity, 0, capacity * sizeof(control_section));
+            *sections = grown;
+            capacity *= 2;
+        }
+        (*sections)[count - 1].size = line - ((*sections)[count - 1].text - text);
+        (*sections)[count++].text = text + line;
+    }
+    (*sections)[count - 1].size = size - ((*sections)[count - 1].text - text);
+    return count;
+}
+
+// Function to check the sections against each other once pass 1 is done:
+// their names are unique, and the entry point END names is in the first
+// one. Every section but the first then ends with a bare E record.
+static int linkSections(control_section *sections, int count) {
+    int status = 0;
+    symtab names;
+    initSymtab(&names);
+
+    int first = -1;
+    const program *end_prog = NULL;
+    const source_line *end_line = NULL;
+    for (int s = 0; s < count; s++) {
+        program *prog = &sections[s].prog;
+        sections[s].entry_address = -1;
+        if (prog->line_count == 0) continue;
+        if (first == -1) first = s;
+
+        const char *name = getLineLabel(prog, &prog->lines[0]);
+        int added;
+        if (name[0] && (findOrAddToSymtab(&names, name, strlen(name), s, &added) == -1 || !added)) {
+            fprintf(getDiagnostics(prog), "Error: Duplicate control section '%s'.\n", name);
+            status = -1;
+        }
+        for (int i = 0; !end_line && i < prog->line_count; i++) {
+            if (prog->lines[i].opcode_id == OP_END) {
+                end_prog = prog;
+                end_line = &prog->lines[i];
+            }
+        }
+    }
+    freeSymtab(&names);
+    if (first == -1) return status;
+
+    program *entry_prog = &sections[first].prog;
+    sections[first].entry_address = entry_prog->lines[0].locctr;
+    if (end_line && end_line->operand.length > 0) {
+        int id = searchSymtab(&entry_prog->symtab, end_prog->text + end_line->operand.offset,
+                              end_line->operand.length);
+        if (id == -1) {
+            fprintf(getDiagnostics(entry_prog), "Error: Entry point '%.*s' is not in the first control section.\n",
+                    end_line->operand.length, end_prog->text + end_line->operand.offset);
+            return -1;
+        }
+        sections[first].entry_address = getSymbolAddress(&entry_prog->symtab, id);
+    }
+    return status;
+}
+
+// Function to assemble a source made of control sections
+int assembleControlSections(const char *text, size_t size, int thread_count, FILE *object_file, FILE *listing,
+                            FILE *diagnostics, int *line_count) {
+    control_section *sections;
+    int count = splitSections(text, size, &sections);
+    if (count < 0) {
+        fprintf(diagnostics, "Error: Out of memory.\n");
+        free(sections);
+        return -1;
+    }
+    if (thread_count < 1) thread_count = 1;
+    section_jobs jobs = {sections, listing != NULL};
+
+    // Sections share nothing, so both passes of all of them run in parallel;
+    // only the checks between the sections run in between
+    int status = runThreadPool(thread_count, count, assembleSectionPass1, &jobs);
+    for (int s = 0; s < count; s++) {
+        if (sections[s].status != 0) status = -1;
+    }
+    if (status == 0) status = linkSections(sections, count);
+    if (status == 0) status = runThreadPool(thread_count, count, assembleSectionPass2, &jobs);
+
+    for (int s = 0; s < count; s++) {
+        if (sections[s].diagnostics_file) fclose(sections[s].diagnostics_file);
+        if (sections[s].status != 0) status = -1;
+    }
+
+    // Everything reaches the files in source order, the object programs only when all sections assembled
+    if (line_count) *line_count = 0;
+    for (int s = 0; s < count; s++) {
+        control_section *section = &sections[s];
+        fwrite(section->diagnostics, 1, section->diagnostics_size, diagnostics);
+        if (listing) fwrite(section->listing, 1, section->listing_size, listing);
+        if (status == 0) fwrite(section->object, 1, section->object_size, object_file);
+        if (line_count) *line_count += section->prog.line_count;
+
+        free(section->diagnostics);
+        free(section->listing);
+        free(section->object);
+        freeProgram(&section->prog);
+    }
+    free(sections);
+    return status;
+}
+
+// ------x--------x----------x------------x------ CONTROL SECTIONS ----------------x------------x--------------x---x
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
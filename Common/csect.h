@@ -0,0 +1,35 @@
+#ifndef CSECT_H
+#define CSECT_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// ------x--------x----------x------------x------ CONTROL SECTIONS ----------------x------------x--------------x---x
+
+// Most symbols in one D record, and in one R record
+#define MAX_DEFINE_RECORD_SYMBOLS 6
+#define MAX_REFER_RECORD_SYMBOLS 12
+
+// Function to check whether a source is made of control sections: it has
+// a CSECT, EXTDEF or EXTREF line
+int hasControlSections(const char *text, size_t size);
+
+// Function to assemble a source made of control sections on thread_count
+// threads. The source is split at every CSECT line, and every section is
+// assembled on its own, with its own LOCCTR (from 0) and SYMTAB: pass 1 of
+// all sections runs in parallel, then pass 2 of all of them. Every section
+// becomes an object program of its own, with D records for its EXTDEF
+// symbols, R records for its EXTREF symbols and M records for every
+// address field the loader has to relocate or fill in; they are written
+// to object_file in source order, and so are their listings (when listing
+// is not NULL) and their messages. The first section holds the entry
+// point named by END, the other sections end with a bare E record.
+// *line_count (when not NULL) gets the lines of all sections.
+int assembleControlSections(const char *text, size_t size, int thread_count, FILE *object_file, FILE *listing,
+                            FILE *diagnostics, int *line_count);
+
+// ------x--------x----------x------------x------ CONTROL SECTIONS ----------------x------------x--------------x---x
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+
+#endif
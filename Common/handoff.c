@@ -0,0 +1,242 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+
+#include "handoff.h"
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// ------x--------x----------x------------x------ HANDOFF ----------------x------------x----------------x--------x
+
+// Temporary files of this process are numbered, so two threads writing the
+// same path at once never share a temporary file either
+static unsigned int temp_counter = 0;
+
+#define TEMP_SUFFIX_LENGTH 48
+
+// Function to name the next temporary file of path: <path>.<pid>.<number>.tmp
+static void nameTempFile(char *temp_path, const char *path) {
+    unsigned int number = __atomic_fetch_add(&temp_counter, 1, __ATOMIC_RELAXED);
+    snprintf(temp_path, strlen(path) + TEMP_SUFFIX_LENGTH, "%s.%ld.%u.tmp", path, (long)getpid(), number);
+}
+
+// Function to create a new, unique temporary file next to path. The
+// temporary name is stored in *temp_path; returns the descriptor or -1.
+static int createTempFile(const char *path, char **temp_path) {
+    *temp_path = malloc(strlen(path) + TEMP_SUFFIX_LENGTH);
+    if (!*temp_path) {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    for (int attempt = 0; attempt < 100; attempt++) {
+        nameTempFile(*temp_path, path);
+
+        // O_EXCL: a stale file of an earlier process with the same id is never reused
+        int fd = open(*temp_path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0666);
+        if (fd >= 0 || errno != EEXIST) {
+            if (fd < 0) {
+                free(*temp_path);
+                *temp_path = NULL;
+            }
+            return fd;
+        }
+    }
+
+    free(*temp_path);
+    *temp_path = NULL;
+    errno = EEXIST;
+    return -1;
+}
+
+// Function to find the file an output to path really replaces. Returns 1
+// when path exists but is not a regular file (a device, a FIFO, a link to
+// nothing), which is written in place since renaming over it would replace
+// the node itself; otherwise returns 0 with *target set to path, every
+// symbolic link resolved, so the temporary file is made next to the real
+// file and the links are kept. Returns -1 without memory.
+static int resolveOutputPath(const char *path, char **target) {
+    struct stat link_info, info;
+    *target = NULL;
+
+    if (lstat(path, &link_info) != 0) {
+        *target = strdup(path);     // A new file
+    } else if (stat(path, &info) != 0 || !S_ISREG(info.st_mode)) {
+        return 1;
+    } else if (S_ISLNK(link_info.st_mode)) {
+        *target = realpath(path, NULL);
+    } else {
+        *target = strdup(path);
+    }
+    return *target ? 0 : -1;
+}
+
+// Function to create the temporary file an output is written to
+int openAtomicFile(atomic_file *out, const char *path) {
+    memset(out, 0, sizeof(*out));
+    int direct = resolveOutputPath(path, &out->path);
+    if (direct == 1) {
+        out->path = strdup(path);
+        if (out->path) out->file = fopen(path, "w");
+    } else if (direct == 0) {
+        int fd = createTempFile(out->path, &out->temp_path);
+        if (fd >= 0) {
+            out->file = fdopen(fd, "w");
+            if (!out->file) close(fd);
+        }
+    }
+
+    if (!out->file) {
+        perror(path);
+        discardAtomicFile(out);
+        return -1;
+    }
+    return 0;
+}
+
+// Function to put the finished file in place of the old one
+int commitAtomicFile(atomic_file *out) {
+    int status = fclose(out->file) == 0 ? 0 : -1;
+    out->file = NULL;
+
+    if (status == 0 && out->temp_path && rename(out->temp_path, out->path) != 0) status = -1;
+    if (status != 0) perror(out->path);
+
+    // After a successful rename the temporary name no longer exists
+    if (status == 0) {
+        free(out->temp_path);
+        out->temp_path = NULL;
+    }
+    discardAtomicFile(out);
+    return status;
+}
+
+// Function to give up on an output, leaving the old file as it was
+void discardAtomicFile(atomic_file *out) {
+    if (out->file) fclose(out->file);
+    if (out->temp_path) unlink(out->temp_path);
+    free(out->temp_path);
+    free(out->path);
+    memset(out, 0, sizeof(*out));
+}
+
+// Function to create a directory and any missing parents
+int makeDirectories(const char *path) {
+    char *copy = strdup(path);
+    if (!copy) {
+        fprintf(stderr, "Error: Out of memory.\n");
+        return -1;
+    }
+
+    // Every parent is created in turn; the ones that exist are skipped
+    int status = 0;
+    for (char *p = copy + 1; status == 0; p++) {
+        int last = *p == '\0';
+        if (*p != '/' && !last) continue;
+
+        *p = '\0';
+        if (mkdir(copy, 0777) != 0 && errno != EEXIST) status = -1;
+        if (last) break;
+        *p = '/';
+    }
+
+    struct stat info;
+    if (status == 0 && stat(path, &info) != 0) status = -1;
+    if (status == 0 && !S_ISDIR(info.st_mode)) {
+        errno = ENOTDIR;
+        status = -1;
+    }
+    if (status != 0) perror(path);
+    free(copy);
+    return status;
+}
+
+// Function to join a directory and a file name
+char *joinPath(const char *dir, const char *name) {
+    size_t dir_length = strlen(dir);
+    size_t name_length = strlen(name);
+    int needs_slash = dir_length > 0 && dir[dir_length - 1] != '/';
+
+    char *path = malloc(dir_length + needs_slash + name_length + 1);
+    if (!path) return NULL;
+    memcpy(path, dir, dir_length);
+    if (needs_slash) path[dir_length] = '/';
+    memcpy(path + dir_length + needs_slash, name, name_length + 1);
+    return path;
+}
+
+// Function to copy a whole file inside the kernel: copy_file_range where the
+// file system supports it (which can share the blocks), sendfile otherwise
+static int copyFileData(int in, int out, off_t size) {
+    off_t copied = 0;
+    int use_sendfile = 0;
+
+    while (copied < size) {
+        ssize_t count = -1;
+        if (!use_sendfile) {
+            count = copy_file_range(in, NULL, out, NULL, size - copied, 0);
+            if (count < 0 && (errno == ENOSYS || errno == EXDEV || errno == EINVAL || errno == EOPNOTSUPP)) {
+                use_sendfile = 1;
+                continue;
+            }
+        } else {
+            count = sendfile(out, in, NULL, size - copied);
+        }
+
+        if (count < 0 && errno == EINTR) continue;
+        if (count <= 0) return -1;     // An error, or the file shrank
+        copied += count;
+    }
+    return 0;
+}
+
+// Function to atomically replace to with a copy of from (or to write it in
+// place, when to is not a regular file)
+int handOffFile(const char *from, const char *to) {
+    char *temp_path = NULL;
+
+    // Handing a file to itself (the output directory is its own) is already done
+    struct stat from_info, to_info;
+    if (stat(from, &from_info) == 0 && stat(to, &to_info) == 0 &&
+        from_info.st_dev == to_info.st_dev && from_info.st_ino == to_info.st_ino) {
+        return 0;
+    }
+
+    int in = open(from, O_RDONLY | O_CLOEXEC);
+    if (in < 0) {
+        perror(from);
+        return -1;
+    }
+
+    struct stat info;
+    char *target = NULL;
+    int out = -1;
+    int status = fstat(in, &info);
+    int direct = status == 0 ? resolveOutputPath(to, &target) : -1;
+    if (direct == 1) {
+        out = open(to, O_WRONLY | O_TRUNC | O_CLOEXEC);
+    } else if (direct == 0) {
+        out = createTempFile(target, &temp_path);
+    }
+    if (out < 0) status = -1;
+    if (status == 0) status = copyFileData(in, out, info.st_size);
+    if (out >= 0 && close(out) != 0) status = -1;
+    if (status == 0 && temp_path && rename(temp_path, target) != 0) status = -1;
+
+    if (status != 0) {
+        perror(to);
+        if (temp_path) unlink(temp_path);
+    }
+    free(temp_path);
+    free(target);
+    close(in);
+    return status;
+}
+
+// ------x--------x----------x------------x------ HANDOFF ----------------x------------x----------------x--------x
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
@@ -0,0 +1,45 @@
+#ifndef HANDOFF_H
+#define HANDOFF_H
+
+#include <stdio.h>
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// ------x--------x----------x------------x------ HANDOFF ----------------x------------x----------------x--------x
+
+// An output file that is written under a temporary name next to its final
+// path and renamed over it when complete. Readers, and other jobs writing
+// the same directory, only ever see the old file or the whole new one.
+// A symbolic link is followed, so the file it points to is replaced and the
+// link kept; a path that is not a regular file (/dev/null, a FIFO) is
+// written in place, like fopen would.
+typedef struct {
+    FILE *file;
+    char *path;
+    char *temp_path;
+} atomic_file;
+
+// Function to create the temporary file for path, returns -1 (after
+// printing why) when it cannot be created
+int openAtomicFile(atomic_file *out, const char *path);
+
+// Function to close the file and rename it to its final path; on any
+// error the temporary file is removed and the old file is left as it was
+int commitAtomicFile(atomic_file *out);
+
+// Function to close and remove the temporary file without replacing anything
+void discardAtomicFile(atomic_file *out);
+
+// Function to create a directory and any missing parents (mkdir -p)
+int makeDirectories(const char *path);
+
+// Function to join a directory and a file name, returns NULL without memory
+char *joinPath(const char *dir, const char *name);
+
+// Function to atomically replace to with a copy of from. The kernel copies the
+// data with copy_file_range, without passing it through user space.
+int handOffFile(const char *from, const char *to);
+
+// ------x--------x----------x------------x------ HANDOFF ----------------x------------x----------------x--------x
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+
+#endif
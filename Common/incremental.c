@@ -0,0 +1,771 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "incremental.h"
+#include "relax.h"
+#include "scan.h"
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// ------x--------x----------x------------x------ INCREMENTAL ASSEMBLY ----------------x------------x---------x------x
+
+// Status of an update that has to assemble the whole program again instead
+#define NEEDS_FULL_RUN 1
+
+// Function to initialise an empty incremental assembly
+void initIncremental(incremental_assembly *inc) {
+    memset(inc, 0, sizeof(*inc));
+    initProgram(&inc->prog);
+    initOutputBuffer(&inc->object, NULL);
+}
+
+// Function to release the memory held by an incremental assembly
+void freeIncremental(incremental_assembly *inc) {
+    freeProgram(&inc->prog);
+    free(inc->lines);
+    free(inc->records);
+    free(inc->code);
+    free(inc->moved);
+    free(inc->object.data);
+    free(inc->dirty);
+    memset(inc, 0, sizeof(*inc));
+}
+
+// Function to get the stream errors are reported to
+static FILE *getReport(const incremental_assembly *inc) {
+    return inc->diagnostics ? inc->diagnostics : stderr;
+}
+
+// Function to make room for the state of count lines
+static int reserveLineStates(incremental_assembly *inc, int count) {
+    if (count <= inc->line_capacity) return 0;
+
+    int new_capacity = inc->line_capacity ? inc->line_capacity : 64;
+    while (new_capacity < count) new_capacity *= 2;
+    line_state *lines = realloc(inc->lines, new_capacity * sizeof(line_state));
+    if (!lines) return -1;
+    inc->lines = lines;
+    inc->line_capacity = new_capacity;
+    return 0;
+}
+
+// Function to make room for count lines in the program itself
+static int reserveProgramLines(program *prog, int count) {
+    if (count <= prog->line_capacity) return 0;
+
+    int new_capacity = prog->line_capacity ? prog->line_capacity : 64;
+    while (new_capacity < count) new_capacity *= 2;
+    source_line *lines = realloc(prog->lines, new_capacity * sizeof(source_line));
+    if (!lines) return -1;
+    prog->lines = lines;
+    prog->line_capacity = new_capacity;
+    return 0;
+}
+
+// Function to make room for a moved flag per symbol (all clear)
+static int reserveMovedFlags(incremental_assembly *inc, int count) {
+    if (count <= inc->moved_capacity) return 0;
+
+    unsigned char *moved = realloc(inc->moved, count);
+    if (!moved) return -1;
+    memset(moved + inc->moved_capacity, 0, count - inc->moved_capacity);
+    inc->moved = moved;
+    inc->moved_capacity = count;
+    return 0;
+}
+
+// Function to append object code to the code cache, returns its offset or -1
+static long addCode(incremental_assembly *inc, const unsigned char *code, int size) {
+    if (inc->code_size + size > inc->code_capacity) {
+        size_t new_capacity = inc->code_capacity ? inc->code_capacity * 2 : 64 * 1024;
+        while (new_capacity < inc->code_size + size) new_capacity *= 2;
+        unsigned char *new_code = realloc(inc->code, new_capacity);
+        if (!new_code) return -1;
+        inc->code = new_code;
+        inc->code_capacity = new_capacity;
+    }
+
+    long offset = inc->code_size;
+    memcpy(inc->code + offset, code, size);
+    inc->code_size += size;
+    inc->live_code_size += size;
+    return offset;
+}
+
+// Function to record a range of the object program that changed
+static void addDirtyRange(incremental_assembly *inc, size_t offset, size_t length) {
+    // Ranges that touch are merged, edits are usually close together
+    if (inc->dirty_count > 0) {
+        output_range *last = &inc->dirty[inc->dirty_count - 1];
+        if (offset >= last->offset && offset <= last->offset + last->length) {
+            if (offset + length > last->offset + last->length) last->length = offset + length - last->offset;
+            return;
+        }
+    }
+
+    if (inc->dirty_count == inc->dirty_capacity) {
+        int new_capacity = inc->dirty_capacity ? inc->dirty_capacity * 2 : 16;
+        output_range *dirty = realloc(inc->dirty, new_capacity * sizeof(output_range));
+        if (!dirty) {
+            // Without room for the range the whole object program is dirty
+            inc->dirty_count = 1;
+            inc->dirty[0].offset = 0;
+            inc->dirty[0].length = inc->object.size;
+            return;
+        }
+        inc->dirty = dirty;
+        inc->dirty_capacity = new_capacity;
+    }
+    inc->dirty[inc->dirty_count].offset = offset;
+    inc->dirty[inc->dirty_count].length = length;
+    inc->dirty_count++;
+}
+
+// Function to remember the symbol an operand refers to, so that it can be
+// found again when that symbol moves (indexed operands and WORD included)
+static void resolveOperandId(program *prog, source_line *line) {
+    line->operand_id = -1;
+    int is_word = isSymbolWord(prog->text, line);
+    if (!is_word && (line->opcode_id == -1 || optab[line->opcode_id].format != 3 || line->operand.length == 0)) {
+        return;
+    }
+
+    const char *operand = prog->text + line->operand.offset;
+    const char *comma = is_word ? NULL : memchr(operand, ',', line->operand.length);
+    int length = comma ? (int)(comma - operand) : line->operand.length;
+    line->operand_id = searchSymtab(&prog->symtab, operand, length);
+}
+
+// Function to get the number of characters of a hex number in a record
+static int getHexWidth(unsigned int value, int digits) {
+    int count = 1;
+    while (value >>= 4) count++;
+    return count > digits ? count : digits;
+}
+
+// Function to format text records after the kept part of the object
+// program, noting where every record and every line's code ends up.
+// The records hold the code of the lines from first_line on.
+static int formatRecords(incremental_assembly *inc, output_buffer *out, const text_record_list *list, int first_line) {
+    const program *prog = &inc->prog;
+    int line = first_line;
+    int consumed = 0;
+
+    for (int r = 0; r < list->count; r++) {
+        const text_record *record = &list->records[r];
+
+        if (inc->record_count == inc->record_capacity) {
+            int new_capacity = inc->record_capacity ? inc->record_capacity * 2 : 256;
+            record_state *records = realloc(inc->records, new_capacity * sizeof(record_state));
+            if (!records) return -1;
+            inc->records = records;
+            inc->record_capacity = new_capacity;
+        }
+        record_state *state = &inc->records[inc->record_count++];
+        state->object_offset = out->size;
+        state->first_line = -1;
+
+        // T^start^length, then ^ and the hex of every field
+        size_t position = out->size + 2 + getHexWidth(record->address, 6) + 1 + getHexWidth(record->length, 2);
+        for (int i = 0; i < record->field_count; i++) {
+            int begin = record->fields[i];
+            int length = (i + 1 < record->field_count ? record->fields[i + 1] : record->length) - begin;
+
+            if (consumed == 0) {
+                while (line < prog->line_count && inc->lines[line].code_size == 0) line++;
+                if (line == prog->line_count) return -1;
+                inc->lines[line].object_offset = position + 1;
+                if (i == 0) state->first_line = line;
+            }
+            if (length != inc->lines[line].code_size) inc->lines[line].object_offset = -1;
+
+            consumed += length;
+            if (consumed >= inc->lines[line].code_size) {
+                line++;
+                consumed = 0;
+            }
+            position += 1 + 2 * length;
+        }
+
+        writeTextRecords(out, record, 1);
+    }
+    return out->failed ? -1 : 0;
+}
+
+// ------x--------x----------x------------x------ INCREMENTAL ASSEMBLY ----------------x------------x---------x------x
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+
+
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// ------x--------x----------x------------x------ FULL RUN ----------------x------------x----------------x-----------x
+
+// Function to run pass 1, remembering where every line starts in the text
+static int layoutProgram(incremental_assembly *inc, const char *text, size_t size) {
+    program *prog = &inc->prog;
+    source_fields fields;
+    source_scanner scanner;
+    int locctr = 0;
+
+    prog->text = text;
+    prog->text_size = size;
+
+    initSourceScanner(&scanner, text, 0, size);
+    while (scanSourceLine(&scanner, &fields)) {
+        if (fields.mnemonic.length == 0 && fields.label.length == 0) continue;
+
+        source_line *line = addAddressedLine(prog, &fields, &locctr);
+        if (!line || reserveLineStates(inc, prog->line_count) != 0) return -1;
+        if (fields.label.length > 0) {
+            defineLabel(prog, line, fields.label, line->locctr);
+        }
+        inc->lines[prog->line_count - 1].source_offset = fields.line.offset;
+    }
+    prog->end_address = locctr;
+
+    if (!prog->is_start_found) {
+        fprintf(getDiagnostics(prog), "Warning: No START directive found. LOCCTR starts from 0.\n");
+    }
+    if (prog->is_xe && relaxProgram(prog) != 0) return -1;
+
+    for (int i = 0; i < prog->line_count; i++) {
+        resolveOperandId(prog, &prog->lines[i]);
+    }
+    return 0;
+}
+
+// Function to run pass 2 into the in-memory object program, keeping the
+// object code of every line in the code cache
+static int encodeProgram(incremental_assembly *inc) {
+    program *prog = &inc->prog;
+    pass2_state state;
+    text_record_list list = {NULL, 0, 0};
+    int program_length = prog->end_address - prog->start_address;
+
+    // Without a file the writer keeps the object program in its buffer
+    initPass2(prog, &state, NULL);
+    for (int i = 0; i < prog->line_count; i++) {
+        source_line *line = &prog->lines[i];
+        line_state *current = &inc->lines[i];
+        current->code_size = 0;
+        current->object_offset = -1;
+
+        if (hasObjectCode(line)) {
+            unsigned char buffer[MAX_CODE_LENGTH];
+            unsigned char *code = buffer;
+            int size = encodeLineCode(prog, line, &code, &state.errors);
+            long offset = addCode(inc, code, size);
+            if (code != buffer) free(code);
+            if (offset < 0) {
+                fprintf(getDiagnostics(prog), "Error: Out of memory.\n");
+                state.errors++;
+                break;
+            }
+            current->code_offset = offset;
+            current->code_size = size;
+        }
+        emitCode(prog, &state, line, current->code_size > 0 ? inc->code + current->code_offset : NULL,
+                 current->code_size, program_length);
+
+        // The header is written by the first line; after it the records are collected
+        if (i == 0) collectTextRecords(&state.writer, &list);
+    }
+
+    breakTextRecord(&state.writer);
+    collectTextRecords(&state.writer, NULL);
+    int status = formatRecords(inc, &state.writer.buffer, &list, 0);
+    freeTextRecords(&list);
+
+    if (finishPass2(&state) != 0) status = -1;
+    inc->object = state.writer.buffer;
+    return status;
+}
+
+// Function to assemble the whole program again. It can be updated
+// incrementally afterwards only if it assembled without any message.
+static int assembleFull(incremental_assembly *inc, const char *text, size_t size) {
+    program *prog = &inc->prog;
+
+    // Messages are gathered to know whether there were any
+    char *messages = NULL;
+    size_t messages_size = 0;
+    FILE *diagnostics = open_memstream(&messages, &messages_size);
+
+    resetProgram(prog);
+    setDiagnostics(prog, diagnostics ? diagnostics : getReport(inc));
+    free(inc->object.data);
+    initOutputBuffer(&inc->object, NULL);
+    inc->record_count = 0;
+    inc->code_size = 0;
+    inc->live_code_size = 0;
+    inc->valid = 0;
+
+    int status = layoutProgram(inc, text, size);
+    if (status == 0) status = encodeProgram(inc);
+
+    if (diagnostics) {
+        fclose(diagnostics);
+        fwrite(messages, 1, messages_size, getReport(inc));
+        free(messages);
+    }
+    setDiagnostics(prog, getReport(inc));
+
+    inc->valid = status == 0 && diagnostics && messages_size == 0;
+    inc->stats.full = 1;
+    inc->stats.relaid_lines = prog->line_count;
+    inc->stats.encoded_lines = prog->line_count;
+    inc->stats.emitted_records = inc->record_count;
+    addDirtyRange(inc, 0, inc->object.size);
+    return status;
+}
+
+// ------x--------x----------x------------x------ FULL RUN ----------------x------------x----------------x-----------x
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+
+
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// ------x--------x----------x------------x------ UPDATE ----------------x------------x----------------x-----------x
+
+// The lines of the edited part of the text, tokenized again
+typedef struct {
+    source_line *lines;
+    size_t *offsets;
+    source_view *labels;
+    int count;
+    int capacity;
+} edited_lines;
+
+// Function to find the length of the common start of two texts
+static size_t findCommonPrefix(const char *a, const char *b, size_t limit) {
+    size_t i = 0;
+    while (i + 64 <= limit && memcmp(a + i, b + i, 64) == 0) i += 64;
+    while (i < limit && a[i] == b[i]) i++;
+    return i;
+}
+
+// Function to find the length of the common end of two texts
+static size_t findCommonSuffix(const char *a_end, const char *b_end, size_t limit) {
+    size_t i = 0;
+    while (i + 64 <= limit && memcmp(a_end - i - 64, b_end - i - 64, 64) == 0) i += 64;
+    while (i < limit && a_end[-1 - (long)i] == b_end[-1 - (long)i]) i++;
+    return i;
+}
+
+static int isLineStart(const char *text, size_t position) {
+    return position == 0 || text[position - 1] == '\n';
+}
+
+// Function to find the first line that starts at or after offset
+static int findLineAt(const incremental_assembly *inc, size_t offset) {
+    int low = 0, high = inc->prog.line_count;
+    while (low < high) {
+        int middle = low + (high - low) / 2;
+        if (inc->lines[middle].source_offset < offset) low = middle + 1;
+        else high = middle;
+    }
+    return low;
+}
+
+// Function to tokenize the edited part of the new text. Returns
+// NEEDS_FULL_RUN for anything a full run has to report or lay out.
+static int tokenizeEdit(const char *text, size_t begin, size_t end, edited_lines *edit, int limit) {
+    source_fields fields;
+    source_scanner scanner;
+
+    initSourceScanner(&scanner, text, begin, end);
+    while (scanSourceLine(&scanner, &fields)) {
+        if (fields.mnemonic.length == 0 && fields.label.length == 0) continue;
+        if (edit->count == limit) return NEEDS_FULL_RUN;
+
+        if (edit->count == edit->capacity) {
+            int new_capacity = edit->capacity ? edit->capacity * 2 : 16;
+            source_line *lines = realloc(edit->lines, new_capacity * sizeof(source_line));
+            if (lines) edit->lines = lines;
+            size_t *offsets = realloc(edit->offsets, new_capacity * sizeof(size_t));
+            if (offsets) edit->offsets = offsets;
+            source_view *labels = realloc(edit->labels, new_capacity * sizeof(source_view));
+            if (labels) edit->labels = labels;
+            if (!lines || !offsets || !labels) return NEEDS_FULL_RUN;
+            edit->capacity = new_capacity;
+        }
+
+        source_line *line = &edit->lines[edit->count];
+        memset(line, 0, sizeof(*line));
+        line->label_id = -1;
+        line->operand_id = -1;
+        line->mnemonic = fields.mnemonic;
+        line->operand = fields.operand;
+        line->opcode_id = searchOptab(text + line->mnemonic.offset, line->mnemonic.length);
+        edit->offsets[edit->count] = fields.line.offset;
+        edit->labels[edit->count] = fields.label;
+        edit->count++;
+
+        // START and END set up the whole program, and unknown mnemonics
+        // or malformed constants are errors a full run reports
+        int size = getInstructionSize(line->opcode_id, text, line->operand);
+        if (line->opcode_id == -1 || line->opcode_id == OP_START || line->opcode_id == OP_END) return NEEDS_FULL_RUN;
+
+        // SIC/XE addressing may change the format of lines anywhere in the program
+        if (usesXeAddressing(text, line)) return NEEDS_FULL_RUN;
+        if (size == 0 && line->opcode_id != OP_CSECT) return NEEDS_FULL_RUN;
+        if (line->opcode_id == OP_BYTE && text[line->operand.offset + 1] != '\'') return NEEDS_FULL_RUN;
+    }
+    return 0;
+}
+
+// Function to encode a line again into code, returns its size or -1
+static int encodeAgain(const program *prog, const source_line *line, unsigned char *code) {
+    if (line->opcode_id == OP_BYTE && line->operand.length > MAX_CODE_LENGTH) return -1;
+    return encodeLine(prog, line, code);
+}
+
+// Function to update the previous run after an edit. The edited lines are
+// the ones between the common start and the common end of the old and the
+// new text; everything around them is reused.
+static int updateProgram(incremental_assembly *inc, const char *text, size_t size) {
+    program *prog = &inc->prog;
+    const char *old_text = prog->text;
+    size_t old_size = prog->text_size;
+    size_t limit = old_size < size ? old_size : size;
+
+    size_t prefix = findCommonPrefix(old_text, text, limit);
+    if (prefix == old_size && old_size == size) {
+        prog->text = text;
+        return 0;
+    }
+    size_t suffix = findCommonSuffix(old_text + old_size, text + size, limit - prefix);
+
+    // Widen the edit to whole lines in both texts
+    while (prefix > 0 && old_text[prefix - 1] != '\n') prefix--;
+    while (suffix > 0 && !(isLineStart(old_text, old_size - suffix) && isLineStart(text, size - suffix))) suffix--;
+    size_t old_end = old_size - suffix, new_end = size - suffix;
+
+    int first = findLineAt(inc, prefix);
+    int last = findLineAt(inc, old_end);
+    int count = prog->line_count;
+
+    // Large edits are cheaper to assemble again from scratch
+    edited_lines edit = {NULL, NULL, NULL, 0, 0};
+    int status = tokenizeEdit(text, prefix, new_end, &edit, 1024 + count / 8);
+
+    // The edited lines must not touch START or END, or anything before the
+    // first line or after the last, and must define the same labels in the
+    // same order, so every symbol keeps its id
+    if (first == 0 || first >= count || prog->lines[count - 1].opcode_id != OP_END) status = NEEDS_FULL_RUN;
+
+    // A SIC/XE program is relaxed as a whole, so any edit may move every line
+    if (prog->is_xe) status = NEEDS_FULL_RUN;
+    int labels = 0;
+    for (int i = first; status == 0 && i < last; i++) {
+        const source_line *line = &prog->lines[i];
+        if (line->opcode_id == OP_START || line->opcode_id == OP_END) status = NEEDS_FULL_RUN;
+        if (line->label_id == -1) continue;
+        while (labels < edit.count && edit.labels[labels].length == 0) labels++;
+        if (labels == edit.count || !viewEquals(text, edit.labels[labels], getSymbolName(&prog->symtab, line->label_id))) {
+            status = NEEDS_FULL_RUN;
+            break;
+        }
+        edit.lines[labels++].label_id = line->label_id;
+    }
+    for (; status == 0 && labels < edit.count; labels++) {
+        if (edit.labels[labels].length > 0) status = NEEDS_FULL_RUN;
+    }
+
+    // New addresses of the edited lines
+    int address = first < count ? prog->lines[first].locctr : prog->end_address;
+    int old_region_size = (last < count ? prog->lines[last].locctr : prog->end_address) - address;
+    for (int k = 0; status == 0 && k < edit.count; k++) {
+        edit.lines[k].locctr = address;
+        address += getInstructionSize(edit.lines[k].opcode_id, text, edit.lines[k].operand);
+    }
+    int size_delta = address - (first < count ? prog->lines[first].locctr : prog->end_address) - old_region_size;
+
+    // The object program can be patched in place if every edited line
+    // keeps its address, its size and whether it has object code
+    int patch = edit.count == last - first && size_delta == 0;
+    for (int k = 0; status == 0 && patch && k < edit.count; k++) {
+        const source_line *old_line = &prog->lines[first + k];
+        const source_line *new_line = &edit.lines[k];
+        const line_state *state = &inc->lines[first + k];
+        if (new_line->locctr != old_line->locctr || hasObjectCode(new_line) != hasObjectCode(old_line)) {
+            patch = 0;
+        } else if (hasObjectCode(new_line)) {
+            int new_size = getInstructionSize(new_line->opcode_id, text, new_line->operand);
+            if (new_size != state->code_size || state->object_offset < 0) patch = 0;
+        } else if (getInstructionSize(new_line->opcode_id, text, new_line->operand) !=
+                   getInstructionSize(old_line->opcode_id, old_text, old_line->operand)) {
+            patch = 0;
+        }
+    }
+
+    if (status != 0) {
+        free(edit.lines);
+        free(edit.offsets);
+        free(edit.labels);
+        return status;
+    }
+
+    // From here on the program is changed; anything unexpected is fixed by a full run
+    int new_count = count - (last - first) + edit.count;
+    if (reserveProgramLines(prog, new_count) != 0 || reserveLineStates(inc, new_count) != 0 ||
+        reserveMovedFlags(inc, prog->symtab.size) != 0) {
+        free(edit.lines);
+        free(edit.offsets);
+        free(edit.labels);
+        return NEEDS_FULL_RUN;
+    }
+
+    // Lines after the edit move in the text (and in memory when the number of lines changes);
+    // the line code of pass 1 no longer matches them
+    prog->code.count = 0;
+    if (new_count != count) {
+        memmove(prog->lines + first + edit.count, prog->lines + last, (count - last) * sizeof(source_line));
+        memmove(inc->lines + first + edit.count, inc->lines + last, (count - last) * sizeof(line_state));
+        prog->line_count = new_count;
+    }
+
+    long byte_delta = (long)size - (long)old_size;
+    int any_moved = 0;
+    int tail = first + edit.count;
+    if (byte_delta != 0 || size_delta != 0) {
+        for (int i = tail; i < new_count; i++) {
+            source_line *line = &prog->lines[i];
+            line->mnemonic.offset += byte_delta;
+            line->operand.offset += byte_delta;
+            inc->lines[i].source_offset += byte_delta;
+
+            // Only when the edit changed the size do the lines after it get new addresses
+            if (size_delta != 0) {
+                line->locctr += size_delta;
+                if (line->label_id != -1) {
+                    prog->symtab.entries[line->label_id].address += size_delta;
+                    inc->moved[line->label_id] = 1;
+                    any_moved = 1;
+                }
+            }
+        }
+        if (size_delta != 0) {
+            prog->end_address += size_delta;
+            inc->stats.relaid_lines += new_count - tail;
+        }
+    }
+
+    // The edited lines themselves; their labels may have moved too
+    prog->text = text;
+    prog->text_size = size;
+    for (int k = 0; k < edit.count; k++) {
+        source_line *line = &prog->lines[first + k];
+        *line = edit.lines[k];
+        resolveMnemonic(prog, line);
+        if (line->label_id != -1 && getSymbolAddress(&prog->symtab, line->label_id) != line->locctr) {
+            prog->symtab.entries[line->label_id].address = line->locctr;
+            inc->moved[line->label_id] = 1;
+            any_moved = 1;
+        }
+        resolveOperandId(prog, line);
+
+        line_state *state = &inc->lines[first + k];
+        state->source_offset = edit.offsets[k];
+        if (!patch) {
+            state->code_size = 0;
+            state->object_offset = -1;
+        }
+    }
+    inc->stats.relaid_lines += edit.count;
+    free(edit.lines);
+    free(edit.offsets);
+    free(edit.labels);
+
+    // A new operand that is not defined is an error a full run reports
+    for (int k = 0; k < edit.count; k++) {
+        const source_line *line = &prog->lines[first + k];
+        if (line->operand_id == -1 && line->operand.length > 0 &&
+            ((line->opcode_id != -1 && optab[line->opcode_id].format == 3) || isSymbolWord(text, line))) {
+            status = NEEDS_FULL_RUN;
+        }
+    }
+
+    // Text records are written again from the last record that starts
+    // before the edit with the first byte of a line, since a record that
+    // ended just before the edit may now take in more code
+    int restart_record = 0, restart_line = 0;
+    if (!patch) {
+        int low = 0, high = inc->record_count;
+        while (low < high) {
+            int middle = low + (high - low) / 2;
+            int line = inc->records[middle].first_line;
+            if (line != -1 && line >= first) high = middle;
+            else low = middle + 1;
+        }
+        restart_record = low;
+        while (restart_record > 0 && (restart_record == inc->record_count ||
+               inc->records[restart_record].first_line == -1 || inc->records[restart_record].first_line >= first)) {
+            restart_record--;
+        }
+        if (inc->record_count > 0 && inc->records[restart_record].first_line != -1 &&
+            inc->records[restart_record].first_line < first) {
+            restart_line = inc->records[restart_record].first_line;
+        }
+    }
+
+    // Encode the edited lines, and every line that refers to a symbol that moved
+    for (int i = 0; status == 0 && i < new_count; i++) {
+        source_line *line = &prog->lines[i];
+        line_state *state = &inc->lines[i];
+        int edited = i >= first && i < tail;
+        if (!edited && !(any_moved && line->operand_id != -1 && inc->moved[line->operand_id])) {
+            // Fast path over the lines nothing happened to
+            if (!any_moved && i < first) {
+                i = first - 1;
+            } else if (!any_moved && i >= tail) {
+                break;
+            }
+            continue;
+        }
+        if (!hasObjectCode(line)) continue;
+
+        unsigned char code[MAX_CODE_LENGTH];
+        int code_size = encodeAgain(prog, line, code);
+        if (code_size < 0) {
+            status = NEEDS_FULL_RUN;
+            break;
+        }
+        inc->stats.encoded_lines++;
+
+        if (patch || i < restart_line) {
+            // Same size as before, so its hex is overwritten where it is
+            if (code_size != state->code_size || state->object_offset < 0) {
+                status = NEEDS_FULL_RUN;
+                break;
+            }
+            memcpy(inc->code + state->code_offset, code, code_size);
+            formatHexBytes(inc->object.data + state->object_offset, code, code_size);
+            addDirtyRange(inc, state->object_offset, 2 * code_size);
+            inc->stats.emitted_records++;
+        } else if (code_size == state->code_size) {
+            memcpy(inc->code + state->code_offset, code, code_size);
+        } else {
+            long offset = addCode(inc, code, code_size);
+            if (offset < 0) {
+                status = NEEDS_FULL_RUN;
+                break;
+            }
+            inc->live_code_size -= state->code_size;
+            state->code_offset = offset;
+            state->code_size = code_size;
+        }
+    }
+    if (any_moved) memset(inc->moved, 0, prog->symtab.size);
+    if (status != 0 || patch) return status;
+
+    // Lay the text records out again from the restart line with the code
+    // that is already encoded, after the part of the object program that is kept
+    size_t keep = inc->record_count > 0 ? inc->records[restart_record].object_offset : inc->object.size;
+    if (inc->record_count == 0) return NEEDS_FULL_RUN;
+
+    pass2_state state;
+    text_record_list list = {NULL, 0, 0};
+    initPass2(prog, &state, NULL);
+    state.started = 1;
+    state.entry_address = prog->lines[0].locctr;
+    state.writer.buffer = inc->object;
+    state.writer.buffer.size = keep;
+    state.writer.has_length = 1;
+    state.writer.start_address = prog->start_address;
+    collectTextRecords(&state.writer, &list);
+
+    int program_length = prog->end_address - prog->start_address;
+    for (int i = restart_line; i < new_count; i++) {
+        line_state *current = &inc->lines[i];
+        if (!hasObjectCode(&prog->lines[i])) current->code_size = 0;
+        current->object_offset = -1;
+        emitCode(prog, &state, &prog->lines[i], current->code_size > 0 ? inc->code + current->code_offset : NULL,
+                 current->code_size, program_length);
+    }
+    breakTextRecord(&state.writer);
+    collectTextRecords(&state.writer, NULL);
+
+    inc->record_count = restart_record;
+    status = formatRecords(inc, &state.writer.buffer, &list, restart_line);
+    inc->stats.emitted_records += list.count;
+    freeTextRecords(&list);
+    if (finishPass2(&state) != 0) status = NEEDS_FULL_RUN;
+    inc->object = state.writer.buffer;
+    if (status != 0) return NEEDS_FULL_RUN;
+
+    // The program length in the header record
+    if (size_delta != 0) {
+        formatHex(inc->object.data + 16, program_length, 6);
+        addDirtyRange(inc, 16, 6);
+    }
+    addDirtyRange(inc, keep, inc->object.size - keep);
+
+    // Replaced code is only reclaimed by a full run
+    if (inc->code_size > 2 * inc->live_code_size + (1 << 20)) inc->valid = 0;
+    return 0;
+}
+
+// Function to assemble text, reusing the previous run where it did not change
+int assembleIncremental(incremental_assembly *inc, const char *text, size_t size) {
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    memset(&inc->stats, 0, sizeof(inc->stats));
+    inc->dirty_count = 0;
+
+    int status = inc->valid ? updateProgram(inc, text, size) : NEEDS_FULL_RUN;
+    if (status == NEEDS_FULL_RUN) {
+        memset(&inc->stats, 0, sizeof(inc->stats));
+        inc->dirty_count = 0;
+        status = assembleFull(inc, text, size);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    inc->stats.line_count = inc->prog.line_count;
+    inc->stats.seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    return status;
+}
+
+// Function to write the object program, or only the parts that changed
+int writeIncrementalObject(const incremental_assembly *inc, const char *path, int patch) {
+    // A file that is gone no longer holds the previous run
+    patch = patch && !inc->stats.full;
+    int fd = patch ? open(path, O_WRONLY) : -1;
+    if (fd < 0) {
+        patch = 0;
+        fd = open(path, O_WRONLY | O_CREAT, 0644);
+    }
+    if (fd < 0) {
+        perror("Error opening the object program file");
+        return -1;
+    }
+
+    int status = 0;
+    if (!patch) {
+        size_t written = 0;
+        while (status == 0 && written < inc->object.size) {
+            ssize_t count = pwrite(fd, inc->object.data + written, inc->object.size - written, written);
+            if (count <= 0) status = -1;
+            else written += count;
+        }
+    } else {
+        for (int i = 0; status == 0 && i < inc->dirty_count; i++) {
+            const output_range *range = &inc->dirty[i];
+            if (pwrite(fd, inc->object.data + range->offset, range->length, range->offset) != (ssize_t)range->length) {
+                status = -1;
+            }
+        }
+    }
+    if (status == 0 && ftruncate(fd, inc->object.size) != 0) status = -1;
+    if (close(fd) != 0) status = -1;
+    if (status != 0) perror("Error writing the object program file");
+    return status;
+}
+
+// ------x--------x----------x------------x------ UPDATE ----------------x------------x----------------x-----------x
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
@@ -0,0 +1,93 @@
+#ifndef INCREMENTAL_H
+#define INCREMENTAL_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include "output.h"
+#include "program.h"
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// ------x--------x----------x------------x------ INCREMENTAL ASSEMBLY ----------------x------------x---------x------x
+
+// What is remembered about every line of the program between runs
+typedef struct {
+    size_t source_offset;   // Where the source line starts in the text
+    size_t code_offset;     // Its object code in the code cache
+    int code_size;          // Bytes of object code (0 for none)
+    long object_offset;     // Where its hex starts in the object program (-1 when it has
+                            // none or it is split over several text records)
+} line_state;
+
+// Where every text record of the object program starts
+typedef struct {
+    size_t object_offset;
+    int first_line;         // Line of its first byte (-1 if that line began in an earlier record)
+} record_state;
+
+// A byte range of the object program that changed in the last run
+typedef struct {
+    size_t offset;
+    size_t length;
+} output_range;
+
+typedef struct {
+    int full;               // Whether everything was assembled again
+    int line_count;
+    int relaid_lines;       // Lines whose address was assigned again
+    int encoded_lines;      // Lines whose object code was generated again
+    int emitted_records;    // Text records written again (or patched in place)
+    double seconds;
+} incremental_stats;
+
+// An assembled program kept between runs, so that after an edit only the
+// lines that changed are tokenized again. Addresses are assigned again
+// from the first changed line only when its size changed, only the lines
+// that refer to symbols that moved are encoded again, and the object
+// program is patched in place when no text record changes its layout.
+// Programs with errors or warnings, and edits to START or END or to the
+// labels, are simply assembled again in full.
+typedef struct {
+    program prog;           // Its views point into the text of the last run
+
+    line_state *lines;
+    int line_capacity;
+    record_state *records;
+    int record_count;
+    int record_capacity;
+
+    // Object code of every line, so lines that did not change are not encoded again
+    unsigned char *code;
+    size_t code_size;
+    size_t code_capacity;
+    size_t live_code_size;
+
+    unsigned char *moved;   // Per symbol id: its address changed in this run
+    int moved_capacity;
+
+    output_buffer object;   // The object program, kept in memory
+    output_range *dirty;    // Ranges of the object program the last run changed
+    int dirty_count;
+    int dirty_capacity;
+
+    int valid;              // Whether the last run can be updated incrementally
+    incremental_stats stats;
+    FILE *diagnostics;      // Where errors are reported (stderr when NULL)
+} incremental_assembly;
+
+void initIncremental(incremental_assembly *inc);
+void freeIncremental(incremental_assembly *inc);
+
+// Function to assemble text, reusing the previous run where the text did
+// not change. The text has to stay valid until the next run, because the
+// program keeps views into it. Returns -1 if the program has errors.
+int assembleIncremental(incremental_assembly *inc, const char *text, size_t size);
+
+// Function to write the object program to path: only the dirty ranges
+// when the file still holds the previous run, otherwise all of it
+int writeIncrementalObject(const incremental_assembly *inc, const char *path, int patch);
+
+// ------x--------x----------x------------x------ INCREMENTAL ASSEMBLY ----------------x------------x---------x------x
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+
+#endif
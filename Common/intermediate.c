@@ -0,0 +1,308 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "handoff.h"
+#include "intermediate.h"
+#include "output.h"
+#include "stats.h"
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// ------x--------x----------x------------x------ BINARY INTERMEDIATE ----------------x------------x----------x-------x
+
+_Static_assert(sizeof(intermediate_header) == 32, "intermediate_header must have a fixed layout");
+_Static_assert(sizeof(intermediate_record) == 20, "intermediate_record must have a fixed layout");
+_Static_assert(sizeof(symtab_entry) == 16, "symtab_entry must have a fixed layout");
+
+// Addresses an object program can hold (6 hex digits)
+#define ADDRESS_SPACE (1 << 24)
+
+// Function to check that an address of the file lies in the address space
+static int isAddress(int32_t address) {
+    return address >= 0 && address <= ADDRESS_SPACE;
+}
+
+// Function to find the symbol id of an operand
+static int resolveOperand(const program *prog, const source_line *line) {
+    if (line->opcode_id == -1 || line->operand.length == 0) return -1;
+
+    // Only instructions and END refer to a symbol; indexed operands stay text
+    if (line->opcode_id != OP_END && optab[line->opcode_id].format != 3) return -1;
+
+    const char *operand = prog->text + line->operand.offset;
+    if (memchr(operand, ',', line->operand.length)) return -1;
+
+    return searchSymtab(&prog->symtab, operand, line->operand.length);
+}
+
+// Function to check whether a line keeps its operand as text
+static int hasTextOperand(const source_line *line, int operand_id) {
+    return operand_id == -1 && (line->operand.length > 0 || line->opcode_id == -1);
+}
+
+// Function to write the text of a line into the string table
+static void writeLineText(const program *prog, const source_line *line, output_buffer *out) {
+    if (line->opcode_id == -1) {
+        appendBytes(out, prog->text + line->mnemonic.offset, line->mnemonic.length);
+        appendChar(out, 0);
+    }
+    appendBytes(out, prog->text + line->operand.offset, line->operand.length);
+    appendChar(out, 0);
+}
+
+// Function to write the binary intermediate file (intermediate.bin)
+int writeBinaryIntermediate(const program *prog, const char *path) {
+    // Written under a temporary name, so pass 2 never maps a half-written file
+    atomic_file intermediate_file;
+    if (openAtomicFile(&intermediate_file, path) != 0) {
+        return -1;
+    }
+    FILE *file = intermediate_file.file;
+
+    // Resolve every operand once; only the ones that are not symbols are kept as text
+    int *operand_ids = malloc((prog->line_count + 1) * sizeof(int));
+    if (!operand_ids) {
+        fprintf(stderr, "Error: Out of memory.\n");
+        discardAtomicFile(&intermediate_file);
+        return -1;
+    }
+
+    size_t text_size = 0;
+    for (int i = 0; i < prog->line_count; i++) {
+        const source_line *line = &prog->lines[i];
+        operand_ids[i] = resolveOperand(prog, line);
+        if (hasTextOperand(line, operand_ids[i])) {
+            if (line->opcode_id == -1) text_size += line->mnemonic.length + 1;
+            text_size += line->operand.length + 1;
+        }
+    }
+
+    intermediate_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, INTERMEDIATE_MAGIC, 4);
+    header.version = INTERMEDIATE_VERSION;
+    header.byte_order = INTERMEDIATE_BYTE_ORDER;
+    header.line_count = prog->line_count;
+    header.symbol_count = prog->symtab.size;
+    header.string_table_size = prog->symtab.arena_size + text_size;
+    header.start_address = prog->start_address;
+    header.end_address = prog->end_address;
+    header.is_start_found = prog->is_start_found;
+
+    // Everything is gathered in large blocks before it is written
+    output_buffer out;
+    initOutputBuffer(&out, file);
+    appendBytes(&out, (const char *)&header, sizeof(header));
+
+    // One record per line
+    uint32_t text_offset = prog->symtab.arena_size;
+    for (int i = 0; i < prog->line_count; i++) {
+        const source_line *line = &prog->lines[i];
+        intermediate_record record;
+
+        record.locctr = line->locctr;
+        record.size = getLineSize(prog->text, line);
+        record.label_id = line->label_id;
+        record.operand = operand_ids[i];
+        record.opcode_id = line->opcode_id;
+        record.flags = line->format != 0 ? RECORD_XE : 0;
+
+        if (hasTextOperand(line, operand_ids[i])) {
+            record.operand = text_offset;
+            record.flags |= RECORD_TEXT;
+            if (line->opcode_id == -1) text_offset += line->mnemonic.length + 1;
+            text_offset += line->operand.length + 1;
+        }
+
+        appendBytes(&out, (const char *)&record, sizeof(record));
+    }
+
+    // The SYMTAB and its names, exactly as they are held in memory
+    appendBytes(&out, (const char *)prog->symtab.entries, prog->symtab.size * sizeof(symtab_entry));
+    appendBytes(&out, prog->symtab.arena, prog->symtab.arena_size);
+
+    // The literal operands, in record order
+    for (int i = 0; i < prog->line_count; i++) {
+        if (hasTextOperand(&prog->lines[i], operand_ids[i])) {
+            writeLineText(prog, &prog->lines[i], &out);
+        }
+    }
+
+    free(operand_ids);
+
+    if (closeOutputBuffer(&out) != 0 || ferror(file)) {
+        perror("Error writing intermediate file");
+        discardAtomicFile(&intermediate_file);
+        return -1;
+    }
+    return commitAtomicFile(&intermediate_file);
+}
+
+// Function to check every id and offset in the sections of a mapped file
+// once, so pass 2 can use them as they are; returns -1 (after printing the
+// first one that is wrong) for a corrupt file
+static int checkBinaryIntermediate(const binary_intermediate *file, const char *path) {
+    const intermediate_header *header = file->header;
+    int64_t symbol_count = header->symbol_count;
+    uint32_t string_size = header->string_table_size;
+
+    if (!isAddress(header->start_address) || !isAddress(header->end_address)) {
+        fprintf(stderr, "Error: '%s' is corrupt: its program addresses are out of range.\n", path);
+        return -1;
+    }
+
+    // Every name and operand ends at a NUL inside the table, so strlen stays in it
+    if (string_size > 0 && file->strings[string_size - 1] != 0) {
+        fprintf(stderr, "Error: '%s' is corrupt: its string table is not terminated.\n", path);
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < header->symbol_count; i++) {
+        const symtab_entry *symbol = &file->symbols[i];
+        if (symbol->name_length < 0 || symbol->name_offset > string_size ||
+            (uint32_t)symbol->name_length > string_size - symbol->name_offset) {
+            fprintf(stderr, "Error: '%s' is corrupt: symbol %u has no name in the string table.\n", path, i);
+            return -1;
+        }
+        if (!isAddress(symbol->address)) {
+            fprintf(stderr, "Error: '%s' is corrupt: symbol %u has an invalid address.\n", path, i);
+            return -1;
+        }
+    }
+
+    for (uint32_t i = 0; i < header->line_count; i++) {
+        const intermediate_record *record = &file->records[i];
+        const char *wrong = NULL;
+        if (!isAddress(record->locctr)) {
+            wrong = "address";
+        } else if (record->label_id < -1 || record->label_id >= symbol_count) {
+            wrong = "label";
+        } else if (record->opcode_id < -1 || record->opcode_id >= OPTAB_COUNT) {
+            wrong = "mnemonic";
+        } else if (record->flags & RECORD_TEXT) {
+            // The text of an unknown mnemonic comes first, then the operand
+            uint32_t offset = record->operand;
+            if (offset < string_size && record->opcode_id == -1) offset += strlen(file->strings + offset) + 1;
+            if (offset >= string_size) wrong = "operand";
+        } else if (record->operand < -1 || record->operand >= symbol_count) {
+            wrong = "operand";
+        }
+        if (wrong) {
+            fprintf(stderr, "Error: '%s' is corrupt: record %u has an invalid %s.\n", path, i + 1, wrong);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Function to map intermediate.bin and check its header and sections
+int openBinaryIntermediate(binary_intermediate *file, const char *path) {
+    memset(file, 0, sizeof(*file));
+    if (openSourceBuffer(&file->buffer, path) != 0) {
+        return -1;
+    }
+
+    const intermediate_header *header = (const intermediate_header *)file->buffer.data;
+    if (file->buffer.size < sizeof(*header) || memcmp(header->magic, INTERMEDIATE_MAGIC, 4) != 0) {
+        fprintf(stderr, "Error: '%s' is not a binary intermediate file.\n", path);
+        closeBinaryIntermediate(file);
+        return -1;
+    }
+    if (header->version != INTERMEDIATE_VERSION || header->byte_order != INTERMEDIATE_BYTE_ORDER) {
+        fprintf(stderr, "Error: '%s' was written by another version or byte order.\n", path);
+        closeBinaryIntermediate(file);
+        return -1;
+    }
+
+    size_t expected = sizeof(*header) + (size_t)header->line_count * sizeof(intermediate_record) +
+                      (size_t)header->symbol_count * sizeof(symtab_entry) + header->string_table_size;
+    if (file->buffer.size < expected) {
+        fprintf(stderr, "Error: '%s' is truncated.\n", path);
+        closeBinaryIntermediate(file);
+        return -1;
+    }
+
+    // The sections follow each other, so they are found without parsing
+    file->header = header;
+    file->records = (const intermediate_record *)(header + 1);
+    file->symbols = (const symtab_entry *)(file->records + header->line_count);
+    file->strings = (const char *)(file->symbols + header->symbol_count);
+    if (checkBinaryIntermediate(file, path) != 0) {
+        closeBinaryIntermediate(file);
+        return -1;
+    }
+    return 0;
+}
+
+// Function to unmap intermediate.bin
+void closeBinaryIntermediate(binary_intermediate *file) {
+    closeSourceBuffer(&file->buffer);
+    memset(file, 0, sizeof(*file));
+}
+
+// Function to make prog use the SYMTAB and string table of a mapped file
+void attachBinaryIntermediate(program *prog, const binary_intermediate *file) {
+    const intermediate_header *header = file->header;
+
+    attachSymtab(&prog->symtab, file->symbols, header->symbol_count, file->strings, header->string_table_size);
+    prog->text = file->strings;
+    prog->text_size = header->string_table_size;
+    prog->start_address = header->start_address;
+    prog->end_address = header->end_address;
+    prog->is_start_found = header->is_start_found;
+}
+
+// Function to turn a record into a source line
+void loadRecord(const binary_intermediate *file, int index, source_line *line) {
+    const intermediate_record *record = &file->records[index];
+    source_view empty = {0, 0};
+
+    line->locctr = record->locctr;
+    line->label_id = record->label_id;
+    line->opcode_id = record->opcode_id;
+    line->operand_id = -1;
+    line->format = record->flags & RECORD_XE ? (record->size == 4 ? 4 : 3) : 0;
+    line->base_id = -1;
+    line->mnemonic = line->operand = empty;
+
+    if (record->flags & RECORD_TEXT) {
+        // Literal operand (and unknown mnemonic) text in the string table
+        size_t offset = record->operand;
+        if (record->opcode_id == -1) {
+            line->mnemonic.offset = offset;
+            line->mnemonic.length = strlen(file->strings + offset);
+            offset += line->mnemonic.length + 1;
+        }
+        line->operand.offset = offset;
+        line->operand.length = strlen(file->strings + offset);
+    } else if (record->operand != -1) {
+        // Symbol operand, its name is in the SYMTAB
+        const symtab_entry *symbol = &file->symbols[record->operand];
+        line->operand_id = record->operand;
+        line->operand.offset = symbol->name_offset;
+        line->operand.length = symbol->name_length;
+    }
+}
+
+// Function to run pass 2 over a mapped intermediate file
+int runBinaryPass2(program *prog, const binary_intermediate *file, FILE *object_file) {
+    pass2_state state;
+    source_line line;
+    int base_id = -1;
+
+    attachBinaryIntermediate(prog, file);
+
+    initPass2(prog, &state, object_file);
+    STATS_COUNT(COUNTER_LINES, file->header->line_count);
+    for (uint32_t i = 0; i < file->header->line_count; i++) {
+        loadRecord(file, i, &line);
+        base_id = trackBase(prog, &line, base_id);
+        if (line.format != 0) line.base_id = base_id;
+        emitLine(prog, &state, &line, prog->end_address - prog->start_address);
+    }
+
+    return finishPass2(&state);
+}
+
+// ------x--------x----------x------------x------ BINARY INTERMEDIATE ----------------x------------x----------x-------x
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
@@ -0,0 +1,85 @@
+#ifndef INTERMEDIATE_H
+#define INTERMEDIATE_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "program.h"
+#include "source.h"
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// ------x--------x----------x------------x------ BINARY INTERMEDIATE ----------------x------------x----------x-------x
+
+// Layout of intermediate.bin, written by pass 1 and mapped by pass 2:
+//
+//   intermediate_header
+//   intermediate_record[line_count]
+//   symtab_entry[symbol_count]      the SYMTAB, in symbol id order
+//   char[string_table_size]         symbol names, then literal operands
+//
+// Every section starts on a 4 byte boundary and all fields are in the byte
+// order of the host that wrote the file (checked through byte_order).
+
+#define INTERMEDIATE_MAGIC "SICI"
+#define INTERMEDIATE_VERSION 2
+#define INTERMEDIATE_BYTE_ORDER 0x0102
+
+// The operand is text in the string table rather than a symbol id
+#define RECORD_TEXT 0x0001
+
+// A format 3 / 4 instruction of a SIC/XE program, format 4 when its size is 4
+#define RECORD_XE 0x0002
+
+typedef struct {
+    char magic[4];
+    uint16_t version;
+    uint16_t byte_order;
+    uint32_t line_count;
+    uint32_t symbol_count;
+    uint32_t string_table_size;
+    int32_t start_address;
+    int32_t end_address;
+    uint32_t is_start_found;
+} intermediate_header;
+
+// One fixed-width record per source line. operand is the symbol id of the
+// operand, or with RECORD_TEXT the offset of its NUL-terminated text in the
+// string table (preceded by the NUL-terminated mnemonic when the mnemonic
+// is unknown), or -1 when the line has no operand.
+typedef struct {
+    int32_t locctr;
+    uint32_t size;
+    int32_t label_id;
+    int32_t operand;
+    int16_t opcode_id;
+    uint16_t flags;
+} intermediate_record;
+
+// A mapped intermediate.bin with pointers to its sections
+typedef struct {
+    source_buffer buffer;
+    const intermediate_header *header;
+    const intermediate_record *records;
+    const symtab_entry *symbols;
+    const char *strings;
+} binary_intermediate;
+
+int writeBinaryIntermediate(const program *prog, const char *path);
+// Function to map intermediate.bin, returns -1 (after printing why) for a
+// file of another version or one whose ids or offsets are out of range
+int openBinaryIntermediate(binary_intermediate *file, const char *path);
+void closeBinaryIntermediate(binary_intermediate *file);
+
+// Function to make prog use the SYMTAB and string table of a mapped file
+void attachBinaryIntermediate(program *prog, const binary_intermediate *file);
+
+// Function to turn a record into a source line whose views point into the string table
+void loadRecord(const binary_intermediate *file, int index, source_line *line);
+
+// Function to run pass 2 over a mapped intermediate file
+int runBinaryPass2(program *prog, const binary_intermediate *file, FILE *object_file);
+
+// ------x--------x----------x------------x------ BINARY INTERMEDIATE ----------------x------------x----------x-------x
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+
+#endif
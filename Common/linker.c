@@ -0,0 +1,657 @@
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "linker.h"
+#include "loader.h"
+#include "objimage.h"
+#include "pool.h"
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// ------x--------x----------x------------x------ LINKING LOADER ----------------x------------x----------------x---x
+
+// Addresses a 24-bit address field can hold
+#define ADDRESS_SPACE (1 << 24)
+
+// Function to drop the blanks a record pads a name with
+static int trimName(const char *name, int length) {
+    while (length > 0 && name[length - 1] == ' ') length--;
+    return length;
+}
+
+// Function to get the shard of the ESTAB a symbol belongs to
+static int getShard(unsigned int hash) {
+    return hash >> (32 - ESTAB_SHARD_BITS);
+}
+
+// Function to add a section to a file, returns NULL when memory runs out
+static link_section *addLinkSection(link_file *file, int index) {
+    if (file->section_count == file->section_capacity) {
+        int new_capacity = file->section_capacity ? file->section_capacity * 2 : 8;
+        link_section *sections = realloc(file->sections, new_capacity * sizeof(link_section));
+        if (!sections) return NULL;
+        file->sections = sections;
+        file->section_capacity = new_capacity;
+    }
+    link_section *section = &file->sections[file->section_count++];
+    memset(section, 0, sizeof(*section));
+    section->entry_address = -1;
+    section->file = index;
+    return section;
+}
+
+// Function to add an external symbol of the last section of a file, hashing its name
+static int addLinkSymbol(link_file *file, const char *name, int length, int address, int is_section) {
+    if (file->symbol_count == file->symbol_capacity) {
+        int new_capacity = file->symbol_capacity ? file->symbol_capacity * 2 : 64;
+        link_symbol *symbols = realloc(file->symbols, new_capacity * sizeof(link_symbol));
+        if (!symbols) return -1;
+        file->symbols = symbols;
+        file->symbol_capacity = new_capacity;
+    }
+    link_symbol *symbol = &file->symbols[file->symbol_count++];
+    symbol->name = name;
+    symbol->name_length = length;
+    symbol->hash = hashSymbol(name, length);
+    symbol->section = file->section_count - 1;
+    symbol->address = address;
+    symbol->is_section = is_section;
+    symbol->is_duplicate = 0;
+    return 0;
+}
+
+// ------x--------x----------x------------x------ PASS 1 ----------------x------------x----------------x-----------x
+
+// Function to read a header record: H^name^start^length
+static int readLinkHeader(record_reader *reader, link_file *file, link_section *section) {
+    const char *name;
+    int length;
+    if (!nextRecordField(reader, &name, &length)) {
+        fprintf(reader->diagnostics, "Error: Line %d: Invalid program name.\n", reader->line_number);
+        return -1;
+    }
+    section->name = name;
+    section->name_length = trimName(name, length);
+    if (nextHexRecordField(reader, 6, &section->start_address, "start address") != 0 ||
+        nextHexRecordField(reader, 6, &section->length, "program length") != 0) {
+        return -1;
+    }
+
+    // A section without a name is loaded, but no other section can refer to it
+    if (section->name_length > 0 &&
+        addLinkSymbol(file, section->name, section->name_length, section->start_address, 1) != 0) {
+        fprintf(reader->diagnostics, "Error: Out of memory.\n");
+        return -1;
+    }
+    return 0;
+}
+
+// Function to read a define record: D^name^address[^name^address...]
+static int readDefineRecord(record_reader *reader, link_file *file) {
+    const char *name;
+    int length;
+    while (nextRecordField(reader, &name, &length)) {
+        int address;
+        length = trimName(name, length);
+        if (length == 0) {
+            fprintf(reader->diagnostics, "Error: Line %d: Invalid symbol name.\n", reader->line_number);
+            return -1;
+        }
+        if (nextHexRecordField(reader, 6, &address, "symbol address") != 0) return -1;
+        if (addLinkSymbol(file, name, length, address, 0) != 0) {
+            fprintf(reader->diagnostics, "Error: Out of memory.\n");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Function to map an object file and find its sections and the symbols
+// they define. Text and M records are left for pass 2.
+static int scanLinkFile(link_file *file, int index, FILE *diagnostics) {
+    if (openSourceBuffer(&file->buffer, file->path) != 0) {
+        fprintf(diagnostics, "Error: Cannot read the object program.\n");
+        return -1;
+    }
+    if (isBinaryObject(file->buffer.data, file->buffer.size)) {
+        fprintf(diagnostics, "Error: A binary object program has no D, R or M records; link its text form.\n");
+        return -1;
+    }
+
+    record_reader reader;
+    memset(&reader, 0, sizeof(reader));
+    reader.diagnostics = diagnostics;
+
+    link_section *section = NULL;
+    const char *end = file->buffer.data + file->buffer.size;
+    for (const char *line = file->buffer.data; line < end;) {
+        const char *record = line;
+        char type = nextRecord(&reader, &line, end);
+        if (!type) continue;
+
+        if (!section && type != 'H') {
+            fprintf(diagnostics, "Error: Line %d: Record outside of a control section.\n", reader.line_number);
+            return -1;
+        }
+
+        int status = 0;
+        switch (type) {
+        case 'H':
+            if (section) {
+                fprintf(diagnostics, "Error: Line %d: Header record before the end record of '%.*s'.\n",
+                        reader.line_number, section->name_length, section->name);
+                return -1;
+            }
+            section = addLinkSection(file, index);
+            if (!section) {
+                fprintf(diagnostics, "Error: Out of memory.\n");
+                return -1;
+            }
+            section->text = record;
+            section->first_line = reader.line_number;
+            status = readLinkHeader(&reader, file, section);
+            break;
+
+        case 'D':
+            status = readDefineRecord(&reader, file);
+            break;
+
+        case 'R':
+        case 'T':
+        case 'M':
+            // References are checked by the M records that use them, in pass 2
+            break;
+
+        case 'E':
+            if (reader.next < reader.end) {
+                status = nextHexRecordField(&reader, 6, &section->entry_address, "entry address");
+            }
+            section->size = (line < end ? line : end) - section->text;
+            section = NULL;
+            break;
+
+        default:
+            fprintf(diagnostics, "Error: Line %d: Unknown record type '%c'.\n", reader.line_number, type);
+            return -1;
+        }
+        if (status != 0) return -1;
+    }
+
+    if (section) {
+        fprintf(diagnostics, "Error: Section '%.*s' has no end record.\n", section->name_length, section->name);
+        return -1;
+    }
+    return 0;
+}
+
+// Function run by the thread pool for every file
+static void scanLinkFileJob(void *context, int index) {
+    linker *link = context;
+    link_file *file = &link->files[index];
+
+    // Messages are kept with the file so they are printed in file order
+    FILE *diagnostics = open_memstream(&file->diagnostics, &file->diagnostics_size);
+    file->status = scanLinkFile(file, index, diagnostics ? diagnostics : stderr);
+    if (diagnostics) fclose(diagnostics);
+}
+
+// Function to give every section its load address, one after the other,
+// and every symbol the address it is loaded at
+static int placeSections(linker *link, int program_address) {
+    int count = 0;
+    for (int i = 0; i < link->file_count; i++) count += link->files[i].section_count;
+    link->sections = malloc((count ? count : 1) * sizeof(link_section *));
+    if (!link->sections) {
+        fprintf(stderr, "Error: Out of memory.\n");
+        return -1;
+    }
+
+    for (int i = 0; i < link->file_count; i++) {
+        for (int j = 0; j < link->files[i].section_count; j++) {
+            link->sections[link->section_count++] = &link->files[i].sections[j];
+        }
+    }
+    if (link->section_count == 0) {
+        fprintf(stderr, "Error: No control sections to link.\n");
+        return -1;
+    }
+
+    // The first section is loaded where it was assembled unless told otherwise
+    long address = program_address >= 0 ? program_address : link->sections[0]->start_address;
+    link->program_address = address;
+    link->entry_address = -1;
+    for (int i = 0; i < link->section_count; i++) {
+        link_section *section = link->sections[i];
+        section->load_address = address;
+        address += section->length;
+        if (address > ADDRESS_SPACE) {
+            fprintf(stderr, "Error: %s: Section '%.*s' does not fit below %06X.\n",
+                    link->files[section->file].path, section->name_length, section->name, ADDRESS_SPACE);
+            return -1;
+        }
+
+        // The first entry point named by an E record is the entry point of the program
+        if (link->entry_address == -1 && section->entry_address != -1) {
+            link->entry_address = section->load_address + section->entry_address - section->start_address;
+        }
+    }
+    link->program_length = address - link->program_address;
+    if (link->entry_address == -1) link->entry_address = link->program_address;
+
+    for (int i = 0; i < link->file_count; i++) {
+        link_file *file = &link->files[i];
+        for (int j = 0; j < file->symbol_count; j++) {
+            const link_section *section = &file->sections[file->symbols[j].section];
+            file->symbols[j].address += section->load_address - section->start_address;
+        }
+    }
+    return 0;
+}
+
+// Function to insert the symbols of one shard into it, in the order they
+// were defined; a later definition of a name is marked as a duplicate
+static void buildEstabShard(void *context, int shard) {
+    linker *link = context;
+    symtab *table = &link->estab[shard];
+    for (int i = link->shard_starts[shard]; i < link->shard_starts[shard + 1]; i++) {
+        link_symbol *symbol = link->shard_symbols[i];
+        if (searchHashedSymtab(table, symbol->name, symbol->name_length, symbol->hash) != -1) {
+            symbol->is_duplicate = 1;
+        } else if (addHashedToSymtab(table, symbol->name, symbol->name_length, symbol->hash, symbol->address) == -1) {
+            link->shard_status[shard] = -1;
+            return;
+        }
+    }
+}
+
+// Function to build the ESTAB: the symbols are sorted by shard, then every
+// shard is filled by a job of its own
+static int buildEstab(linker *link) {
+    int counts[ESTAB_SHARDS] = {0};
+    int total = 0;
+    for (int i = 0; i < link->file_count; i++) {
+        for (int j = 0; j < link->files[i].symbol_count; j++) {
+            counts[getShard(link->files[i].symbols[j].hash)]++;
+            total++;
+        }
+    }
+    link->shard_symbols = malloc((total ? total : 1) * sizeof(link_symbol *));
+    if (!link->shard_symbols) {
+        fprintf(stderr, "Error: Out of memory.\n");
+        return -1;
+    }
+
+    int next[ESTAB_SHARDS];
+    for (int shard = 0; shard < ESTAB_SHARDS; shard++) {
+        link->shard_starts[shard + 1] = link->shard_starts[shard] + counts[shard];
+        next[shard] = link->shard_starts[shard];
+    }
+    for (int i = 0; i < link->file_count; i++) {
+        for (int j = 0; j < link->files[i].symbol_count; j++) {
+            link_symbol *symbol = &link->files[i].symbols[j];
+            link->shard_symbols[next[getShard(symbol->hash)]++] = symbol;
+        }
+    }
+
+    runThreadPool(link->thread_count, ESTAB_SHARDS, buildEstabShard, link);
+
+    // Duplicates are reported in file order, whatever shard they fell in
+    int status = 0;
+    for (int shard = 0; shard < ESTAB_SHARDS; shard++) {
+        if (link->shard_status[shard] != 0) {
+            fprintf(stderr, "Error: Out of memory.\n");
+            return -1;
+        }
+    }
+    for (int i = 0; i < link->file_count; i++) {
+        const link_file *file = &link->files[i];
+        for (int j = 0; j < file->symbol_count; j++) {
+            const link_symbol *symbol = &file->symbols[j];
+            if (!symbol->is_duplicate) continue;
+            fprintf(stderr, "Error: %s: External symbol '%.*s' is already defined.\n", file->path,
+                    symbol->name_length, symbol->name);
+            status = -1;
+        }
+    }
+    return status;
+}
+
+// ------x--------x----------x------------x------ PASS 1 ----------------x------------x----------------x-----------x
+
+// ------x--------x----------x------------x------ PASS 2 ----------------x------------x----------------x-----------x
+
+// Where the text records of a section go
+typedef struct {
+    linker *link;
+    link_section *section;
+} section_sink;
+
+// Function to find an external symbol in the ESTAB, returns 0 when it is not there
+static int lookupExternalSymbol(const linker *link, const char *name, int length, int *address) {
+    unsigned int hash = hashSymbol(name, length);
+    const symtab *table = &link->estab[getShard(hash)];
+    int id = searchHashedSymtab(table, name, length, hash);
+    if (id == -1) return 0;
+    *address = getSymbolAddress(table, id);
+    return 1;
+}
+
+// Function to place the code of a text record in the memory image; a
+// record outside its own section has no place, since that memory may
+// belong to a section another job is loading
+static unsigned char *placeSectionCode(void *context, int address, int length) {
+    section_sink *sink = context;
+    link_section *section = sink->section;
+    if (address < section->start_address || address + length > section->start_address + section->length) {
+        return NULL;
+    }
+
+    // The loaded bytes are kept as ranges, joining a record to the one before it
+    int load_address = section->load_address + address - section->start_address;
+    link_range *last = section->range_count ? &section->ranges[section->range_count - 1] : NULL;
+    if (last && last->address + last->length == load_address) {
+        last->length += length;
+    } else {
+        if (section->range_count == section->range_capacity) {
+            int new_capacity = section->range_capacity ? section->range_capacity * 2 : 16;
+            link_range *ranges = realloc(section->ranges, new_capacity * sizeof(link_range));
+            if (!ranges) return NULL;
+            section->ranges = ranges;
+            section->range_capacity = new_capacity;
+        }
+        section->ranges[section->range_count++] = (link_range){load_address, length};
+    }
+    return sink->link->memory + (load_address - sink->link->program_address);
+}
+
+// Function to apply a modification record: M^address^half-bytes[^+symbol].
+// The field starts at address, in its second half-byte when its length is
+// odd. Without a symbol, or with the name of the section itself, the field
+// is relocated by the load address of the section.
+static int applyModificationRecord(const linker *link, const link_section *section, record_reader *reader) {
+    int address, half_bytes;
+    if (nextHexRecordField(reader, 6, &address, "modification address") != 0 ||
+        nextHexRecordField(reader, 2, &half_bytes, "modification length") != 0) {
+        return -1;
+    }
+    int bytes = (half_bytes + 1) / 2;
+    if (half_bytes < 1 || half_bytes > 6) {
+        fprintf(reader->diagnostics, "Error: Line %d: Invalid modification length.\n", reader->line_number);
+        return -1;
+    }
+    if (address < section->start_address || address + bytes > section->start_address + section->length) {
+        fprintf(reader->diagnostics, "Error: Line %d: Modification at %06X is outside section '%.*s'.\n",
+                reader->line_number, address, section->name_length, section->name);
+        return -1;
+    }
+
+    int value = section->load_address - section->start_address;
+    int sign = 1;
+    const char *name;
+    int length;
+    if (nextRecordField(reader, &name, &length) && length > 0) {
+        if (name[0] == '+' || name[0] == '-') {
+            sign = name[0] == '-' ? -1 : 1;
+            name++;
+            length--;
+        }
+        length = trimName(name, length);
+        int is_own_name = length == section->name_length && !memcmp(name, section->name, length);
+        if (!is_own_name && !lookupExternalSymbol(link, name, length, &value)) {
+            fprintf(reader->diagnostics, "Error: Line %d: Undefined external symbol '%.*s'.\n",
+                    reader->line_number, length, name);
+            return -1;
+        }
+    }
+
+    // The field is added to with a carry that stops at its own width
+    unsigned char *place = link->memory + (section->load_address + address - section->start_address -
+                                           link->program_address);
+    uint32_t word = 0;
+    for (int i = 0; i < bytes; i++) word = word << 8 | place[i];
+    uint32_t mask = (1u << (4 * half_bytes)) - 1;
+    word = (word & ~mask) | ((word + (uint32_t)(sign * value)) & mask);
+    for (int i = bytes - 1; i >= 0; i--) {
+        place[i] = word & 0xFF;
+        word >>= 8;
+    }
+    return 0;
+}
+
+// Function to load a section into the memory image: its text records
+// first, then its M records, which may change bytes of any of them
+static int loadLinkSection(linker *link, link_section *section, FILE *diagnostics) {
+    section_sink sink = {link, section};
+    record_reader reader;
+    const char *end = section->text + section->size;
+
+    for (int pass = 0; pass < 2; pass++) {
+        memset(&reader, 0, sizeof(reader));
+        reader.diagnostics = diagnostics;
+        reader.line_number = section->first_line - 1;
+
+        for (const char *line = section->text; line < end;) {
+            char type = nextRecord(&reader, &line, end);
+            if (pass == 0 && type == 'T') {
+                int length = readTextRecord(&reader, placeSectionCode, &sink);
+                if (length < 0) return -1;
+                section->text_records++;
+                section->bytes_loaded += length;
+            } else if (pass == 1 && type == 'M') {
+                if (applyModificationRecord(link, section, &reader) != 0) return -1;
+                section->modification_records++;
+            }
+        }
+    }
+    return 0;
+}
+
+// Function run by the thread pool for every section
+static void loadLinkSectionJob(void *context, int index) {
+    linker *link = context;
+    link_section *section = link->sections[index];
+
+    FILE *diagnostics = open_memstream(&section->diagnostics, &section->diagnostics_size);
+    section->status = loadLinkSection(link, section, diagnostics ? diagnostics : stderr);
+    if (diagnostics) fclose(diagnostics);
+}
+
+// ------x--------x----------x------------x------ PASS 2 ----------------x------------x----------------x-----------x
+
+// Function to gather the statistics of a link
+static void collectLinkStats(const linker *link, link_stats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    stats->files = link->file_count;
+    stats->sections = link->section_count;
+    for (int i = 0; i < link->section_count; i++) {
+        stats->text_records += link->sections[i]->text_records;
+        stats->modification_records += link->sections[i]->modification_records;
+        stats->bytes_loaded += link->sections[i]->bytes_loaded;
+    }
+
+    // Every symbol is found after as many slots as it sits from its home slot, plus one
+    long long probes = 0;
+    for (int shard = 0; shard < ESTAB_SHARDS; shard++) {
+        const symtab *table = &link->estab[shard];
+        unsigned int mask = table->slot_count - 1;
+        for (int slot = 0; slot < table->slot_count; slot++) {
+            if (table->slots[slot] == -1) continue;
+            int probe = ((slot - table->entries[table->slots[slot]].hash) & mask) + 1;
+            probes += probe;
+            if (probe > stats->longest_probe) stats->longest_probe = probe;
+        }
+        stats->symbols += table->size;
+        stats->slots += table->slot_count;
+    }
+    stats->mean_probe = stats->symbols ? (double)probes / stats->symbols : 0;
+}
+
+// Function to link the object files at paths
+int linkObjectFiles(linker *link, const char *const *paths, int path_count, int program_address,
+                    int thread_count, link_stats *stats) {
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    memset(link, 0, sizeof(*link));
+    link->thread_count = thread_count;
+    for (int shard = 0; shard < ESTAB_SHARDS; shard++) initSymtab(&link->estab[shard]);
+    link->files = calloc(path_count ? path_count : 1, sizeof(link_file));
+    if (!link->files) {
+        fprintf(stderr, "Error: Out of memory.\n");
+        return -1;
+    }
+    link->file_count = path_count;
+    for (int i = 0; i < path_count; i++) link->files[i].path = paths[i];
+
+    // Pass 1: sections and symbols of every file, then their addresses and the ESTAB
+    runThreadPool(thread_count, path_count, scanLinkFileJob, link);
+    int status = 0;
+    for (int i = 0; i < path_count; i++) {
+        const link_file *file = &link->files[i];
+        if (file->diagnostics_size > 0) {
+            fprintf(stderr, "%s:\n%.*s", file->path, (int)file->diagnostics_size, file->diagnostics);
+        }
+        if (file->status != 0) status = -1;
+    }
+    if (status == 0) status = placeSections(link, program_address);
+    if (status == 0) status = buildEstab(link);
+
+    // Pass 2: every section loaded into the image and relocated
+    if (status == 0) {
+        link->memory = calloc(link->program_length ? link->program_length : 1, 1);
+        if (!link->memory) {
+            fprintf(stderr, "Error: Out of memory.\n");
+            status = -1;
+        }
+    }
+    if (status == 0) {
+        runThreadPool(thread_count, link->section_count, loadLinkSectionJob, link);
+        for (int i = 0; i < link->section_count; i++) {
+            const link_section *section = link->sections[i];
+            if (section->diagnostics_size > 0) {
+                fprintf(stderr, "%s: section '%.*s':\n%.*s", link->files[section->file].path,
+                        section->name_length, section->name, (int)section->diagnostics_size,
+                        section->diagnostics);
+            }
+            if (section->status != 0) status = -1;
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    if (stats) {
+        collectLinkStats(link, stats);
+        stats->seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    }
+    return status;
+}
+
+// Function to write the linked program in one of the object program forms
+int writeLinkedProgram(const linker *link, char format, FILE *out) {
+    object_image image;
+    initObjectImage(&image);
+
+    const link_section *first = link->sections[0];
+    int name_length = first->name_length < 6 ? first->name_length : 6;
+    memcpy(image.program.name, first->name, name_length);
+    image.program.start_address = link->program_address;
+    image.program.length = link->program_length;
+    image.program.entry_address = link->entry_address;
+
+    // The loaded bytes become the segments, joined where they meet
+    int range_count = 0;
+    for (int i = 0; i < link->section_count; i++) range_count += link->sections[i]->range_count;
+    image.segments = malloc((range_count ? range_count : 1) * sizeof(object_segment));
+    image.code = malloc(link->program_length ? link->program_length : 1);
+    if (!image.segments || !image.code) {
+        fprintf(stderr, "Error: Out of memory.\n");
+        freeObjectImage(&image);
+        return -1;
+    }
+    image.segment_capacity = range_count;
+    image.code_capacity = link->program_length;
+
+    for (int i = 0; i < link->section_count; i++) {
+        const link_section *section = link->sections[i];
+        for (int j = 0; j < section->range_count; j++) {
+            const link_range *range = &section->ranges[j];
+            object_segment *last = image.segment_count ? &image.segments[image.segment_count - 1] : NULL;
+            if (last && last->address + (int)last->length == range->address) {
+                last->length += range->length;
+            } else {
+                image.segments[image.segment_count++] = (object_segment){range->address, range->length};
+            }
+        }
+    }
+
+    // Text records of a section may overlap, so the code is copied from the image segment by segment
+    for (int i = 0; i < image.segment_count; i++) {
+        memcpy(image.code + image.code_size, link->memory + (image.segments[i].address - link->program_address),
+               image.segments[i].length);
+        image.code_size += image.segments[i].length;
+    }
+
+    int status = format == 't' ? writeTextObject(&image, out) : writeBinaryObject(&image, format == 'i', out);
+    freeObjectImage(&image);
+    return status;
+}
+
+// Function to print the load map
+void printLoadMap(const linker *link, FILE *out) {
+    fprintf(out, "%-16s %-16s %-8s %s\n", "Control section", "Symbol name", "Address", "Length");
+    fprintf(out, "------------------------------------------------------\n");
+    for (int i = 0; i < link->file_count; i++) {
+        const link_file *file = &link->files[i];
+        for (int j = 0; j < file->symbol_count; j++) {
+            const link_symbol *symbol = &file->symbols[j];
+            if (symbol->is_section) {
+                const link_section *section = &file->sections[symbol->section];
+                fprintf(out, "%-16.*s %-16s %06X   %06X\n", symbol->name_length, symbol->name, "",
+                        symbol->address, section->length);
+            } else {
+                fprintf(out, "%-16s %-16.*s %06X\n", "", symbol->name_length, symbol->name, symbol->address);
+            }
+        }
+    }
+    fprintf(out, "------------------------------------------------------\n");
+    fprintf(out, "Program address: %06X\nProgram length: %06X\nEntry address: %06X\n", link->program_address,
+            link->program_length, link->entry_address);
+}
+
+// Function to print the link time and the statistics of the ESTAB
+void printLinkStats(const link_stats *stats, int thread_count, FILE *out) {
+    double seconds = stats->seconds > 0 ? stats->seconds : 1e-9;
+    fprintf(out, "Linked %d sections from %d files (%d bytes loaded) in %.3f s on %d threads\n",
+            stats->sections, stats->files, stats->bytes_loaded, stats->seconds, thread_count);
+    fprintf(out, "%d text records, %d modification records, %.0f records/s\n", stats->text_records,
+            stats->modification_records, (stats->text_records + stats->modification_records) / seconds);
+    fprintf(out, "ESTAB: %d symbols in %d shards, %d slots (%.1f%% full), %.2f slots per lookup, longest %d\n",
+            stats->symbols, ESTAB_SHARDS, stats->slots, stats->slots ? 100.0 * stats->symbols / stats->slots : 0.0,
+            stats->mean_probe, stats->longest_probe);
+}
+
+// Function to release the files, sections and ESTAB of a link
+void freeLinker(linker *link) {
+    for (int i = 0; i < link->file_count; i++) {
+        link_file *file = &link->files[i];
+        for (int j = 0; j < file->section_count; j++) {
+            free(file->sections[j].ranges);
+            free(file->sections[j].diagnostics);
+        }
+        free(file->sections);
+        free(file->symbols);
+        free(file->diagnostics);
+        if (file->buffer.data) closeSourceBuffer(&file->buffer);
+    }
+    for (int shard = 0; shard < ESTAB_SHARDS; shard++) freeSymtab(&link->estab[shard]);
+    free(link->files);
+    free(link->sections);
+    free(link->shard_symbols);
+    free(link->memory);
+    memset(link, 0, sizeof(*link));
+}
+
+// ------x--------x----------x------------x------ LINKING LOADER ----------------x------------x----------------x---x
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
@@ -0,0 +1,148 @@
+#ifndef LINKER_H
+#define LINKER_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include "source.h"
+#include "symtab.h"
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// ------x--------x----------x------------x------ LINKING LOADER ----------------x------------x----------------x---x
+
+// Links the control sections of many object files (H, D, R, T, M and E
+// records, as sicasm writes them for CSECT sources) into one program. The
+// sections are loaded one after the other, in the order of the files and of
+// the sections in each file, from the program address on:
+//
+//   pass 1  every file is mapped and scanned on the thread pool for its
+//           sections (H and E records) and the symbols they define (D
+//           records); the names are hashed there too. The load address of
+//           every section follows from the lengths, and the external symbol
+//           table (ESTAB) is built from the hashed names, one shard per job.
+//   pass 2  every section is loaded on the thread pool: its text records
+//           are copied to its place in the memory image, then its M records
+//           add the address of their symbol (or the load address of the
+//           section) to the fields they name. Sections never share bytes,
+//           so the jobs write to the image without locks.
+
+// Shards of the ESTAB, a power of two. A symbol belongs to the shard named
+// by the top bits of its hash (the SYMTAB probes with the low bits), so
+// every shard is built by one job, in the order the symbols were defined.
+#define ESTAB_SHARD_BITS 6
+#define ESTAB_SHARDS (1 << ESTAB_SHARD_BITS)
+
+// An external symbol: the name of a control section or a symbol of a D record
+typedef struct {
+    const char *name;
+    int name_length;
+    unsigned int hash;
+    int section;            // Index of the defining section in its file
+    int address;            // As assembled, then as loaded
+    int is_section;
+    int is_duplicate;
+} link_symbol;
+
+// A run of loaded bytes, from the text records of a section
+typedef struct {
+    int address;
+    int length;
+} link_range;
+
+// One control section: the lines from its H record to its E record
+typedef struct {
+    const char *text;
+    size_t size;
+    int first_line;
+    const char *name;
+    int name_length;
+    int start_address;
+    int length;
+    int entry_address;      // Entry point of its E record, -1 for a bare E
+    int load_address;
+    int file;
+
+    // Filled in by pass 2
+    int status;
+    int text_records;
+    int modification_records;
+    int bytes_loaded;
+    link_range *ranges;
+    int range_count;
+    int range_capacity;
+    char *diagnostics;
+    size_t diagnostics_size;
+} link_section;
+
+// One object file, memory-mapped for the whole link
+typedef struct {
+    const char *path;
+    source_buffer buffer;
+    int status;
+    link_section *sections;
+    int section_count;
+    int section_capacity;
+    link_symbol *symbols;
+    int symbol_count;
+    int symbol_capacity;
+    char *diagnostics;
+    size_t diagnostics_size;
+} link_file;
+
+typedef struct {
+    link_file *files;
+    int file_count;
+    link_section **sections;    // Of every file, in load order
+    int section_count;
+    int thread_count;
+
+    symtab estab[ESTAB_SHARDS];
+    link_symbol **shard_symbols;
+    int shard_starts[ESTAB_SHARDS + 1];
+    int shard_status[ESTAB_SHARDS];
+
+    // The linked program: memory[0, program_length) is loaded at program_address
+    int program_address;
+    int program_length;
+    int entry_address;
+    unsigned char *memory;
+} linker;
+
+typedef struct {
+    int files;
+    int sections;
+    int symbols;
+    int slots;
+    int longest_probe;      // Slots the longest ESTAB lookup visits
+    double mean_probe;
+    int text_records;
+    int modification_records;
+    int bytes_loaded;
+    double seconds;
+} link_stats;
+
+// Function to link the object files at paths on thread_count threads.
+// program_address is where the first section is loaded, -1 for its own
+// start address. Errors are printed to stderr, in file order; returns 0
+// when every section was loaded and every M record resolved.
+int linkObjectFiles(linker *link, const char *const *paths, int path_count, int program_address,
+                    int thread_count, link_stats *stats);
+
+// Function to write the linked program as H / T / E records (format 't'),
+// binary segments ('b') or a raw memory image ('i'). The header names the
+// first section.
+int writeLinkedProgram(const linker *link, char format, FILE *out);
+
+// Function to print the load map: every section with its load address and
+// length, and the symbols it defines with theirs
+void printLoadMap(const linker *link, FILE *out);
+
+// Function to print the link time and the statistics of the ESTAB
+void printLinkStats(const link_stats *stats, int thread_count, FILE *out);
+
+void freeLinker(linker *link);
+
+// ------x--------x----------x------------x------ LINKING LOADER ----------------x------------x----------------x---x
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+
+#endif
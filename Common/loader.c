@@ -0,0 +1,225 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "loader.h"
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// ------x--------x----------x------------x------ LOADER ----------------x------------x----------------x-----------x
+
+// Value + 1 of every hex digit, 0 for any other character
+static const unsigned char hex_values[256] = {
+    ['0'] = 1, ['1'] = 2, ['2'] = 3, ['3'] = 4, ['4'] = 5, ['5'] = 6, ['6'] = 7, ['7'] = 8, ['8'] = 9, ['9'] = 10,
+    ['A'] = 11, ['B'] = 12, ['C'] = 13, ['D'] = 14, ['E'] = 15, ['F'] = 16,
+    ['a'] = 11, ['b'] = 12, ['c'] = 13, ['d'] = 14, ['e'] = 15, ['f'] = 16,
+};
+
+// Function to move on to the record on the next line
+char nextRecord(record_reader *reader, const char **line, const char *end) {
+    const char *newline = memchr(*line, '\n', end - *line);
+    const char *line_end = newline ? newline : end;
+    reader->line_number++;
+    reader->next = *line + 1;
+    reader->end = line_end;
+    if (line_end > *line && line_end[-1] == '\r') reader->end--;
+    *line = line_end + 1;
+
+    // Blank lines have no type; every record starts with its type and a ^
+    if (reader->end == reader->next - 1) return 0;
+    char type = reader->next[-1];
+    if (reader->next < reader->end && *reader->next == '^') reader->next++;
+    return type;
+}
+
+// Function to get the next ^-separated field of a record
+int nextRecordField(record_reader *reader, const char **field, int *length) {
+    if (reader->next > reader->end) return 0;
+    const char *separator = memchr(reader->next, '^', reader->end - reader->next);
+    if (!separator) separator = reader->end;
+    *field = reader->next;
+    *length = separator - reader->next;
+    reader->next = separator + 1;
+    return 1;
+}
+
+// Function to read the next field as a hex number of 1 to digits digits
+int nextHexRecordField(record_reader *reader, int digits, int *value, const char *what) {
+    const char *field;
+    int length;
+    int valid = nextRecordField(reader, &field, &length) && length > 0 && length <= digits;
+
+    *value = 0;
+    for (int i = 0; valid && i < length; i++) {
+        int digit = hex_values[(unsigned char)field[i]] - 1;
+        if (digit < 0) valid = 0;
+        *value = *value * 16 + digit;
+    }
+    if (!valid) {
+        fprintf(reader->diagnostics, "Error: Line %d: Invalid %s.\n", reader->line_number, what);
+        return -1;
+    }
+    return 0;
+}
+
+// Function to read the header record: H^name^start^length
+static int loadHeaderRecord(record_reader *reader, loaded_program *program) {
+    const char *name;
+    int length;
+    if (!nextRecordField(reader, &name, &length) || length > 6) {
+        fprintf(reader->diagnostics, "Error: Line %d: Invalid program name.\n", reader->line_number);
+        return -1;
+    }
+
+    // The name is padded with blanks to 6 characters
+    while (length > 0 && name[length - 1] == ' ') length--;
+    memcpy(program->name, name, length);
+    program->name[length] = '\0';
+
+    if (nextHexRecordField(reader, 6, &program->start_address, "start address") != 0 ||
+        nextHexRecordField(reader, 6, &program->length, "program length") != 0) {
+        return -1;
+    }
+    program->entry_address = program->start_address;
+    return 0;
+}
+
+// Function to copy the code of a text record where the sink puts it:
+// T^address^length^code[^code...]
+int readTextRecord(record_reader *reader, text_record_sink sink, void *context) {
+    int address, length;
+    if (nextHexRecordField(reader, 6, &address, "text record address") != 0 ||
+        nextHexRecordField(reader, 2, &length, "text record length") != 0) {
+        return -1;
+    }
+    unsigned char *code = sink(context, address, length);
+    if (!code) {
+        fprintf(reader->diagnostics, "Error: Line %d: Text record at %06X does not fit in memory.\n",
+                reader->line_number, address);
+        return -1;
+    }
+
+    // Every instruction or constant is a field of its own; the bytes run on across them
+    int loaded = 0;
+    int high = -1;
+    const char *field;
+    int field_length;
+    while (nextRecordField(reader, &field, &field_length)) {
+        for (int i = 0; i < field_length; i++) {
+            int digit = hex_values[(unsigned char)field[i]] - 1;
+            if (digit < 0 || loaded == length) {
+                loaded = -1;
+                break;
+            }
+            if (high < 0) {
+                high = digit;
+            } else {
+                code[loaded++] = (unsigned char)(high << 4 | digit);
+                high = -1;
+            }
+        }
+        if (loaded < 0) break;
+    }
+
+    if (loaded != length || high >= 0) {
+        fprintf(reader->diagnostics, "Error: Line %d: Text record at %06X does not hold %d bytes.\n",
+                reader->line_number, address, length);
+        return -1;
+    }
+    return length;
+}
+
+// Function to read the records of an object program
+int readObjectProgram(const char *text, size_t size, text_record_sink sink, void *context,
+                      loaded_program *program, FILE *diagnostics) {
+    memset(program, 0, sizeof(*program));
+    if (!diagnostics) diagnostics = stderr;
+
+    record_reader reader = {0};
+    reader.diagnostics = diagnostics;
+
+    int has_header = 0;
+    int has_end = 0;
+    const char *end = text + size;
+    for (const char *line = text; line < end && !has_end;) {
+        char type = nextRecord(&reader, &line, end);
+        if (!type) continue;
+
+        int status = 0;
+        if (!has_header && type != 'H') {
+            fprintf(diagnostics, "Error: Line %d: Object program does not start with a header record.\n",
+                    reader.line_number);
+            return -1;
+        }
+        switch (type) {
+        case 'H':
+            if (has_header) {
+                fprintf(diagnostics, "Error: Line %d: Second header record.\n", reader.line_number);
+                return -1;
+            }
+            has_header = 1;
+            status = loadHeaderRecord(&reader, program);
+            break;
+
+        case 'T':
+            status = readTextRecord(&reader, sink, context);
+            if (status >= 0) {
+                program->text_records++;
+                program->bytes_loaded += status;
+            }
+            break;
+
+        case 'E':
+            // The entry address may be left out, the program then starts at its start address
+            has_end = 1;
+            if (reader.next < reader.end) {
+                status = nextHexRecordField(&reader, 6, &program->entry_address, "entry address");
+            }
+            break;
+
+        default:
+            fprintf(diagnostics, "Error: Line %d: Unknown record type '%c'.\n", reader.line_number, type);
+            return -1;
+        }
+        if (status < 0) return -1;
+    }
+
+    if (!has_end) {
+        fprintf(diagnostics, "Error: Object program has no end record.\n");
+        return -1;
+    }
+    return 0;
+}
+
+// Memory a program is loaded into
+typedef struct {
+    unsigned char *memory;
+    int memory_size;
+} memory_sink;
+
+// Function to place a text record at its address in memory
+static unsigned char *placeInMemory(void *context, int address, int length) {
+    memory_sink *sink = context;
+    return address + length <= sink->memory_size ? sink->memory + address : NULL;
+}
+
+// Function to check that a loaded program starts inside memory
+int checkEntryAddress(const loaded_program *program, int memory_size, FILE *diagnostics) {
+    if (program->entry_address < 0 || program->entry_address >= memory_size) {
+        fprintf(diagnostics, "Error: Entry address %06X is outside memory.\n", program->entry_address);
+        return -1;
+    }
+    return 0;
+}
+
+// Function to load an absolute object program into memory
+int loadObjectProgram(const char *text, size_t size, unsigned char *memory, int memory_size,
+                      loaded_program *program, FILE *diagnostics) {
+    memory_sink sink = {memory, memory_size};
+    if (readObjectProgram(text, size, placeInMemory, &sink, program, diagnostics) != 0) {
+        return -1;
+    }
+    return checkEntryAddress(program, memory_size, diagnostics);
+}
+
+// ------x--------x----------x------------x------ LOADER ----------------x------------x----------------x-----------x
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
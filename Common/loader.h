@@ -0,0 +1,67 @@
+#ifndef LOADER_H
+#define LOADER_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// ------x--------x----------x------------x------ LOADER ----------------x------------x----------------x-----------x
+
+// What the header and end records of a loaded object program said
+typedef struct {
+    char name[7];
+    int start_address;
+    int length;
+    int entry_address;
+    int text_records;
+    int bytes_loaded;
+} loaded_program;
+
+// Function to find the place for the code of a text record of length bytes
+// at address, returns NULL when it has none
+typedef unsigned char *(*text_record_sink)(void *context, int address, int length);
+
+// One record being read: the rest of its line and its number for messages
+typedef struct {
+    const char *next;
+    const char *end;
+    int line_number;
+    FILE *diagnostics;
+} record_reader;
+
+// Function to start reading the record on the line at *line (before end),
+// moving *line to the line after it. Returns the record type, or 0 for a
+// blank line.
+char nextRecord(record_reader *reader, const char **line, const char *end);
+
+// Function to get the next ^-separated field of a record, returns 0 at its end
+int nextRecordField(record_reader *reader, const char **field, int *length);
+
+// Function to read the next field as a hex number of 1 to digits digits;
+// returns -1, after printing what was expected, for anything else
+int nextHexRecordField(record_reader *reader, int digits, int *value, const char *what);
+
+// Function to read the rest of a text record (address, length and code),
+// giving its code to sink. Returns the number of bytes, or -1.
+int readTextRecord(record_reader *reader, text_record_sink sink, void *context);
+
+// Function to read the H / T / E records of an object program (fields
+// separated by ^), giving the code of every text record to sink. Returns
+// -1, after printing the line and what is wrong with it, for a malformed
+// record or one the sink has no place for.
+int readObjectProgram(const char *text, size_t size, text_record_sink sink, void *context,
+                      loaded_program *program, FILE *diagnostics);
+
+// Function to check that the entry address of a loaded program lies in
+// memory[0, memory_size), returns -1 (after printing it) when it does not
+int checkEntryAddress(const loaded_program *program, int memory_size, FILE *diagnostics);
+
+// Function to load an absolute object program (the H / T / E records
+// written by pass 2) into memory[0, memory_size)
+int loadObjectProgram(const char *text, size_t size, unsigned char *memory, int memory_size,
+                      loaded_program *program, FILE *diagnostics);
+
+// ------x--------x----------x------------x------ LOADER ----------------x------------x----------------x-----------x
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+
+#endif
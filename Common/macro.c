@@ -0,0 +1,669 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "macro.h"
+#include "stats.h"
+#include "symtab.h"
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// ------x--------x----------x------------x------ MACRO PROCESSOR ----------------x------------x---------------x---x
+
+// Ids of $ labels, MACRO_LABEL_ID_LENGTH letters each
+#define MAX_LABEL_IDS (26 * 26 * 26 * 26)
+
+// Characters, in the source or in a line being expanded
+typedef struct {
+    const char *chars;
+    int length;
+} macro_text;
+
+// One parameter: &NAME, or &NAME=DEFAULT for a keyword parameter. The name
+// is kept without its &.
+typedef struct {
+    macro_text name;
+    macro_text default_value;
+    int is_keyword;
+} macro_parameter;
+
+// One macro of the definition table; its parameters and body lines are
+// ranges of the tables of the processor
+typedef struct {
+    macro_text name;
+    int first_parameter;
+    int parameter_count;
+    int first_line;
+    int line_count;
+} macro_definition;
+
+// Where the id of a $ label was written in the output
+typedef struct {
+    size_t offset;
+    int id;
+} label_marker;
+
+// An expansion kept for later calls with the same macro and arguments. Its
+// lines are still in the output, where the first call wrote them; a later
+// call copies them and writes new ids over the ones at its markers.
+typedef struct {
+    size_t offset;
+    size_t length;
+    int first_marker;
+    int marker_count;
+    int id_count;           // Ids taken by the expansion and the calls nested in it
+    int starts_with_label;
+} memo_expansion;
+
+// A marker of a kept expansion, relative to its first character and id
+typedef struct {
+    size_t offset;
+    int id;
+} memo_marker;
+
+typedef struct {
+    FILE *diagnostics;
+
+    // Definition table, with the macros found by name in names
+    macro_definition *macros;
+    int macro_count;
+    int macro_capacity;
+    macro_parameter *parameters;
+    int parameter_count;
+    int parameter_capacity;
+    macro_text *body;
+    int body_count;
+    int body_capacity;
+    symtab names;
+
+    // Expansions kept so far, found by (macro, arguments) in memo_keys
+    symtab memo_keys;
+    memo_expansion *memos;
+    int memo_count;
+    int memo_capacity;
+    memo_marker *memo_markers;
+    int memo_marker_count;
+    int memo_marker_capacity;
+    char *key;
+    size_t key_capacity;
+
+    // Ids written since the call in the source began, and the ids of the line being expanded
+    label_marker *markers;
+    int marker_count;
+    int marker_capacity;
+    int *line_markers;
+    int line_marker_count;
+    int line_marker_capacity;
+
+    // One line being expanded for every level of nesting
+    char *lines[MAX_MACRO_DEPTH];
+    size_t line_capacities[MAX_MACRO_DEPTH];
+
+    char *output;
+    size_t output_size;
+    size_t output_capacity;
+
+    int next_id;
+    int label_pending;      // A call label was written and its first line is still to come
+} macro_processor;
+
+// Function to report that memory ran out
+static int reportNoMemory(macro_processor *proc) {
+    fprintf(proc->diagnostics, "Error: Out of memory while expanding macros.\n");
+    return -1;
+}
+
+// Function to make room for one more item in an array
+static int growArray(void **items, int *capacity, int count, size_t item_size) {
+    if (count < *capacity) return 0;
+    int new_capacity = *capacity ? *capacity * 2 : 64;
+    void *grown = realloc(*items, new_capacity * item_size);
+    if (!grown) return -1;
+    *items = grown;
+    *capacity = new_capacity;
+    return 0;
+}
+
+// Function to make room for length more characters in a buffer
+static int reserveChars(char **buffer, size_t *capacity, size_t size, size_t length) {
+    if (size + length <= *capacity) return 0;
+    size_t new_capacity = *capacity ? *capacity : 256;
+    while (new_capacity < size + length) new_capacity *= 2;
+    char *grown = realloc(*buffer, new_capacity);
+    if (!grown) return -1;
+    *buffer = grown;
+    *capacity = new_capacity;
+    return 0;
+}
+
+// Function to append characters to the expanded source
+static int appendOutput(macro_processor *proc, const char *chars, size_t length) {
+    if (length == 0) return 0;
+    if (reserveChars(&proc->output, &proc->output_capacity, proc->output_size, length) != 0) {
+        return reportNoMemory(proc);
+    }
+    memcpy(proc->output + proc->output_size, chars, length);
+    proc->output_size += length;
+    return 0;
+}
+
+// Function to check for a character of a parameter name
+static int isNameChar(char c) {
+    return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+// Function to write the id of a $ label as letters
+static void writeLabelId(char *out, int id) {
+    for (int i = MACRO_LABEL_ID_LENGTH - 1; i >= 0; i--) {
+        out[i] = 'A' + id % 26;
+        id /= 26;
+    }
+}
+
+// Function to get the next item of a comma-separated list from *position
+// on, returns 0 after the last one. Commas inside quotes do not count.
+static int nextListItem(macro_text list, int *position, macro_text *item) {
+    if (*position > list.length) return 0;
+    int end = *position;
+    int quoted = 0;
+    while (end < list.length && (quoted || list.chars[end] != ',')) {
+        if (list.chars[end] == '\'') quoted = !quoted;
+        end++;
+    }
+    item->chars = list.chars + *position;
+    item->length = end - *position;
+    *position = end + 1;
+    return 1;
+}
+
+// Function to find a parameter of a macro by name, returns its index in
+// the macro or -1
+static int findParameter(const macro_processor *proc, const macro_definition *macro, const char *name,
+                         int length) {
+    for (int i = 0; i < macro->parameter_count; i++) {
+        macro_text parameter = proc->parameters[macro->first_parameter + i].name;
+        if (parameter.length == length && !memcmp(parameter.chars, name, length)) return i;
+    }
+    return -1;
+}
+
+// ------x--------x----------x------------x------ DEFINITIONS ----------------x------------x----------------x------x
+
+// Function to add the parameters of a MACRO line to the table
+static int addParameters(macro_processor *proc, macro_definition *macro, macro_text list, macro_text line) {
+    macro_text item;
+    int position = 0;
+    while (list.length > 0 && nextListItem(list, &position, &item)) {
+        // &NAME, optionally followed by =DEFAULT
+        macro_parameter parameter = {{item.chars + 1, 0}, {"", 0}, 0};
+        int is_named = item.length > 1 && item.chars[0] == '&';
+        while (is_named && parameter.name.length + 1 < item.length &&
+               isNameChar(parameter.name.chars[parameter.name.length])) {
+            parameter.name.length++;
+        }
+        int rest = 1 + parameter.name.length;
+        if (rest < item.length && item.chars[rest] == '=') {
+            parameter.is_keyword = 1;
+            parameter.default_value.chars = item.chars + rest + 1;
+            parameter.default_value.length = item.length - rest - 1;
+        } else if (rest != item.length) {
+            is_named = 0;
+        }
+
+        if (!is_named || parameter.name.length == 0) {
+            fprintf(proc->diagnostics, "Error: Bad macro parameter '%.*s' on line: %.*s\n", item.length, item.chars,
+                    line.length, line.chars);
+            return -1;
+        }
+        if (findParameter(proc, macro, parameter.name.chars, parameter.name.length) != -1) {
+            fprintf(proc->diagnostics, "Error: Macro parameter '&%.*s' is listed twice on line: %.*s\n",
+                    parameter.name.length, parameter.name.chars, line.length, line.chars);
+            return -1;
+        }
+        if (macro->parameter_count == MAX_MACRO_PARAMETERS) {
+            fprintf(proc->diagnostics, "Error: A macro takes at most %d parameters: %.*s\n", MAX_MACRO_PARAMETERS,
+                    line.length, line.chars);
+            return -1;
+        }
+
+        if (growArray((void **)&proc->parameters, &proc->parameter_capacity, proc->parameter_count,
+                      sizeof(macro_parameter)) != 0) {
+            return reportNoMemory(proc);
+        }
+        proc->parameters[proc->parameter_count++] = parameter;
+        macro->parameter_count++;
+    }
+    return 0;
+}
+
+// Function to read a definition, from its MACRO line (in fields) to its
+// MEND line, into the table; *position moves past the MEND line
+static int defineMacro(macro_processor *proc, const char *text, size_t size, const source_fields *fields,
+                       size_t *position) {
+    macro_text line = {text + fields->line.offset, fields->line.length};
+    macro_definition macro = {{text + fields->label.offset, fields->label.length},
+                              proc->parameter_count, 0, proc->body_count, 0};
+    if (macro.name.length == 0) {
+        fprintf(proc->diagnostics, "Error: MACRO needs the name of the macro as its label: %.*s\n", line.length,
+                line.chars);
+        return -1;
+    }
+    if (searchSymtab(&proc->names, macro.name.chars, macro.name.length) != -1) {
+        fprintf(proc->diagnostics, "Error: Macro '%.*s' is defined twice.\n", macro.name.length, macro.name.chars);
+        return -1;
+    }
+    if (addParameters(proc, &macro, (macro_text){text + fields->operand.offset, fields->operand.length}, line) != 0) {
+        return -1;
+    }
+
+    // The body runs to MEND; blank and comment lines are dropped
+    for (;;) {
+        if (*position >= size) {
+            fprintf(proc->diagnostics, "Error: Macro '%.*s' has no MEND.\n", macro.name.length, macro.name.chars);
+            return -1;
+        }
+        source_fields body;
+        *position = tokenizeSourceLine(text, size, *position, &body);
+        if (viewEquals(text, body.mnemonic, "MEND")) break;
+        if (viewEquals(text, body.mnemonic, "MACRO")) {
+            fprintf(proc->diagnostics, "Error: Macro definitions cannot be nested: %.*s\n", body.line.length,
+                    text + body.line.offset);
+            return -1;
+        }
+        if (body.mnemonic.length == 0) continue;
+
+        if (growArray((void **)&proc->body, &proc->body_capacity, proc->body_count, sizeof(macro_text)) != 0) {
+            return reportNoMemory(proc);
+        }
+        proc->body[proc->body_count++] = (macro_text){text + body.line.offset, body.line.length};
+        macro.line_count++;
+    }
+
+    if (growArray((void **)&proc->macros, &proc->macro_capacity, proc->macro_count, sizeof(macro_definition)) != 0 ||
+        addToSymtab(&proc->names, macro.name.chars, macro.name.length, proc->macro_count) == -1) {
+        return reportNoMemory(proc);
+    }
+    proc->macros[proc->macro_count++] = macro;
+
+    // A kept expansion may have left a call to this macro unexpanded
+    if (proc->memo_count > 0) {
+        resetSymtab(&proc->memo_keys);
+        proc->memo_count = 0;
+        proc->memo_marker_count = 0;
+    }
+    return 0;
+}
+
+// ------x--------x----------x------------x------ DEFINITIONS ----------------x------------x----------------x------x
+
+// ------x--------x----------x------------x------ EXPANSION ----------------x------------x----------------x--------x
+
+// Function to match the arguments of a call with the parameters of a macro
+static int bindArguments(macro_processor *proc, const macro_definition *macro, macro_text arguments,
+                         macro_text *values, macro_text line) {
+    for (int i = 0; i < macro->parameter_count; i++) {
+        values[i] = proc->parameters[macro->first_parameter + i].default_value;
+    }
+
+    int next_positional = 0;
+    int position = 0;
+    macro_text item;
+    while (arguments.length > 0 && nextListItem(arguments, &position, &item)) {
+        // A keyword argument is NAME=VALUE or &NAME=VALUE for a keyword parameter
+        int name_start = item.length > 0 && item.chars[0] == '&';
+        int name_end = name_start;
+        while (name_end < item.length && isNameChar(item.chars[name_end])) name_end++;
+        if (name_end > name_start && name_end < item.length && item.chars[name_end] == '=') {
+            int parameter = findParameter(proc, macro, item.chars + name_start, name_end - name_start);
+            if (parameter == -1 || !proc->parameters[macro->first_parameter + parameter].is_keyword) {
+                fprintf(proc->diagnostics, "Error: Macro '%.*s' has no keyword parameter '%.*s' on line: %.*s\n",
+                        macro->name.length, macro->name.chars, name_end - name_start, item.chars + name_start,
+                        line.length, line.chars);
+                return -1;
+            }
+            values[parameter] = (macro_text){item.chars + name_end + 1, item.length - name_end - 1};
+            continue;
+        }
+
+        // Anything else is the next positional argument
+        while (next_positional < macro->parameter_count &&
+               proc->parameters[macro->first_parameter + next_positional].is_keyword) {
+            next_positional++;
+        }
+        if (next_positional == macro->parameter_count) {
+            fprintf(proc->diagnostics, "Error: Too many arguments for macro '%.*s' on line: %.*s\n",
+                    macro->name.length, macro->name.chars, line.length, line.chars);
+            return -1;
+        }
+        values[next_positional++] = item;
+    }
+    return 0;
+}
+
+// Function to build the key of an expansion in proc->key: the index of the
+// macro and the value of every parameter. Returns its length.
+static int buildMemoKey(macro_processor *proc, int macro_index, const macro_text *values, int count) {
+    size_t length = sizeof(macro_index);
+    for (int i = 0; i < count; i++) length += values[i].length + 1;
+    if (reserveChars(&proc->key, &proc->key_capacity, 0, length) != 0) return reportNoMemory(proc);
+
+    char *key = proc->key;
+    memcpy(key, &macro_index, sizeof(macro_index));
+    key += sizeof(macro_index);
+    for (int i = 0; i < count; i++) {
+        memcpy(key, values[i].chars, values[i].length);
+        key += values[i].length;
+        *key++ = '\0';
+    }
+    return length;
+}
+
+// Function to substitute the arguments of a call into a body line, into
+// the line buffer of its nesting level, giving its $ labels the id of the
+// expansion. The offsets of the ids go to proc->line_markers. Returns the
+// length of the line, or -1.
+static int substituteLine(macro_processor *proc, const macro_definition *macro, const macro_text *values,
+                          macro_text body, int id, int depth) {
+    char **line = &proc->lines[depth];
+    size_t *capacity = &proc->line_capacities[depth];
+    size_t length = 0;
+    int quoted = 0;
+    proc->line_marker_count = 0;
+
+    for (int i = 0; i < body.length;) {
+        const char *chars = body.chars + i;
+        int count = 1;
+
+        // &NAME is replaced by the argument of the parameter
+        if (chars[0] == '&' && i + 1 < body.length && isNameChar(chars[1])) {
+            int end = i + 1;
+            while (end < body.length && isNameChar(body.chars[end])) end++;
+            int parameter = findParameter(proc, macro, chars + 1, end - i - 1);
+            if (parameter == -1) {
+                fprintf(proc->diagnostics, "Error: '%.*s' is not a parameter of macro '%.*s': %.*s\n", end - i, chars,
+                        macro->name.length, macro->name.chars, body.length, body.chars);
+                return -1;
+            }
+            chars = values[parameter].chars;
+            count = values[parameter].length;
+            i = end;
+        } else {
+            if (chars[0] == '\'') quoted = !quoted;
+            i++;
+        }
+
+        if (reserveChars(line, capacity, length, count + MACRO_LABEL_ID_LENGTH) != 0) return reportNoMemory(proc);
+        memcpy(*line + length, chars, count);
+        length += count;
+
+        // $NAME outside of quotes becomes $<id>NAME
+        if (count == 1 && chars[0] == '$' && !quoted && i < body.length && isNameChar(body.chars[i])) {
+            if (growArray((void **)&proc->line_markers, &proc->line_marker_capacity, proc->line_marker_count,
+                          sizeof(int)) != 0) {
+                return reportNoMemory(proc);
+            }
+            proc->line_markers[proc->line_marker_count++] = length;
+            writeLabelId(*line + length, id);
+            length += MACRO_LABEL_ID_LENGTH;
+        }
+    }
+    return length;
+}
+
+// Function to add a marker for an id written in the output
+static int addMarker(macro_processor *proc, size_t offset, int id) {
+    if (growArray((void **)&proc->markers, &proc->marker_capacity, proc->marker_count, sizeof(label_marker)) != 0) {
+        return reportNoMemory(proc);
+    }
+    proc->markers[proc->marker_count++] = (label_marker){offset, id};
+    return 0;
+}
+
+// Function to check that the first line of an expansion has no label when
+// the call already put one there
+static int checkFirstLabel(macro_processor *proc, int has_label, const char *line, int length) {
+    if (proc->label_pending && has_label) {
+        fprintf(proc->diagnostics, "Error: The first line of a macro call with a label has a label of its own: %.*s\n",
+                length, line);
+        return -1;
+    }
+    return 0;
+}
+
+// Function to write an expanded line to the output, with the markers of its ids
+static int emitLine(macro_processor *proc, const char *line, int length, int has_label, int id) {
+    if (checkFirstLabel(proc, has_label, line, length) != 0) return -1;
+    proc->label_pending = 0;
+
+    size_t offset = proc->output_size;
+    if (appendOutput(proc, line, length) != 0 || appendOutput(proc, "\n", 1) != 0) return -1;
+    for (int i = 0; i < proc->line_marker_count; i++) {
+        if (addMarker(proc, offset + proc->line_markers[i], id) != 0) return -1;
+    }
+    return 0;
+}
+
+// Function to copy an expansion kept from an earlier call with the same
+// arguments, giving its $ labels new ids
+static int replayExpansion(macro_processor *proc, const memo_expansion *memo, macro_text line) {
+    if (checkFirstLabel(proc, memo->starts_with_label, line.chars, line.length) != 0) return -1;
+    if (proc->next_id > MAX_LABEL_IDS - memo->id_count) {
+        fprintf(proc->diagnostics, "Error: More than %d macro expansions.\n", MAX_LABEL_IDS);
+        return -1;
+    }
+    if (reserveChars(&proc->output, &proc->output_capacity, proc->output_size, memo->length + 1) != 0) {
+        return reportNoMemory(proc);
+    }
+
+    size_t offset = proc->output_size;
+    memcpy(proc->output + offset, proc->output + memo->offset, memo->length);
+    proc->output_size += memo->length;
+    for (int i = 0; i < memo->marker_count; i++) {
+        const memo_marker *marker = &proc->memo_markers[memo->first_marker + i];
+        int id = proc->next_id + marker->id;
+        writeLabelId(proc->output + offset + marker->offset, id);
+        if (addMarker(proc, offset + marker->offset, id) != 0) return -1;
+    }
+    proc->next_id += memo->id_count;
+    if (memo->length > 0) proc->label_pending = 0;
+
+    STATS_COUNT(COUNTER_MACRO_REUSED, 1);
+    return 0;
+}
+
+// Function to keep the expansion the output holds from start on, for
+// later calls with the same arguments
+static int keepExpansion(macro_processor *proc, int macro_index, const macro_text *values, size_t start,
+                         int first_marker, int first_id) {
+    int key_length = buildMemoKey(proc, macro_index, values, proc->macros[macro_index].parameter_count);
+    if (key_length < 0) return -1;
+
+    memo_expansion memo = {start, proc->output_size - start, proc->memo_marker_count, proc->marker_count - first_marker,
+                           proc->next_id - first_id, 0};
+    memo.starts_with_label = memo.length > 0 && proc->output[start] != ' ' && proc->output[start] != '\t';
+
+    for (int i = first_marker; i < proc->marker_count; i++) {
+        if (growArray((void **)&proc->memo_markers, &proc->memo_marker_capacity, proc->memo_marker_count,
+                      sizeof(memo_marker)) != 0) {
+            return reportNoMemory(proc);
+        }
+        proc->memo_markers[proc->memo_marker_count++] =
+            (memo_marker){proc->markers[i].offset - start, proc->markers[i].id - first_id};
+    }
+
+    if (growArray((void **)&proc->memos, &proc->memo_capacity, proc->memo_count, sizeof(memo_expansion)) != 0 ||
+        addToSymtab(&proc->memo_keys, proc->key, key_length, proc->memo_count) == -1) {
+        return reportNoMemory(proc);
+    }
+    proc->memos[proc->memo_count++] = memo;
+    return 0;
+}
+
+static int expandCall(macro_processor *proc, int macro_index, macro_text label, macro_text arguments,
+                      macro_text line, int depth, int *keepable);
+
+// Function to expand the body of a macro with the arguments of a call.
+// *keepable is cleared when a $ label of this body is passed on to a
+// nested call: its id is then inside an argument, where no marker finds it.
+static int expandBody(macro_processor *proc, int macro_index, const macro_text *values, int depth,
+                      int *keepable) {
+    if (proc->next_id == MAX_LABEL_IDS) {
+        fprintf(proc->diagnostics, "Error: More than %d macro expansions.\n", MAX_LABEL_IDS);
+        return -1;
+    }
+    int id = proc->next_id++;
+
+    const macro_definition *macro = &proc->macros[macro_index];
+    for (int i = 0; i < macro->line_count; i++) {
+        int length = substituteLine(proc, macro, values, proc->body[macro->first_line + i], id, depth);
+        if (length < 0) return -1;
+
+        const char *line = proc->lines[depth];
+        source_fields fields;
+        tokenizeSourceLine(line, length, 0, &fields);
+        if (fields.mnemonic.length == 0) continue;
+
+        int nested = searchSymtab(&proc->names, line + fields.mnemonic.offset, fields.mnemonic.length);
+        if (nested == -1) {
+            if (emitLine(proc, line, length, fields.label.length > 0, id) != 0) return -1;
+            continue;
+        }
+
+        if (proc->line_marker_count > 0) *keepable = 0;
+        if (expandCall(proc, nested, (macro_text){line + fields.label.offset, fields.label.length},
+                       (macro_text){line + fields.operand.offset, fields.operand.length}, (macro_text){line, length},
+                       depth + 1, keepable) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Function to expand one call of a macro into the output, or to copy the
+// expansion of an earlier call with the same arguments
+static int expandCall(macro_processor *proc, int macro_index, macro_text label, macro_text arguments,
+                      macro_text line, int depth, int *keepable) {
+    if (depth == MAX_MACRO_DEPTH) {
+        fprintf(proc->diagnostics, "Error: Macro calls nest more than %d deep on line: %.*s\n", MAX_MACRO_DEPTH,
+                line.length, line.chars);
+        return -1;
+    }
+
+    const macro_definition *macro = &proc->macros[macro_index];
+    macro_text values[MAX_MACRO_PARAMETERS];
+    if (bindArguments(proc, macro, arguments, values, line) != 0) return -1;
+    STATS_COUNT(COUNTER_MACRO_CALLS, 1);
+
+    // The label of the call goes before the first line the call generates
+    if (label.length > 0) {
+        if (checkFirstLabel(proc, 1, line.chars, line.length) != 0) return -1;
+        if (appendOutput(proc, label.chars, label.length) != 0) return -1;
+        proc->label_pending = 1;
+    }
+
+    int key_length = buildMemoKey(proc, macro_index, values, macro->parameter_count);
+    if (key_length < 0) return -1;
+    int memo = searchSymtab(&proc->memo_keys, proc->key, key_length);
+    if (memo != -1) {
+        if (replayExpansion(proc, &proc->memos[getSymbolAddress(&proc->memo_keys, memo)], line) != 0) return -1;
+    } else {
+        size_t start = proc->output_size;
+        int first_marker = proc->marker_count;
+        int first_id = proc->next_id;
+        int keep = 1;
+        if (expandBody(proc, macro_index, values, depth, &keep) != 0) return -1;
+        if (keep && keepExpansion(proc, macro_index, values, start, first_marker, first_id) != 0) return -1;
+        if (!keep) *keepable = 0;
+    }
+
+    if (label.length > 0 && proc->label_pending) {
+        fprintf(proc->diagnostics, "Error: Macro call generates no line for its label: %.*s\n", line.length,
+                line.chars);
+        return -1;
+    }
+    return 0;
+}
+
+// ------x--------x----------x------------x------ EXPANSION ----------------x------------x----------------x--------x
+
+// Function to free everything but the output
+static void freeMacroProcessor(macro_processor *proc) {
+    free(proc->macros);
+    free(proc->parameters);
+    free(proc->body);
+    freeSymtab(&proc->names);
+    freeSymtab(&proc->memo_keys);
+    free(proc->memos);
+    free(proc->memo_markers);
+    free(proc->key);
+    free(proc->markers);
+    free(proc->line_markers);
+    for (int i = 0; i < MAX_MACRO_DEPTH; i++) free(proc->lines[i]);
+}
+
+// Function to check whether a source defines macros
+int hasMacros(const char *text, size_t size) {
+    size_t next;
+    return findDirectiveLine(text, size, 0, "MACRO", &next) < size;
+}
+
+// Function to expand every macro call of a source
+int expandMacros(const char *text, size_t size, source_buffer *expanded, FILE *diagnostics) {
+    macro_processor proc;
+    memset(&proc, 0, sizeof(proc));
+    proc.diagnostics = diagnostics;
+    initSymtab(&proc.names);
+    initSymtab(&proc.memo_keys);
+    proc.names.diagnostics = proc.memo_keys.diagnostics = diagnostics;
+
+    int status = 0;
+    size_t position = 0;
+    size_t copied = 0;
+    while (status == 0 && position < size) {
+        size_t start = position;
+        source_fields fields;
+        position = tokenizeSourceLine(text, size, position, &fields);
+        if (fields.mnemonic.length == 0) continue;
+
+        int is_definition = viewEquals(text, fields.mnemonic, "MACRO");
+        int is_end = viewEquals(text, fields.mnemonic, "MEND");
+        int macro = -1;
+        if (!is_definition && !is_end && proc.macro_count > 0) {
+            macro = searchSymtab(&proc.names, text + fields.mnemonic.offset, fields.mnemonic.length);
+        }
+        if (!is_definition && !is_end && macro == -1) continue;
+
+        // The lines since the last definition or call are copied as they are
+        status = appendOutput(&proc, text + copied, start - copied);
+        macro_text line = {text + fields.line.offset, fields.line.length};
+        if (status != 0) {
+            break;
+        } else if (is_definition) {
+            status = defineMacro(&proc, text, size, &fields, &position);
+        } else if (is_end) {
+            fprintf(diagnostics, "Error: MEND without MACRO: %.*s\n", line.length, line.chars);
+            status = -1;
+        } else {
+            int keepable = 1;
+            status = expandCall(&proc, macro, (macro_text){text + fields.label.offset, fields.label.length},
+                                (macro_text){text + fields.operand.offset, fields.operand.length}, line, 0,
+                                &keepable);
+            proc.marker_count = 0;
+        }
+        copied = position;
+    }
+    if (status == 0) status = appendOutput(&proc, text + copied, size - copied);
+
+    freeMacroProcessor(&proc);
+    if (status != 0) {
+        free(proc.output);
+        return -1;
+    }
+    expanded->data = proc.output;
+    expanded->size = proc.output_size;
+    expanded->is_mapped = 0;
+    return 0;
+}
+
+// ------x--------x----------x------------x------ MACRO PROCESSOR ----------------x------------x---------------x---x
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
@@ -0,0 +1,52 @@
+#ifndef MACRO_H
+#define MACRO_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include "source.h"
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// ------x--------x----------x------------x------ MACRO PROCESSOR ----------------x------------x---------------x---x
+
+// A macro is defined between a MACRO line, which names it and its
+// parameters, and a MEND line:
+//
+//   NAME    MACRO   &POS1,&POS2,&KEY=DEFAULT
+//           ...     body lines, which use &POS1, &POS2 and &KEY
+//           MEND
+//
+// and called by its name as a mnemonic, with positional arguments in the
+// order of the positional parameters and keyword arguments (KEY=VALUE or
+// &KEY=VALUE) in any order after them. A keyword parameter that is not
+// given takes its default, a positional one that is not given is empty.
+// The label of a call goes on the first line the call generates. A label
+// of the body that starts with $ gets an id unique to each expansion
+// ($LOOP becomes $AAAALOOP, $AAABLOOP, ...), so a macro may define labels
+// and still be called more than once. Bodies may call other macros.
+
+// Most parameters of one macro
+#define MAX_MACRO_PARAMETERS 32
+
+// Deepest nesting of macro calls inside macro bodies
+#define MAX_MACRO_DEPTH 16
+
+// Letters of the id given to the $ labels of an expansion
+#define MACRO_LABEL_ID_LENGTH 4
+
+// Function to check whether a source defines macros: it has a MACRO line
+int hasMacros(const char *text, size_t size);
+
+// Function to expand every macro call of a source, removing the
+// definitions, into expanded (a buffer in memory, freed with
+// closeSourceBuffer()) that pass 1 reads in place of the source. Lines
+// that call no macro are copied as they are. An expansion is kept, keyed
+// by the macro and its arguments, so a later call with the same arguments
+// copies its lines and only gives its $ labels new ids. Errors are printed
+// to diagnostics; returns 0 on success and -1 on the first error.
+int expandMacros(const char *text, size_t size, source_buffer *expanded, FILE *diagnostics);
+
+// ------x--------x----------x------------x------ MACRO PROCESSOR ----------------x------------x---------------x---x
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+
+#endif
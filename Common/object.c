@@ -0,0 +1,180 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "object.h"
+#include "stats.h"
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// ------x--------x----------x------------x------ OBJECT PROGRAM ----------------x------------x----------------x----x
+
+// Function to start an object program, writing its header record
+void writeHeaderRecord(object_writer *writer, FILE *out, const char *name, int start_address, int length) {
+    memset(writer, 0, sizeof(*writer));
+    writer->out = out;
+    writer->start_address = start_address;
+    writer->has_length = length >= 0;
+    initOutputBuffer(&writer->buffer, out);
+
+    // H^name^start^length, with a fixed width so the length can be patched later
+    // (without a file the object program is kept in the buffer)
+    writer->header_position = out ? ftell(out) : -1;
+    writer->header_offset = writer->buffer.flushed + writer->buffer.size;
+    size_t name_length = strlen(name);
+    appendBytes(&writer->buffer, "H^", 2);
+    appendField(&writer->buffer, name, name_length < 6 ? name_length : 6, 6);
+    appendChar(&writer->buffer, '^');
+    appendHex(&writer->buffer, start_address, 6);
+    appendChar(&writer->buffer, '^');
+    appendHex(&writer->buffer, length >= 0 ? length : 0, 6);
+    appendChar(&writer->buffer, '\n');
+}
+
+// Function to format text records
+void writeTextRecords(output_buffer *out, const text_record *records, int count) {
+    for (int r = 0; r < count; r++) {
+        const text_record *record = &records[r];
+
+        // T^start^length^ followed by the object code of every instruction
+        appendBytes(out, "T^", 2);
+        appendHex(out, record->address, 6);
+        appendChar(out, '^');
+        appendHex(out, record->length, 2);
+        for (int i = 0; i < record->field_count; i++) {
+            int begin = record->fields[i];
+            int end = i + 1 < record->field_count ? record->fields[i + 1] : record->length;
+            appendChar(out, '^');
+            appendHexBytes(out, record->record + begin, end - begin);
+        }
+        appendChar(out, '\n');
+    }
+    STATS_COUNT(COUNTER_TEXT_RECORDS, count);
+}
+
+// Function to append a finished text record to a list
+static int addTextRecord(text_record_list *list, const text_record *record) {
+    if (list->count == list->capacity) {
+        int new_capacity = list->capacity ? list->capacity * 2 : 256;
+        text_record *records = realloc(list->records, new_capacity * sizeof(text_record));
+        if (!records) return -1;
+        list->records = records;
+        list->capacity = new_capacity;
+    }
+    list->records[list->count++] = *record;
+    return 0;
+}
+
+// Function to write out (or collect) the current text record, if it holds anything
+static void flushTextRecord(object_writer *writer) {
+    if (writer->record_length == 0) return;
+
+    text_record record;
+    record.address = writer->record_address;
+    record.length = writer->record_length;
+    record.field_count = writer->field_count;
+    memcpy(record.record, writer->record, writer->record_length);
+    for (int i = 0; i < writer->field_count; i++) {
+        record.fields[i] = writer->fields[i];
+    }
+
+    if (!writer->collect) {
+        writeTextRecords(&writer->buffer, &record, 1);
+    } else if (addTextRecord(writer->collect, &record) != 0) {
+        fprintf(stderr, "Error: Out of memory.\n");
+        writer->failed = 1;
+    }
+
+    writer->record_length = 0;
+    writer->field_count = 0;
+}
+
+// Function to add the object code of one instruction or constant at an address
+void writeObjectCode(object_writer *writer, int address, const unsigned char *code, int size) {
+    while (size > 0) {
+        // Start a new record when this code does not follow the current one
+        // or does not fit in it; constants longer than a record are split
+        int contiguous = writer->record_length > 0 && writer->record_address + writer->record_length == address;
+        int fits = size <= MAX_TEXT_RECORD_BYTES - writer->record_length;
+        if (!contiguous || (!fits && writer->record_length > 0)) {
+            flushTextRecord(writer);
+        }
+        if (writer->record_length == 0) {
+            writer->record_address = address;
+        }
+
+        int chunk = size;
+        if (chunk > MAX_TEXT_RECORD_BYTES - writer->record_length) {
+            chunk = MAX_TEXT_RECORD_BYTES - writer->record_length;
+        }
+
+        writer->fields[writer->field_count++] = writer->record_length;
+        memcpy(writer->record + writer->record_length, code, chunk);
+        writer->record_length += chunk;
+
+        code += chunk;
+        address += chunk;
+        size -= chunk;
+    }
+}
+
+// Function to end the current text record (e.g. at a RESW/RESB gap)
+void breakTextRecord(object_writer *writer) {
+    flushTextRecord(writer);
+}
+
+// Function to flush the last text record and write the end record
+int writeEndRecord(object_writer *writer, int entry_address, int end_address) {
+    flushTextRecord(writer);
+    if (entry_address >= 0) {
+        appendBytes(&writer->buffer, "E^", 2);
+        appendHex(&writer->buffer, entry_address, 6);
+    } else {
+        appendChar(&writer->buffer, 'E');
+    }
+    appendChar(&writer->buffer, '\n');
+
+    // Patch the program length into the header once it is known; it is
+    // usually still in the buffer, otherwise it is patched in the file
+    int status = 0;
+    if (!writer->has_length) {
+        char digits[6];
+        formatHex(digits, end_address - writer->start_address, 6);
+
+        output_buffer *buffer = &writer->buffer;
+        if (writer->header_offset >= buffer->flushed) {
+            memcpy(buffer->data + (writer->header_offset - buffer->flushed) + 16, digits, 6);
+        } else {
+            flushOutputBuffer(buffer);
+            long end_position = ftell(writer->out);
+            if (writer->header_position < 0 || fseek(writer->out, writer->header_position + 16, SEEK_SET) != 0) {
+                fprintf(stderr, "Error: Cannot patch the program length into the header record.\n");
+                status = -1;
+            } else {
+                fwrite(digits, 1, 6, writer->out);
+                fseek(writer->out, end_position, SEEK_SET);
+            }
+        }
+    }
+
+    if (closeOutputBuffer(&writer->buffer) != 0) status = -1;
+    return status != 0 || (writer->out && ferror(writer->out)) || writer->failed ? -1 : 0;
+}
+
+// Function to release a writer that is given up before its end record
+void freeObjectWriter(object_writer *writer) {
+    closeOutputBuffer(&writer->buffer);
+}
+
+// Function to collect the finished text records of a writer in a list
+void collectTextRecords(object_writer *writer, text_record_list *list) {
+    writer->collect = list;
+}
+
+// Function to release the memory held by a list of text records
+void freeTextRecords(text_record_list *list) {
+    free(list->records);
+    memset(list, 0, sizeof(*list));
+}
+
+// ------x--------x----------x------------x------ OBJECT PROGRAM ----------------x------------x----------------x----x
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
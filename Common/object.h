@@ -0,0 +1,83 @@
+#ifndef OBJECT_H
+#define OBJECT_H
+
+#include <stdio.h>
+
+#include "output.h"
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// ------x--------x----------x------------x------ OBJECT PROGRAM ----------------x------------x----------------x----x
+
+// Most bytes of object code a single text record can hold
+#define MAX_TEXT_RECORD_BYTES 30
+
+// A finished text record, kept by a collecting writer to be written later
+typedef struct {
+    int address;
+    int length;
+    int field_count;
+    unsigned char record[MAX_TEXT_RECORD_BYTES];
+    unsigned char fields[MAX_TEXT_RECORD_BYTES];
+} text_record;
+
+typedef struct {
+    text_record *records;
+    int count;
+    int capacity;
+} text_record_list;
+
+// Writer for the H / T / E records of an object program. Only the text
+// record being filled is held in memory; it is written out when it is full,
+// when the next byte is not contiguous with it, or at a break (RESW/RESB).
+// Records are formatted into an output buffer that reaches the file in
+// large blocks.
+typedef struct {
+    FILE *out;
+    output_buffer buffer;
+    long header_position;   // Where the H record starts in the file, to patch its length
+    size_t header_offset;   // Where it starts in the buffered output
+    int start_address;
+    int has_length;
+
+    int record_address;     // Address of the first byte of the current record
+    int record_length;      // Number of bytes in the current record
+    unsigned char record[MAX_TEXT_RECORD_BYTES];
+    int fields[MAX_TEXT_RECORD_BYTES];  // Byte offset where each instruction starts
+    int field_count;
+
+    text_record_list *collect;  // When set, finished text records go here instead of out
+    int failed;
+} object_writer;
+
+// Function to start an object program, writing its header record. Pass a
+// negative length when it is not known yet; writeEndRecord() then patches it.
+// With a NULL file the whole object program is kept in writer->buffer.
+void writeHeaderRecord(object_writer *writer, FILE *out, const char *name, int start_address, int length);
+
+// Function to add the object code of one instruction or constant at an address
+void writeObjectCode(object_writer *writer, int address, const unsigned char *code, int size);
+
+// Function to end the current text record (e.g. at a RESW/RESB gap)
+void breakTextRecord(object_writer *writer);
+
+// Function to flush the last text record and write the end record (a bare
+// "E" without an entry address when entry_address is negative)
+int writeEndRecord(object_writer *writer, int entry_address, int end_address);
+
+// Function to release a writer that is given up before its end record
+void freeObjectWriter(object_writer *writer);
+
+// Function to keep the finished text records of a writer in list (NULL to
+// write them out again). Records are laid out exactly as when written
+// directly, so they can be formatted later, e.g. on several threads.
+void collectTextRecords(object_writer *writer, text_record_list *list);
+
+// Function to format text records in the T^start^length^code format
+void writeTextRecords(output_buffer *out, const text_record *records, int count);
+
+void freeTextRecords(text_record_list *list);
+
+// ------x--------x----------x------------x------ OBJECT PROGRAM ----------------x------------x----------------x----x
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+
+#endif
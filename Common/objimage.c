@@ -0,0 +1,324 @@
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "object.h"
+#include "objimage.h"
+#include "source.h"
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// ------x--------x----------x------------x------ BINARY OBJECT ----------------x------------x----------------x----x
+
+// Addresses a 24-bit address field can hold
+#define ADDRESS_SPACE (1 << 24)
+
+// Function to start an empty object image
+void initObjectImage(object_image *image) {
+    memset(image, 0, sizeof(*image));
+}
+
+// Function to release the segments and code of an object image
+void freeObjectImage(object_image *image) {
+    free(image->segments);
+    free(image->code);
+    initObjectImage(image);
+}
+
+// Function to tell a binary object program from a text one
+int isBinaryObject(const char *data, size_t size) {
+    return size >= 4 && memcmp(data, OBJECT_IMAGE_MAGIC, 4) == 0;
+}
+
+// Function to make room for length more bytes of code, returns where they go
+static unsigned char *reserveCode(object_image *image, size_t length) {
+    if (image->code_size + length > image->code_capacity) {
+        size_t new_capacity = image->code_capacity ? image->code_capacity * 2 : 4096;
+        while (new_capacity < image->code_size + length) new_capacity *= 2;
+        unsigned char *code = realloc(image->code, new_capacity);
+        if (!code) return NULL;
+        image->code = code;
+        image->code_capacity = new_capacity;
+    }
+    unsigned char *place = image->code + image->code_size;
+    image->code_size += length;
+    return place;
+}
+
+// Function to add length bytes of code at address, extending the last
+// segment when they follow it; returns where the bytes go
+static unsigned char *addSegmentCode(void *context, int address, int length) {
+    object_image *image = context;
+    object_segment *last = image->segment_count ? &image->segments[image->segment_count - 1] : NULL;
+    if (address < 0 || address + length > ADDRESS_SPACE) return NULL;
+
+    if (!last || last->address + (int)last->length != address) {
+        if (image->segment_count == image->segment_capacity) {
+            int new_capacity = image->segment_capacity ? image->segment_capacity * 2 : 64;
+            object_segment *segments = realloc(image->segments, new_capacity * sizeof(object_segment));
+            if (!segments) return NULL;
+            image->segments = segments;
+            image->segment_capacity = new_capacity;
+        }
+        last = &image->segments[image->segment_count++];
+        last->address = address;
+        last->length = 0;
+    }
+
+    unsigned char *place = reserveCode(image, length);
+    if (place) last->length += length;
+    return place;
+}
+
+// Function to check the header and sections of a binary object program and
+// read its header into program
+static int checkBinaryObject(const char *data, size_t size, loaded_program *program, FILE *diagnostics) {
+    const object_image_header *header = (const object_image_header *)data;
+    if (size < sizeof(*header)) {
+        fprintf(diagnostics, "Error: Binary object program is truncated.\n");
+        return -1;
+    }
+    if (header->version != OBJECT_IMAGE_VERSION || header->byte_order != OBJECT_IMAGE_BYTE_ORDER) {
+        fprintf(diagnostics, "Error: Binary object program was written by another version or byte order.\n");
+        return -1;
+    }
+
+    size_t segments_end = sizeof(*header) + (size_t)header->segment_count * sizeof(object_segment);
+    if (size < segments_end || header->code_offset < segments_end ||
+        size - header->code_offset < header->code_size || header->code_offset > size) {
+        fprintf(diagnostics, "Error: Binary object program is truncated.\n");
+        return -1;
+    }
+
+    // Every segment must lie in the address space, and together they hold exactly the code
+    const object_segment *segments = (const object_segment *)(header + 1);
+    size_t total = 0;
+    for (uint32_t i = 0; i < header->segment_count; i++) {
+        if (segments[i].address < 0 || segments[i].address + (size_t)segments[i].length > ADDRESS_SPACE) {
+            fprintf(diagnostics, "Error: Segment %u of the binary object program is outside memory.\n", i + 1);
+            return -1;
+        }
+        total += segments[i].length;
+    }
+    if (total != header->code_size) {
+        fprintf(diagnostics, "Error: Segments of the binary object program do not hold %u bytes.\n",
+                header->code_size);
+        return -1;
+    }
+
+    memset(program, 0, sizeof(*program));
+    memcpy(program->name, header->name, 6);
+    program->start_address = header->start_address;
+    program->length = header->length;
+    program->entry_address = header->entry_address;
+    program->text_records = header->segment_count;
+    program->bytes_loaded = header->code_size;
+    return 0;
+}
+
+// Function to read the segments of a binary object program into image
+static int readBinaryObject(object_image *image, const char *data, size_t size, FILE *diagnostics) {
+    if (checkBinaryObject(data, size, &image->program, diagnostics) != 0) {
+        return -1;
+    }
+
+    const object_image_header *header = (const object_image_header *)data;
+    const object_segment *segments = (const object_segment *)(header + 1);
+    const unsigned char *code = (const unsigned char *)data + header->code_offset;
+    for (uint32_t i = 0; i < header->segment_count; i++) {
+        unsigned char *place = addSegmentCode(image, segments[i].address, segments[i].length);
+        if (!place) {
+            fprintf(diagnostics, "Error: Out of memory.\n");
+            return -1;
+        }
+        memcpy(place, code, segments[i].length);
+        code += segments[i].length;
+    }
+    return 0;
+}
+
+// Function to read an object program in either form
+int readObjectImage(object_image *image, const char *data, size_t size, FILE *diagnostics) {
+    initObjectImage(image);
+    if (!diagnostics) diagnostics = stderr;
+
+    int status;
+    if (isBinaryObject(data, size)) {
+        status = readBinaryObject(image, data, size, diagnostics);
+    } else {
+        status = readObjectProgram(data, size, addSegmentCode, image, &image->program, diagnostics);
+    }
+    if (status != 0) freeObjectImage(image);
+    return status;
+}
+
+// Function to write zero bytes
+static void writeZeros(size_t count, FILE *out) {
+    static const char zeros[256];
+    while (count > 0) {
+        size_t chunk = count < sizeof(zeros) ? count : sizeof(zeros);
+        fwrite(zeros, 1, chunk, out);
+        count -= chunk;
+    }
+}
+
+// Function to write an object image as a binary object program
+int writeBinaryObject(const object_image *image, int raw, FILE *out) {
+    object_image_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, OBJECT_IMAGE_MAGIC, 4);
+    header.version = OBJECT_IMAGE_VERSION;
+    header.byte_order = OBJECT_IMAGE_BYTE_ORDER;
+    memcpy(header.name, image->program.name, strlen(image->program.name));
+    header.start_address = image->program.start_address;
+    header.length = image->program.length;
+    header.entry_address = image->program.entry_address;
+
+    if (!raw) {
+        header.segment_count = image->segment_count;
+        header.code_size = image->code_size;
+        header.code_offset = sizeof(header) + image->segment_count * sizeof(object_segment);
+        fwrite(&header, sizeof(header), 1, out);
+        fwrite(image->segments, sizeof(object_segment), image->segment_count, out);
+        fwrite(image->code, 1, image->code_size, out);
+        return ferror(out) ? -1 : 0;
+    }
+
+    // A raw image covers the program and every segment, from the start of
+    // a page, so it can be mapped at its address
+    int low = image->program.start_address;
+    int high = image->program.start_address + image->program.length;
+    for (int i = 0; i < image->segment_count; i++) {
+        const object_segment *segment = &image->segments[i];
+        if (segment->address < low) low = segment->address;
+        if (segment->address + (int)segment->length > high) high = segment->address + segment->length;
+    }
+    low &= ~(OBJECT_IMAGE_PAGE_SIZE - 1);
+
+    unsigned char *memory = calloc(high - low > 0 ? high - low : 1, 1);
+    if (!memory) {
+        fprintf(stderr, "Error: Out of memory.\n");
+        return -1;
+    }
+    const unsigned char *code = image->code;
+    for (int i = 0; i < image->segment_count; i++) {
+        memcpy(memory + image->segments[i].address - low, code, image->segments[i].length);
+        code += image->segments[i].length;
+    }
+
+    object_segment segment = {low, high - low};
+    header.flags = OBJECT_IMAGE_RAW;
+    header.segment_count = 1;
+    header.code_size = segment.length;
+    header.code_offset = OBJECT_IMAGE_PAGE_SIZE;
+    fwrite(&header, sizeof(header), 1, out);
+    fwrite(&segment, sizeof(segment), 1, out);
+    writeZeros(header.code_offset - sizeof(header) - sizeof(segment), out);
+    fwrite(memory, 1, segment.length, out);
+    free(memory);
+    return ferror(out) ? -1 : 0;
+}
+
+// Function to write an object image as H / T / E records
+int writeTextObject(const object_image *image, FILE *out) {
+    object_writer writer;
+    writeHeaderRecord(&writer, out, image->program.name, image->program.start_address, image->program.length);
+
+    const unsigned char *code = image->code;
+    for (int i = 0; i < image->segment_count; i++) {
+        const object_segment *segment = &image->segments[i];
+        for (uint32_t offset = 0; offset < segment->length; offset += 3) {
+            int size = segment->length - offset < 3 ? segment->length - offset : 3;
+            writeObjectCode(&writer, segment->address + offset, code + offset, size);
+        }
+        breakTextRecord(&writer);
+        code += segment->length;
+    }
+    return writeEndRecord(&writer, image->program.entry_address,
+                          image->program.start_address + image->program.length);
+}
+
+// Function to convert an object program to text, binary segments or a raw image
+int convertObjectProgram(const char *data, size_t size, char format, FILE *out, FILE *diagnostics) {
+    object_image image;
+    if (readObjectImage(&image, data, size, diagnostics) != 0) {
+        return -1;
+    }
+    int status = format == 't' ? writeTextObject(&image, out) : writeBinaryObject(&image, format == 'i', out);
+    freeObjectImage(&image);
+    return status;
+}
+
+// Function to map the code of a raw image over memory, returns 1 when it is mapped
+static int mapRawImage(const char *path, const object_image_header *header, const object_segment *segment,
+                       unsigned char *memory, int memory_size) {
+    // The mapping covers whole pages, and the rest of the last one reads as zeros
+    long page_size = sysconf(_SC_PAGESIZE);
+    if (page_size <= 0) return 0;
+    size_t mapped_size = (segment->length + page_size - 1) / page_size * page_size;
+    unsigned char *place = memory + segment->address;
+    if (segment->length == 0 || (uintptr_t)place % page_size != 0 || header->code_offset % page_size != 0 ||
+        segment->address + mapped_size > (size_t)memory_size) {
+        return 0;
+    }
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return 0;
+    void *mapped = mmap(place, segment->length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd,
+                        header->code_offset);
+    close(fd);
+    return mapped != MAP_FAILED;
+}
+
+// Function to load an object program file in either form into memory
+int loadObjectFile(const char *path, unsigned char *memory, int memory_size, loaded_program *program,
+                   FILE *diagnostics) {
+    if (!diagnostics) diagnostics = stderr;
+    source_buffer buffer;
+    if (openSourceBuffer(&buffer, path) != 0) {
+        return -1;
+    }
+    if (!isBinaryObject(buffer.data, buffer.size)) {
+        int status = loadObjectProgram(buffer.data, buffer.size, memory, memory_size, program, diagnostics);
+        closeSourceBuffer(&buffer);
+        return status;
+    }
+
+    // The sections are checked once, then the code is copied (or mapped) as it is
+    if (checkBinaryObject(buffer.data, buffer.size, program, diagnostics) != 0) {
+        closeSourceBuffer(&buffer);
+        return -1;
+    }
+
+    const object_image_header *header = (const object_image_header *)buffer.data;
+    const object_segment *segments = (const object_segment *)(header + 1);
+    for (uint32_t i = 0; i < header->segment_count; i++) {
+        if (segments[i].address + (size_t)segments[i].length > (size_t)memory_size) {
+            fprintf(diagnostics, "Error: Segment at %06X does not fit in memory.\n", segments[i].address);
+            closeSourceBuffer(&buffer);
+            return -1;
+        }
+    }
+    if (checkEntryAddress(program, memory_size, diagnostics) != 0) {
+        closeSourceBuffer(&buffer);
+        return -1;
+    }
+
+    int mapped = (header->flags & OBJECT_IMAGE_RAW) && header->segment_count == 1 && buffer.is_mapped &&
+                 mapRawImage(path, header, &segments[0], memory, memory_size);
+    if (!mapped) {
+        const char *code = buffer.data + header->code_offset;
+        for (uint32_t i = 0; i < header->segment_count; i++) {
+            memcpy(memory + segments[i].address, code, segments[i].length);
+            code += segments[i].length;
+        }
+    }
+    closeSourceBuffer(&buffer);
+    return 0;
+}
+
+// ------x--------x----------x------------x------ BINARY OBJECT ----------------x------------x----------------x----x
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
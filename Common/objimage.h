@@ -0,0 +1,100 @@
+#ifndef OBJIMAGE_H
+#define OBJIMAGE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "loader.h"
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// ------x--------x----------x------------x------ BINARY OBJECT ----------------x------------x----------------x----x
+
+// Layout of a binary object program, the compact form of the H / T / E records:
+//
+//   object_image_header
+//   object_segment[segment_count]   address and length of each run of code
+//   unsigned char[code_size]        the code of every segment in turn, from code_offset
+//
+// Contiguous text records become one segment. A raw image (OBJECT_IMAGE_RAW)
+// is a single segment covering the whole program with the gaps zero-filled;
+// its code starts on a page boundary, so it can be mapped straight into the
+// memory of a simulator. All fields are in the byte order of the host that
+// wrote the file (checked through byte_order).
+
+#define OBJECT_IMAGE_MAGIC "SICO"
+#define OBJECT_IMAGE_VERSION 1
+#define OBJECT_IMAGE_BYTE_ORDER 0x0102
+
+// Alignment of the code of a raw image in the file
+#define OBJECT_IMAGE_PAGE_SIZE 4096
+
+// The file holds one zero-filled image instead of separate segments
+#define OBJECT_IMAGE_RAW 0x0001
+
+typedef struct {
+    char magic[4];
+    uint16_t version;
+    uint16_t byte_order;
+    char name[8];               // NUL-padded
+    int32_t start_address;
+    int32_t length;
+    int32_t entry_address;
+    uint32_t flags;
+    uint32_t segment_count;
+    uint32_t code_size;
+    uint32_t code_offset;
+    uint32_t reserved;
+} object_image_header;
+
+typedef struct {
+    int32_t address;
+    uint32_t length;
+} object_segment;
+
+// An object program in memory, in either form's terms: the header, end
+// record and code segments, with the code of all segments in one buffer
+typedef struct {
+    loaded_program program;
+    object_segment *segments;
+    int segment_count;
+    int segment_capacity;
+    unsigned char *code;
+    size_t code_size;
+    size_t code_capacity;
+} object_image;
+
+void initObjectImage(object_image *image);
+void freeObjectImage(object_image *image);
+
+// Function to tell a binary object program from a text one by its first bytes
+int isBinaryObject(const char *data, size_t size);
+
+// Function to read either form into image; returns -1 after printing why
+int readObjectImage(object_image *image, const char *data, size_t size, FILE *diagnostics);
+
+// Function to write image as a binary object program, with raw as one
+// mappable image rather than segments
+int writeBinaryObject(const object_image *image, int raw, FILE *out);
+
+// Function to write image as H / T / E records. The memory image is the
+// same as the one it was read from; the ^ between the fields of a text
+// record falls on every 3 bytes.
+int writeTextObject(const object_image *image, FILE *out);
+
+// Function to convert an object program in either form to text (format 't'),
+// binary segments ('b') or a raw image ('i')
+int convertObjectProgram(const char *data, size_t size, char format, FILE *out, FILE *diagnostics);
+
+// Function to load an object program file in either form into
+// memory[0, memory_size). Segments are copied without any parsing, and a
+// raw image whose pages line up with memory is mapped over it (private
+// copy on write) instead of read, zeroing the rest of its last page.
+// "-" reads stdin.
+int loadObjectFile(const char *path, unsigned char *memory, int memory_size, loaded_program *program,
+                   FILE *diagnostics);
+
+// ------x--------x----------x------------x------ BINARY OBJECT ----------------x------------x----------------x----x
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+
+#endif
@@ -0,0 +1,788 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "onepass.h"
+#include "ring.h"
+#include "scan.h"
+#include "stats.h"
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// ------x--------x----------x------------x------ ONE PASS ----------------x------------x----------------x----------x
+
+// A forward reference: the address bytes of an instruction (or the whole
+// word of a WORD) that refers to a label before it is defined
+typedef struct {
+    long record;    // Text record holding the instruction, counted from the first one
+    int offset;     // Where the instruction starts in the record
+    int symbol;     // Id of the label in the SYMTAB
+    int next;       // Next fixup of the same label (-1 at the end of the chain)
+    int is_word;    // A WORD, which holds any address in its 3 bytes
+} fixup;
+
+// Size of the H record, which has fixed-width fields: H^name^start^length
+#define HEADER_RECORD_SIZE 23
+
+// A block of whole source lines, filled by the reader of a pipeline
+typedef struct {
+    char *data;
+    size_t size;
+    size_t capacity;
+} source_block;
+
+// Text records the assembler of a pipeline hands to its emitter at once
+typedef struct {
+    text_record records[PIPELINE_BATCH_RECORDS];
+    int count;
+} record_batch;
+
+// The three stages of a pipelined pass and the rings between them. Blocks
+// and batches go round: the reader fills a block and the assembler gives
+// it back, the assembler fills a batch and the emitter gives it back; a
+// NULL item ends a stream.
+typedef struct {
+    int fd;
+    FILE *object_file;
+    spsc_ring blocks;           // Reader to assembler
+    spsc_ring free_blocks;      // Assembler to reader
+    spsc_ring batches;          // Assembler to emitter
+    spsc_ring free_batches;     // Emitter to assembler
+    record_batch *batch;        // Batch the assembler is filling
+    int stop;                   // Set by the assembler to stop the reader after an error
+    int read_status;
+    int emit_status;
+
+    // The object program without its text records (its H and E records),
+    // handed to the emitter with the end of the batches
+    char *object_text;
+    size_t object_size;
+} one_pass_pipeline;
+
+typedef struct {
+    program *prog;
+    pass2_state state;
+    int locctr;
+
+    // A label referred to before it is defined is added to the SYMTAB with
+    // address -1 (undefined to lookupSymbol); chains holds the first fixup of
+    // each such label by id, and fixups every reference in the order they appear
+    int *chains;
+    int chain_capacity;
+    fixup *fixups;
+    int fixup_count;
+    int fixup_capacity;
+    int unresolved;
+
+    // Finished text records that are not written yet, and how many fixups
+    // each of them (and the record being filled after them) still waits for
+    text_record_list records;
+    int *waiting;
+    int waiting_capacity;
+    long first_record;      // Number of the first record in the list
+    int written;            // Records at the front of the list already written
+
+    // Operand of END when it named a label that was not defined yet
+    char *entry_name;
+    int entry_length;
+
+    // Where the object program goes when it is kept in memory, since the
+    // length in its header record is only known at the end
+    FILE *object_file;
+
+    // Stages the ready text records go to instead (NULL without a pipeline)
+    one_pass_pipeline *pipeline;
+} one_pass;
+
+// Function to start a single pass over a program
+static void initOnePass(one_pass *pass, program *prog, FILE *object_file, one_pass_pipeline *pipeline) {
+    memset(pass, 0, sizeof(*pass));
+    pass->prog = prog;
+    pass->pipeline = pipeline;
+
+    // Records are written out as soon as they are complete, and the length is
+    // patched into the header at the end; an output that cannot seek (a pipe)
+    // gets the whole object program at the end instead. A pipeline keeps only
+    // the H and E records here, its emitter writes the text records.
+    initPass2(prog, &pass->state, !pipeline && ftell(object_file) >= 0 ? object_file : NULL);
+    pass->object_file = object_file;
+}
+
+// Function to release the memory of a single pass, and its object program
+// when it was given up before the end
+static void freeOnePass(one_pass *pass, int finished) {
+    if (!finished && pass->state.started) {
+        freeObjectWriter(&pass->state.writer);
+        if (!pass->state.object_file) free(pass->state.writer.buffer.data);
+    }
+    freeTextRecords(&pass->records);
+    free(pass->chains);
+    free(pass->fixups);
+    free(pass->waiting);
+    free(pass->entry_name);
+}
+
+// Function to make room for the fixup counts of every listed record and of
+// the record being filled
+static int reserveWaiting(one_pass *pass) {
+    int needed = pass->records.count + 1;
+    if (needed <= pass->waiting_capacity) return 0;
+
+    int new_capacity = pass->waiting_capacity ? pass->waiting_capacity * 2 : 256;
+    while (new_capacity < needed) new_capacity *= 2;
+    int *waiting = realloc(pass->waiting, new_capacity * sizeof(int));
+    if (!waiting) return -1;
+    memset(waiting + pass->waiting_capacity, 0, (new_capacity - pass->waiting_capacity) * sizeof(int));
+    pass->waiting = waiting;
+    pass->waiting_capacity = new_capacity;
+    return 0;
+}
+
+// Function to get the bytes of a record, which may still be the one being filled
+static unsigned char *getRecordBytes(one_pass *pass, long record) {
+    long index = record - pass->first_record;
+    return index < pass->records.count ? pass->records.records[index].record : pass->state.writer.record;
+}
+
+// Function to hand the batch being filled to the emitter of a pipeline
+static void sendRecordBatch(one_pass_pipeline *pipeline) {
+    if (pipeline->batch && pipeline->batch->count > 0) {
+        pushRing(&pipeline->batches, pipeline->batch);
+        pipeline->batch = NULL;
+    }
+}
+
+// Function to copy ready text records into batches for the emitter; a full
+// batch is sent at once, and the assembler waits for an empty one while
+// the emitter is behind
+static void addRecordsToBatch(one_pass_pipeline *pipeline, const text_record *records, int count) {
+    while (count > 0) {
+        if (!pipeline->batch) {
+            pipeline->batch = popRing(&pipeline->free_batches);
+        }
+        record_batch *batch = pipeline->batch;
+        int chunk = PIPELINE_BATCH_RECORDS - batch->count;
+        if (chunk > count) chunk = count;
+        memcpy(batch->records + batch->count, records, chunk * sizeof(text_record));
+        batch->count += chunk;
+        records += chunk;
+        count -= chunk;
+        if (batch->count == PIPELINE_BATCH_RECORDS) sendRecordBatch(pipeline);
+    }
+}
+
+// Function to write every record that no longer waits for a fixup, in order
+static void writeReadyRecords(one_pass *pass) {
+    text_record_list *list = &pass->records;
+    if (reserveWaiting(pass) != 0) {
+        pass->state.writer.failed = 1;
+        return;
+    }
+
+    int ready = pass->written;
+    while (ready < list->count && pass->waiting[ready] == 0) ready++;
+    if (ready > pass->written) {
+        if (pass->pipeline) {
+            addRecordsToBatch(pass->pipeline, list->records + pass->written, ready - pass->written);
+        } else {
+            writeTextRecords(&pass->state.writer.buffer, list->records + pass->written, ready - pass->written);
+        }
+        pass->written = ready;
+    }
+
+    // Once most of the list is written, the rest moves to the front
+    if (pass->written > 0 && pass->written * 2 >= list->count) {
+        int rest = list->count - pass->written;
+        memmove(list->records, list->records + pass->written, rest * sizeof(text_record));
+        memmove(pass->waiting, pass->waiting + pass->written, (rest + 1) * sizeof(int));
+        memset(pass->waiting + rest + 1, 0, pass->written * sizeof(int));
+        list->count = rest;
+        pass->first_record += pass->written;
+        pass->written = 0;
+    }
+}
+
+// Function to encode a format 3 instruction (or a WORD) whose operand is a
+// label that is not defined yet, returns 0 (and encodes nothing) for any
+// other line and -1 without memory. The label is looked up once: a defined
+// one is kept in operand_id for encodeLine, an undefined one is added as a
+// placeholder. A label defined past SIC_ADDRESS_LIMIT is treated as
+// undefined by an instruction, so it is reported at the end, in order with
+// the forward references.
+static int encodeForwardReference(program *prog, source_line *line, unsigned char *code, int *symbol) {
+    int is_word = isSymbolWord(prog->text, line);
+    if (!is_word && (line->opcode_id < 0 || optab[line->opcode_id].format != 3)) return 0;
+
+    const char *text = prog->text;
+    source_view first = line->operand, second = {line->operand.offset, 0};
+    const char *comma = is_word ? NULL : memchr(text + first.offset, ',', first.length);
+    if (comma) {
+        first.length = comma - (text + first.offset);
+        second.offset = first.offset + first.length + 1;
+        second.length = line->operand.length - first.length - 1;
+    }
+    if (first.length == 0) return 0;
+    int added;
+    int id = findOrAddToSymtab(&prog->symtab, text + first.offset, first.length, -1, &added);
+    if (id == -1) return -1;
+    int address = added ? -1 : getSymbolAddress(&prog->symtab, id);
+    if (address != -1 && (is_word || address < SIC_ADDRESS_LIMIT)) {
+        if (!is_word) line->operand_id = id;
+        return 0;
+    }
+
+    // The address stays 0 until the label is defined; the index bit is known now
+    code[0] = is_word ? 0 : optab[line->opcode_id].opcode;
+    code[1] = comma && viewEquals(text, second, "X") ? 0x80 : 0;
+    code[2] = 0;
+    *symbol = id;
+    return 1;
+}
+
+// Function to put the instruction (or WORD) just added to the record being
+// filled on the fixup chain of the label it refers to
+static int addFixup(one_pass *pass, int symbol, int is_word) {
+    int status = 0;
+    if (pass->fixup_count == pass->fixup_capacity) {
+        int new_capacity = pass->fixup_capacity ? pass->fixup_capacity * 2 : 256;
+        fixup *fixups = realloc(pass->fixups, new_capacity * sizeof(fixup));
+        if (fixups) {
+            pass->fixups = fixups;
+            pass->fixup_capacity = new_capacity;
+        } else {
+            status = -1;
+        }
+    }
+
+    // Labels added since the last fixup start with an empty chain
+    if (symbol >= pass->chain_capacity && status == 0) {
+        int new_capacity = pass->chain_capacity ? pass->chain_capacity * 2 : 256;
+        while (new_capacity <= symbol) new_capacity *= 2;
+        int *chains = realloc(pass->chains, new_capacity * sizeof(int));
+        if (chains) {
+            memset(chains + pass->chain_capacity, -1, (new_capacity - pass->chain_capacity) * sizeof(int));
+            pass->chains = chains;
+            pass->chain_capacity = new_capacity;
+        } else {
+            status = -1;
+        }
+    }
+    if (status != 0 || reserveWaiting(pass) != 0) {
+        fprintf(getDiagnostics(pass->prog), "Error: Out of memory.\n");
+        return -1;
+    }
+
+    fixup *entry = &pass->fixups[pass->fixup_count];
+    entry->record = pass->first_record + pass->records.count;
+    entry->offset = pass->state.writer.record_length - 3;
+    entry->symbol = symbol;
+    entry->is_word = is_word;
+    entry->next = pass->chains[symbol];
+    pass->chains[symbol] = pass->fixup_count++;
+
+    pass->waiting[pass->records.count]++;
+    pass->unresolved++;
+    return 0;
+}
+
+// Function to patch the address of a label that was just defined into
+// every instruction that referred to it before. An address past the reach
+// of an instruction's address field leaves it waiting, to be reported at
+// the end; a WORD takes any address.
+static void resolveFixups(one_pass *pass, int symbol, int address) {
+    if (symbol >= pass->chain_capacity) return;
+
+    for (int i = pass->chains[symbol]; i != -1; i = pass->fixups[i].next) {
+        const fixup *entry = &pass->fixups[i];
+        if (!entry->is_word && address >= SIC_ADDRESS_LIMIT) continue;
+
+        unsigned char *code = getRecordBytes(pass, entry->record) + entry->offset;
+        if (entry->is_word) code[0] = (address >> 16) & 0xFF;
+        code[1] |= (address >> 8) & 0xFF;
+        code[2] = address & 0xFF;
+        pass->waiting[entry->record - pass->first_record]--;
+        pass->unresolved--;
+    }
+    pass->chains[symbol] = -1;
+}
+
+// Function to define the label of a line, which may have been referred to
+// (and added as a placeholder) before
+static void defineOnePassLabel(one_pass *pass, source_line *line, source_view label) {
+    program *prog = pass->prog;
+    const char *name = prog->text + label.offset;
+    int added;
+    line->label_id = findOrAddToSymtab(&prog->symtab, name, label.length, line->locctr, &added);
+    if (line->label_id == -1 || added) return;
+
+    // A defined label keeps its first address, as in pass 1
+    if (getSymbolAddress(&prog->symtab, line->label_id) != -1) {
+        fprintf(getDiagnostics(prog), "Error: Duplicate symbol '%.*s'.\n", label.length, name);
+        return;
+    }
+    setSymbolAddress(&prog->symtab, line->label_id, line->locctr);
+    resolveFixups(pass, line->label_id, line->locctr);
+}
+
+// Function to remember the operand of END while it is not defined; a later
+// END, as in pass 2, replaces it
+static void noteEntryPoint(one_pass *pass, const source_line *line) {
+    const program *prog = pass->prog;
+    free(pass->entry_name);
+    pass->entry_name = NULL;
+    if (line->operand.length == 0 || lookupSymbol(prog, line->operand) != -1) return;
+
+    pass->entry_name = malloc(line->operand.length);
+    if (pass->entry_name) {
+        memcpy(pass->entry_name, prog->text + line->operand.offset, line->operand.length);
+        pass->entry_length = line->operand.length;
+    }
+}
+
+// Function to lay out, encode and emit one line
+static int assembleOnePassLine(one_pass *pass, const source_fields *fields) {
+    program *prog = pass->prog;
+
+    // Only the current line is kept
+    prog->line_count = 0;
+    source_line *line = addAddressedLine(prog, fields, &pass->locctr);
+    if (!line) return -1;
+
+    // The format of a SIC/XE instruction depends on where its operand ends up
+    if (prog->is_xe) {
+        fprintf(getDiagnostics(prog), "Error: SIC/XE addressing needs both passes: %.*s\n", fields->line.length,
+                prog->text + fields->line.offset);
+        return -1;
+    }
+
+    if (fields->label.length > 0) {
+        defineOnePassLabel(pass, line, fields->label);
+        STATS_MARK(PHASE_SYMBOL_INSERT);
+    }
+
+    unsigned char buffer[MAX_CODE_LENGTH];
+    unsigned char *code = buffer;
+    int symbol = -1;
+    int forward = 0;
+    int size = 0;
+    if (hasObjectCode(line)) {
+        forward = encodeForwardReference(prog, line, code, &symbol);
+        if (forward < 0) return -1;
+        size = forward ? 3 : encodeLineCode(prog, line, &code, &pass->state.errors);
+    }
+    STATS_MARK(PHASE_RESOLVE);
+
+    // The header is written by the first line; after it the records are collected
+    emitCode(prog, &pass->state, line, size > 0 ? code : NULL, size, -1);
+    if (!pass->state.writer.collect) collectTextRecords(&pass->state.writer, &pass->records);
+    if (code != buffer) free(code);
+    if (forward && addFixup(pass, symbol, line->opcode_id == OP_WORD) != 0) return -1;
+    if (line->opcode_id == OP_END) noteEntryPoint(pass, line);
+
+    if (pass->records.count > pass->written) writeReadyRecords(pass);
+    STATS_MARK(PHASE_EMIT);
+    return 0;
+}
+
+// Function to assemble every complete line of text[0, size)
+static int assembleOnePassText(one_pass *pass, const char *text, size_t size) {
+    source_fields fields;
+    source_scanner scanner;
+
+    pass->prog->text = text;
+    pass->prog->text_size = size;
+
+    initSourceScanner(&scanner, text, 0, size);
+    while (scanSourceLine(&scanner, &fields)) {
+        // Blank and comment lines take no space
+        if (fields.mnemonic.length == 0 && fields.label.length == 0) continue;
+        if (assembleOnePassLine(pass, &fields) != 0) return -1;
+    }
+    return 0;
+}
+
+// Function to finish the object program once the whole source is read
+static int finishOnePass(one_pass *pass) {
+    program *prog = pass->prog;
+    pass2_state *state = &pass->state;
+
+    prog->end_address = pass->locctr;
+    prog->line_count = 0;
+    if (!prog->is_start_found) {
+        fprintf(getDiagnostics(prog), "Warning: No START directive found. LOCCTR starts from 0.\n");
+    }
+    if (!state->started) {
+        return finishPass2(state);
+    }
+
+    // References to labels that were never defined, or were defined past the
+    // reach of a format 3 address, keep address 0 and are reported in the
+    // order they appear, as pass 2 does
+    breakTextRecord(&state->writer);
+    for (int i = 0; i < pass->fixup_count; i++) {
+        const fixup *entry = &pass->fixups[i];
+        int address = getSymbolAddress(&prog->symtab, entry->symbol);
+        const char *name = getSymbolName(&prog->symtab, entry->symbol);
+        if (address != -1 && (entry->is_word || address < SIC_ADDRESS_LIMIT)) continue;
+        if (address == -1) {
+            fprintf(state->diagnostics, "Error: Undefined symbol '%s'.\n", name);
+        } else {
+            fprintf(state->diagnostics, "Error: Address %06X of '%s' is out of range (over 7FFF).\n", address, name);
+        }
+        pass->waiting[entry->record - pass->first_record]--;
+        state->errors++;
+    }
+    writeReadyRecords(pass);
+    collectTextRecords(&state->writer, NULL);
+
+    if (pass->entry_name) {
+        int id = searchSymtab(&prog->symtab, pass->entry_name, pass->entry_length);
+        if (id != -1 && getSymbolAddress(&prog->symtab, id) != -1) {
+            state->entry_address = getSymbolAddress(&prog->symtab, id);
+        }
+    }
+
+    // The header gets the length pass 1 computes, from the start address to the final LOCCTR
+    state->end_address = pass->locctr - prog->start_address + state->writer.start_address;
+    int status = finishPass2(state);
+
+    // The emitter of a pipeline puts the H and E records around its text records
+    if (pass->pipeline) {
+        sendRecordBatch(pass->pipeline);
+        pass->pipeline->object_text = state->writer.buffer.data;
+        pass->pipeline->object_size = state->writer.buffer.size;
+    } else if (!state->object_file) {
+        output_buffer *buffer = &state->writer.buffer;
+        if (fwrite(buffer->data, 1, buffer->size, pass->object_file) != buffer->size) status = -1;
+        free(buffer->data);
+    }
+    return status;
+}
+
+// Function to assemble text in a single pass
+int runOnePass(program *prog, const char *text, size_t size, FILE *object_file) {
+    one_pass pass;
+    initOnePass(&pass, prog, object_file, NULL);
+
+    int status = assembleOnePassText(&pass, text, size);
+    int finished = status == 0;
+    if (finished) status = finishOnePass(&pass);
+
+    freeOnePass(&pass, finished);
+    return status;
+}
+
+// Function to assemble a source read from fd in a single pass
+int runStreamingOnePass(program *prog, int fd, FILE *object_file) {
+    size_t capacity = ONE_PASS_READ_SIZE;
+    size_t size = 0;
+    char *text = malloc(capacity);
+    if (!text) {
+        fprintf(getDiagnostics(prog), "Error: Out of memory.\n");
+        return -1;
+    }
+
+    one_pass pass;
+    initOnePass(&pass, prog, object_file, NULL);
+
+    int status = 0;
+    for (;;) {
+        // A line longer than the whole buffer makes it grow
+        if (size == capacity) {
+            char *bigger = realloc(text, capacity * 2);
+            if (!bigger) {
+                fprintf(getDiagnostics(prog), "Error: Out of memory.\n");
+                status = -1;
+                break;
+            }
+            text = bigger;
+            capacity *= 2;
+        }
+
+        ssize_t count = read(fd, text + size, capacity - size);
+        if (count < 0) {
+            perror("Error reading the source");
+            status = -1;
+            break;
+        }
+        STATS_COUNT(COUNTER_BYTES_READ, count);
+        if (count == 0) {
+            // The last line may have no newline
+            status = assembleOnePassText(&pass, text, size);
+            break;
+        }
+        size += count;
+
+        // Assemble the complete lines; the start of the next one moves to the front
+        const char *last = memrchr(text, '\n', size);
+        if (!last) continue;
+        size_t complete = last - text + 1;
+        status = assembleOnePassText(&pass, text, complete);
+        if (status != 0) break;
+        memmove(text, text + complete, size - complete);
+        size -= complete;
+    }
+
+    int finished = status == 0;
+    if (finished) status = finishOnePass(&pass);
+
+    // Nothing refers into the text any more
+    prog->text = NULL;
+    prog->text_size = 0;
+    freeOnePass(&pass, finished);
+    free(text);
+    return status;
+}
+
+// Function to make room for at least needed bytes in a block
+static int reserveBlock(source_block *block, size_t needed) {
+    if (needed <= block->capacity) return 0;
+    size_t capacity = block->capacity ? block->capacity : ONE_PASS_READ_SIZE;
+    while (capacity < needed) capacity *= 2;
+    char *data = realloc(block->data, capacity);
+    if (!data) {
+        fprintf(stderr, "Error: Out of memory.\n");
+        return -1;
+    }
+    block->data = data;
+    block->capacity = capacity;
+    return 0;
+}
+
+// Reader stage: fills blocks with whole lines from the source and passes
+// them on. Only PIPELINE_BLOCKS blocks exist, so the reader waits for the
+// assembler to give one back when it is that far ahead.
+static void *readPipelineSource(void *context) {
+    one_pass_pipeline *pipeline = context;
+    source_block carry = {NULL, 0, 0};   // Start of a line cut off at the end of a block
+    int allocated = 0;
+    int status = 0;
+    int done = 0;
+
+    while (!done && !__atomic_load_n(&pipeline->stop, __ATOMIC_RELAXED)) {
+        source_block *block;
+        if (allocated < PIPELINE_BLOCKS) {
+            block = calloc(1, sizeof(source_block));
+            if (!block) {
+                fprintf(stderr, "Error: Out of memory.\n");
+                status = -1;
+                break;
+            }
+            allocated++;
+        } else {
+            block = popRing(&pipeline->free_blocks);
+        }
+
+        block->size = 0;
+        if (reserveBlock(block, carry.size + ONE_PASS_READ_SIZE) != 0) {
+            pushRing(&pipeline->blocks, block);
+            status = -1;
+            break;
+        }
+        if (carry.size > 0) memcpy(block->data, carry.data, carry.size);
+        block->size = carry.size;
+        carry.size = 0;
+
+        // Read until the block holds a whole line; a line longer than the block makes it grow
+        for (;;) {
+            if (block->size == block->capacity && reserveBlock(block, block->capacity * 2) != 0) {
+                status = -1;
+                done = 1;
+                break;
+            }
+            ssize_t count = read(pipeline->fd, block->data + block->size, block->capacity - block->size);
+            if (count < 0 && errno == EINTR) continue;
+            if (count < 0) {
+                perror("Error reading the source");
+                status = -1;
+            }
+            if (count <= 0) {
+                // The last line may have no newline
+                done = 1;
+                break;
+            }
+            STATS_COUNT(COUNTER_BYTES_READ, count);
+            block->size += count;
+            if (memchr(block->data + block->size - count, '\n', count)) break;
+        }
+
+        // The start of the next line moves to the next block
+        if (!done) {
+            const char *last = memrchr(block->data, '\n', block->size);
+            size_t complete = last - block->data + 1;
+            if (reserveBlock(&carry, block->size - complete) != 0) {
+                status = -1;
+                done = 1;
+            } else {
+                carry.size = block->size - complete;
+                if (carry.size > 0) memcpy(carry.data, block->data + complete, carry.size);
+                block->size = complete;
+            }
+        }
+        pushRing(&pipeline->blocks, block);
+    }
+
+    pipeline->read_status = status;
+    pushRing(&pipeline->blocks, NULL);
+    free(carry.data);
+    return NULL;
+}
+
+// Function to copy what was spilled to a temporary file to the object file
+static int copySpilledRecords(FILE *spill, FILE *object_file) {
+    char buffer[64 * 1024];
+    if (fflush(spill) != 0 || fseek(spill, 0, SEEK_SET) != 0) return -1;
+    size_t count;
+    while ((count = fread(buffer, 1, sizeof(buffer), spill)) > 0) {
+        if (fwrite(buffer, 1, count, object_file) != count) return -1;
+    }
+    return ferror(spill) ? -1 : 0;
+}
+
+// Emitter stage: formats the text records of every batch and writes them.
+// The length in the H record is only known once the source has ended, so
+// a file gets room for the H record ahead of the text records and has it
+// written there at the end; a pipe, which cannot seek, gets the text
+// records spilled to a temporary file and copied after the H record.
+static void *emitPipelineRecords(void *context) {
+    one_pass_pipeline *pipeline = context;
+    FILE *object_file = pipeline->object_file;
+    int seekable = ftell(object_file) >= 0;
+    long header_position = -1;
+    FILE *target = NULL;
+    output_buffer out;
+    int status = 0;
+
+    record_batch *batch;
+    while ((batch = popRing(&pipeline->batches)) != NULL) {
+        if (!target && status == 0) {
+            if (seekable) {
+                header_position = ftell(object_file);
+                fprintf(object_file, "%*s", HEADER_RECORD_SIZE, "");
+                target = object_file;
+            } else {
+                target = tmpfile();
+                if (!target) {
+                    perror("tmpfile");
+                    status = -1;
+                }
+            }
+            if (target) initOutputBuffer(&out, target);
+        }
+        if (target) writeTextRecords(&out, batch->records, batch->count);
+        batch->count = 0;
+        pushRing(&pipeline->free_batches, batch);
+    }
+    if (target && closeOutputBuffer(&out) != 0) status = -1;
+
+    // Nothing is left to put around the text records when the assembler failed
+    const char *text = pipeline->object_text;
+    size_t size = pipeline->object_size;
+    const char *newline = text ? memchr(text, '\n', size) : NULL;
+    size_t header_size = newline ? (size_t)(newline - text + 1) : 0;
+    if (status == 0 && text) {
+        if (!target) {
+            if (fwrite(text, 1, size, object_file) != size) status = -1;
+        } else if (seekable) {
+            long end_position = ftell(object_file);
+            if (header_size != HEADER_RECORD_SIZE || fseek(object_file, header_position, SEEK_SET) != 0) {
+                fprintf(stderr, "Error: Cannot write the header record.\n");
+                status = -1;
+            } else {
+                fwrite(text, 1, header_size, object_file);
+                fseek(object_file, end_position, SEEK_SET);
+                fwrite(text + header_size, 1, size - header_size, object_file);
+            }
+        } else {
+            fwrite(text, 1, header_size, object_file);
+            if (copySpilledRecords(target, object_file) != 0) status = -1;
+            fwrite(text + header_size, 1, size - header_size, object_file);
+        }
+    }
+    if (target && target != object_file) fclose(target);
+    if (ferror(object_file)) status = -1;
+    pipeline->emit_status = status;
+    return NULL;
+}
+
+// Function to assemble a source read from fd in a single pass, pipelined
+int runPipelinedOnePass(program *prog, int fd, FILE *object_file) {
+    one_pass_pipeline pipeline;
+    memset(&pipeline, 0, sizeof(pipeline));
+    pipeline.fd = fd;
+    pipeline.object_file = object_file;
+    initRing(&pipeline.blocks);
+    initRing(&pipeline.free_blocks);
+    initRing(&pipeline.batches);
+    initRing(&pipeline.free_batches);
+
+    // Every batch there is starts out empty, on the emitter's side
+    record_batch *batches[PIPELINE_BATCHES];
+    int batch_count = 0;
+    for (; batch_count < PIPELINE_BATCHES; batch_count++) {
+        batches[batch_count] = malloc(sizeof(record_batch));
+        if (!batches[batch_count]) break;
+        batches[batch_count]->count = 0;
+        pushRing(&pipeline.free_batches, batches[batch_count]);
+    }
+
+    pthread_t reader, emitter;
+    int status = batch_count == PIPELINE_BATCHES ? 0 : -1;
+    int reader_started = status == 0 && pthread_create(&reader, NULL, readPipelineSource, &pipeline) == 0;
+    int emitter_started = reader_started && pthread_create(&emitter, NULL, emitPipelineRecords, &pipeline) == 0;
+    if (!emitter_started) {
+        fprintf(getDiagnostics(prog), "Error: Cannot start the pipeline.\n");
+        status = -1;
+        __atomic_store_n(&pipeline.stop, 1, __ATOMIC_RELAXED);
+    }
+
+    // Assembler stage, on this thread: tokenizes, lays out and encodes every
+    // block, and gives it back to the reader
+    one_pass pass;
+    initOnePass(&pass, prog, object_file, &pipeline);
+    source_block *block;
+    while (reader_started && (block = popRing(&pipeline.blocks)) != NULL) {
+        if (status == 0) {
+            status = assembleOnePassText(&pass, block->data, block->size);
+            sendRecordBatch(&pipeline);
+        }
+        if (status != 0) __atomic_store_n(&pipeline.stop, 1, __ATOMIC_RELAXED);
+        pushRing(&pipeline.free_blocks, block);
+    }
+    if (pipeline.read_status != 0) status = -1;
+
+    int finished = status == 0;
+    if (finished) status = finishOnePass(&pass);
+    prog->text = NULL;
+    prog->text_size = 0;
+
+    if (emitter_started) {
+        // A batch left over after an error is not written
+        if (pipeline.batch) pipeline.batch->count = 0;
+        sendRecordBatch(&pipeline);
+        pushRing(&pipeline.batches, NULL);
+        pthread_join(emitter, NULL);
+        if (pipeline.emit_status != 0) status = -1;
+    }
+    if (reader_started) pthread_join(reader, NULL);
+
+    // Every block is back on the free ring once the reader has stopped
+    void *item;
+    while (tryPopRing(&pipeline.free_blocks, &item)) {
+        source_block *free_block = item;
+        free(free_block->data);
+        free(free_block);
+    }
+    for (int i = 0; i < batch_count; i++) {
+        free(batches[i]);
+    }
+    freeOnePass(&pass, finished);
+    free(pipeline.object_text);
+    return status;
+}
+
+// ------x--------x----------x------------x------ ONE PASS ----------------x------------x----------------x----------x
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
@@ -0,0 +1,48 @@
+#ifndef ONEPASS_H
+#define ONEPASS_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include "program.h"
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// ------x--------x----------x------------x------ ONE PASS ----------------x------------x----------------x----------x
+
+// Bytes of source read at a time when streaming
+#define ONE_PASS_READ_SIZE (256 * 1024)
+
+// Function to assemble text in a single pass, writing the object program
+// as it goes. Every line is encoded as soon as it is laid out; an operand
+// that refers to a label defined later is encoded with address 0 and put
+// on that label's fixup chain, which is patched when the label is defined.
+// Text records are written once no record before them waits for a fixup.
+// The object program is byte-identical to runPass1() + runPass2(). Lines
+// are not kept, so prog only holds the SYMTAB and OPTAB afterwards; labels
+// that were referred to but never defined are in it with address -1.
+int runOnePass(program *prog, const char *text, size_t size, FILE *object_file);
+
+// Function to assemble a source read from fd (a pipe, stdin) in a single
+// pass, one block of lines at a time, without holding the whole source
+int runStreamingOnePass(program *prog, int fd, FILE *object_file);
+
+// Blocks of source in flight between the reader and the assembler of a
+// pipelined pass, and batches of text records between the assembler and
+// the emitter; they bound its memory whatever the size of the source
+#define PIPELINE_BLOCKS 8
+#define PIPELINE_BATCHES 8
+#define PIPELINE_BATCH_RECORDS 512
+
+// Function to assemble a source read from fd in a single pass on three
+// threads: a reader that fills blocks of whole lines, the assembler (this
+// thread) that tokenizes, sizes and encodes them, and an emitter that
+// formats and writes the text records. The stages pass blocks and batches
+// through bounded single-producer / single-consumer rings, so reading,
+// assembling and writing overlap, and a stage that gets ahead waits for
+// the next one. The object program is the same as runStreamingOnePass().
+int runPipelinedOnePass(program *prog, int fd, FILE *object_file);
+
+// ------x--------x----------x------------x------ ONE PASS ----------------x------------x----------------x----------x
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+
+#endif
@@ -0,0 +1,81 @@
+#include <stdint.h>
+
+#include "optab.h"
+#include "optab_hash.h"
+#include "stats.h"
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// ------x--------x----------x------------x------ OPTAB ----------------x------------x----------------x-----------x
+
+_Static_assert(OPTAB_HASH_ENTRIES == OPTAB_COUNT, "optab_hash.h is out of date, rerun Tools/gen_optab");
+
+// Opcode and format of every instruction as constants, so aliases can refer to them
+enum {
+#define OPCODE(name, opcode, format) OPCODE_##name = opcode, FORMAT_##name = format,
+#define ALIAS(name, target)
+#define DIRECTIVE(name)
+#include "optab.def"
+#undef OPCODE
+#undef ALIAS
+#undef DIRECTIVE
+};
+
+// Predefined opcode table
+const optab_entry optab[OPTAB_COUNT] = {
+#define OPCODE(name, opcode, format) [OP_##name] = {#name, opcode, format, format},
+#define ALIAS(name, target) [OP_##name] = {#name, OPCODE_##target, FORMAT_##target, FORMAT_##target},
+#define DIRECTIVE(name) [OP_##name] = {#name, -1, 0, 0},
+#include "optab.def"
+#undef OPCODE
+#undef ALIAS
+#undef DIRECTIVE
+};
+
+// Function to pack a mnemonic of up to 8 characters into a key
+// (must match packMnemonic() in Tools/gen_optab.c)
+static inline uint64_t packMnemonic(const char *mnemonic, int length) {
+    uint64_t key = 0;
+    for (int i = 0; i < length; i++) {
+        key |= (uint64_t)(unsigned char)mnemonic[i] << (8 * i);
+    }
+    return key;
+}
+
+// Function to get the optab_id for a given mnemonic from the perfect hash
+int searchOptab(const char *mnemonic, int length) {
+    STATS_COUNT(COUNTER_OPCODE_LOOKUPS, 1);
+    if (length <= 0 || length > 8) {
+        STATS_COUNT(COUNTER_OPCODE_MISSES, 1);
+        return -1;
+    }
+
+    uint64_t key = packMnemonic(mnemonic, length);
+    int id = optab_hash_slots[(key * OPTAB_HASH_MULTIPLIER) >> OPTAB_HASH_SHIFT];
+
+    // Every mnemonic has its own slot, so one compare confirms the match
+    if (id == -1 || optab_hash_keys[id] != key) {
+        STATS_COUNT(COUNTER_OPCODE_MISSES, 1);
+        return -1;
+    }
+    return id;
+}
+
+// Function to find the instruction with a given machine opcode. Two
+// instructions with the same opcode give duplicate case labels, so a
+// conflicting optab.def does not compile.
+int searchOpcode(int opcode) {
+    switch (opcode) {
+#define OPCODE(name, opcode, format) case opcode: return OP_##name;
+#define ALIAS(name, target)
+#define DIRECTIVE(name)
+#include "optab.def"
+#undef OPCODE
+#undef ALIAS
+#undef DIRECTIVE
+    default:
+        return -1;
+    }
+}
+
+// ------x--------x----------x------------x------ OPTAB ----------------x------------x----------------x-----------x
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
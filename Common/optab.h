@@ -0,0 +1,39 @@
+#ifndef OPTAB_H
+#define OPTAB_H
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// ------x--------x----------x------------x------ OPTAB ----------------x------------x----------------x-----------x
+
+// One id per mnemonic in optab.def (OP_LDA, OP_START, ...)
+typedef enum {
+#define OPCODE(name, opcode, format) OP_##name,
+#define ALIAS(name, target) OP_##name,
+#define DIRECTIVE(name) OP_##name,
+#include "optab.def"
+#undef OPCODE
+#undef ALIAS
+#undef DIRECTIVE
+    OPTAB_COUNT
+} optab_id;
+
+// Structure for each opcode entry
+typedef struct {
+    const char *mnemonic;
+    int opcode;     // Machine opcode, -1 for directives
+    int format;     // SIC/XE instruction format (1, 2 or 3), 0 for directives
+    int size;       // Bytes of object code for the instruction, 0 for directives
+} optab_entry;
+
+// The OPTAB itself, indexed by optab_id and compiled into every program
+extern const optab_entry optab[OPTAB_COUNT];
+
+// Function to find a mnemonic, returns its optab_id or -1 if it is unknown
+int searchOptab(const char *mnemonic, int length);
+
+// Function to find the instruction with a given machine opcode, or -1
+int searchOpcode(int opcode);
+
+// ------x--------x----------x------------x------ OPTAB ----------------x------------x----------------x-----------x
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+
+#endif
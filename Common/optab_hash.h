@@ -0,0 +1,343 @@
+// Generated by Tools/gen_optab from Common/optab.def, do not edit.
+
+#define OPTAB_HASH_ENTRIES 76
+#define OPTAB_HASH_MULTIPLIER 0x01092EB9D1494E2Bull
+#define OPTAB_HASH_SHIFT 56
+
+static const uint64_t optab_hash_keys[OPTAB_COUNT] = {
+    [OP_LDA] = 0x000000000041444Cull,
+    [OP_LDX] = 0x000000000058444Cull,
+    [OP_LDL] = 0x00000000004C444Cull,
+    [OP_STA] = 0x0000000000415453ull,
+    [OP_STX] = 0x0000000000585453ull,
+    [OP_STL] = 0x00000000004C5453ull,
+    [OP_LDCH] = 0x000000004843444Cull,
+    [OP_STCH] = 0x0000000048435453ull,
+    [OP_STSW] = 0x0000000057535453ull,
+    [OP_ADD] = 0x0000000000444441ull,
+    [OP_SUB] = 0x0000000000425553ull,
+    [OP_MUL] = 0x00000000004C554Dull,
+    [OP_DIV] = 0x0000000000564944ull,
+    [OP_COMP] = 0x00000000504D4F43ull,
+    [OP_TIX] = 0x0000000000584954ull,
+    [OP_AND] = 0x0000000000444E41ull,
+    [OP_OR] = 0x000000000000524Full,
+    [OP_J] = 0x000000000000004Aull,
+    [OP_JEQ] = 0x000000000051454Aull,
+    [OP_JGT] = 0x000000000054474Aull,
+    [OP_JLT] = 0x0000000000544C4Aull,
+    [OP_JSUB] = 0x000000004255534Aull,
+    [OP_RSUB] = 0x0000000042555352ull,
+    [OP_TD] = 0x0000000000004454ull,
+    [OP_RD] = 0x0000000000004452ull,
+    [OP_WD] = 0x0000000000004457ull,
+    [OP_LDB] = 0x000000000042444Cull,
+    [OP_LDS] = 0x000000000053444Cull,
+    [OP_LDT] = 0x000000000054444Cull,
+    [OP_LDF] = 0x000000000046444Cull,
+    [OP_STB] = 0x0000000000425453ull,
+    [OP_STS] = 0x0000000000535453ull,
+    [OP_STT] = 0x0000000000545453ull,
+    [OP_STF] = 0x0000000000465453ull,
+    [OP_STI] = 0x0000000000495453ull,
+    [OP_ADDF] = 0x0000000046444441ull,
+    [OP_SUBF] = 0x0000000046425553ull,
+    [OP_MULF] = 0x00000000464C554Dull,
+    [OP_DIVF] = 0x0000000046564944ull,
+    [OP_COMPF] = 0x00000046504D4F43ull,
+    [OP_LPS] = 0x000000000053504Cull,
+    [OP_SSK] = 0x00000000004B5353ull,
+    [OP_RMO] = 0x00000000004F4D52ull,
+    [OP_CLEAR] = 0x0000005241454C43ull,
+    [OP_TIXR] = 0x0000000052584954ull,
+    [OP_ADDR] = 0x0000000052444441ull,
+    [OP_SUBR] = 0x0000000052425553ull,
+    [OP_MULR] = 0x00000000524C554Dull,
+    [OP_DIVR] = 0x0000000052564944ull,
+    [OP_COMPR] = 0x00000052504D4F43ull,
+    [OP_SHIFTL] = 0x00004C5446494853ull,
+    [OP_SHIFTR] = 0x0000525446494853ull,
+    [OP_SVC] = 0x0000000000435653ull,
+    [OP_FIX] = 0x0000000000584946ull,
+    [OP_FLOAT] = 0x00000054414F4C46ull,
+    [OP_NORM] = 0x000000004D524F4Eull,
+    [OP_SIO] = 0x00000000004F4953ull,
+    [OP_HIO] = 0x00000000004F4948ull,
+    [OP_TIO] = 0x00000000004F4954ull,
+    [OP_JMP] = 0x0000000000504D4Aull,
+    [OP_BR] = 0x0000000000005242ull,
+    [OP_JSR] = 0x000000000052534Aull,
+    [OP_RET] = 0x0000000000544552ull,
+    [OP_START] = 0x0000005452415453ull,
+    [OP_END] = 0x0000000000444E45ull,
+    [OP_BYTE] = 0x0000000045545942ull,
+    [OP_WORD] = 0x0000000044524F57ull,
+    [OP_RESB] = 0x0000000042534552ull,
+    [OP_RESW] = 0x0000000057534552ull,
+    [OP_CSECT] = 0x0000005443455343ull,
+    [OP_BASE] = 0x0000000045534142ull,
+    [OP_NOBASE] = 0x0000455341424F4Eull,
+    [OP_EXTDEF] = 0x0000464544545845ull,
+    [OP_EXTREF] = 0x0000464552545845ull,
+    [OP_MACRO] = 0x0000004F5243414Dull,
+    [OP_MEND] = 0x00000000444E454Dull,
+};
+
+static const signed char optab_hash_slots[256] = {
+    OP_SSK,
+    OP_NORM,
+    -1,
+    -1,
+    -1,
+    OP_TIX,
+    -1,
+    -1,
+    -1,
+    -1,
+    OP_MULF,
+    -1,
+    -1,
+    -1,
+    -1,
+    -1,
+    -1,
+    -1,
+    -1,
+    -1,
+    OP_LDT,
+    -1,
+    -1,
+    -1,
+    -1,
+    -1,
+    OP_RESW,
+    -1,
+    OP_DIVR,
+    OP_ADD,
+    -1,
+    -1,
+    OP_STF,
+    -1,
+    -1,
+    OP_RET,
+    -1,
+    OP_CSECT,
+    -1,
+    -1,
+    -1,
+    -1,
+    -1,
+    -1,
+    -1,
+    OP_JGT,
+    -1,
+    -1,
+    -1,
+    -1,
+    -1,
+    -1,
+    OP_SHIFTR,
+    OP_BR,
+    OP_STA,
+    -1,
+    OP_STL,
+    -1,
+    OP_COMP,
+    OP_MUL,
+    OP_LDCH,
+    OP_SUBF,
+    OP_JSR,
+    -1,
+    -1,
+    -1,
+    OP_OR,
+    OP_COMPR,
+    -1,
+    -1,
+    -1,
+    OP_FLOAT,
+    -1,
+    -1,
+    -1,
+    -1,
+    OP_J,
+    -1,
+    -1,
+    -1,
+    -1,
+    -1,
+    -1,
+    OP_LPS,
+    OP_HIO,
+    -1,
+    -1,
+    -1,
+    -1,
+    -1,
+    -1,
+    OP_JLT,
+    -1,
+    -1,
+    -1,
+    OP_SIO,
+    OP_TIO,
+    OP_MEND,
+    -1,
+    -1,
+    -1,
+    OP_STB,
+    OP_DIVF,
+    OP_START,
+    -1,
+    OP_STX,
+    -1,
+    -1,
+    -1,
+    -1,
+    OP_SUB,
+    -1,
+    -1,
+    -1,
+    -1,
+    -1,
+    OP_COMPF,
+    -1,
+    -1,
+    -1,
+    OP_AND,
+    -1,
+    -1,
+    -1,
+    OP_SHIFTL,
+    OP_END,
+    -1,
+    OP_STS,
+    -1,
+    -1,
+    OP_WORD,
+    OP_RMO,
+    -1,
+    OP_LDF,
+    -1,
+    -1,
+    -1,
+    -1,
+    OP_TIXR,
+    -1,
+    -1,
+    -1,
+    -1,
+    OP_JEQ,
+    -1,
+    -1,
+    -1,
+    -1,
+    OP_EXTDEF,
+    -1,
+    -1,
+    OP_DIV,
+    -1,
+    -1,
+    -1,
+    -1,
+    OP_LDA,
+    -1,
+    OP_LDL,
+    -1,
+    -1,
+    -1,
+    OP_ADDR,
+    -1,
+    -1,
+    OP_STSW,
+    OP_SVC,
+    -1,
+    -1,
+    OP_JMP,
+    -1,
+    -1,
+    OP_STI,
+    -1,
+    OP_STT,
+    -1,
+    -1,
+    -1,
+    OP_JSUB,
+    -1,
+    -1,
+    -1,
+    -1,
+    -1,
+    -1,
+    -1,
+    OP_RSUB,
+    -1,
+    -1,
+    OP_EXTREF,
+    -1,
+    -1,
+    OP_MULR,
+    -1,
+    -1,
+    -1,
+    -1,
+    OP_RD,
+    -1,
+    OP_TD,
+    -1,
+    -1,
+    OP_WD,
+    OP_LDB,
+    -1,
+    -1,
+    OP_CLEAR,
+    OP_LDX,
+    -1,
+    -1,
+    -1,
+    -1,
+    OP_BASE,
+    -1,
+    OP_STCH,
+    -1,
+    -1,
+    -1,
+    -1,
+    -1,
+    OP_RESB,
+    -1,
+    -1,
+    OP_BYTE,
+    -1,
+    -1,
+    -1,
+    -1,
+    -1,
+    OP_LDS,
+    -1,
+    -1,
+    -1,
+    -1,
+    -1,
+    -1,
+    OP_ADDF,
+    -1,
+    -1,
+    -1,
+    -1,
+    -1,
+    -1,
+    OP_SUBR,
+    -1,
+    -1,
+    OP_FIX,
+    -1,
+    -1,
+    OP_MACRO,
+    -1,
+    -1,
+    -1,
+    OP_NOBASE,
+    -1,
+    -1,
+};
@@ -0,0 +1,170 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "output.h"
+#include "stats.h"
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// ------x--------x----------x------------x------ OUTPUT BUFFER ----------------x------------x----------------x-----x
+
+static const char hex_digits[16] = "0123456789ABCDEF";
+
+// Two hex digits for every byte value: "000102...FEFF"
+#define HEX_ROW(high) high "0" high "1" high "2" high "3" high "4" high "5" high "6" high "7" \
+                      high "8" high "9" high "A" high "B" high "C" high "D" high "E" high "F"
+static const char hex_pairs[512] =
+    HEX_ROW("0") HEX_ROW("1") HEX_ROW("2") HEX_ROW("3") HEX_ROW("4") HEX_ROW("5") HEX_ROW("6") HEX_ROW("7")
+    HEX_ROW("8") HEX_ROW("9") HEX_ROW("A") HEX_ROW("B") HEX_ROW("C") HEX_ROW("D") HEX_ROW("E") HEX_ROW("F");
+
+static const char spaces[64] = "                                                                ";
+
+// Function to start a buffer for file (NULL to collect in memory)
+void initOutputBuffer(output_buffer *out, FILE *file) {
+    memset(out, 0, sizeof(*out));
+    out->file = file;
+}
+
+// Function to make the buffer big enough for length more bytes
+static int growOutputBuffer(output_buffer *out, size_t length) {
+    size_t capacity = out->capacity ? out->capacity : (out->file ? OUTPUT_BUFFER_SIZE : 4096);
+    while (capacity < out->size + length) capacity *= 2;
+
+    char *data = realloc(out->data, capacity);
+    if (!data) {
+        out->failed = 1;
+        return -1;
+    }
+    out->data = data;
+    out->capacity = capacity;
+    STATS_PEAK(PEAK_OUTPUT_BUFFER, capacity);
+    return 0;
+}
+
+// Function to get room for length more bytes at the end of the buffer,
+// flushing a file buffer that is full. Returns NULL if out of memory.
+static char *reserveOutput(output_buffer *out, size_t length) {
+    if (out->size + length > out->capacity) {
+        if (out->file && out->size > 0) flushOutputBuffer(out);
+        if (out->size + length > out->capacity && growOutputBuffer(out, length) != 0) {
+            return NULL;
+        }
+    }
+    return out->data + out->size;
+}
+
+// Function to append raw bytes
+void appendBytes(output_buffer *out, const char *bytes, size_t length) {
+    // Large blocks going to a file are not copied through the buffer
+    if (out->file && length >= OUTPUT_BUFFER_SIZE) {
+        flushOutputBuffer(out);
+        if (fwrite(bytes, 1, length, out->file) != length) out->failed = 1;
+        out->flushed += length;
+        STATS_COUNT(COUNTER_BYTES_WRITTEN, length);
+        return;
+    }
+
+    char *p = reserveOutput(out, length);
+    if (!p) return;
+    memcpy(p, bytes, length);
+    out->size += length;
+}
+
+void appendChar(output_buffer *out, char ch) {
+    char *p = reserveOutput(out, 1);
+    if (!p) return;
+    *p = ch;
+    out->size++;
+}
+
+void appendString(output_buffer *out, const char *string) {
+    appendBytes(out, string, strlen(string));
+}
+
+// Function to append padding spaces
+static void appendSpaces(output_buffer *out, size_t count) {
+    while (count > 0) {
+        size_t length = count < sizeof(spaces) ? count : sizeof(spaces);
+        appendBytes(out, spaces, length);
+        count -= length;
+    }
+}
+
+// Function to append text left-justified in a field of width (like %-*.*s)
+void appendField(output_buffer *out, const char *text, size_t length, int width) {
+    appendBytes(out, text, length);
+    if ((size_t)width > length) appendSpaces(out, width - length);
+}
+
+// Function to get the number of hex digits of a number (at least 1)
+static int countHexDigits(unsigned int value) {
+    int count = 1;
+    while (value >>= 4) count++;
+    return count;
+}
+
+// Function to format exactly digits hex digits of a number
+void formatHex(char *dest, unsigned int value, int digits) {
+    for (int i = digits - 1; i >= 0; i--) {
+        dest[i] = hex_digits[value & 0xF];
+        value >>= 4;
+    }
+}
+
+// Function to format bytes as two hex digits each
+void formatHexBytes(char *dest, const unsigned char *bytes, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        memcpy(dest + 2 * i, hex_pairs + 2 * bytes[i], 2);
+    }
+}
+
+// Function to append a number in upper case hex with at least digits digits
+void appendHex(output_buffer *out, unsigned int value, int digits) {
+    int count = countHexDigits(value);
+    if (count < digits) count = digits;
+
+    char *p = reserveOutput(out, count);
+    if (!p) return;
+    formatHex(p, value, count);
+    out->size += count;
+}
+
+// Function to append a hex number left-justified in a field of width
+void appendHexField(output_buffer *out, unsigned int value, int width) {
+    int count = countHexDigits(value);
+    appendHex(out, value, count);
+    if (width > count) appendSpaces(out, width - count);
+}
+
+// Function to append bytes as two hex digits each
+void appendHexBytes(output_buffer *out, const unsigned char *bytes, size_t count) {
+    char *p = reserveOutput(out, count * 2);
+    if (!p) return;
+    formatHexBytes(p, bytes, count);
+    out->size += count * 2;
+}
+
+// Function to hand the buffered bytes to the file
+int flushOutputBuffer(output_buffer *out) {
+    if (out->file && out->size > 0) {
+        if (fwrite(out->data, 1, out->size, out->file) != out->size) out->failed = 1;
+        out->flushed += out->size;
+        STATS_COUNT(COUNTER_BYTES_WRITTEN, out->size);
+        out->size = 0;
+    }
+    return out->failed ? -1 : 0;
+}
+
+// Function to flush and release the buffer
+int closeOutputBuffer(output_buffer *out) {
+    int status = flushOutputBuffer(out);
+    if (out->file) {
+        free(out->data);
+        out->data = NULL;
+        out->size = out->capacity = 0;
+    }
+    return status;
+}
+
+// ------x--------x----------x------------x------ OUTPUT BUFFER ----------------x------------x----------------x-----x
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
@@ -0,0 +1,63 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// ------x--------x----------x------------x------ OUTPUT BUFFER ----------------x------------x----------------x-----x
+
+// Bytes gathered before they are handed to the file in one write
+#define OUTPUT_BUFFER_SIZE (256 * 1024)
+
+// Output gathered in a large buffer and written to a file in big blocks,
+// so a listing or an object program takes a handful of write calls
+// instead of one stdio call per field. Numbers are formatted with lookup
+// tables rather than printf. Without a file the buffer simply grows and
+// keeps everything in memory.
+typedef struct {
+    FILE *file;         // NULL to keep the output in memory
+    char *data;
+    size_t size;
+    size_t capacity;
+    size_t flushed;     // Bytes already handed to the file
+    int failed;
+} output_buffer;
+
+// Function to start a buffer for file (NULL to collect in memory)
+void initOutputBuffer(output_buffer *out, FILE *file);
+
+// Functions to append raw bytes
+void appendBytes(output_buffer *out, const char *bytes, size_t length);
+void appendChar(output_buffer *out, char ch);
+void appendString(output_buffer *out, const char *string);
+
+// Function to append text left-justified in a field of width (like %-*.*s)
+void appendField(output_buffer *out, const char *text, size_t length, int width);
+
+// Function to append a number in upper case hex with at least digits
+// digits (like %0*X)
+void appendHex(output_buffer *out, unsigned int value, int digits);
+
+// Function to append a hex number left-justified in a field of width (like %-*X)
+void appendHexField(output_buffer *out, unsigned int value, int width);
+
+// Function to append bytes as two hex digits each (like %02X per byte)
+void appendHexBytes(output_buffer *out, const unsigned char *bytes, size_t count);
+
+// Functions to format hex straight into memory: exactly digits digits of a
+// number, and two digits per byte (2 * count characters)
+void formatHex(char *dest, unsigned int value, int digits);
+void formatHexBytes(char *dest, const unsigned char *bytes, size_t count);
+
+// Function to hand the buffered bytes to the file, returns -1 on errors
+int flushOutputBuffer(output_buffer *out);
+
+// Function to flush and release the buffer, returns -1 if anything failed.
+// A memory buffer keeps its data, which the caller then frees.
+int closeOutputBuffer(output_buffer *out);
+
+// ------x--------x----------x------------x------ OUTPUT BUFFER ----------------x------------x----------------x-----x
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+
+#endif
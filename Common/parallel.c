@@ -0,0 +1,476 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "parallel.h"
+#include "pool.h"
+#include "relax.h"
+#include "scan.h"
+#include "stats.h"
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// ------x--------x----------x------------x------ PARALLEL PASS 1 ----------------x------------x---------------x---x
+
+// Pass 2 chunks hold at least this many lines
+#define MIN_PARALLEL_CHUNK_LINES 4096
+
+// Label of a line of a chunk, defined in the SYMTAB when the chunks are merged
+typedef struct {
+    int line;               // Index of the line in the chunk
+    unsigned int hash;
+    source_view name;
+} chunk_label;
+
+// A range of the source, tokenized and sized on its own
+typedef struct {
+    size_t begin;
+    size_t end;
+
+    program prog;           // Lines of the chunk and the OPTAB ids they use
+    chunk_label *labels;
+    int label_count;
+    int label_capacity;
+
+    int relative_count;     // Lines before the first START, addressed from 0
+    int locctr;             // LOCCTR after the chunk (from 0 unless it has a START)
+    int line_base;          // Index of the first line of the chunk in the program
+    int line_count;
+    int base;               // LOCCTR at the beginning of the chunk
+    int status;
+
+    char *diagnostics;
+    size_t diagnostics_size;
+} pass1_chunk;
+
+typedef struct {
+    program *prog;
+    const char *text;
+    pass1_chunk *chunks;
+} pass1_job;
+
+// Function to remember the label of the last line of a chunk
+static int addChunkLabel(pass1_chunk *chunk, const char *text, source_view name) {
+    if (chunk->label_count == chunk->label_capacity) {
+        int new_capacity = chunk->label_capacity ? chunk->label_capacity * 2 : 256;
+        chunk_label *labels = realloc(chunk->labels, new_capacity * sizeof(chunk_label));
+        if (!labels) return -1;
+        chunk->labels = labels;
+        chunk->label_capacity = new_capacity;
+    }
+
+    chunk_label *label = &chunk->labels[chunk->label_count++];
+    label->line = chunk->prog.line_count - 1;
+    label->hash = hashSymbol(text + name.offset, name.length);
+    label->name = name;
+    return 0;
+}
+
+// Function to tokenize and size the lines of one chunk, with LOCCTR from 0
+static void sizeChunk(void *context, int index) {
+    pass1_job *job = context;
+    pass1_chunk *chunk = &job->chunks[index];
+    source_fields fields;
+    source_scanner scanner;
+    int locctr = 0;
+
+    // Diagnostics are kept with the chunk and printed in source order
+    FILE *diagnostics = open_memstream(&chunk->diagnostics, &chunk->diagnostics_size);
+    initProgram(&chunk->prog);
+    setDiagnostics(&chunk->prog, diagnostics ? diagnostics : stderr);
+    chunk->prog.text = job->text;
+    chunk->prog.text_size = chunk->end;
+
+    initSourceScanner(&scanner, job->text, chunk->begin, chunk->end);
+    while (scanSourceLine(&scanner, &fields)) {
+        if (fields.mnemonic.length == 0 && fields.label.length == 0) continue;
+
+        if (!addAddressedLine(&chunk->prog, &fields, &locctr)) {
+            chunk->status = -1;
+            break;
+        }
+
+        // Lines up to the first START do not know their address yet
+        if (!chunk->prog.is_start_found) chunk->relative_count = chunk->prog.line_count;
+
+        if (fields.label.length > 0) {
+            if (addChunkLabel(chunk, job->text, fields.label) != 0) {
+                fprintf(getDiagnostics(&chunk->prog), "Error: Out of memory.\n");
+                chunk->status = -1;
+                break;
+            }
+            STATS_MARK(PHASE_SYMBOL_INSERT);
+        }
+    }
+
+    chunk->locctr = locctr;
+    if (diagnostics) fclose(diagnostics);
+}
+
+// Function to copy the lines of one chunk into the program, moving the
+// ones before the first START to the base address of the chunk
+static void placeChunk(void *context, int index) {
+    pass1_job *job = context;
+    pass1_chunk *chunk = &job->chunks[index];
+    source_line *lines = job->prog->lines + chunk->line_base;
+
+    if (chunk->prog.line_count == 0) return;
+    memcpy(lines, chunk->prog.lines, chunk->prog.line_count * sizeof(source_line));
+    for (int i = 0; i < chunk->relative_count; i++) {
+        lines[i].locctr += chunk->base;
+    }
+}
+
+// Function to define the labels and OPTAB ids of one chunk in the program
+static void mergeChunk(program *prog, const pass1_chunk *chunk) {
+    for (int i = 0; i < chunk->prog.optab_size; i++) {
+        int id = chunk->prog.optab_ids[i];
+        if (!prog->optab_used[id]) {
+            prog->optab_used[id] = 1;
+            prog->optab_ids[prog->optab_size++] = id;
+        }
+    }
+
+    for (int i = 0; i < chunk->label_count; i++) {
+        const chunk_label *label = &chunk->labels[i];
+        source_line *line = &prog->lines[chunk->line_base + label->line];
+        const char *name = prog->text + label->name.offset;
+
+        // A duplicate label still refers to the symbol defined first
+        line->label_id = addHashedToSymtab(&prog->symtab, name, label->name.length, label->hash, line->locctr);
+        if (line->label_id == -1) {
+            line->label_id = searchSymtab(&prog->symtab, name, label->name.length);
+        }
+    }
+}
+
+// Function to fill in the line code of the lines of one chunk, once the
+// SYMTAB is complete (it is only read, so the chunks run in parallel)
+static void codeChunk(void *context, int index) {
+    pass1_job *job = context;
+    pass1_chunk *chunk = &job->chunks[index];
+    program *prog = job->prog;
+
+    STATS_START(start);
+    resolveLineCode(prog, chunk->line_base, chunk->line_base + chunk->line_count);
+    STATS_STOP(PHASE_RESOLVE, start);
+}
+
+// Function to split the source into chunks that end at line boundaries
+static void splitChunks(const char *text, size_t size, pass1_chunk *chunks, int chunk_count) {
+    size_t position = 0;
+    for (int i = 0; i < chunk_count; i++) {
+        size_t end = size * (i + 1) / chunk_count;
+        if (end < position) end = position;
+        if (i + 1 < chunk_count && end < size) {
+            const char *newline = memchr(text + end, '\n', size - end);
+            end = newline ? (size_t)(newline - text) + 1 : size;
+        } else {
+            end = size;
+        }
+        chunks[i].begin = position;
+        chunks[i].end = end;
+        position = end;
+    }
+}
+
+// Function to run pass 1 on several threads
+int runParallelPass1(program *prog, const char *text, size_t size, int thread_count) {
+    int chunk_count = thread_count * CHUNKS_PER_THREAD;
+    if ((size_t)chunk_count > size / MIN_PARALLEL_CHUNK_SIZE) chunk_count = size / MIN_PARALLEL_CHUNK_SIZE;
+    if (thread_count <= 1 || chunk_count <= 1) {
+        return runPass1(prog, text, size);
+    }
+
+    pass1_chunk *chunks = calloc(chunk_count, sizeof(pass1_chunk));
+    if (!chunks) {
+        fprintf(getDiagnostics(prog), "Error: Out of memory.\n");
+        return -1;
+    }
+    splitChunks(text, size, chunks, chunk_count);
+
+    prog->text = text;
+    prog->text_size = size;
+    pass1_job job = {prog, text, chunks};
+    int status = runThreadPool(thread_count, chunk_count, sizeChunk, &job);
+
+    // Prefix sums: every chunk starts where the previous one ended, unless
+    // a START in it set the LOCCTR
+    int locctr = 0, line_count = 0;
+    for (int i = 0; status == 0 && i < chunk_count; i++) {
+        pass1_chunk *chunk = &chunks[i];
+        if (chunk->status != 0) status = -1;
+
+        chunk->base = locctr;
+        chunk->line_base = line_count;
+        chunk->line_count = chunk->prog.line_count;
+        line_count += chunk->prog.line_count;
+        locctr = chunk->prog.is_start_found ? chunk->locctr : locctr + chunk->locctr;
+
+        if (chunk->prog.is_start_found) {
+            prog->start_address = chunk->prog.start_address;
+            prog->is_start_found = 1;
+        }
+        if (chunk->prog.is_xe) prog->is_xe = 1;
+    }
+
+    // Every chunk knows where its lines go, so they are placed in parallel
+    if (status == 0 && line_count > prog->line_capacity) {
+        source_line *lines = realloc(prog->lines, line_count * sizeof(source_line));
+        if (!lines) {
+            fprintf(getDiagnostics(prog), "Error: Out of memory.\n");
+            status = -1;
+        } else {
+            prog->lines = lines;
+            prog->line_capacity = line_count;
+        }
+    }
+    if (status == 0) {
+        prog->line_count = line_count;
+        prog->end_address = locctr;
+        status = runThreadPool(thread_count, chunk_count, placeChunk, &job);
+    }
+
+    // The SYMTAB is filled in source order, so the symbol ids and the
+    // duplicate errors are the ones the serial pass gives
+    STATS_START(start);
+    for (int i = 0; i < chunk_count; i++) {
+        pass1_chunk *chunk = &chunks[i];
+        fwrite(chunk->diagnostics, 1, chunk->diagnostics_size, getDiagnostics(prog));
+        if (status == 0) mergeChunk(prog, chunk);
+
+        free(chunk->diagnostics);
+        free(chunk->labels);
+        freeProgram(&chunk->prog);
+    }
+    STATS_STOP(PHASE_SYMBOL_INSERT, start);
+
+    // With the SYMTAB complete, a SIC/XE program is relaxed as a whole, then
+    // the operands of every chunk are resolved in parallel
+    if (status == 0 && prog->is_xe && relaxProgram(prog) != 0) status = -1;
+    prog->code.count = 0;
+    if (status == 0 && reserveLineCode(prog, line_count) == 0) {
+        if (runThreadPool(thread_count, chunk_count, codeChunk, &job) == 0) prog->code.count = line_count;
+    }
+    free(chunks);
+    STATS_PEAK(PEAK_LINES, prog->line_count);
+
+    if (status == 0 && !prog->is_start_found) {
+        fprintf(getDiagnostics(prog), "Warning: No START directive found. LOCCTR starts from 0.\n");
+    }
+    return status;
+}
+
+// ------x--------x----------x------------x------ PARALLEL PASS 1 ----------------x------------x---------------x---x
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+
+
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// ------x--------x----------x------------x------ PARALLEL PASS 2 ----------------x------------x---------------x---x
+
+// Lines [begin, end) encoded one after the other into code
+typedef struct {
+    int begin;
+    int end;
+
+    unsigned char *code;
+    size_t code_size;
+    size_t code_capacity;
+    int errors;
+    int status;
+
+    char *diagnostics;
+    size_t diagnostics_size;
+} pass2_chunk;
+
+typedef struct {
+    const program *prog;
+    pass2_chunk *chunks;
+    int *sizes;             // Bytes of code of every line
+} pass2_job;
+
+// Text records [begin, end) formatted into text
+typedef struct {
+    const text_record *records;
+    int begin;
+    int end;
+    char *text;
+    size_t text_size;
+} record_chunk;
+
+// Function to append the code of a line to the code of its chunk
+static int addChunkCode(pass2_chunk *chunk, const unsigned char *code, int size) {
+    if (size <= 0) return 0;    // RESB, RESW and directives have no code (and may have no buffer)
+    if (chunk->code_size + size > chunk->code_capacity) {
+        size_t new_capacity = chunk->code_capacity ? chunk->code_capacity * 2 : 64 * 1024;
+        while (new_capacity < chunk->code_size + size) new_capacity *= 2;
+        unsigned char *new_code = realloc(chunk->code, new_capacity);
+        if (!new_code) return -1;
+        chunk->code = new_code;
+        chunk->code_capacity = new_capacity;
+    }
+    memcpy(chunk->code + chunk->code_size, code, size);
+    chunk->code_size += size;
+    return 0;
+}
+
+// Function to encode the lines of one chunk
+static void encodeChunk(void *context, int index) {
+    pass2_job *job = context;
+    pass2_chunk *chunk = &job->chunks[index];
+
+    // The program is only read; the copy just reports to the chunk
+    FILE *diagnostics = open_memstream(&chunk->diagnostics, &chunk->diagnostics_size);
+    program view = *job->prog;
+    setDiagnostics(&view, diagnostics ? diagnostics : stderr);
+
+    // A chunk is all resolving, so it is timed in full rather than sampled.
+    // Resolved format 3 instructions are encoded from the line code alone.
+    int has_code = view.code.count == view.line_count;
+    STATS_START(start);
+    for (int i = chunk->begin; i < chunk->end; i++) {
+        const source_line *line = &view.lines[i];
+        unsigned char buffer[MAX_CODE_LENGTH];
+        unsigned char *code = buffer;
+
+        job->sizes[i] = has_code ? encodeResolvedLine(&view, i, code) : 0;
+        if (job->sizes[i] == 0) {
+            if (!hasObjectCode(line)) continue;
+            job->sizes[i] = encodeLineCode(&view, line, &code, &chunk->errors);
+        }
+        if (addChunkCode(chunk, code, job->sizes[i]) != 0) {
+            fprintf(getDiagnostics(&view), "Error: Out of memory.\n");
+            chunk->status = -1;
+        }
+        if (code != buffer) free(code);
+        if (chunk->status != 0) break;
+    }
+    STATS_STOP(PHASE_RESOLVE, start);
+
+    if (diagnostics) fclose(diagnostics);
+}
+
+// Function to format the text records of one chunk
+static void formatChunk(void *context, int index) {
+    record_chunk *chunk = &((record_chunk *)context)[index];
+    output_buffer out;
+    initOutputBuffer(&out, NULL);
+    writeTextRecords(&out, chunk->records + chunk->begin, chunk->end - chunk->begin);
+    if (out.failed) {
+        free(out.data);
+        return;
+    }
+    chunk->text = out.data;
+    chunk->text_size = out.size;
+}
+
+// Function to write text records in order, formatting them on several threads
+static int writeRecordsInParallel(output_buffer *out, const text_record_list *list, int thread_count) {
+    int chunk_count = thread_count * CHUNKS_PER_THREAD;
+    if (chunk_count > list->count) chunk_count = list->count;
+    if (chunk_count <= 1) {
+        writeTextRecords(out, list->records, list->count);
+        return 0;
+    }
+
+    record_chunk *chunks = calloc(chunk_count, sizeof(record_chunk));
+    if (!chunks) {
+        writeTextRecords(out, list->records, list->count);
+        return 0;
+    }
+    for (int i = 0; i < chunk_count; i++) {
+        chunks[i].records = list->records;
+        chunks[i].begin = (int)((long long)list->count * i / chunk_count);
+        chunks[i].end = (int)((long long)list->count * (i + 1) / chunk_count);
+    }
+
+    runThreadPool(thread_count, chunk_count, formatChunk, chunks);
+
+    // A chunk that could not be formatted in memory is formatted here
+    for (int i = 0; i < chunk_count; i++) {
+        if (chunks[i].text) {
+            appendBytes(out, chunks[i].text, chunks[i].text_size);
+        } else {
+            writeTextRecords(out, list->records + chunks[i].begin, chunks[i].end - chunks[i].begin);
+        }
+        free(chunks[i].text);
+    }
+    free(chunks);
+    return 0;
+}
+
+// Function to run pass 2 on several threads
+int runParallelPass2(const program *prog, FILE *object_file, int thread_count) {
+    int chunk_count = thread_count * CHUNKS_PER_THREAD;
+    if (chunk_count > prog->line_count / MIN_PARALLEL_CHUNK_LINES) {
+        chunk_count = prog->line_count / MIN_PARALLEL_CHUNK_LINES;
+    }
+    if (thread_count <= 1 || chunk_count <= 1) {
+        return runPass2(prog, object_file);
+    }
+
+    pass2_chunk *chunks = calloc(chunk_count, sizeof(pass2_chunk));
+    int *sizes = malloc(prog->line_count * sizeof(int));
+    if (!chunks || !sizes) {
+        free(chunks);
+        free(sizes);
+        return runPass2(prog, object_file);
+    }
+    for (int i = 0; i < chunk_count; i++) {
+        chunks[i].begin = (int)((long long)prog->line_count * i / chunk_count);
+        chunks[i].end = (int)((long long)prog->line_count * (i + 1) / chunk_count);
+    }
+
+    // Encoding (the symbol lookups) is done by every chunk on its own
+    pass2_job job = {prog, chunks, sizes};
+    int status = runThreadPool(thread_count, chunk_count, encodeChunk, &job);
+
+    // The text records depend on everything before them, so they are laid
+    // out in one walk; it only copies the code that is already encoded
+    pass2_state state;
+    text_record_list records = {NULL, 0, 0};
+    int program_length = prog->end_address - prog->start_address;
+    initPass2(prog, &state, object_file);
+
+    STATS_START(start);
+    for (int c = 0; c < chunk_count; c++) {
+        pass2_chunk *chunk = &chunks[c];
+        size_t position = 0;
+
+        fwrite(chunk->diagnostics, 1, chunk->diagnostics_size, getDiagnostics(prog));
+        state.errors += chunk->errors;
+        if (chunk->status != 0) status = -1;
+
+        for (int i = chunk->begin; status == 0 && i < chunk->end; i++) {
+            emitCode(prog, &state, &prog->lines[i], chunk->code + position, sizes[i], program_length);
+            position += sizes[i];
+
+            // The header is written by the first line; after it the records are collected
+            if (i == 0) collectTextRecords(&state.writer, &records);
+        }
+
+        free(chunk->diagnostics);
+        free(chunk->code);
+    }
+    STATS_STOP(PHASE_EMIT, start);
+
+    // Every record is formatted independently, then written in order
+    if (status == 0) {
+        breakTextRecord(&state.writer);
+        collectTextRecords(&state.writer, NULL);
+        STATS_START(write_start);
+        writeRecordsInParallel(&state.writer.buffer, &records, thread_count);
+        STATS_STOP(PHASE_EMIT, write_start);
+        status = finishPass2(&state);
+    } else if (state.started) {
+        freeObjectWriter(&state.writer);
+    }
+
+    freeTextRecords(&records);
+    free(chunks);
+    free(sizes);
+    return status;
+}
+
+// ------x--------x----------x------------x------ PARALLEL PASS 2 ----------------x------------x---------------x---x
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
@@ -0,0 +1,33 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <stdio.h>
+
+#include "program.h"
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// ------x--------x----------x------------x------ PARALLEL PASSES ----------------x------------x---------------x---x
+
+// Sources smaller than this are assembled by the serial passes
+#define MIN_PARALLEL_CHUNK_SIZE (64 * 1024)
+// Chunks per thread, so threads that finish early can steal the rest
+#define CHUNKS_PER_THREAD 4
+
+// Function to run pass 1 on thread_count threads. The source is split into
+// chunks at line boundaries; every chunk is tokenized and sized on its own
+// with LOCCTR starting at 0, the chunk base addresses are then a prefix sum
+// of the chunk sizes, and the labels of the chunks are merged into the
+// SYMTAB in source order (so duplicates across chunks are still found).
+// The program is the same as the one runPass1() builds.
+int runParallelPass1(program *prog, const char *text, size_t size, int thread_count);
+
+// Function to run pass 2 on thread_count threads. Lines are encoded per
+// chunk into separate buffers, the text records are laid out in one cheap
+// serial walk, and the records are formatted per chunk and written in
+// order, so the object program is byte-identical to runPass2().
+int runParallelPass2(const program *prog, FILE *object_file, int thread_count);
+
+// ------x--------x----------x------------x------ PARALLEL PASSES ----------------x------------x---------------x---x
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+
+#endif
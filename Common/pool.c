@@ -0,0 +1,142 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "pool.h"
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// ------x--------x----------x------------x------ THREAD POOL ----------------x------------x----------------x-----x
+
+// Jobs still queued on one thread: [begin, end). The owner takes jobs from
+// the front, thieves take the back half, so they rarely touch the same jobs.
+typedef struct {
+    pthread_mutex_t lock;
+    int begin;
+    int end;
+} pool_queue;
+
+typedef struct {
+    pool_queue *queues;
+    int thread_count;
+    pool_job_function run;
+    void *context;
+} thread_pool;
+
+typedef struct {
+    thread_pool *pool;
+    int index;
+} pool_worker;
+
+// Function to take the next job from the front of a queue, -1 if it is empty
+static int popJob(pool_queue *queue) {
+    pthread_mutex_lock(&queue->lock);
+    int job = queue->begin < queue->end ? queue->begin++ : -1;
+    pthread_mutex_unlock(&queue->lock);
+    return job;
+}
+
+// Function to steal half of the jobs of another thread into the queue of
+// thief, returns the first stolen job to run or -1 when every queue is empty
+static int stealJobs(thread_pool *pool, int thief) {
+    for (int i = 1; i < pool->thread_count; i++) {
+        pool_queue *victim = &pool->queues[(thief + i) % pool->thread_count];
+        int first = -1, last = -1;
+
+        pthread_mutex_lock(&victim->lock);
+        int remaining = victim->end - victim->begin;
+        if (remaining > 0) {
+            int count = (remaining + 1) / 2;
+            victim->end -= count;
+            first = victim->end;
+            last = first + count;
+        }
+        pthread_mutex_unlock(&victim->lock);
+
+        if (first != -1) {
+            pool_queue *own = &pool->queues[thief];
+            pthread_mutex_lock(&own->lock);
+            own->begin = first + 1;
+            own->end = last;
+            pthread_mutex_unlock(&own->lock);
+            return first;
+        }
+    }
+    return -1;
+}
+
+// Function run by every thread of the pool until no jobs are left anywhere
+static void *runWorker(void *argument) {
+    pool_worker *worker = argument;
+    thread_pool *pool = worker->pool;
+
+    for (;;) {
+        int job = popJob(&pool->queues[worker->index]);
+        if (job == -1) job = stealJobs(pool, worker->index);
+        if (job == -1) break;
+        pool->run(pool->context, job);
+    }
+    return NULL;
+}
+
+// Function to run all jobs on a pool of threads and wait for them
+int runThreadPool(int thread_count, int job_count, pool_job_function run, void *context) {
+    if (thread_count < 1) thread_count = 1;
+    if (thread_count > job_count) thread_count = job_count > 0 ? job_count : 1;
+
+    thread_pool pool;
+    pool.thread_count = thread_count;
+    pool.run = run;
+    pool.context = context;
+    pool.queues = malloc(thread_count * sizeof(pool_queue));
+    pthread_t *threads = malloc(thread_count * sizeof(pthread_t));
+    pool_worker *workers = malloc(thread_count * sizeof(pool_worker));
+    if (!pool.queues || !threads || !workers) {
+        fprintf(stderr, "Error: Out of memory.\n");
+        free(pool.queues);
+        free(threads);
+        free(workers);
+        return -1;
+    }
+
+    // Every thread starts with an equal, contiguous range of the jobs
+    for (int i = 0; i < thread_count; i++) {
+        pthread_mutex_init(&pool.queues[i].lock, NULL);
+        pool.queues[i].begin = (int)((long long)job_count * i / thread_count);
+        pool.queues[i].end = (int)((long long)job_count * (i + 1) / thread_count);
+        workers[i].pool = &pool;
+        workers[i].index = i;
+    }
+
+    // The calling thread is worker 0; jobs of a thread that cannot be
+    // started are stolen by the others
+    int *started = calloc(thread_count, sizeof(int));
+    for (int i = 1; i < thread_count; i++) {
+        if (started && pthread_create(&threads[i], NULL, runWorker, &workers[i]) == 0) {
+            started[i] = 1;
+        }
+    }
+    runWorker(&workers[0]);
+
+    for (int i = 1; i < thread_count; i++) {
+        if (started && started[i]) pthread_join(threads[i], NULL);
+    }
+    for (int i = 0; i < thread_count; i++) {
+        pthread_mutex_destroy(&pool.queues[i].lock);
+    }
+
+    free(started);
+    free(pool.queues);
+    free(threads);
+    free(workers);
+    return 0;
+}
+
+// Function to get the number of online processors
+int getProcessorCount(void) {
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (int)count : 1;
+}
+
+// ------x--------x----------x------------x------ THREAD POOL ----------------x------------x----------------x-----x
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
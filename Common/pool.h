@@ -0,0 +1,23 @@
+#ifndef POOL_H
+#define POOL_H
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// ------x--------x----------x------------x------ THREAD POOL ----------------x------------x----------------x-----x
+
+// Function run for every job of a pool. context is shared by all jobs,
+// job is the index of the job (0 .. job_count - 1).
+typedef void (*pool_job_function)(void *context, int job);
+
+// Function to run job_count jobs on thread_count threads (the calling
+// thread is one of them) and wait for all of them. Every thread starts with
+// an equal range of jobs and steals half of another thread's remaining
+// range when its own runs out, so uneven jobs still keep every thread busy.
+int runThreadPool(int thread_count, int job_count, pool_job_function run, void *context);
+
+// Function to get the number of online processors (at least 1)
+int getProcessorCount(void);
+
+// ------x--------x----------x------------x------ THREAD POOL ----------------x------------x----------------x-----x
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+
+#endif
@@ -0,0 +1,1208 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "handoff.h"
+#include "object.h"
+#include "output.h"
+#include "program.h"
+#include "relax.h"
+#include "scan.h"
+#include "stats.h"
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// ------x--------x----------x------------x------ PROGRAM ----------------x------------x----------------x-----------x
+
+// Function to initialise an empty program
+void initProgram(program *prog) {
+    memset(prog, 0, sizeof(*prog));
+}
+
+// Function to release the memory held by a program
+void freeProgram(program *prog) {
+    free(prog->lines);
+    free(prog->code.locctr);
+    free(prog->code.symbol_id);
+    free(prog->code.word);
+    free(prog->code.opcode_id);
+    free(prog->code.flags);
+    freeSymtab(&prog->symtab);
+    freeSymtab(&prog->external);
+    initProgram(prog);
+}
+
+// Function to empty a program but keep the memory of its lines and SYMTAB,
+// so assembling many programs in a row does not allocate again
+void resetProgram(program *prog) {
+    resetSymtab(&prog->symtab);
+    resetSymtab(&prog->external);
+    prog->code.count = 0;
+    memset(prog->optab_used, 0, sizeof(prog->optab_used));
+    prog->optab_size = 0;
+    prog->text = NULL;
+    prog->text_size = 0;
+    prog->line_count = 0;
+    prog->start_address = 0;
+    prog->end_address = 0;
+    prog->is_start_found = 0;
+    prog->is_xe = 0;
+    prog->is_section = 0;
+}
+
+// Function to report the errors of a program (and its SYMTAB) to out
+void setDiagnostics(program *prog, FILE *out) {
+    prog->diagnostics = out;
+    prog->symtab.diagnostics = out;
+    prog->external.diagnostics = out;
+}
+
+// Function to get the stream errors of a program are reported to
+FILE *getDiagnostics(const program *prog) {
+    return prog->diagnostics ? prog->diagnostics : stderr;
+}
+
+// Function to append a new, empty line to the program and return it
+source_line *addSourceLine(program *prog) {
+    // Grow the line array geometrically so appending stays cheap
+    if (prog->line_count == prog->line_capacity) {
+        int new_capacity = prog->line_capacity ? prog->line_capacity * 2 : 64;
+        source_line *lines = realloc(prog->lines, new_capacity * sizeof(source_line));
+        if (!lines) {
+            fprintf(getDiagnostics(prog), "Error: Out of memory.\n");
+            return NULL;
+        }
+        prog->lines = lines;
+        prog->line_capacity = new_capacity;
+    }
+
+    source_line *line = &prog->lines[prog->line_count++];
+    memset(line, 0, sizeof(*line));
+    STATS_COUNT(COUNTER_LINES, 1);
+    line->label_id = -1;
+    line->opcode_id = -1;
+    line->operand_id = -1;
+    return line;
+}
+
+// ------x--------x----------x------------x------ PROGRAM ----------------x------------x----------------x-----------x
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+
+
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// ------x--------x----------x------------x------ OPTAB ----------------x------------x----------------x-----------x
+
+// Function to resolve the mnemonic of a line to its optab_id, recording
+// every mnemonic the program uses for optab.txt
+int resolveMnemonic(program *prog, source_line *line) {
+    source_view mnemonic = line->mnemonic;
+
+    // +MNEMONIC is the format 4 (extended) form of a format 3 instruction
+    int extended = mnemonic.length > 1 && prog->text[mnemonic.offset] == '+';
+    if (extended) {
+        mnemonic.offset++;
+        mnemonic.length--;
+    }
+    line->opcode_id = searchOptab(prog->text + mnemonic.offset, mnemonic.length);
+    if (extended) {
+        if (line->opcode_id != -1 && optab[line->opcode_id].format == 3) {
+            line->format = 4;
+        } else {
+            line->opcode_id = -1;
+        }
+    }
+
+    if (line->opcode_id != -1 && !prog->optab_used[line->opcode_id]) {
+        prog->optab_used[line->opcode_id] = 1;
+        prog->optab_ids[prog->optab_size++] = line->opcode_id;
+        STATS_PEAK(PEAK_OPTAB_ENTRIES, prog->optab_size);
+    }
+    return line->opcode_id;
+}
+
+// Function to get the number of a register operand (A, X, L, B, S, T, F, PC, SW)
+// or of a register given by its number 0-9, returns -1 for anything else
+static int getRegisterNumber(const char *text, source_view operand) {
+    static const char *registers[] = {"A", "X", "L", "B", "S", "T", "F", "", "PC", "SW"};
+    if (operand.length == 0) return -1;
+    for (int i = 0; i < (int)(sizeof(registers) / sizeof(registers[0])); i++) {
+        if (viewEquals(text, operand, registers[i])) return i;
+    }
+    char digit = text[operand.offset];
+    return operand.length == 1 && digit >= '0' && digit <= '9' ? digit - '0' : -1;
+}
+
+// Function to get a decimal number from min to max (both below 100) of a
+// format 2 operand, returns -1 for anything else
+static int getSmallNumber(const char *text, source_view operand, int min, int max) {
+    if (operand.length == 0 || operand.length > 2 || !isDecimal(text, operand)) return -1;
+    int value = parseDecimal(text, operand);
+    return value >= min && value <= max ? value : -1;
+}
+
+// ------x--------x----------x------------x------ OPTAB ----------------x------------x----------------x-----------x
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+
+
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// ------x--------x----------x------------x------ SIC/XE ----------------x------------x----------------x-----------x
+
+// Function to check whether a line uses SIC/XE addressing: a +, # or @, or BASE / NOBASE
+int usesXeAddressing(const char *text, const source_line *line) {
+    if (line->format == 4 || line->opcode_id == OP_BASE || line->opcode_id == OP_NOBASE) return 1;
+    if (line->opcode_id == -1 || optab[line->opcode_id].format != 3 || line->operand.length == 0) return 0;
+    return text[line->operand.offset] == '#' || text[line->operand.offset] == '@';
+}
+
+// Function to split the operand of a format 3 / 4 instruction into its
+// addressing prefix, its value and the index register
+void parseXeOperand(const char *text, source_view operand, xe_operand *parsed) {
+    source_view value = operand;
+    parsed->ni = XE_SIMPLE;
+    parsed->indexed = 0;
+    if (value.length > 0 && (text[value.offset] == '#' || text[value.offset] == '@')) {
+        parsed->ni = text[value.offset] == '#' ? XE_IMMEDIATE : XE_INDIRECT;
+        value.offset++;
+        value.length--;
+    }
+
+    const char *chars = text + value.offset;
+    const char *comma = memchr(chars, ',', value.length);
+    if (comma) {
+        source_view second = {value.offset + (comma - chars) + 1, value.length - (comma - chars) - 1};
+        parsed->indexed = viewEquals(text, second, "X");
+        value.length = comma - chars;
+    }
+    parsed->value = value;
+    parsed->is_constant = value.length == 0 || isDecimal(text, value);
+}
+
+// Function to get the smallest constant an address field of bits bits
+// holds: an immediate value may be negative (two's complement), an address not
+static int getConstantMinimum(const xe_operand *operand, int bits) {
+    return operand->ni == XE_IMMEDIATE && operand->is_constant ? -(1 << (bits - 1)) : 0;
+}
+
+// Function to follow BASE and NOBASE: returns the symbol id of the BASE in
+// effect after line, given the one in effect before it
+int trackBase(const program *prog, const source_line *line, int base_id) {
+    if (line->opcode_id == OP_BASE) {
+        return searchSymtab(&prog->symtab, prog->text + line->operand.offset, line->operand.length);
+    }
+    return line->opcode_id == OP_NOBASE ? -1 : base_id;
+}
+
+// Function to choose how a format 3 instruction at locctr reaches target,
+// with base the address in the base register (-1 without BASE). Returns
+// the n and i bits and the 15 bits after x as they sit in the instruction
+// word, or -1 when only format 4 reaches the target. In order:
+// PC-relative, base-relative, a 12-bit address (or, for an immediate
+// constant, a signed 12-bit value), and for simple addressing the SIC form
+// (n = i = 0) with its 15-bit address.
+int getFormat3Field(int locctr, int target, int base, const xe_operand *operand) {
+    int ni = operand->ni << 16;
+    if (!operand->is_constant) {
+        int displacement = target - (locctr + 3);
+        if (displacement >= -2048 && displacement <= 2047) return ni | 0x2000 | (displacement & 0xFFF);
+        if (base != -1 && target >= base && target - base <= 4095) return ni | 0x4000 | (target - base);
+    }
+    if (target >= getConstantMinimum(operand, 12) && target <= 4095) return ni | (target & 0xFFF);
+    if (operand->ni == XE_SIMPLE && target >= 0 && target <= 0x7FFF) return target;
+    return -1;
+}
+
+// Function to get the bytes a line takes, as laid out (4 for a format 4 instruction)
+int getLineSize(const char *text, const source_line *line) {
+    if (line->format == 4) return 4;
+    return line->opcode_id == OP_START ? 0 : getInstructionSize(line->opcode_id, text, line->operand);
+}
+
+// Function to encode the format 3 / 4 instruction of a SIC/XE program into
+// word (its 3 or 4 bytes, high byte first), with the operand at target;
+// returns its size, or -1 when the instruction cannot reach the target
+static int getXeWord(const program *prog, const source_line *line, const xe_operand *operand, int target,
+                     uint32_t *word) {
+    uint32_t opcode = optab[line->opcode_id].opcode;
+    if (line->format == 4) {
+        if (target < getConstantMinimum(operand, 20) || target > 0xFFFFF) return -1;
+        *word = (opcode | operand->ni) << 24 | (uint32_t)operand->indexed << 23 | 1 << 20 | (target & 0xFFFFF);
+        return 4;
+    }
+
+    int base = line->base_id == -1 ? -1 : getSymbolAddress(&prog->symtab, line->base_id);
+    int field = getFormat3Field(line->locctr, target, base, operand);
+    if (field == -1) return -1;
+    *word = opcode << 16 | field | operand->indexed << 15;
+    return 3;
+}
+
+// Function to generate the object code of a format 3 / 4 instruction of a
+// SIC/XE program, returns its size or -1 on an error
+static int encodeXeLine(const program *prog, const source_line *line, unsigned char *code) {
+    const char *text = prog->text;
+    xe_operand operand;
+    parseXeOperand(text, line->operand, &operand);
+
+    int status = line->format;
+    int target;
+    if (operand.is_constant) {
+        target = parseDecimal(text, operand.value);
+    } else if (line->operand_id != -1) {
+        target = getSymbolAddress(&prog->symtab, line->operand_id);
+    } else {
+        target = lookupSymbol(prog, operand.value);
+        if (target == -1 && isExternalSymbol(prog, operand.value)) {
+            // The loader adds the address of the symbol through a modification record,
+            // which only a format 4 address field has room for
+            target = 0;
+            if (line->format != 4) {
+                fprintf(getDiagnostics(prog), "Error: External symbol '%.*s' needs format 4.\n",
+                        operand.value.length, text + operand.value.offset);
+                status = -1;
+            }
+        } else if (target == -1) {
+            fprintf(getDiagnostics(prog), "Error: Undefined symbol '%.*s'.\n", operand.value.length,
+                    text + operand.value.offset);
+            target = 0;
+            status = -1;
+        }
+    }
+    if (operand.indexed && operand.ni != XE_SIMPLE) {
+        fprintf(getDiagnostics(prog), "Error: Indexed addressing cannot be immediate or indirect: '%.*s'.\n",
+                line->operand.length, text + line->operand.offset);
+        status = -1;
+    }
+
+    uint32_t word;
+    if (getXeWord(prog, line, &operand, target, &word) < 0) {
+        fprintf(getDiagnostics(prog), "Error: Operand '%.*s' at %06X is out of range of format %d.\n",
+                line->operand.length, text + line->operand.offset, line->locctr, line->format);
+        word = (uint32_t)(optab[line->opcode_id].opcode | operand.ni) << (line->format == 4 ? 24 : 16);
+        status = -1;
+    }
+    for (int i = 0; i < line->format; i++) {
+        code[i] = (word >> (8 * (line->format - 1 - i))) & 0xFF;
+    }
+    return status;
+}
+
+// ------x--------x----------x------------x------ SIC/XE ----------------x------------x----------------x-----------x
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+
+
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// ------x--------x----------x------------x------ SYMTAB ----------------x------------x----------------x-----------x
+
+// Function to look up the address of a symbol, returns -1 if it is not defined
+int lookupSymbol(const program *prog, source_view symbol) {
+    int id = searchSymtab(&prog->symtab, prog->text + symbol.offset, symbol.length);
+    return id == -1 ? -1 : getSymbolAddress(&prog->symtab, id);
+}
+
+// Function to check whether a symbol is one the control section takes from another (EXTREF)
+int isExternalSymbol(const program *prog, source_view symbol) {
+    return prog->external.size > 0 && searchSymtab(&prog->external, prog->text + symbol.offset, symbol.length) != -1;
+}
+
+// Function to check whether a line is a WORD whose operand is a symbol, which
+// stands for the address of that symbol
+int isSymbolWord(const char *text, const source_line *line) {
+    return line->opcode_id == OP_WORD && line->operand.length > 0 && !isDecimal(text, line->operand);
+}
+
+// Function to get the label of a line, or "" if it has none
+const char *getLineLabel(const program *prog, const source_line *line) {
+    return line->label_id == -1 ? "" : getSymbolName(&prog->symtab, line->label_id);
+}
+
+// Function to define the label of a line at the given address
+void defineLabel(program *prog, source_line *line, source_view label, int address) {
+    const char *name = prog->text + label.offset;
+    line->label_id = addToSymtab(&prog->symtab, name, label.length, address);
+
+    // A duplicate label still refers to the symbol defined first
+    if (line->label_id == -1) {
+        line->label_id = searchSymtab(&prog->symtab, name, label.length);
+    }
+}
+
+// ------x--------x----------x------------x------ SYMTAB ----------------x------------x----------------x-----------x
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+
+
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// ------x--------x----------x------------x------ LINE CODE ----------------x------------x----------------x--------x
+
+// Function to make room for the line code of count lines
+int reserveLineCode(program *prog, int count) {
+    line_code *code = &prog->code;
+    if (count <= code->capacity) return 0;
+
+    int new_capacity = code->capacity ? code->capacity * 2 : 64;
+    while (new_capacity < count) new_capacity *= 2;
+
+    // Every array that grows is kept, so a failure leaves them all usable
+    int32_t *locctr = realloc(code->locctr, new_capacity * sizeof(int32_t));
+    if (locctr) code->locctr = locctr;
+    int32_t *symbol_id = realloc(code->symbol_id, new_capacity * sizeof(int32_t));
+    if (symbol_id) code->symbol_id = symbol_id;
+    uint32_t *word = realloc(code->word, new_capacity * sizeof(uint32_t));
+    if (word) code->word = word;
+    int16_t *opcode_id = realloc(code->opcode_id, new_capacity * sizeof(int16_t));
+    if (opcode_id) code->opcode_id = opcode_id;
+    uint8_t *flags = realloc(code->flags, new_capacity);
+    if (flags) code->flags = flags;
+
+    if (!locctr || !symbol_id || !word || !opcode_id || !flags) {
+        fprintf(getDiagnostics(prog), "Error: Out of memory.\n");
+        return -1;
+    }
+    code->capacity = new_capacity;
+    return 0;
+}
+
+// Function to find the symbol the operand of a line refers to: the part
+// before a comma for a format 3 instruction (after its # or @ with SIC/XE
+// addressing), the whole operand for END. Returns 0 when it refers to none.
+static int getOperandSymbol(const program *prog, const source_line *line, source_view *symbol, int *indexed) {
+    *symbol = line->operand;
+    *indexed = 0;
+    if (line->opcode_id == OP_END) return symbol->length > 0;
+    if (line->opcode_id == -1 || optab[line->opcode_id].format != 3) return 0;
+    if (line->format != 0) {
+        xe_operand operand;
+        parseXeOperand(prog->text, line->operand, &operand);
+        *symbol = operand.value;
+        *indexed = operand.indexed;
+        return !operand.is_constant;
+    }
+
+    const char *chars = prog->text + line->operand.offset;
+    const char *comma = memchr(chars, ',', line->operand.length);
+    if (comma) {
+        source_view second = {line->operand.offset + (comma - chars) + 1, line->operand.length - (comma - chars) - 1};
+        symbol->length = comma - chars;
+        *indexed = viewEquals(prog->text, second, "X");
+    }
+    return symbol->length > 0;
+}
+
+// Function to fill in the line code of line index, with symbol_id the
+// SYMTAB id of its operand symbol (-1 when it has none or it is undefined)
+static void storeLineCode(program *prog, int index, int has_symbol, int symbol_id, int indexed) {
+    const source_line *line = &prog->lines[index];
+    line_code *code = &prog->code;
+
+    // A label keeps the address it is defined with, so the object code of a
+    // resolved instruction is final. An operand whose symbol is undefined is
+    // left to encodeLine(), which reports it, as is one out of range.
+    int flags = indexed ? LINE_CODE_INDEXED : 0;
+    uint32_t word = 0;
+    if (line->format != 0 && (!has_symbol || symbol_id != -1)) {
+        xe_operand operand;
+        parseXeOperand(prog->text, line->operand, &operand);
+        int target = has_symbol ? getSymbolAddress(&prog->symtab, symbol_id) : parseDecimal(prog->text, operand.value);
+        if ((!indexed || operand.ni == XE_SIMPLE) && getXeWord(prog, line, &operand, target, &word) > 0) {
+            flags |= LINE_CODE_RESOLVED | (line->format == 4 ? LINE_CODE_EXTENDED : 0);
+        }
+    } else if (line->opcode_id != -1 && optab[line->opcode_id].format == 3 && (!has_symbol || symbol_id != -1)) {
+        int address = symbol_id == -1 ? 0 : getSymbolAddress(&prog->symtab, symbol_id);
+        if (address < SIC_ADDRESS_LIMIT) {
+            if (indexed) address |= 0x8000;
+            word = optab[line->opcode_id].opcode << 16 | address;
+            flags |= LINE_CODE_RESOLVED;
+        }
+    }
+
+    code->locctr[index] = line->locctr;
+    code->symbol_id[index] = symbol_id;
+    code->word[index] = word;
+    code->opcode_id[index] = line->opcode_id;
+    code->flags[index] = flags;
+}
+
+// How many lines ahead of its search the slot, and then the entry, of an
+// operand symbol are prefetched. A power of two; the ring holds 2 steps.
+#define RESOLVE_AHEAD 8
+#define RESOLVE_RING (4 * RESOLVE_AHEAD)
+
+// Operand symbol of a line on its way through resolveLineCode()
+typedef struct {
+    source_view symbol;
+    unsigned int hash;
+    int has_symbol;
+    int indexed;
+} pending_operand;
+
+// Function to fill in the line code of lines [first, last) once the SYMTAB
+// is complete (it is only read, so ranges can be resolved in parallel).
+// The operand symbols are spread over the whole table, so every search is
+// a cache miss or two; they are overlapped in a pipeline: a line's slot is
+// prefetched 2 * RESOLVE_AHEAD lines before it is searched, and the entry
+// in that slot RESOLVE_AHEAD lines before.
+void resolveLineCode(program *prog, int first, int last) {
+    const symtab *table = &prog->symtab;
+    pending_operand ring[RESOLVE_RING];
+
+    for (int i = first; i < last + 2 * RESOLVE_AHEAD; i++) {
+        if (i < last) {
+            pending_operand *next = &ring[i & (RESOLVE_RING - 1)];
+            next->has_symbol = getOperandSymbol(prog, &prog->lines[i], &next->symbol, &next->indexed);
+            if (next->has_symbol) {
+                next->hash = hashSymbol(prog->text + next->symbol.offset, next->symbol.length);
+                prefetchSymbolSlot(table, next->hash);
+            }
+        }
+
+        int middle = i - RESOLVE_AHEAD;
+        if (middle >= first && middle < last && ring[middle & (RESOLVE_RING - 1)].has_symbol) {
+            prefetchSymbolEntry(table, ring[middle & (RESOLVE_RING - 1)].hash);
+        }
+
+        int index = i - 2 * RESOLVE_AHEAD;
+        if (index >= first) {
+            const pending_operand *operand = &ring[index & (RESOLVE_RING - 1)];
+            int symbol_id = -1;
+            if (operand->has_symbol) {
+                symbol_id = searchHashedSymtab(table, prog->text + operand->symbol.offset, operand->symbol.length,
+                                               operand->hash);
+            }
+            storeLineCode(prog, index, operand->has_symbol, symbol_id, operand->indexed);
+        }
+    }
+}
+
+// Function to build the line code of every line, after pass 1
+int buildLineCode(program *prog) {
+    prog->code.count = 0;
+    if (reserveLineCode(prog, prog->line_count) != 0) return -1;
+    resolveLineCode(prog, 0, prog->line_count);
+    prog->code.count = prog->line_count;
+    return 0;
+}
+
+// ------x--------x----------x------------x------ LINE CODE ----------------x------------x----------------x--------x
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+
+
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// ------x--------x----------x------------x------ PASS 1 ----------------x------------x----------------x-----------x
+
+// Function to get the instruction size
+int getInstructionSize(int opcode_id, const char *text, source_view operand) {
+    // WORD -> 3 size
+    // RESW -> 3 * sizeof(operand)
+    // RESB -> sizeof(operand)
+    // Byte:
+    //     starts with "C" then it's a char -> length of string inside the quotes
+    //     starts with "X" then it's a hexa -> hexadecimal bytes
+    // Instructions -> size of their format in the OPTAB
+    // Other directives -> 0
+    // Default size of instruction for SIC -> 3
+
+    switch (opcode_id) {
+    case OP_WORD: return 3;
+    case OP_RESW: return 3 * parseDecimal(text, operand);
+    case OP_RESB: return parseDecimal(text, operand);
+    case OP_BYTE:
+        if (operand.length < 3) return 0;
+        if (text[operand.offset] == 'C') return operand.length - 3; // Length of string inside quotes
+        else if (text[operand.offset] == 'X') return (operand.length - 3) / 2; // Hexadecimal bytes
+        return 0;
+    case -1: return 3;
+    default: return optab[opcode_id].size;
+    }
+}
+
+// Function to add the comma-separated symbols of an EXTREF to the external
+// symbols of the control section
+static int addExternalSymbols(program *prog, source_view operand) {
+    const char *chars = prog->text + operand.offset;
+    int begin = 0;
+    while (begin < operand.length) {
+        const char *comma = memchr(chars + begin, ',', operand.length - begin);
+        int end = comma ? comma - chars : operand.length;
+        int added;
+        if (end > begin && findOrAddToSymtab(&prog->external, chars + begin, end - begin, 0, &added) == -1) {
+            fprintf(getDiagnostics(prog), "Error: Out of memory.\n");
+            return -1;
+        }
+        begin = end + 1;
+    }
+    return 0;
+}
+
+// Function to add a tokenized source line to the program and assign it its
+// address, advancing *locctr past it. The label of the line is not defined.
+source_line *addAddressedLine(program *prog, const source_fields *fields, int *locctr) {
+    const char *text = prog->text;
+
+    source_line *current_line = addSourceLine(prog);
+    if (!current_line) return NULL;
+    current_line->mnemonic = fields->mnemonic;
+    current_line->operand = fields->operand;
+
+    // Look the mnemonic up in the OPTAB once, later stages use its id
+    STATS_MARK(PHASE_LAYOUT);
+    resolveMnemonic(prog, current_line);
+    STATS_MARK(PHASE_OPCODE_LOOKUP);
+
+    // Control sections are split apart and assembled one by one, each in a program of its own
+    int opcode_id = current_line->opcode_id;
+    if (!prog->is_section && (opcode_id == OP_CSECT || opcode_id == OP_EXTDEF || opcode_id == OP_EXTREF)) {
+        fprintf(getDiagnostics(prog), "Error: Control sections are only assembled by sicasm: %.*s\n",
+                fields->line.length, text + fields->line.offset);
+        return NULL;
+    }
+    // Macros are expanded before pass 1, so a definition left here is in a
+    // mode without the macro processor
+    if (opcode_id == OP_MACRO || opcode_id == OP_MEND) {
+        fprintf(getDiagnostics(prog), "Error: Macros are only expanded by sicasm and pass1_1: %.*s\n",
+                fields->line.length, text + fields->line.offset);
+        return NULL;
+    }
+    if (opcode_id == OP_EXTREF && addExternalSymbols(prog, current_line->operand) != 0) {
+        return NULL;
+    }
+
+    // Handling the start directive (a control section starts at 0)
+    if (opcode_id == OP_START || opcode_id == OP_CSECT) {
+        // Assign the starting address to locctr
+        *locctr = opcode_id == OP_START ? parseHex(text, current_line->operand) : 0;
+
+        // If start address is found assign it to start_address
+        // and is_start_found becomes true
+        prog->start_address = *locctr;
+        prog->is_start_found = 1;
+
+        // No further computing needed for starting address
+        current_line->locctr = *locctr;
+        STATS_MARK(PHASE_LAYOUT);
+        return current_line;
+    }
+
+    current_line->locctr = *locctr;
+
+    // Increment the locctr according to the instruction size
+    int increment = getLineSize(text, current_line);
+    if (usesXeAddressing(text, current_line)) prog->is_xe = 1;
+
+    // Check for any error in getting the size (END, BASE, NOBASE, EXTDEF and EXTREF take no space)
+    if (increment == 0 && opcode_id != OP_END && opcode_id != OP_BASE && opcode_id != OP_NOBASE &&
+        opcode_id != OP_EXTDEF && opcode_id != OP_EXTREF) {
+        fprintf(getDiagnostics(prog), "Error: Unknown mnemonic '%.*s' on line: %.*s\n",
+                fields->mnemonic.length, text + fields->mnemonic.offset,
+                fields->line.length, text + fields->line.offset);
+    }
+
+    *locctr += increment;
+    STATS_MARK(PHASE_LAYOUT);
+    return current_line;
+}
+
+// Function to run pass 1 over the source text, assigning an address to every
+// line and building the SYMTAB and OPTAB of the program
+int runPass1(program *prog, const char *text, size_t size) {
+    source_fields fields;
+    source_scanner scanner;
+
+    prog->text = text;
+    prog->text_size = size;
+
+    // Initialising the location counter -> locctr
+    int locctr = 0;
+
+    // Split every line into label, mnemonic and operand without copying them
+    initSourceScanner(&scanner, text, 0, size);
+    while (scanSourceLine(&scanner, &fields)) {
+
+        // Blank and comment lines take no space
+        if (fields.mnemonic.length == 0 && fields.label.length == 0) continue;
+
+        source_line *current_line = addAddressedLine(prog, &fields, &locctr);
+        if (!current_line) return -1;
+
+        // If the instruction has a label (the label of START gets the start address)
+        if (fields.label.length > 0) {
+            defineLabel(prog, current_line, fields.label, current_line->locctr);
+            STATS_MARK(PHASE_SYMBOL_INSERT);
+        }
+
+    }
+
+    // Every symbol is defined now: a SIC/XE program gets the smallest format
+    // of each instruction, then all operands are resolved in one go
+    prog->end_address = locctr;
+    if (prog->is_xe && relaxProgram(prog) != 0) return -1;
+    STATS_START(resolve_start);
+    if (buildLineCode(prog) != 0) return -1;
+    STATS_STOP(PHASE_RESOLVE, resolve_start);
+    STATS_PEAK(PEAK_LINES, prog->line_count);
+
+    if (!prog->is_start_found) {
+        fprintf(getDiagnostics(prog), "Warning: No START directive found. LOCCTR starts from 0.\n");
+    }
+
+    return 0;
+}
+
+// ------x--------x----------x------------x------ PASS 1 ----------------x------------x----------------x-----------x
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+
+
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// ------x--------x----------x------------x------ PASS 2 ----------------x------------x----------------x-----------x
+
+// Function to generate the object code of one line, returns its size in bytes
+// (0 for lines without object code, -1 on an error such as an undefined symbol).
+// code must hold getInstructionSize() bytes.
+int encodeLine(const program *prog, const source_line *line, unsigned char *code) {
+    const char *text = prog->text;
+    source_view operand = line->operand;
+    const char *chars = text + operand.offset;
+
+    switch (line->opcode_id) {
+    case -1:
+        return 0;
+
+    case OP_WORD: {
+        // WORD -> one 3 byte constant: a decimal number, or the address of a symbol
+        int value = 0;
+        int status = 3;
+        if (isSymbolWord(text, line)) {
+            value = lookupSymbol(prog, operand);
+            if (value == -1 && isExternalSymbol(prog, operand)) {
+                // Relocated by the loader through a modification record
+                value = 0;
+            } else if (value == -1) {
+                fprintf(getDiagnostics(prog), "Error: Undefined symbol '%.*s'.\n", operand.length, chars);
+                value = 0;
+                status = -1;
+            }
+        } else {
+            value = parseDecimal(text, operand);
+        }
+        code[0] = (value >> 16) & 0xFF;
+        code[1] = (value >> 8) & 0xFF;
+        code[2] = value & 0xFF;
+        return status;
+    }
+
+    case OP_BYTE: {
+        // BYTE C'...' -> the characters, BYTE X'...' -> the hexadecimal bytes
+        int length = operand.length - 3;
+        if (length < 0 || chars[1] != '\'') return -1;
+        if (chars[0] == 'C') {
+            memcpy(code, chars + 2, length);
+            return length;
+        }
+        for (int i = 0; i + 1 < length; i += 2) {
+            source_view digits = {operand.offset + 2 + i, 2};
+            code[i / 2] = parseHex(text, digits);
+        }
+        return length / 2;
+    }
+    }
+
+    const optab_entry *op = &optab[line->opcode_id];
+    if (op->format == 1) {
+        // Format 1 is the opcode alone
+        code[0] = op->opcode;
+        return 1;
+    }
+
+    // The operand may be followed by a second field after a comma
+    source_view first = operand, second = {operand.offset, 0};
+    const char *comma = memchr(chars, ',', operand.length);
+    if (comma) {
+        first.length = comma - chars;
+        second.offset = operand.offset + first.length + 1;
+        second.length = operand.length - first.length - 1;
+    }
+
+    if (op->format == 2) {
+        // Format 2 is the opcode followed by two register numbers. CLEAR and
+        // TIXR take one register, SVC one number; SHIFTL and SHIFTR keep
+        // their count (1-16) less one in place of the second register.
+        int id = line->opcode_id;
+        int single = id == OP_CLEAR || id == OP_TIXR || id == OP_SVC;
+        int r1 = id == OP_SVC ? getSmallNumber(text, first, 0, 15) : getRegisterNumber(text, first);
+        int r2 = 0;
+        if (id == OP_SHIFTL || id == OP_SHIFTR) {
+            r2 = getSmallNumber(text, second, 1, 16) - 1;
+        } else if (!single) {
+            r2 = getRegisterNumber(text, second);
+        }
+
+        int status = 2;
+        if (r1 < 0 || r2 < 0 || (single && comma) || (!single && !comma)) {
+            fprintf(getDiagnostics(prog), "Error: Invalid operand '%.*s' for %s.\n", operand.length, chars,
+                    op->mnemonic);
+            r1 = r2 = 0;
+            status = -1;
+        }
+        code[0] = op->opcode;
+        code[1] = (r1 << 4) | r2;
+        return status;
+    }
+
+    if (op->format == 3 && line->format != 0) {
+        return encodeXeLine(prog, line, code);
+    }
+
+    if (op->format == 3) {
+        // Format 3 is the opcode and the operand address, with the top
+        // address bit set for indexed addressing (",X")
+        int address = 0;
+        int status = 3;
+
+        if (line->operand_id != -1) {
+            address = getSymbolAddress(&prog->symtab, line->operand_id);
+        } else if (first.length > 0) {
+            address = lookupSymbol(prog, first);
+            if (address == -1 && isExternalSymbol(prog, first)) {
+                // Relocated by the loader through a modification record
+                address = 0;
+            } else if (address == -1) {
+                fprintf(getDiagnostics(prog), "Error: Undefined symbol '%.*s'.\n", first.length, text + first.offset);
+                address = 0;
+                status = -1;
+            }
+        }
+        if (address >= SIC_ADDRESS_LIMIT) {
+            fprintf(getDiagnostics(prog), "Error: Address %06X of '%.*s' is out of range (over 7FFF).\n", address,
+                    first.length, text + first.offset);
+            address = 0;
+            status = -1;
+        }
+        if (comma && viewEquals(text, second, "X")) address |= 0x8000;
+
+        code[0] = op->opcode;
+        code[1] = (address >> 8) & 0xFF;
+        code[2] = address & 0xFF;
+        return status;
+    }
+
+    return 0;
+}
+
+// Function to start pass 2 with an empty object program
+void initPass2(const program *prog, pass2_state *state, FILE *object_file) {
+    memset(state, 0, sizeof(*state));
+    state->object_file = object_file;
+    state->diagnostics = getDiagnostics(prog);
+}
+
+// Function to check whether a line has object code (START, END, RESW and RESB have none)
+int hasObjectCode(const source_line *line) {
+    switch (line->opcode_id) {
+    case OP_START:
+    case OP_END:
+    case OP_RESW:
+    case OP_RESB:
+    case OP_BASE:
+    case OP_NOBASE:
+    case OP_CSECT:
+    case OP_EXTDEF:
+    case OP_EXTREF:
+        return 0;
+    }
+    return 1;
+}
+
+// Function to add the already encoded object code of one line to the
+// current text record (code and size are ignored for lines without code)
+void emitCode(const program *prog, pass2_state *state, const source_line *line,
+              const unsigned char *code, int size, int program_length) {
+    // The header record is written at the START line, or before the first line without one
+    if (!state->started) {
+        state->started = 1;
+        state->entry_address = line->locctr;
+        const char *name = line->opcode_id == OP_START || line->opcode_id == OP_CSECT ? getLineLabel(prog, line) : "";
+        writeHeaderRecord(&state->writer, state->object_file, name, line->locctr, program_length);
+    }
+
+    switch (line->opcode_id) {
+    case OP_START:
+        return;
+
+    case OP_END:
+        // The operand of END is the first instruction to execute
+        if (line->operand_id != -1) {
+            state->entry_address = getSymbolAddress(&prog->symtab, line->operand_id);
+        } else if (line->operand.length > 0) {
+            int address = lookupSymbol(prog, line->operand);
+            if (address != -1) state->entry_address = address;
+        }
+        return;
+
+    case OP_BASE:
+        // The base register is only assumed to hold the symbol, which has to exist
+        if (lookupSymbol(prog, line->operand) == -1) {
+            fprintf(state->diagnostics, "Error: Undefined symbol '%.*s'.\n", line->operand.length,
+                    prog->text + line->operand.offset);
+            state->errors++;
+        }
+        return;
+
+    case OP_NOBASE:
+        return;
+
+    case OP_RESW:
+    case OP_RESB:
+        // Reserved space has no object code, so the text record ends here
+        breakTextRecord(&state->writer);
+        state->end_address = line->locctr + getLineSize(prog->text, line);
+        return;
+    }
+
+    if (size > 0) {
+        writeObjectCode(&state->writer, line->locctr, code, size);
+        state->end_address = line->locctr + size;
+    }
+}
+
+// Function to encode one line, returning the number of bytes of code to
+// emit. An error is counted in *errors; the code is still emitted for it.
+// code may be replaced by a larger buffer the caller has to free.
+int encodeLineCode(const program *prog, const source_line *line, unsigned char **code, int *errors) {
+    // Only BYTE constants can be longer than the local buffer
+    if (line->opcode_id == OP_BYTE && line->operand.length > MAX_CODE_LENGTH) {
+        *code = malloc(line->operand.length);
+        if (!*code) {
+            fprintf(getDiagnostics(prog), "Error: Out of memory.\n");
+            (*errors)++;
+            return 0;
+        }
+    }
+
+    int size = encodeLine(prog, line, *code);
+    if (size < 0) {
+        (*errors)++;
+        size = line->opcode_id == OP_BYTE ? 0 : getLineSize(prog->text, line);
+    }
+    return size;
+}
+
+// Function to run pass 2 on one line, adding its object code to the current text record
+int emitLine(const program *prog, pass2_state *state, const source_line *line, int program_length) {
+    unsigned char buffer[MAX_CODE_LENGTH];
+    unsigned char *code = buffer;
+    int size = 0;
+
+    STATS_BEGIN_LINE();
+    if (hasObjectCode(line)) {
+        size = encodeLineCode(prog, line, &code, &state->errors);
+    }
+    STATS_MARK(PHASE_RESOLVE);
+    emitCode(prog, state, line, size > 0 ? code : NULL, size, program_length);
+    STATS_MARK(PHASE_EMIT);
+
+    if (code != buffer) free(code);
+    return 0;
+}
+
+// Function to encode line index from its line code alone, returns 3 or 4
+// for a resolved format 3 or 4 instruction and 0 (encoding nothing) for any
+// other line. The line code must be up to date.
+int encodeResolvedLine(const program *prog, int index, unsigned char *code) {
+    const line_code *lines = &prog->code;
+    if (!(lines->flags[index] & LINE_CODE_RESOLVED)) return 0;
+
+    uint32_t word = lines->word[index];
+    if (lines->flags[index] & LINE_CODE_EXTENDED) {
+        code[0] = word >> 24;
+        code[1] = (word >> 16) & 0xFF;
+        code[2] = (word >> 8) & 0xFF;
+        code[3] = word & 0xFF;
+        return 4;
+    }
+    code[0] = (word >> 16) & 0xFF;
+    code[1] = (word >> 8) & 0xFF;
+    code[2] = word & 0xFF;
+    return 3;
+}
+
+// Function to run pass 2 on line index. Once the header record is written,
+// a resolved format 3 instruction goes from its line code straight into the
+// text record; every other line takes the way through emitLine().
+void emitLineAt(const program *prog, pass2_state *state, int index, int program_length) {
+    const line_code *lines = &prog->code;
+    if (state->started && lines->count == prog->line_count && (lines->flags[index] & LINE_CODE_RESOLVED)) {
+        unsigned char code[4];
+        STATS_BEGIN_LINE();
+        int size = encodeResolvedLine(prog, index, code);
+        STATS_MARK(PHASE_RESOLVE);
+        writeObjectCode(&state->writer, lines->locctr[index], code, size);
+        state->end_address = lines->locctr[index] + size;
+        STATS_MARK(PHASE_EMIT);
+        return;
+    }
+    emitLine(prog, state, &prog->lines[index], program_length);
+}
+
+// Function to finish pass 2, writing the last text record and the end record
+int finishPass2(pass2_state *state) {
+    if (!state->started) {
+        fprintf(state->diagnostics, "Error: Empty program.\n");
+        return -1;
+    }
+    STATS_START(start);
+    int status = writeEndRecord(&state->writer, state->entry_address, state->end_address);
+    STATS_STOP(PHASE_EMIT, start);
+    if (status != 0) {
+        return -1;
+    }
+    return state->errors ? -1 : 0;
+}
+
+// Function to run pass 2, writing the object program for an assembled program
+int runPass2(const program *prog, FILE *object_file) {
+    pass2_state state;
+    initPass2(prog, &state, object_file);
+
+    for (int i = 0; i < prog->line_count; i++) {
+        emitLineAt(prog, &state, i, prog->end_address - prog->start_address);
+    }
+
+    return finishPass2(&state);
+}
+
+// ------x--------x----------x------------x------ PASS 2 ----------------x------------x----------------x-----------x
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+
+
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// ------x--------x----------x------------x------ FILES ----------------x------------x----------------x-----------x
+
+// Function to format one line as LOCCTR, label, mnemonic and operand columns
+static void appendLineColumns(output_buffer *out, const program *prog, const source_line *line) {
+    const char *label = getLineLabel(prog, line);
+    appendHexField(out, line->locctr, 10);
+    appendChar(out, ' ');
+    appendField(out, label, strlen(label), 10);
+    appendChar(out, ' ');
+
+    // An instruction relaxation widened is written in its + form
+    const char *mnemonic = prog->text + line->mnemonic.offset;
+    if (line->format == 4 && mnemonic[0] != '+') {
+        appendChar(out, '+');
+        appendField(out, mnemonic, line->mnemonic.length, 9);
+    } else {
+        appendField(out, mnemonic, line->mnemonic.length, 10);
+    }
+    appendChar(out, ' ');
+    appendField(out, prog->text + line->operand.offset, line->operand.length, 10);
+    appendChar(out, '\n');
+}
+
+// Function to print the LOCCTR / label / mnemonic / operand table
+void printListing(const program *prog, FILE *file) {
+    output_buffer out;
+    initOutputBuffer(&out, file);
+
+    appendString(&out, "LOCCTR     Label      Mnemonic   Operand   \n");
+    appendString(&out, "------------------------------------------------------\n");
+    for (int i = 0; i < prog->line_count; i++) {
+        appendLineColumns(&out, prog, &prog->lines[i]);
+    }
+    appendString(&out, "------------------------------------------------------\n");
+    appendString(&out, "Starting Address: ");
+    appendHex(&out, prog->start_address, 4);
+    appendString(&out, "\nEnd Address: ");
+    appendHex(&out, prog->end_address, 4);
+    appendString(&out, "\nProgram Length: ");
+    appendHex(&out, prog->end_address - prog->start_address, 4);
+    appendChar(&out, '\n');
+
+    closeOutputBuffer(&out);
+}
+
+// Function to flush the buffer of a debug file and put the file in place
+static int closeDebugFile(output_buffer *out, atomic_file *file, const char *message) {
+    if (closeOutputBuffer(out) != 0) {
+        perror(message);
+        discardAtomicFile(file);
+        return -1;
+    }
+    return commitAtomicFile(file);
+}
+
+// Function to write the intermediate file (intermediate.txt)
+int writeIntermediateFile(const program *prog, const char *path) {
+    atomic_file intermediate_file;
+    if (openAtomicFile(&intermediate_file, path) != 0) {
+        return -1;
+    }
+
+    output_buffer out;
+    initOutputBuffer(&out, intermediate_file.file);
+    for (int i = 0; i < prog->line_count; i++) {
+        appendLineColumns(&out, prog, &prog->lines[i]);
+    }
+
+    return closeDebugFile(&out, &intermediate_file, "Error writing intermediate file");
+}
+
+// Fucntion to write the symbol table to a text file
+int writeSymtabToFile(const program *prog, const char *path) {
+    atomic_file symtab_file;
+    if (openAtomicFile(&symtab_file, path) != 0) {
+        return -1;
+    }
+
+    output_buffer out;
+    initOutputBuffer(&out, symtab_file.file);
+    for (int i = 0; i < prog->symtab.size; i++) {
+        const char *name = getSymbolName(&prog->symtab, i);
+        appendField(&out, name, strlen(name), 10);
+        appendChar(&out, ' ');
+        appendHex(&out, getSymbolAddress(&prog->symtab, i), 4);
+        appendChar(&out, '\n');
+    }
+
+    return closeDebugFile(&out, &symtab_file, "Error writing symtab file");
+}
+
+// Function to write the OPTAB to a file (optab.txt)
+int writeOptabToFile(const program *prog, const char *path) {
+    atomic_file optab_file;
+    if (openAtomicFile(&optab_file, path) != 0) {
+        return -1;
+    }
+
+    output_buffer out;
+    initOutputBuffer(&out, optab_file.file);
+    for (int i = 0; i < prog->optab_size; i++) {
+        const optab_entry *op = &optab[prog->optab_ids[i]];
+        if (op->format == 0) continue;
+        appendField(&out, op->mnemonic, strlen(op->mnemonic), 10);
+        appendChar(&out, ' ');
+        appendHexField(&out, op->opcode, 10);
+        appendChar(&out, '\n');
+    }
+
+    return closeDebugFile(&out, &optab_file, "Error writing optab file");
+}
+
+// Function to tokenize the line of the intermediate file starting at position
+// into a source line, returns the position of the next line
+static size_t parseIntermediateLine(program *prog, size_t position, source_line *current_line) {
+    source_view line, fields[MAX_SPLIT_FIELDS];
+    size_t next = nextLine(prog->text, prog->text_size, position, &line);
+
+    memset(current_line, 0, sizeof(*current_line));
+    current_line->label_id = -1;
+    current_line->opcode_id = -1;
+    current_line->operand_id = -1;
+
+    // Columns are "%-10X %-10s %-10s %-10s", so the label column is
+    // blank when the instruction has no label
+    int has_label = line.length > 11 && prog->text[line.offset + 11] != ' ';
+    int count = splitFields(prog->text, line, fields, has_label ? 4 : 3);
+    if (count == 0) return next;
+
+    int field = 0;
+    current_line->locctr = parseHex(prog->text, fields[field++]);
+    if (has_label && field < count) {
+        // Labels are normally already defined by the symtab file
+        source_view label = fields[field++];
+        current_line->label_id = searchSymtab(&prog->symtab, prog->text + label.offset, label.length);
+        if (current_line->label_id == -1) {
+            defineLabel(prog, current_line, label, current_line->locctr);
+        }
+    }
+    if (field < count) current_line->mnemonic = fields[field++];
+    if (field < count) current_line->operand = fields[field++];
+
+    resolveMnemonic(prog, current_line);
+    return next;
+}
+
+// Function to check whether the intermediate file holds a SIC/XE program.
+// Only a file with a +, # or @ or a BASE somewhere is tokenized to find out.
+static int isXeIntermediate(program *prog) {
+    const char *text = prog->text;
+    size_t size = prog->text_size;
+    if (!memchr(text, '+', size) && !memchr(text, '#', size) && !memchr(text, '@', size) &&
+        !memmem(text, size, "BASE", 4)) {
+        return 0;
+    }
+
+    source_line current_line;
+    size_t position = 0;
+    while (position < size) {
+        position = parseIntermediateLine(prog, position, &current_line);
+        if (usesXeAddressing(text, &current_line)) return 1;
+    }
+    return 0;
+}
+
+// Function to run pass 2 straight from the (mapped) intermediate file.
+// Records are tokenized and emitted one at a time, so memory use does not
+// grow with the program: only the SYMTAB and the current text record are held.
+int runStreamingPass2(program *prog, const char *text, size_t size, FILE *object_file) {
+    source_line current_line;
+    pass2_state state;
+    size_t position = 0;
+    int base_id = -1;
+
+    prog->text = text;
+    prog->text_size = size;
+    prog->is_xe = isXeIntermediate(prog);
+
+    initPass2(prog, &state, object_file);
+    while (position < size) {
+        position = parseIntermediateLine(prog, position, &current_line);
+        if (current_line.mnemonic.length == 0) continue;
+
+        // Every format 3 instruction of a SIC/XE program (the + ones are format 4)
+        // is encoded with the BASE in effect
+        if (prog->is_xe) {
+            base_id = trackBase(prog, &current_line, base_id);
+            current_line.base_id = base_id;
+            if (current_line.opcode_id != -1 && optab[current_line.opcode_id].format == 3 &&
+                current_line.format != 4) {
+                current_line.format = 3;
+            }
+        }
+
+        // The program length is patched into the header at the end
+        STATS_COUNT(COUNTER_LINES, 1);
+        emitLine(prog, &state, &current_line, -1);
+    }
+
+    return finishPass2(&state);
+}
+
+// Function to parse the symbol table file back into a program
+int readSymtabFile(program *prog, const char *path) {
+    source_buffer buffer;
+    if (openSourceBuffer(&buffer, path) != 0) {
+        return -1;
+    }
+
+    // Every line is "name address", both fields are read in place
+    source_view line, fields[2];
+    size_t position = 0;
+    while (position < buffer.size) {
+        position = nextLine(buffer.data, buffer.size, position, &line);
+        if (splitFields(buffer.data, line, fields, 2) == 2) {
+            addToSymtab(&prog->symtab, buffer.data + fields[0].offset, fields[0].length,
+                        parseHex(buffer.data, fields[1]));
+        }
+    }
+
+    closeSourceBuffer(&buffer);
+    return 0;
+}
+
+// ------x--------x----------x------------x------ FILES ----------------x------------x----------------x-----------x
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
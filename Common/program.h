@@ -0,0 +1,183 @@
+#ifndef PROGRAM_H
+#define PROGRAM_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "object.h"
+#include "optab.h"
+#include "source.h"
+#include "symtab.h"
+
+#define MAX_CODE_LENGTH 64
+
+// Addresses a SIC format 3 instruction can hold: the top bit of its 16-bit
+// address field is the index bit
+#define SIC_ADDRESS_LIMIT 0x8000
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// ------x--------x----------x------------x------ PROGRAM ----------------x------------x----------------x-----------x
+
+// Structure for each instruction, to store its address, label, mnemonic and operand.
+// The label is kept as its symbol id in the SYMTAB (-1 when the line has none)
+// and the mnemonic is resolved to its optab_id once (-1 when it is unknown).
+// The mnemonic and operand are views into the text of the program.
+// operand_id is the symbol id of the operand when it is already known
+// (-1 means pass 2 looks the operand up by name). In a SIC/XE program
+// format is 3 or 4 for a format 3 / 4 instruction and base_id is the symbol
+// of the BASE in effect (-1 for none); format 0 is the SIC encoding, and
+// base_id is then unused.
+typedef struct {
+    int locctr;
+    int label_id;
+    int opcode_id;
+    int operand_id;
+    source_view mnemonic;
+    source_view operand;
+    int format;
+    int base_id;
+} source_line;
+
+// Operand of a format 3 / 4 instruction: [#|@]value[,X]
+typedef struct {
+    source_view value;      // Symbol or decimal number, empty for none (RSUB)
+    int ni;                 // The n and i bits: XE_IMMEDIATE, XE_INDIRECT or XE_SIMPLE
+    int indexed;
+    int is_constant;        // value is a number (or empty) rather than a symbol
+} xe_operand;
+
+#define XE_IMMEDIATE 1
+#define XE_INDIRECT 2
+#define XE_SIMPLE 3
+
+// What pass 2 needs of every line, as parallel arrays indexed like the
+// lines. Pass 1 resolves the operand of a format 3 instruction and keeps its
+// object code, so pass 2 reads 9 bytes of the line (locctr, word, flags)
+// instead of its source_line, its text and the SYMTAB. The text and labels
+// stay in the lines, for listings and messages.
+typedef struct {
+    int32_t *locctr;
+    int32_t *symbol_id;     // SYMTAB id of the operand symbol, -1 for none or undefined
+    uint32_t *word;         // Object code of a resolved format 3 or 4 instruction
+    int16_t *opcode_id;
+    uint8_t *flags;         // LINE_CODE_*
+    int count;              // Equal to line_count when it is up to date
+    int capacity;
+} line_code;
+
+// The line is a format 3 instruction whose operand (if any) is resolved,
+// so it is encoded from the line code alone
+#define LINE_CODE_RESOLVED 0x01
+// The operand ends with ",X"
+#define LINE_CODE_INDEXED 0x02
+// The word is a format 4 instruction, all 4 bytes of it
+#define LINE_CODE_EXTENDED 0x04
+
+// In-memory representation of a program shared by pass 1 and pass 2.
+// Pass 1 fills in the lines and the tables, pass 2 only reads them, so
+// nothing has to be written to disk and parsed back between the passes.
+typedef struct {
+    // Text the views of the lines point into (the mapped source file)
+    const char *text;
+    size_t text_size;
+
+    source_line *lines;
+    int line_count;
+    int line_capacity;
+
+    symtab symtab;
+
+    // Hot fields of the lines for pass 2
+    line_code code;
+
+    // Ids of the OPTAB entries the program uses, in order of first use
+    int optab_ids[OPTAB_COUNT];
+    unsigned char optab_used[OPTAB_COUNT];
+    int optab_size;
+
+    int start_address;
+    int end_address;
+    int is_start_found;
+
+    // Some line uses SIC/XE addressing (+, #, @ or BASE), so every format 3
+    // instruction is encoded with it and pass 1 relaxes their formats
+    int is_xe;
+
+    // The program is one control section, assembled on its own (Common/csect.c):
+    // its EXTREF symbols are kept apart from the SYMTAB, and encode as address 0
+    int is_section;
+    symtab external;
+
+    // Where errors and warnings are reported (stderr when NULL)
+    FILE *diagnostics;
+} program;
+
+// State of pass 2 while it writes an object program, line by line
+typedef struct {
+    FILE *object_file;
+    object_writer writer;
+    int started;
+    int entry_address;
+    int end_address;
+    int errors;
+    FILE *diagnostics;
+} pass2_state;
+
+// Program lifetime
+void initProgram(program *prog);
+void freeProgram(program *prog);
+void resetProgram(program *prog);
+source_line *addSourceLine(program *prog);
+void setDiagnostics(program *prog, FILE *out);
+FILE *getDiagnostics(const program *prog);
+
+// OPTAB
+int resolveMnemonic(program *prog, source_line *line);
+
+// Line code
+int reserveLineCode(program *prog, int count);
+void resolveLineCode(program *prog, int first, int last);
+int buildLineCode(program *prog);
+
+// SIC/XE addressing
+int usesXeAddressing(const char *text, const source_line *line);
+void parseXeOperand(const char *text, source_view operand, xe_operand *parsed);
+int trackBase(const program *prog, const source_line *line, int base_id);
+int getFormat3Field(int locctr, int target, int base, const xe_operand *operand);
+int getLineSize(const char *text, const source_line *line);
+
+// SYMTAB
+int lookupSymbol(const program *prog, source_view symbol);
+int isExternalSymbol(const program *prog, source_view symbol);
+int isSymbolWord(const char *text, const source_line *line);
+const char *getLineLabel(const program *prog, const source_line *line);
+void defineLabel(program *prog, source_line *line, source_view label, int address);
+
+// Pass 1 & Pass 2
+int getInstructionSize(int opcode_id, const char *text, source_view operand);
+source_line *addAddressedLine(program *prog, const source_fields *fields, int *locctr);
+int runPass1(program *prog, const char *text, size_t size);
+int runPass2(const program *prog, FILE *object_file);
+int encodeLine(const program *prog, const source_line *line, unsigned char *code);
+void initPass2(const program *prog, pass2_state *state, FILE *object_file);
+int hasObjectCode(const source_line *line);
+int encodeLineCode(const program *prog, const source_line *line, unsigned char **code, int *errors);
+void emitCode(const program *prog, pass2_state *state, const source_line *line,
+              const unsigned char *code, int size, int program_length);
+int emitLine(const program *prog, pass2_state *state, const source_line *line, int program_length);
+int encodeResolvedLine(const program *prog, int index, unsigned char *code);
+void emitLineAt(const program *prog, pass2_state *state, int index, int program_length);
+int finishPass2(pass2_state *state);
+
+// Listing and debug files
+void printListing(const program *prog, FILE *out);
+int writeIntermediateFile(const program *prog, const char *path);
+int writeSymtabToFile(const program *prog, const char *path);
+int writeOptabToFile(const program *prog, const char *path);
+int runStreamingPass2(program *prog, const char *text, size_t size, FILE *object_file);
+int readSymtabFile(program *prog, const char *path);
+
+// ------x--------x----------x------------x------ PROGRAM ----------------x------------x----------------x-----------x
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+
+#endif
@@ -0,0 +1,132 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "protocol.h"
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// ------x--------x----------x------------x------ PROTOCOL ----------------x------------x----------------x----------x
+
+// Function to write a whole buffer to a descriptor
+int writeFully(int fd, const void *data, size_t size) {
+    const char *bytes = data;
+    while (size > 0) {
+        ssize_t count = write(fd, bytes, size);
+        if (count < 0 && errno == EINTR) continue;
+        if (count <= 0) return -1;
+        bytes += count;
+        size -= count;
+    }
+    return 0;
+}
+
+// Function to read a whole buffer from a descriptor
+int readFully(int fd, void *data, size_t size) {
+    char *bytes = data;
+    while (size > 0) {
+        ssize_t count = read(fd, bytes, size);
+        if (count < 0 && errno == EINTR) continue;
+        if (count <= 0) return -1;
+        bytes += count;
+        size -= count;
+    }
+    return 0;
+}
+
+// Function to read a header line, returns 1 at the end of the stream
+// before the first byte, -1 on an error or an overlong line
+static int readHeader(int fd, char *line, size_t size) {
+    size_t length = 0;
+    for (;;) {
+        char ch;
+        ssize_t count = read(fd, &ch, 1);
+        if (count < 0 && errno == EINTR) continue;
+        if (count == 0 && length == 0) return 1;
+        if (count <= 0) return -1;
+        if (ch == '\n') break;
+        if (length + 1 >= size) return -1;
+        line[length++] = ch;
+    }
+    line[length] = 0;
+    return 0;
+}
+
+// Function to read size bytes into a new NUL-terminated buffer
+static char *readBody(int fd, size_t size) {
+    char *data = malloc(size + 1);
+    if (!data) return NULL;
+    if (readFully(fd, data, size) != 0) {
+        free(data);
+        return NULL;
+    }
+    data[size] = 0;
+    return data;
+}
+
+// Function to send a source program to the daemon
+int sendAssembleRequest(int fd, const char *source, size_t size, const sic_options *options) {
+    char header[MAX_HEADER_LENGTH];
+    int length = snprintf(header, sizeof(header), "ASSEMBLE %zu %d\n", size, options && options->listing);
+    if (writeFully(fd, header, length) != 0) return -1;
+    return writeFully(fd, source, size);
+}
+
+// Function to read the next source program sent to the daemon
+int receiveAssembleRequest(int fd, source_buffer *source, sic_options *options) {
+    char header[MAX_HEADER_LENGTH];
+    size_t size;
+    int listing;
+
+    memset(source, 0, sizeof(*source));
+    memset(options, 0, sizeof(*options));
+
+    int status = readHeader(fd, header, sizeof(header));
+    if (status != 0) return status;
+    if (sscanf(header, "ASSEMBLE %zu %d", &size, &listing) != 2 || size > MAX_REQUEST_SIZE) {
+        return -1;
+    }
+
+    source->data = readBody(fd, size);
+    if (!source->data) return -1;
+    source->size = size;
+    options->listing = listing;
+    return 0;
+}
+
+// Function to send the result of an assembly back to the client
+int sendAssembleResult(int fd, const sic_result *result) {
+    char header[MAX_HEADER_LENGTH];
+    int length = snprintf(header, sizeof(header), "RESULT %d %zu %zu %zu\n", result->status,
+                          result->object_size, result->listing_size, result->diagnostics_size);
+
+    if (writeFully(fd, header, length) != 0) return -1;
+    if (writeFully(fd, result->object_program, result->object_size) != 0) return -1;
+    if (writeFully(fd, result->listing, result->listing_size) != 0) return -1;
+    return writeFully(fd, result->diagnostics, result->diagnostics_size);
+}
+
+// Function to read the result of an assembly from the daemon
+int receiveAssembleResult(int fd, sic_result *result) {
+    char header[MAX_HEADER_LENGTH];
+    memset(result, 0, sizeof(*result));
+
+    if (readHeader(fd, header, sizeof(header)) != 0) return -1;
+    if (sscanf(header, "RESULT %d %zu %zu %zu", &result->status, &result->object_size,
+               &result->listing_size, &result->diagnostics_size) != 4) {
+        return -1;
+    }
+
+    result->object_program = readBody(fd, result->object_size);
+    result->listing = readBody(fd, result->listing_size);
+    result->diagnostics = readBody(fd, result->diagnostics_size);
+    if (!result->object_program || !result->listing || !result->diagnostics) {
+        sic_free_result(result);
+        return -1;
+    }
+    return 0;
+}
+
+// ------x--------x----------x------------x------ PROTOCOL ----------------x------------x----------------x----------x
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
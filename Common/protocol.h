@@ -0,0 +1,39 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <stddef.h>
+
+#include "sic.h"
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// ------x--------x----------x------------x------ PROTOCOL ----------------x------------x----------------x----------x
+
+// Requests and replies of the assembly daemon (sicasmd) over a stream
+// socket. Each is one header line followed by raw bytes, so a connection
+// can carry any number of requests in a row:
+//
+//   ASSEMBLE <source size> <listing 0|1>\n<source>
+//   RESULT <status> <object size> <listing size> <diagnostics size>\n<object><listing><diagnostics>
+
+#define DEFAULT_SOCKET_PATH "/tmp/sicasmd.sock"
+#define MAX_HEADER_LENGTH 128
+#define MAX_REQUEST_SIZE (256 * 1024 * 1024)
+
+// Functions to move a whole buffer over a descriptor (retrying short reads
+// and writes), returning -1 on an error or an early end of stream
+int writeFully(int fd, const void *data, size_t size);
+int readFully(int fd, void *data, size_t size);
+
+int sendAssembleRequest(int fd, const char *source, size_t size, const sic_options *options);
+
+// Function to read the next request into source (malloc'd), returns 1 when
+// the peer closed the connection between requests
+int receiveAssembleRequest(int fd, source_buffer *source, sic_options *options);
+
+int sendAssembleResult(int fd, const sic_result *result);
+int receiveAssembleResult(int fd, sic_result *result);
+
+// ------x--------x----------x------------x------ PROTOCOL ----------------x------------x----------------x----------x
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+
+#endif
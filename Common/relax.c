@@ -0,0 +1,232 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "relax.h"
+#include "stats.h"
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// ------x--------x----------x------------x------ RELAXATION ----------------x------------x----------------x-------x
+
+// A format 3 instruction reaches at most 4095 bytes past the base register
+// or 2048 bytes from the PC (3 bytes past the instruction), so one that
+// reaches its operand only stops doing so when a line between the two
+// grows: the operand or the instruction then lies at most this many bytes
+// after the grown line.
+#define RELAX_REACH (4096 + 3)
+
+// The 12-bit and the SIC 15-bit addresses reach the operand from anywhere,
+// as long as it lies below this address
+#define RELAX_ABSOLUTE_LIMIT 0x8000
+
+// What the operand of a line is, for relaxation
+enum {
+    OPERAND_NONE,       // Not a format 3 instruction, or nothing to relax it by
+    OPERAND_CONSTANT,   // A number, its reach does not depend on the layout
+    OPERAND_LINE,       // A label, defined by the line in target_lines
+    OPERAND_WIDENED,    // The instruction was widened to format 4
+    OPERAND_EXTERNAL,   // An EXTREF symbol, whose address only format 4 has room for
+};
+
+typedef struct {
+    program *prog;
+    int line_count;
+
+    // Fenwick tree over the lines of the bytes each has grown by, so the
+    // address of a line is its pass 1 LOCCTR plus a prefix sum
+    int *growth;
+
+    int *symbol_lines;      // Line defining every symbol, -1 for none
+    int *target_lines;      // Line defining the operand of every instruction
+    uint8_t *kinds;         // OPERAND_* of every line
+
+    // Instructions whose operand is defined by line t:
+    // referrers[reference_starts[t] .. reference_starts[t + 1])
+    int *reference_starts;
+    int *referrers;
+
+    // Instructions to check again, each queued at most once at a time
+    int *worklist;
+    int worklist_size;
+    uint8_t *queued;
+} relaxation;
+
+// Function to add bytes to the growth of line index
+static void addGrowth(relaxation *relax, int index, int bytes) {
+    for (int i = index + 1; i <= relax->line_count; i += i & -i) {
+        relax->growth[i] += bytes;
+    }
+}
+
+// Function to get the address line index has now
+static int getLineAddress(const relaxation *relax, int index) {
+    int address = relax->prog->lines[index].locctr;
+    for (int i = index; i > 0; i -= i & -i) {
+        address += relax->growth[i];
+    }
+    return address;
+}
+
+// Function to check whether instruction index reaches its operand in format 3
+static int reachesInFormat3(const relaxation *relax, int index) {
+    const program *prog = relax->prog;
+    const source_line *line = &prog->lines[index];
+    if (relax->kinds[index] == OPERAND_EXTERNAL) return 0;
+    xe_operand operand;
+    parseXeOperand(prog->text, line->operand, &operand);
+
+    int target = relax->kinds[index] == OPERAND_LINE ? getLineAddress(relax, relax->target_lines[index])
+                                                     : parseDecimal(prog->text, operand.value);
+    int base = -1;
+    if (line->base_id != -1 && relax->symbol_lines[line->base_id] != -1) {
+        base = getLineAddress(relax, relax->symbol_lines[line->base_id]);
+    }
+    STATS_COUNT(COUNTER_RELAX_CHECKS, 1);
+    return getFormat3Field(getLineAddress(relax, index), target, base, &operand) != -1;
+}
+
+// Function to queue instruction index to be checked again
+static void queueLine(relaxation *relax, int index) {
+    if (relax->queued[index] || relax->kinds[index] == OPERAND_NONE || relax->kinds[index] == OPERAND_WIDENED) {
+        return;
+    }
+    relax->queued[index] = 1;
+    relax->worklist[relax->worklist_size++] = index;
+}
+
+// Function to widen instruction index to format 4, and queue every
+// instruction whose reach the extra byte may have changed: the ones that
+// lie, or whose operand lies, within reach after it
+static void widenLine(relaxation *relax, int index) {
+    relax->prog->lines[index].format = 4;
+    relax->kinds[index] = OPERAND_WIDENED;
+    addGrowth(relax, index, 1);
+    STATS_COUNT(COUNTER_WIDENED, 1);
+
+    int limit = getLineAddress(relax, index) + 4 + RELAX_REACH;
+    if (limit < RELAX_ABSOLUTE_LIMIT) limit = RELAX_ABSOLUTE_LIMIT;
+    for (int k = index + 1; k < relax->line_count && getLineAddress(relax, k) <= limit; k++) {
+        queueLine(relax, k);
+        for (int j = relax->reference_starts[k]; j < relax->reference_starts[k + 1]; j++) {
+            queueLine(relax, relax->referrers[j]);
+        }
+    }
+}
+
+// Function to give every line its format and BASE, and find what the
+// operand of every format 3 instruction refers to
+static void classifyLines(relaxation *relax) {
+    program *prog = relax->prog;
+    int count = relax->line_count;
+
+    // Lines before a START are addressed from 0 and are not moved past it
+    int first = 0;
+    while (first < count && prog->lines[first].opcode_id != OP_START) first++;
+    if (first == count) first = 0;
+
+    int base_id = -1;
+    memset(relax->symbol_lines, -1, prog->symtab.size * sizeof(int));
+    for (int i = 0; i < count; i++) {
+        source_line *line = &prog->lines[i];
+        if (line->label_id != -1 && relax->symbol_lines[line->label_id] == -1) relax->symbol_lines[line->label_id] = i;
+        base_id = trackBase(prog, line, base_id);
+        line->base_id = base_id;
+        if (line->opcode_id != -1 && optab[line->opcode_id].format == 3 && line->format != 4) line->format = 3;
+    }
+
+    // An operand with both ,X and # or @ is an error pass 2 reports
+    for (int i = first; i < count; i++) {
+        const source_line *line = &prog->lines[i];
+        if (line->format != 3) continue;
+
+        xe_operand operand;
+        parseXeOperand(prog->text, line->operand, &operand);
+        if (operand.indexed && operand.ni != XE_SIMPLE) continue;
+        if (operand.is_constant) {
+            relax->kinds[i] = OPERAND_CONSTANT;
+            continue;
+        }
+        int id = searchSymtab(&prog->symtab, prog->text + operand.value.offset, operand.value.length);
+        if (id == -1 && isExternalSymbol(prog, operand.value)) relax->kinds[i] = OPERAND_EXTERNAL;
+        if (id == -1 || relax->symbol_lines[id] == -1) continue;
+        relax->kinds[i] = OPERAND_LINE;
+        relax->target_lines[i] = relax->symbol_lines[id];
+        relax->reference_starts[relax->target_lines[i] + 1]++;
+    }
+
+    // Counts to offsets, then every reference into its place (the worklist
+    // is still free and holds the next place of every target)
+    for (int t = 0; t < count; t++) {
+        relax->reference_starts[t + 1] += relax->reference_starts[t];
+    }
+    memcpy(relax->worklist, relax->reference_starts, count * sizeof(int));
+    for (int i = first; i < count; i++) {
+        if (relax->kinds[i] == OPERAND_LINE) relax->referrers[relax->worklist[relax->target_lines[i]]++] = i;
+    }
+}
+
+// Function to choose the format of every instruction and lay the program out again
+int relaxProgram(program *prog) {
+    relaxation relax;
+    memset(&relax, 0, sizeof(relax));
+    relax.prog = prog;
+    relax.line_count = prog->line_count;
+
+    int count = prog->line_count;
+    relax.growth = calloc(count + 1, sizeof(int));
+    relax.symbol_lines = malloc((prog->symtab.size + 1) * sizeof(int));
+    relax.target_lines = malloc((count + 1) * sizeof(int));
+    relax.kinds = calloc(count + 1, 1);
+    relax.reference_starts = calloc(count + 1, sizeof(int));
+    relax.referrers = malloc((count + 1) * sizeof(int));
+    relax.worklist = malloc((count + 1) * sizeof(int));
+    relax.queued = calloc(count + 1, 1);
+
+    int status = 0;
+    if (!relax.growth || !relax.symbol_lines || !relax.target_lines || !relax.kinds || !relax.reference_starts ||
+        !relax.referrers || !relax.worklist || !relax.queued) {
+        fprintf(getDiagnostics(prog), "Error: Out of memory.\n");
+        status = -1;
+    }
+
+    if (status == 0) {
+        STATS_START(start);
+        classifyLines(&relax);
+
+        // Every instruction is checked once, then only the ones a widening may affect
+        for (int i = count - 1; i >= 0; i--) {
+            queueLine(&relax, i);
+        }
+        while (relax.worklist_size > 0) {
+            int index = relax.worklist[--relax.worklist_size];
+            relax.queued[index] = 0;
+            if (!reachesInFormat3(&relax, index)) widenLine(&relax, index);
+        }
+
+        // Lay the lines out again; a label keeps the address of the line defining it first
+        int moved = 0;
+        for (int i = 0; i < count; i++) {
+            source_line *line = &prog->lines[i];
+            line->locctr += moved;
+            if (line->label_id != -1 && relax.symbol_lines[line->label_id] == i) {
+                setSymbolAddress(&prog->symtab, line->label_id, line->locctr);
+            }
+            if (relax.kinds[i] == OPERAND_WIDENED) moved++;
+        }
+        prog->end_address += moved;
+        STATS_STOP(PHASE_LAYOUT, start);
+    }
+
+    free(relax.growth);
+    free(relax.symbol_lines);
+    free(relax.target_lines);
+    free(relax.kinds);
+    free(relax.reference_starts);
+    free(relax.referrers);
+    free(relax.worklist);
+    free(relax.queued);
+    return status;
+}
+
+// ------x--------x----------x------------x------ RELAXATION ----------------x------------x----------------x-------x
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
@@ -0,0 +1,25 @@
+#ifndef RELAX_H
+#define RELAX_H
+
+#include "program.h"
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// ------x--------x----------x------------x------ RELAXATION ----------------x------------x----------------x-------x
+
+// Function to choose the format of every format 3 / 4 instruction of a
+// SIC/XE program after pass 1 has laid it out (with every instruction
+// without a + in format 3), and lay it out again. An instruction whose
+// operand no format 3 addressing reaches (an EXTREF symbol never is) is
+// widened to format 4; that
+// moves everything after it, so only the instructions whose operand or
+// position lies within reach of the move are checked again, from a
+// worklist, until none has to be widened. Instructions only ever grow, so
+// this ends after at most one widening per instruction. Every line gets
+// its format and the BASE in effect; the addresses of the lines, the
+// SYMTAB and the end address are updated.
+int relaxProgram(program *prog);
+
+// ------x--------x----------x------------x------ RELAXATION ----------------x------------x----------------x-------x
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+
+#endif
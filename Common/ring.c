@@ -0,0 +1,83 @@
+#define _GNU_SOURCE
+#include <limits.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+#include "ring.h"
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// ------x--------x----------x------------x------ RING BUFFER ----------------x------------x----------------x-----x
+
+// Function to initialise an empty ring
+void initRing(spsc_ring *ring) {
+    memset(ring, 0, sizeof(*ring));
+}
+
+// Function to tell the processor this thread is spinning
+static inline void relaxProcessor(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+// Function to wait until a counter of the other side is no longer seen.
+// The sleeping flag and the counter are both sequentially consistent, so
+// either the waiter sees the new value or the other side sees the flag
+// and wakes it; the futex itself also rechecks the value before sleeping.
+static void waitForCounter(uint32_t *counter, uint32_t seen, uint32_t *sleeping) {
+    for (int i = 0; i < RING_SPIN_LIMIT; i++) {
+        if (__atomic_load_n(counter, __ATOMIC_ACQUIRE) != seen) return;
+        relaxProcessor();
+    }
+
+    __atomic_store_n(sleeping, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(counter, __ATOMIC_SEQ_CST) == seen) {
+        syscall(SYS_futex, counter, FUTEX_WAIT_PRIVATE, seen, NULL, NULL, 0);
+    }
+    __atomic_store_n(sleeping, 0, __ATOMIC_RELAXED);
+}
+
+// Function to move a counter on, waking the other side if it sleeps on it
+static void advanceCounter(uint32_t *counter, uint32_t value, uint32_t *sleeping) {
+    __atomic_store_n(counter, value, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(sleeping, __ATOMIC_SEQ_CST)) {
+        syscall(SYS_futex, counter, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+    }
+}
+
+// Function to add an item, waiting while the ring is full
+void pushRing(spsc_ring *ring, void *item) {
+    uint32_t head = ring->head;
+    uint32_t tail;
+    while (head - (tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE)) == RING_CAPACITY) {
+        waitForCounter(&ring->tail, tail, &ring->producer_sleeping);
+    }
+    ring->slots[head % RING_CAPACITY] = item;
+    advanceCounter(&ring->head, head + 1, &ring->consumer_sleeping);
+}
+
+// Function to take the oldest item, waiting while the ring is empty
+void *popRing(spsc_ring *ring) {
+    uint32_t tail = ring->tail;
+    uint32_t head;
+    while ((head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE)) == tail) {
+        waitForCounter(&ring->head, head, &ring->consumer_sleeping);
+    }
+    void *item = ring->slots[tail % RING_CAPACITY];
+    advanceCounter(&ring->tail, tail + 1, &ring->producer_sleeping);
+    return item;
+}
+
+// Function to take the oldest item without waiting
+int tryPopRing(spsc_ring *ring, void **item) {
+    uint32_t tail = ring->tail;
+    if (__atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == tail) return 0;
+    *item = ring->slots[tail % RING_CAPACITY];
+    advanceCounter(&ring->tail, tail + 1, &ring->producer_sleeping);
+    return 1;
+}
+
+// ------x--------x----------x------------x------ RING BUFFER ----------------x------------x----------------x-----x
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
@@ -0,0 +1,44 @@
+#ifndef RING_H
+#define RING_H
+
+#include <stdint.h>
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// ------x--------x----------x------------x------ RING BUFFER ----------------x------------x----------------x-----x
+
+// Slots of a ring, a power of two
+#define RING_CAPACITY 16
+
+// Checks of the other side before a waiting thread goes to sleep
+#define RING_SPIN_LIMIT 256
+
+// A bounded queue of pointers between one producer thread and one consumer
+// thread. Each side only writes its own counter (head for the producer,
+// tail for the consumer), on a cache line of its own, so passing an item
+// takes no lock and no read-modify-write. A producer that finds the ring
+// full, or a consumer that finds it empty, spins briefly and then sleeps on
+// the other side's counter (a futex) until it moves: that is the
+// backpressure between the stages of a pipeline.
+typedef struct {
+    _Alignas(64) uint32_t head;         // Items pushed so far
+    uint32_t consumer_sleeping;
+    _Alignas(64) uint32_t tail;         // Items popped so far
+    uint32_t producer_sleeping;
+    _Alignas(64) void *slots[RING_CAPACITY];
+} spsc_ring;
+
+void initRing(spsc_ring *ring);
+
+// Function to add an item, waiting while the ring is full (producer only)
+void pushRing(spsc_ring *ring, void *item);
+
+// Function to take the oldest item, waiting while the ring is empty (consumer only)
+void *popRing(spsc_ring *ring);
+
+// Function to take the oldest item without waiting, returns 0 when the ring is empty
+int tryPopRing(spsc_ring *ring, void **item);
+
+// ------x--------x----------x------------x------ RING BUFFER ----------------x------------x----------------x-----x
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+
+#endif
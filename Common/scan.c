@@ -0,0 +1,311 @@
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SCAN_X86 1
+#endif
+
+#include "scan.h"
+#include "stats.h"
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// ------x--------x----------x------------x------ KERNELS ----------------x------------x----------------x-----------x
+
+// Bit i of every mask describes byte i of the block
+typedef struct {
+    uint64_t blank;
+    uint64_t newline;
+    uint64_t quote;
+} block_masks;
+
+typedef void (*classify_function)(const char *block, block_masks *masks);
+
+// Function to classify a block one byte at a time (any CPU)
+static void classifyScalar(const char *block, block_masks *masks) {
+    uint64_t blank = 0, newline = 0, quote = 0;
+    for (int i = 0; i < SCAN_BLOCK_SIZE; i++) {
+        uint64_t bit = 1ULL << i;
+        if (block[i] == ' ' || block[i] == '\t') blank |= bit;
+        else if (block[i] == '\n') newline |= bit;
+        else if (block[i] == '\'') quote |= bit;
+    }
+    masks->blank = blank;
+    masks->newline = newline;
+    masks->quote = quote;
+}
+
+#ifdef SCAN_X86
+// Function to classify a block 16 bytes at a time
+__attribute__((target("sse2")))
+static void classifySSE2(const char *block, block_masks *masks) {
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i newline = _mm_set1_epi8('\n');
+    const __m128i quote = _mm_set1_epi8('\'');
+    uint64_t blank_bits = 0, newline_bits = 0, quote_bits = 0;
+
+    for (int i = 0; i < SCAN_BLOCK_SIZE; i += 16) {
+        __m128i bytes = _mm_loadu_si128((const __m128i *)(block + i));
+        __m128i blank = _mm_or_si128(_mm_cmpeq_epi8(bytes, space), _mm_cmpeq_epi8(bytes, tab));
+        blank_bits |= (uint64_t)(uint16_t)_mm_movemask_epi8(blank) << i;
+        newline_bits |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, newline)) << i;
+        quote_bits |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, quote)) << i;
+    }
+    masks->blank = blank_bits;
+    masks->newline = newline_bits;
+    masks->quote = quote_bits;
+}
+
+// Function to classify a block 32 bytes at a time
+__attribute__((target("avx2")))
+static void classifyAVX2(const char *block, block_masks *masks) {
+    const __m256i space = _mm256_set1_epi8(' ');
+    const __m256i tab = _mm256_set1_epi8('\t');
+    const __m256i newline = _mm256_set1_epi8('\n');
+    const __m256i quote = _mm256_set1_epi8('\'');
+    uint64_t blank_bits = 0, newline_bits = 0, quote_bits = 0;
+
+    for (int i = 0; i < SCAN_BLOCK_SIZE; i += 32) {
+        __m256i bytes = _mm256_loadu_si256((const __m256i *)(block + i));
+        __m256i blank = _mm256_or_si256(_mm256_cmpeq_epi8(bytes, space), _mm256_cmpeq_epi8(bytes, tab));
+        blank_bits |= (uint64_t)(uint32_t)_mm256_movemask_epi8(blank) << i;
+        newline_bits |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, newline)) << i;
+        quote_bits |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, quote)) << i;
+    }
+    masks->blank = blank_bits;
+    masks->newline = newline_bits;
+    masks->quote = quote_bits;
+}
+#endif
+
+static classify_function classify_kernel;
+static scan_kernel selected_kernel = SCAN_AUTO;
+static pthread_once_t kernel_once = PTHREAD_ONCE_INIT;
+
+// Function to check whether the CPU can run a kernel
+static int isKernelSupported(scan_kernel kernel) {
+    switch (kernel) {
+    case SCAN_AUTO:
+    case SCAN_SCALAR:
+        return 1;
+#ifdef SCAN_X86
+    case SCAN_SSE2:
+        return __builtin_cpu_supports("sse2");
+    case SCAN_AVX2:
+        return __builtin_cpu_supports("avx2");
+#endif
+    default:
+        return 0;
+    }
+}
+
+// Function to pick the kernel, the first time a block is classified
+static void chooseKernel(void) {
+    scan_kernel kernel = selected_kernel;
+#ifdef SCAN_X86
+    __builtin_cpu_init();
+    if (kernel == SCAN_AUTO) {
+        kernel = isKernelSupported(SCAN_AVX2) ? SCAN_AVX2 : isKernelSupported(SCAN_SSE2) ? SCAN_SSE2 : SCAN_SCALAR;
+    }
+#else
+    kernel = SCAN_SCALAR;
+#endif
+    selected_kernel = kernel;
+
+    switch (kernel) {
+#ifdef SCAN_X86
+    case SCAN_SSE2: classify_kernel = classifySSE2; break;
+    case SCAN_AVX2: classify_kernel = classifyAVX2; break;
+#endif
+    default: classify_kernel = classifyScalar; break;
+    }
+}
+
+// Function to choose the kernel before anything is scanned
+int selectScanKernel(scan_kernel kernel) {
+#ifdef SCAN_X86
+    __builtin_cpu_init();
+#endif
+    if (!isKernelSupported(kernel)) return -1;
+    selected_kernel = kernel;
+    chooseKernel();
+    return 0;
+}
+
+// Function to get the name of the kernel in use
+const char *getScanKernelName(void) {
+    pthread_once(&kernel_once, chooseKernel);
+    static const char *names[] = {"auto", "scalar", "sse2", "avx2"};
+    return names[selected_kernel];
+}
+
+// ------x--------x----------x------------x------ KERNELS ----------------x------------x----------------x-----------x
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+
+
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// ------x--------x----------x------------x------ SCANNER ----------------x------------x----------------x-----------x
+
+// What findNext() looks for
+enum {
+    FIND_FIELD,     // The first byte that is not blank
+    FIND_BREAK,     // The first blank or newline
+    FIND_NEWLINE
+};
+
+// Function to classify the block starting at start. The block past the
+// end of the text reads as newlines, so every search stops there.
+static void loadBlock(source_scanner *scanner, size_t start) {
+    block_masks masks;
+    STATS_COUNT(COUNTER_SCAN_BLOCKS, 1);
+
+    if (start + SCAN_BLOCK_SIZE <= scanner->size) {
+        classify_kernel(scanner->text + start, &masks);
+    } else {
+        char block[SCAN_BLOCK_SIZE];
+        memset(block, '\n', sizeof(block));
+        memcpy(block, scanner->text + start, scanner->size - start);
+        classify_kernel(block, &masks);
+    }
+
+    scanner->block_start = start;
+    scanner->blank = masks.blank;
+    scanner->newline = masks.newline;
+    scanner->quote = masks.quote;
+}
+
+// Function to find the next byte of a kind at or after position (the end of
+// the text when there is none)
+static inline size_t findNext(source_scanner *scanner, size_t position, int kind) {
+    while (position < scanner->size) {
+        size_t offset = position - scanner->block_start;
+        if (offset >= SCAN_BLOCK_SIZE) {
+            // Blocks are aligned to 64 bytes of the text, so a line that
+            // crosses one loads the next block once
+            loadBlock(scanner, position - position % SCAN_BLOCK_SIZE);
+            offset = position - scanner->block_start;
+        }
+
+        uint64_t mask = kind == FIND_FIELD ? ~scanner->blank
+                      : kind == FIND_BREAK ? scanner->blank | scanner->newline
+                      : scanner->newline;
+        mask &= ~0ULL << offset;
+
+        if (mask) {
+            size_t found = scanner->block_start + __builtin_ctzll(mask);
+            return found < scanner->size ? found : scanner->size;
+        }
+        position = scanner->block_start + SCAN_BLOCK_SIZE;
+    }
+    return scanner->size;
+}
+
+// Function to check whether text[begin, end) holds a quote
+static int hasQuote(source_scanner *scanner, size_t begin, size_t end) {
+    // Fields are short, so they are nearly always inside the loaded block
+    if (begin >= scanner->block_start && end <= scanner->block_start + SCAN_BLOCK_SIZE) {
+        uint64_t mask = scanner->quote >> (begin - scanner->block_start);
+        if (end - begin < 64) mask &= (1ULL << (end - begin)) - 1;
+        return mask != 0;
+    }
+    return memchr(scanner->text + begin, '\'', end - begin) != NULL;
+}
+
+// Function to check whether position is the "\r" of a "\r\n" (or of the end of the text)
+static int isCarriageReturnEnd(const source_scanner *scanner, size_t position) {
+    return scanner->text[position] == '\r' &&
+           (position + 1 == scanner->size || scanner->text[position + 1] == '\n');
+}
+
+// Function to find the end of a field with quotes: it runs to the next
+// blank outside of quotes, or to the end of the line
+static size_t findQuotedFieldEnd(source_scanner *scanner, size_t start) {
+    const char *text = scanner->text;
+    size_t line_end = findNext(scanner, start, FIND_NEWLINE);
+    if (line_end > start && text[line_end - 1] == '\r') line_end--;
+
+    size_t i = start;
+    int quoted = 0;
+    while (i < line_end && (quoted || (text[i] != ' ' && text[i] != '\t'))) {
+        if (text[i] == '\'') quoted = !quoted;
+        i++;
+    }
+    return i;
+}
+
+// Function to start scanning text[begin, end)
+void initSourceScanner(source_scanner *scanner, const char *text, size_t begin, size_t end) {
+    pthread_once(&kernel_once, chooseKernel);
+
+    memset(scanner, 0, sizeof(*scanner));
+    scanner->text = text;
+    scanner->size = end;
+    scanner->position = begin;
+
+    // Nothing is loaded yet
+    scanner->block_start = (size_t)-1 - SCAN_BLOCK_SIZE;
+}
+
+// Function to tokenize the next line
+int scanSourceLine(source_scanner *state, source_fields *fields) {
+    // Work on a local copy: the text is read through a char pointer, which
+    // could alias the scanner, so the masks would be reloaded after every read
+    source_scanner local = *state, *scanner = &local;
+    const char *text = scanner->text;
+    size_t start = scanner->position;
+    if (start >= scanner->size) return 0;
+    STATS_BEGIN_LINE();
+
+    source_view empty = {start, 0};
+    fields->label = fields->mnemonic = fields->operand = empty;
+
+    // Blank lines and comment lines have no fields
+    char first = text[start];
+    int has_fields = first != '\n' && first != '.' && !isCarriageReturnEnd(scanner, start);
+
+    // If the line does not start with a tab or space then it has all three
+    // label, mnemonic and operand; otherwise only mnemonic and operand
+    int has_label = first != ' ' && first != '\t';
+    int max = has_fields ? (has_label ? 3 : 2) : 0;
+    source_view split[3];
+    int count = 0;
+
+    size_t i = start;
+    while (count < max) {
+        i = findNext(scanner, i, FIND_FIELD);
+        if (i >= scanner->size || text[i] == '\n' || isCarriageReturnEnd(scanner, i)) break;
+
+        size_t end = findNext(scanner, i, FIND_BREAK);
+        if (hasQuote(scanner, i, end)) {
+            end = findQuotedFieldEnd(scanner, i);
+        } else if (text[end - 1] == '\r' && (end == scanner->size || text[end] == '\n')) {
+            end--;
+        }
+
+        split[count].offset = i;
+        split[count].length = end - i;
+        count++;
+        i = end;
+    }
+
+    // The rest of the line is a comment
+    size_t line_end = findNext(scanner, i, FIND_NEWLINE);
+    fields->line.offset = start;
+    fields->line.length = line_end - start;
+    if (fields->line.length > 0 && text[line_end - 1] == '\r') fields->line.length--;
+    scanner->position = line_end < scanner->size ? line_end + 1 : scanner->size;
+    *state = local;
+
+    int field = 0;
+    if (has_label && count > 0) fields->label = split[field++];
+    if (field < count) fields->mnemonic = split[field++];
+    if (field < count) fields->operand = split[field++];
+    STATS_MARK(PHASE_TOKENIZE);
+    return 1;
+}
+
+// ------x--------x----------x------------x------ SCANNER ----------------x------------x----------------x-----------x
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
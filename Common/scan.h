@@ -0,0 +1,52 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "source.h"
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// ------x--------x----------x------------x------ SCANNER ----------------x------------x----------------x-----------x
+
+// Bytes classified at a time
+#define SCAN_BLOCK_SIZE 64
+
+// Kernels that classify a block; SCAN_AUTO picks the best one the CPU has
+typedef enum {
+    SCAN_AUTO,
+    SCAN_SCALAR,
+    SCAN_SSE2,
+    SCAN_AVX2
+} scan_kernel;
+
+// Tokenizer over a whole text. Every 64 byte block is classified once into
+// bit masks of its blank (space, tab), newline and quote bytes, and field
+// and line boundaries are then found with bit scans instead of byte loops.
+// The lines and fields are exactly the ones tokenizeSourceLine() finds.
+typedef struct {
+    const char *text;
+    size_t size;
+    size_t position;
+
+    size_t block_start;     // Offset of the classified block
+    uint64_t blank;
+    uint64_t newline;
+    uint64_t quote;
+} source_scanner;
+
+// Function to start scanning the lines of text[begin, end)
+void initSourceScanner(source_scanner *scanner, const char *text, size_t begin, size_t end);
+
+// Function to tokenize the next line, returns 0 when there are no lines left
+int scanSourceLine(source_scanner *scanner, source_fields *fields);
+
+// Function to choose the kernel (the default is SCAN_AUTO); returns -1 if
+// the CPU does not support it
+int selectScanKernel(scan_kernel kernel);
+const char *getScanKernelName(void);
+
+// ------x--------x----------x------------x------ SCANNER ----------------x------------x----------------x-----------x
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+
+#endif
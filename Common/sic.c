@@ -0,0 +1,105 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "csect.h"
+#include "macro.h"
+#include "sic.h"
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// ------x--------x----------x------------x------ LIBRARY ----------------x------------x----------------x-----------x
+
+// Function to initialise an assembler context
+void sic_init_context(sic_context *ctx) {
+    memset(ctx, 0, sizeof(*ctx));
+    initProgram(&ctx->prog);
+}
+
+// Function to release the memory held by an assembler context
+void sic_free_context(sic_context *ctx) {
+    freeProgram(&ctx->prog);
+    memset(ctx, 0, sizeof(*ctx));
+}
+
+// Function to release the buffers of a result
+void sic_free_result(sic_result *result) {
+    free(result->object_program);
+    free(result->listing);
+    free(result->diagnostics);
+    memset(result, 0, sizeof(*result));
+}
+
+// Function to assemble a source buffer into an object program in memory
+int sic_assemble(sic_context *ctx, const source_buffer *source, const sic_options *options, sic_result *result) {
+    memset(result, 0, sizeof(*result));
+    result->status = -1;
+
+    // Every output goes to a growing memory buffer instead of a file
+    FILE *diagnostics = open_memstream(&result->diagnostics, &result->diagnostics_size);
+    FILE *object_file = open_memstream(&result->object_program, &result->object_size);
+    if (!diagnostics || !object_file) {
+        if (diagnostics) fclose(diagnostics);
+        if (object_file) fclose(object_file);
+        sic_free_result(result);
+        result->status = -1;
+        return -1;
+    }
+
+    // The context keeps the capacity of the previous program
+    program *prog = &ctx->prog;
+    resetProgram(prog);
+    setDiagnostics(prog, diagnostics);
+
+    // Macro calls are expanded into a buffer of this assembly
+    int status = 0;
+    source_buffer expanded = {NULL, 0, 0};
+    if (hasMacros(source->data, source->size)) {
+        status = expandMacros(source->data, source->size, &expanded, diagnostics);
+        source = &expanded;
+    }
+
+    if (status == 0 && hasControlSections(source->data, source->size)) {
+        // Every control section is assembled in a program of its own
+        FILE *listing = options && options->listing ? open_memstream(&result->listing, &result->listing_size) : NULL;
+        status = assembleControlSections(source->data, source->size, 1, object_file, listing, diagnostics,
+                                         &result->line_count);
+        if (listing) fclose(listing);
+    } else if (status == 0) {
+        status = runPass1(prog, source->data, source->size);
+        result->line_count = prog->line_count;
+
+        if (status == 0 && options && options->listing) {
+            FILE *listing = open_memstream(&result->listing, &result->listing_size);
+            if (listing) {
+                printListing(prog, listing);
+                fclose(listing);
+            }
+        }
+
+        if (status == 0) {
+            status = runPass2(prog, object_file);
+        }
+    }
+
+    fclose(object_file);
+    fclose(diagnostics);
+
+    // The lines refer into source, which the caller may release now
+    setDiagnostics(prog, NULL);
+    prog->text = NULL;
+    prog->text_size = 0;
+    closeSourceBuffer(&expanded);
+    ctx->assembled++;
+
+    // A failed assembly returns no partial object program
+    if (status != 0) {
+        result->object_program[0] = 0;
+        result->object_size = 0;
+    }
+
+    result->status = status;
+    return status;
+}
+
+// ------x--------x----------x------------x------ LIBRARY ----------------x------------x----------------x-----------x
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
@@ -0,0 +1,51 @@
+#ifndef SIC_H
+#define SIC_H
+
+#include <stddef.h>
+
+#include "program.h"
+#include "source.h"
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// ------x--------x----------x------------x------ LIBRARY ----------------x------------x----------------x-----------x
+
+// Embeddable assembler. All state lives in a context, so any number of
+// contexts can assemble at the same time on different threads; one context
+// must not be used by two threads at once. A context keeps the memory of
+// its lines and SYMTAB between calls, so later programs assemble warm.
+typedef struct {
+    program prog;
+    int assembled;      // Number of programs assembled with this context
+} sic_context;
+
+typedef struct {
+    int listing;        // Also return the LOCCTR listing
+} sic_options;
+
+// Result of one assembly. The buffers are owned by the result and released
+// with sic_free_result(); each is NUL-terminated.
+typedef struct {
+    int status;         // 0 when the object program was generated
+    int line_count;
+
+    char *object_program;
+    size_t object_size;
+    char *listing;
+    size_t listing_size;
+    char *diagnostics;  // Errors and warnings, in source order
+    size_t diagnostics_size;
+} sic_result;
+
+void sic_init_context(sic_context *ctx);
+void sic_free_context(sic_context *ctx);
+
+// Function to assemble the source text in source into an object program in
+// memory. options may be NULL. Returns result->status.
+int sic_assemble(sic_context *ctx, const source_buffer *source, const sic_options *options, sic_result *result);
+
+void sic_free_result(sic_result *result);
+
+// ------x--------x----------x------------x------ LIBRARY ----------------x------------x----------------x-----------x
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+
+#endif
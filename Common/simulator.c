@@ -0,0 +1,404 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "simulator.h"
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// ------x--------x----------x------------x------ SIMULATOR ----------------x------------x----------------x--------x
+
+// Every instruction the machine runs: X(opcode, format, name). The others
+// in optab.def (floating point, LPS, SSK, STI, SVC) stop it with a fault.
+#define SIM_INSTRUCTIONS(X)                                                                            \
+    X(0x00, 3, LDA) X(0x04, 3, LDX) X(0x08, 3, LDL) X(0x0C, 3, STA) X(0x10, 3, STX) X(0x14, 3, STL)    \
+    X(0x18, 3, ADD) X(0x1C, 3, SUB) X(0x20, 3, MUL) X(0x24, 3, DIV) X(0x28, 3, COMP) X(0x2C, 3, TIX)   \
+    X(0x30, 3, JEQ) X(0x34, 3, JGT) X(0x38, 3, JLT) X(0x3C, 3, J) X(0x40, 3, AND) X(0x44, 3, OR)       \
+    X(0x48, 3, JSUB) X(0x4C, 3, RSUB) X(0x50, 3, LDCH) X(0x54, 3, STCH)                                \
+    X(0x68, 3, LDB) X(0x6C, 3, LDS) X(0x74, 3, LDT) X(0x78, 3, STB) X(0x7C, 3, STS) X(0x84, 3, STT)    \
+    X(0x90, 2, ADDR) X(0x94, 2, SUBR) X(0x98, 2, MULR) X(0x9C, 2, DIVR) X(0xA0, 2, COMPR)              \
+    X(0xA4, 2, SHIFTL) X(0xA8, 2, SHIFTR) X(0xAC, 2, RMO) X(0xB4, 2, CLEAR) X(0xB8, 2, TIXR)           \
+    X(0xD8, 3, RD) X(0xDC, 3, WD) X(0xE0, 3, TD) X(0xE8, 3, STSW)                                      \
+    X(0xF0, 1, SIO) X(0xF4, 1, HIO) X(0xF8, 1, TIO)
+
+// Format of every supported instruction by opcode / 4, 0 for the rest
+#define FORMAT_ENTRY(opcode, format, name) [(opcode) >> 2] = format,
+static const uint8_t instruction_formats[64] = {SIM_INSTRUCTIONS(FORMAT_ENTRY)};
+#undef FORMAT_ENTRY
+
+// A 24-bit word as a signed number
+#define SIGNED(word) ((int)(((word) ^ 0x800000) - 0x800000))
+#define WORD_MASK 0xFFFFFF
+
+// The condition code is kept in bits 6 and 7 of SW: 0 for <, 1 for =, 2 for >
+#define SW_CC_SHIFT 6
+#define SW_CC_MASK (3 << SW_CC_SHIFT)
+
+// Function to create a machine with zeroed memory
+int initMachine(sic_machine *machine, FILE *output) {
+    memset(machine, 0, sizeof(*machine));
+
+    // Memory is mapped, so it starts on a page and a raw object image can be
+    // mapped over it. Execution can run past the last byte by one instruction
+    // before the next one is decoded (and rejected), so the cache has a few
+    // spare entries.
+    void *memory = mmap(NULL, SIM_MEMORY_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    machine->memory = memory != MAP_FAILED ? memory : NULL;
+    machine->decoded = calloc(SIM_MEMORY_SIZE + SIM_MAX_INSTRUCTION_LENGTH, sizeof(decoded_instruction));
+    if (!machine->memory || !machine->decoded) {
+        freeMachine(machine);
+        return -1;
+    }
+
+    machine->registers[SIM_L] = SIM_RETURN_ADDRESS;
+    machine->registers[SIM_SW] = 1 << SW_CC_SHIFT;
+    initOutputBuffer(&machine->output, output);
+    return 0;
+}
+
+void freeMachine(sic_machine *machine) {
+    if (machine->memory) munmap(machine->memory, SIM_MEMORY_SIZE);
+    free(machine->decoded);
+    closeOutputBuffer(&machine->output);
+    if (!machine->output.file) free(machine->output.data);
+    memset(machine, 0, sizeof(*machine));
+}
+
+// Function to forget the decoded instructions that overlap memory[address, address + size)
+void invalidateDecoded(sic_machine *machine, int address, int size) {
+    int first = address - (SIM_MAX_INSTRUCTION_LENGTH - 1);
+    for (int i = first < 0 ? 0 : first; i < address + size && i < SIM_MEMORY_SIZE; i++) {
+        machine->decoded[i].handler = 0;
+    }
+}
+
+// Function to get the stream faults are reported to
+static FILE *getMachineDiagnostics(const sic_machine *machine) {
+    return machine->diagnostics ? machine->diagnostics : stderr;
+}
+
+// Function to check whether an opcode writes to its target address, so it
+// cannot take an immediate operand
+static int isStore(int opcode) {
+    switch (opcode) {
+    case 0x0C: case 0x10: case 0x14: case 0x54: case 0x78: case 0x7C: case 0x84: case 0xE8:
+        return 1;
+    }
+    return 0;
+}
+
+// Function to decode the n, i, x, b, p and e bits of a SIC/XE format 3 or 4
+// instruction at pc. A PC-relative address is final once decoded, since the
+// entry belongs to pc; a base-relative one gets B added when it runs.
+static int decodeXeAddress(sic_machine *machine, int pc, decoded_instruction *entry) {
+    const unsigned char *code = machine->memory + pc;
+    int ni = code[0] & 3;
+    int x = code[1] & 0x80, b = code[1] & 0x40, p = code[1] & 0x20, e = code[1] & 0x10;
+
+    if (e) {
+        if (pc + 4 > SIM_MEMORY_SIZE) {
+            fprintf(getMachineDiagnostics(machine), "Error: Execution ran past the end of memory (%06X).\n", pc);
+            return -1;
+        }
+        entry->length = 4;
+        entry->address = (code[1] & 0xF) << 16 | code[2] << 8 | code[3];
+    } else {
+        entry->address = (code[1] & 0xF) << 8 | code[2];
+    }
+
+    // Indexing only goes with simple addressing, and an address is either PC- or base-relative
+    int invalid = (b && p) || (e && (b || p)) || (x && ni != 3) || (ni == 1 && isStore(code[0] & 0xFC));
+    if (invalid) {
+        fprintf(getMachineDiagnostics(machine), "Error: Invalid addressing in %02X%02X%02X at %06X.\n", code[0],
+                code[1], code[2], pc);
+        return -1;
+    }
+
+    if (p) entry->address = pc + 3 + ((entry->address ^ 0x800) - 0x800);
+    entry->r1 = x != 0;
+    entry->r2 = (ni == 1 ? SIM_IMMEDIATE : ni == 2 ? SIM_INDIRECT : 0) | (b ? SIM_BASE_RELATIVE : 0);
+    return 0;
+}
+
+// Function to decode the instruction at pc into its cache entry, returns -1
+// (after printing why) when there is no instruction the machine can run
+static int decodeInstruction(sic_machine *machine, int pc) {
+    if (pc >= SIM_MEMORY_SIZE) {
+        fprintf(getMachineDiagnostics(machine), "Error: Execution ran past the end of memory (%06X).\n", pc);
+        return -1;
+    }
+
+    const unsigned char *code = machine->memory + pc;
+    int format = instruction_formats[code[0] >> 2];
+    if (pc + format > SIM_MEMORY_SIZE) {
+        fprintf(getMachineDiagnostics(machine), "Error: Execution ran past the end of memory (%06X).\n", pc);
+        return -1;
+    }
+    if (format == 0) {
+        fprintf(getMachineDiagnostics(machine), "Error: Unsupported instruction %02X at %06X.\n", code[0], pc);
+        return -1;
+    }
+
+    decoded_instruction *entry = &machine->decoded[pc];
+    entry->length = format;
+    entry->r1 = entry->r2 = 0;
+    entry->address = 0;
+
+    if (format == 3 && !(code[0] & 3)) {
+        // SIC format: opcode, then the index bit and a 15-bit address
+        entry->r1 = code[1] >> 7;
+        entry->address = (code[1] & 0x7F) << 8 | code[2];
+    } else if (format == 3 && decodeXeAddress(machine, pc, entry) != 0) {
+        return -1;
+    } else if (format == 2) {
+        // Registers A to T; the second field of SHIFTL/SHIFTR is a count, CLEAR and TIXR have none
+        entry->r1 = code[1] >> 4;
+        entry->r2 = code[1] & 0xF;
+        int opcode = code[0] & 0xFC;
+        int uses_r2 = opcode != 0xA4 && opcode != 0xA8 && opcode != 0xB4 && opcode != 0xB8;
+        if (entry->r1 > SIM_T || (uses_r2 && entry->r2 > SIM_T)) {
+            fprintf(getMachineDiagnostics(machine), "Error: Invalid register in %02X%02X at %06X.\n",
+                    code[0], code[1], pc);
+            return -1;
+        }
+    }
+
+    entry->handler = 1 + (code[0] >> 2);
+    machine->decoded_count++;
+    return 0;
+}
+
+// Function to compare two signed words into a condition code (-1, 0 or 1)
+static inline int compareWords(int left, int right) {
+    return (SIGNED(left) > SIGNED(right)) - (SIGNED(left) < SIGNED(right));
+}
+
+// Function to run the machine. Instructions are dispatched straight from
+// their cache entry to their handler (computed goto), and every handler
+// ends by dispatching the next one, so there is no central switch.
+sim_stop runMachine(sic_machine *machine, int entry_address, long long limit) {
+#define HANDLER_ENTRY(opcode, format, name) [1 + ((opcode) >> 2)] = &&op_##name,
+    static void *const handlers[65] = {[0] = &&decode, SIM_INSTRUCTIONS(HANDLER_ENTRY)};
+#undef HANDLER_ENTRY
+
+    unsigned char *memory = machine->memory;
+    decoded_instruction *decoded = machine->decoded;
+    const decoded_instruction *d;
+    int r[SIM_REGISTER_COUNT];
+    memcpy(r, machine->registers, sizeof(r));
+
+    int cc = ((r[SIM_SW] & SW_CC_MASK) >> SW_CC_SHIFT) - 1;
+    int pc = entry_address;
+    int address = 0;
+    int operand = 0;
+    long long budget = limit;
+    sim_stop stop = SIM_FAULT;
+
+#define DISPATCH()                              \
+    do {                                        \
+        if (--budget < 0) goto limit_reached;   \
+        d = &decoded[pc];                       \
+        goto *handlers[d->handler];             \
+    } while (0)
+#define NEXT()              \
+    do {                    \
+        pc += d->length;    \
+        DISPATCH();         \
+    } while (0)
+
+    // Target of a format 3 / 4 instruction: indexed and base-relative as
+    // decoded, then, for indirect addressing, the address in the word there
+#define RESOLVE()                                                                   \
+    do {                                                                            \
+        address = d->address + (d->r1 ? r[SIM_X] : 0);                              \
+        if (d->r2 & (SIM_BASE_RELATIVE | SIM_INDIRECT)) {                           \
+            if (d->r2 & SIM_BASE_RELATIVE) address += r[SIM_B];                     \
+            if (d->r2 & SIM_INDIRECT) {                                             \
+                if ((unsigned int)address > SIM_MEMORY_SIZE - 3) goto bad_address; \
+                address = LOAD_WORD();                                              \
+            }                                                                       \
+        }                                                                           \
+    } while (0)
+    // ... checked to hold size bytes
+#define TARGET(size)                                                            \
+    do {                                                                        \
+        RESOLVE();                                                              \
+        if ((unsigned int)address > SIM_MEMORY_SIZE - (size)) goto bad_address; \
+    } while (0)
+    // The word operand of a format 3 / 4 instruction: the target itself when immediate
+#define OPERAND()                                               \
+    do {                                                        \
+        if (d->r2 & SIM_IMMEDIATE) {                            \
+            RESOLVE();                                          \
+            operand = address & WORD_MASK;                      \
+        } else {                                                \
+            TARGET(3);                                          \
+            operand = LOAD_WORD();                              \
+        }                                                       \
+    } while (0)
+#define LOAD_WORD() (memory[address] << 16 | memory[address + 1] << 8 | memory[address + 2])
+#define STORE_WORD(value)                                   \
+    do {                                                    \
+        memory[address] = ((value) >> 16) & 0xFF;           \
+        memory[address + 1] = ((value) >> 8) & 0xFF;        \
+        memory[address + 2] = (value) & 0xFF;               \
+        invalidateDecoded(machine, address, 3);             \
+    } while (0)
+#define JUMP()          \
+    do {                \
+        pc = address;   \
+        DISPATCH();     \
+    } while (0)
+
+    // Every cache entry belongs to an address in memory, so a run never starts outside it
+    if ((unsigned int)pc >= SIM_MEMORY_SIZE) {
+        fprintf(getMachineDiagnostics(machine), "Error: Entry address %06X is outside memory.\n", pc);
+        goto done;
+    }
+    DISPATCH();
+
+decode:
+    if (decodeInstruction(machine, pc) != 0) {
+        budget++;
+        goto done;
+    }
+    goto *handlers[d->handler];
+
+    // Loads and stores
+op_LDA: OPERAND(); r[SIM_A] = operand; NEXT();
+op_LDX: OPERAND(); r[SIM_X] = operand; NEXT();
+op_LDL: OPERAND(); r[SIM_L] = operand; NEXT();
+op_LDB: OPERAND(); r[SIM_B] = operand; NEXT();
+op_LDS: OPERAND(); r[SIM_S] = operand; NEXT();
+op_LDT: OPERAND(); r[SIM_T] = operand; NEXT();
+op_STA: TARGET(3); STORE_WORD(r[SIM_A]); NEXT();
+op_STX: TARGET(3); STORE_WORD(r[SIM_X]); NEXT();
+op_STL: TARGET(3); STORE_WORD(r[SIM_L]); NEXT();
+op_STB: TARGET(3); STORE_WORD(r[SIM_B]); NEXT();
+op_STS: TARGET(3); STORE_WORD(r[SIM_S]); NEXT();
+op_STT: TARGET(3); STORE_WORD(r[SIM_T]); NEXT();
+op_STSW: TARGET(3); STORE_WORD((r[SIM_SW] & ~SW_CC_MASK) | (cc + 1) << SW_CC_SHIFT); NEXT();
+op_LDCH:
+    if (d->r2 & SIM_IMMEDIATE) {
+        RESOLVE();
+    } else {
+        TARGET(1);
+        address = memory[address];
+    }
+    r[SIM_A] = (r[SIM_A] & 0xFFFF00) | (address & 0xFF);
+    NEXT();
+op_STCH:
+    TARGET(1);
+    memory[address] = r[SIM_A] & 0xFF;
+    invalidateDecoded(machine, address, 1);
+    NEXT();
+
+    // Arithmetic and logic on A
+op_ADD: OPERAND(); r[SIM_A] = (r[SIM_A] + operand) & WORD_MASK; NEXT();
+op_SUB: OPERAND(); r[SIM_A] = (r[SIM_A] - operand) & WORD_MASK; NEXT();
+op_MUL: OPERAND(); r[SIM_A] = (int)((long long)SIGNED(r[SIM_A]) * SIGNED(operand) & WORD_MASK); NEXT();
+op_DIV:
+    OPERAND();
+    if (operand == 0) goto divide_by_zero;
+    r[SIM_A] = (SIGNED(r[SIM_A]) / SIGNED(operand)) & WORD_MASK;
+    NEXT();
+op_AND: OPERAND(); r[SIM_A] &= operand; NEXT();
+op_OR: OPERAND(); r[SIM_A] |= operand; NEXT();
+op_COMP: OPERAND(); cc = compareWords(r[SIM_A], operand); NEXT();
+op_TIX:
+    OPERAND();
+    r[SIM_X] = (r[SIM_X] + 1) & WORD_MASK;
+    cc = compareWords(r[SIM_X], operand);
+    NEXT();
+
+    // Jumps; a J to itself is how a SIC program stops
+op_J:
+    TARGET(1);
+    if (address == pc) {
+        stop = SIM_HALTED;
+        goto done;
+    }
+    JUMP();
+op_JEQ: TARGET(1); if (cc == 0) JUMP(); NEXT();
+op_JGT: TARGET(1); if (cc > 0) JUMP(); NEXT();
+op_JLT: TARGET(1); if (cc < 0) JUMP(); NEXT();
+op_JSUB: TARGET(1); r[SIM_L] = pc + d->length; JUMP();
+op_RSUB:
+    address = r[SIM_L];
+    if (address == SIM_RETURN_ADDRESS) {
+        pc = address;
+        stop = SIM_RETURNED;
+        goto done;
+    }
+    if (address >= SIM_MEMORY_SIZE) goto bad_address;
+    JUMP();
+
+    // Register to register (format 2)
+op_ADDR: r[d->r2] = (r[d->r2] + r[d->r1]) & WORD_MASK; NEXT();
+op_SUBR: r[d->r2] = (r[d->r2] - r[d->r1]) & WORD_MASK; NEXT();
+op_MULR: r[d->r2] = (int)((long long)SIGNED(r[d->r2]) * SIGNED(r[d->r1]) & WORD_MASK); NEXT();
+op_DIVR:
+    if (r[d->r1] == 0) goto divide_by_zero;
+    r[d->r2] = (SIGNED(r[d->r2]) / SIGNED(r[d->r1])) & WORD_MASK;
+    NEXT();
+op_COMPR: cc = compareWords(r[d->r1], r[d->r2]); NEXT();
+op_RMO: r[d->r2] = r[d->r1]; NEXT();
+op_CLEAR: r[d->r1] = 0; NEXT();
+op_TIXR:
+    r[SIM_X] = (r[SIM_X] + 1) & WORD_MASK;
+    cc = compareWords(r[SIM_X], r[d->r1]);
+    NEXT();
+op_SHIFTL: {
+    // Circular, by the count + 1 kept in r2
+    int count = d->r2 + 1;
+    int value = r[d->r1];
+    r[d->r1] = ((value << count) | (value >> (24 - count))) & WORD_MASK;
+    NEXT();
+}
+op_SHIFTR: r[d->r1] = (SIGNED(r[d->r1]) >> (d->r2 + 1)) & WORD_MASK; NEXT();
+
+    // Device stubs: every device is ready, RD and WD use the machine's input and output
+op_TD: RESOLVE(); cc = -1; NEXT();
+op_RD:
+    RESOLVE();
+    r[SIM_A] &= 0xFFFF00;
+    if (machine->input_position < machine->input_size) {
+        r[SIM_A] |= machine->input[machine->input_position++];
+    }
+    NEXT();
+op_WD: RESOLVE(); appendChar(&machine->output, r[SIM_A] & 0xFF); NEXT();
+op_SIO:
+op_HIO:
+op_TIO: cc = -1; NEXT();
+
+bad_address:
+    fprintf(getMachineDiagnostics(machine), "Error: Address %06X is outside memory (instruction at %06X).\n",
+            address, pc);
+    goto done;
+
+divide_by_zero:
+    fprintf(getMachineDiagnostics(machine), "Error: Division by zero at %06X.\n", pc);
+    goto done;
+
+limit_reached:
+    budget = 0;
+    stop = SIM_LIMIT;
+
+done:
+#undef DISPATCH
+#undef NEXT
+#undef RESOLVE
+#undef TARGET
+#undef OPERAND
+#undef LOAD_WORD
+#undef STORE_WORD
+#undef JUMP
+    r[SIM_PC] = pc;
+    r[SIM_SW] = (r[SIM_SW] & ~SW_CC_MASK) | (cc + 1) << SW_CC_SHIFT;
+    memcpy(machine->registers, r, sizeof(r));
+    machine->instructions = limit - budget;
+    return stop;
+}
+
+// ------x--------x----------x------------x------ SIMULATOR ----------------x------------x----------------x--------x
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
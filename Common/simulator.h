@@ -0,0 +1,89 @@
+#ifndef SIMULATOR_H
+#define SIMULATOR_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "output.h"
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// ------x--------x----------x------------x------ SIMULATOR ----------------x------------x----------------x--------x
+
+// Bytes of memory of the simulated machine (the SIC/XE maximum)
+#define SIM_MEMORY_SIZE (1 << 20)
+
+// Longest instruction, in bytes (format 4)
+#define SIM_MAX_INSTRUCTION_LENGTH 4
+
+// Addressing of a format 3 / 4 instruction, kept in r2 of its cache entry;
+// 0 is simple addressing, SIC or SIC/XE
+#define SIM_IMMEDIATE 1         // #operand: the target address is the operand
+#define SIM_INDIRECT 2          // @operand: the word at the target address is the target
+#define SIM_BASE_RELATIVE 4     // B is added to the address when it runs
+
+// L holds this when the program is started, so the RSUB of a program that
+// is called like a subroutine stops the machine
+#define SIM_RETURN_ADDRESS 0xFFFFFF
+
+// Register numbers, as in format 2 instructions
+enum {
+    SIM_A, SIM_X, SIM_L, SIM_B, SIM_S, SIM_T, SIM_F,
+    SIM_PC = 8, SIM_SW,
+    SIM_REGISTER_COUNT
+};
+
+// Why the machine stopped
+typedef enum {
+    SIM_HALTED,     // A J to itself, the usual end of a SIC program
+    SIM_RETURNED,   // RSUB to SIM_RETURN_ADDRESS
+    SIM_LIMIT,      // The instruction limit was reached
+    SIM_FAULT,      // Invalid instruction or address; the reason was printed
+} sim_stop;
+
+// An instruction decoded once and kept for the address it starts at
+typedef struct {
+    uint8_t handler;    // 0 until the instruction at this address is decoded
+    uint8_t length;
+    uint8_t r1;         // Format 2 registers, or the index flag of format 3 / 4
+    uint8_t r2;         // ... and the SIM_ addressing flags of format 3 / 4
+    int32_t address;    // Target address of format 3 / 4 (PC-relative ones
+                        // included), before indexing and base
+} decoded_instruction;
+
+// A SIC/XE machine. Every byte of memory has an entry in the decoded
+// instruction cache, filled the first time an instruction there runs and
+// cleared when any of its bytes is written. Devices are stubs: TD is
+// always ready, RD reads the bytes of input in turn (0 after the last) and
+// WD appends to output, whatever the device number.
+typedef struct {
+    unsigned char *memory;
+    decoded_instruction *decoded;
+    int registers[SIM_REGISTER_COUNT];
+
+    const unsigned char *input;
+    size_t input_size;
+    size_t input_position;
+    output_buffer output;
+
+    long long instructions;     // Executed by the last runMachine()
+    long long decoded_count;    // Instructions decoded (cache misses)
+    FILE *diagnostics;
+} sic_machine;
+
+// Function to create a machine with zeroed, page-aligned memory; WD output goes to output
+// (NULL to keep it in machine->output). Returns -1 without memory.
+int initMachine(sic_machine *machine, FILE *output);
+void freeMachine(sic_machine *machine);
+
+// Function to forget the decoded instructions of memory[address, address + size),
+// after it is changed other than by the program itself (e.g. loaded again)
+void invalidateDecoded(sic_machine *machine, int address, int size);
+
+// Function to run from entry_address until the program stops or limit
+// instructions have run; the registers are kept in the machine
+sim_stop runMachine(sic_machine *machine, int entry_address, long long limit);
+
+// ------x--------x----------x------------x------ SIMULATOR ----------------x------------x----------------x--------x
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+
+#endif
@@ -0,0 +1,232 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "source.h"
+#include "stats.h"
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// ------x--------x----------x------------x------ SOURCE ----------------x------------x----------------x-----------x
+
+// Function to read everything from a descriptor that cannot be mapped
+static int readWholeFile(source_buffer *buffer, int fd) {
+    size_t capacity = 64 * 1024;
+    buffer->data = malloc(capacity);
+    if (!buffer->data) return -1;
+
+    ssize_t count;
+    while ((count = read(fd, buffer->data + buffer->size, capacity - buffer->size)) > 0) {
+        buffer->size += count;
+        if (buffer->size == capacity) {
+            char *data = realloc(buffer->data, capacity * 2);
+            if (!data) return -1;
+            buffer->data = data;
+            capacity *= 2;
+        }
+    }
+    return count < 0 ? -1 : 0;
+}
+
+// Function to open a file as one buffer, memory-mapping it when possible
+int openSourceBuffer(source_buffer *buffer, const char *path) {
+    STATS_START(start);
+    memset(buffer, 0, sizeof(*buffer));
+
+    int fd = strcmp(path, "-") ? open(path, O_RDONLY) : STDIN_FILENO;
+    if (fd < 0) {
+        perror(path);
+        return -1;
+    }
+
+    struct stat info;
+    int status = 0;
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode)) {
+        // An empty file has nothing to map
+        if (info.st_size > 0) {
+            void *data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data == MAP_FAILED) {
+                perror(path);
+                status = -1;
+            } else {
+                madvise(data, info.st_size, MADV_SEQUENTIAL);
+                buffer->data = data;
+                buffer->size = info.st_size;
+                buffer->is_mapped = 1;
+            }
+        }
+    } else if (readWholeFile(buffer, fd) != 0) {
+        perror(path);
+        status = -1;
+    }
+
+    if (fd != STDIN_FILENO) close(fd);
+    if (status != 0) closeSourceBuffer(buffer);
+    STATS_COUNT(COUNTER_BYTES_READ, buffer->size);
+    STATS_STOP(PHASE_READ, start);
+    return status;
+}
+
+// Function to read a file into memory as one buffer
+int readSourceBuffer(source_buffer *buffer, const char *path) {
+    STATS_START(start);
+    memset(buffer, 0, sizeof(*buffer));
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror(path);
+        return -1;
+    }
+
+    int status = readWholeFile(buffer, fd);
+    if (status != 0) {
+        perror(path);
+        closeSourceBuffer(buffer);
+    }
+    close(fd);
+    STATS_COUNT(COUNTER_BYTES_READ, buffer->size);
+    STATS_STOP(PHASE_READ, start);
+    return status;
+}
+
+// Function to unmap or free a buffer
+void closeSourceBuffer(source_buffer *buffer) {
+    if (buffer->is_mapped) {
+        munmap(buffer->data, buffer->size);
+    } else {
+        free(buffer->data);
+    }
+    memset(buffer, 0, sizeof(*buffer));
+}
+
+// Function to find the end of the line starting at position
+size_t nextLine(const char *text, size_t size, size_t position, source_view *line) {
+    const char *start = text + position;
+    const char *newline = memchr(start, '\n', size - position);
+    size_t end = newline ? (size_t)(newline - text) : size;
+
+    line->offset = position;
+    line->length = end - position;
+    if (line->length > 0 && text[end - 1] == '\r') line->length--;
+
+    return newline ? end + 1 : end;
+}
+
+// Function to split a line into whitespace separated fields
+int splitFields(const char *text, source_view line, source_view *fields, int max) {
+    size_t i = line.offset;
+    size_t end = line.offset + line.length;
+    int count = 0;
+
+    while (count < max) {
+        // Skip the whitespace before the field
+        while (i < end && (text[i] == ' ' || text[i] == '\t')) i++;
+        if (i == end) break;
+
+        // The field runs to the next whitespace outside of quotes
+        size_t start = i;
+        int quoted = 0;
+        while (i < end && (quoted || (text[i] != ' ' && text[i] != '\t'))) {
+            if (text[i] == '\'') quoted = !quoted;
+            i++;
+        }
+
+        fields[count].offset = start;
+        fields[count].length = i - start;
+        count++;
+    }
+    return count;
+}
+
+// Function to tokenize the source line starting at position
+size_t tokenizeSourceLine(const char *text, size_t size, size_t position, source_fields *fields) {
+    source_view split[3];
+    source_view empty = {position, 0};
+
+    size_t next = nextLine(text, size, position, &fields->line);
+    fields->label = fields->mnemonic = fields->operand = empty;
+
+    // Blank lines and comment lines have no fields
+    source_view line = fields->line;
+    if (line.length == 0 || text[line.offset] == '.') return next;
+
+    // If the line does not start with a tab or space then it has all three
+    // label, mnemonic and operand; otherwise only mnemonic and operand
+    int has_label = text[line.offset] != ' ' && text[line.offset] != '\t';
+    int count = splitFields(text, line, split, has_label ? 3 : 2);
+
+    int field = 0;
+    if (has_label && count > 0) fields->label = split[field++];
+    if (field < count) fields->mnemonic = split[field++];
+    if (field < count) fields->operand = split[field++];
+    return next;
+}
+
+// Function to find the next line from position on whose mnemonic is directive
+size_t findDirectiveLine(const char *text, size_t size, size_t position, const char *directive, size_t *next) {
+    size_t length = strlen(directive);
+    while (position < size) {
+        const char *found = memmem(text + position, size - position, directive, length);
+        if (!found) break;
+
+        // Only a line whose mnemonic is the directive counts, not a label,
+        // an operand or a comment that contains it
+        const char *line = found;
+        while (line > text && line[-1] != '\n') line--;
+        source_fields fields;
+        *next = tokenizeSourceLine(text, size, line - text, &fields);
+        if (viewEquals(text, fields.mnemonic, directive)) return line - text;
+        position = *next;
+    }
+    return size;
+}
+
+// Function to read a decimal number from a field
+int parseDecimal(const char *text, source_view view) {
+    const char *digit = text + view.offset;
+    const char *end = digit + view.length;
+    int sign = 1, value = 0;
+
+    if (digit < end && (*digit == '-' || *digit == '+')) sign = *digit++ == '-' ? -1 : 1;
+    while (digit < end && *digit >= '0' && *digit <= '9') {
+        // A longer number is out of range of every field; it stops growing there instead of overflowing
+        if (value < 10000000) value = value * 10 + (*digit - '0');
+        digit++;
+    }
+    return sign * value;
+}
+
+// Function to check that a field is a decimal number, with an optional sign
+int isDecimal(const char *text, source_view view) {
+    int i = view.length > 0 && (text[view.offset] == '-' || text[view.offset] == '+');
+    if (i == view.length) return 0;
+    for (; i < view.length; i++) {
+        if (text[view.offset + i] < '0' || text[view.offset + i] > '9') return 0;
+    }
+    return 1;
+}
+
+// Function to read a hexadecimal number from a field
+int parseHex(const char *text, source_view view) {
+    int value = 0;
+    for (int i = 0; i < view.length; i++) {
+        char c = text[view.offset + i];
+        if (c >= '0' && c <= '9') value = value * 16 + (c - '0');
+        else if (c >= 'A' && c <= 'F') value = value * 16 + (c - 'A' + 10);
+        else if (c >= 'a' && c <= 'f') value = value * 16 + (c - 'a' + 10);
+        else break;
+    }
+    return value;
+}
+
+// Function to compare a field with a string
+int viewEquals(const char *text, source_view view, const char *string) {
+    return (int)strlen(string) == view.length && !memcmp(text + view.offset, string, view.length);
+}
+
+// ------x--------x----------x------------x------ SOURCE ----------------x------------x----------------x-----------x
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
@@ -0,0 +1,72 @@
+#ifndef SOURCE_H
+#define SOURCE_H
+
+#include <stddef.h>
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// ------x--------x----------x------------x------ SOURCE ----------------x------------x----------------x-----------x
+
+// A field of a line, as an offset and length into the text it was read
+// from. Fields are never copied out of the text.
+typedef struct {
+    size_t offset;
+    int length;
+} source_view;
+
+// The whole text of a file. Regular files are memory-mapped, anything else
+// (a pipe, "-" for stdin) is read into memory once.
+typedef struct {
+    char *data;
+    size_t size;
+    int is_mapped;
+} source_buffer;
+
+// Fields of one source line: [label] mnemonic [operand] [comment]
+typedef struct {
+    source_view line;
+    source_view label;
+    source_view mnemonic;
+    source_view operand;
+} source_fields;
+
+#define MAX_SPLIT_FIELDS 4
+
+int openSourceBuffer(source_buffer *buffer, const char *path);
+
+// Function to read a file into a private copy, for a file that may be
+// rewritten in place while the buffer is still in use
+int readSourceBuffer(source_buffer *buffer, const char *path);
+void closeSourceBuffer(source_buffer *buffer);
+
+// Function to find the end of the line starting at position, returns the
+// position of the next line and stores the line (without "\n" / "\r\n")
+size_t nextLine(const char *text, size_t size, size_t position, source_view *line);
+
+// Function to split a line into at most max whitespace separated fields.
+// A quote opens a literal (C'A B') that runs to the closing quote.
+int splitFields(const char *text, source_view line, source_view *fields, int max);
+
+// Function to tokenize the source line starting at position, returns the
+// position of the next line. A line that starts with a space or tab has no
+// label. fields->mnemonic.length is 0 for blank and comment (".") lines.
+size_t tokenizeSourceLine(const char *text, size_t size, size_t position, source_fields *fields);
+
+// Function to find the next line from position on whose mnemonic is
+// directive. Returns the offset of the line (size when there is none) and
+// stores the offset of the line after it in *next.
+size_t findDirectiveLine(const char *text, size_t size, size_t position, const char *directive, size_t *next);
+
+// Functions to read numbers from a field without copying it
+int parseDecimal(const char *text, source_view view);
+int parseHex(const char *text, source_view view);
+
+// Function to check that a field is a whole decimal number (an optional sign, then digits)
+int isDecimal(const char *text, source_view view);
+
+// Function to compare a field with a string
+int viewEquals(const char *text, source_view view, const char *string);
+
+// ------x--------x----------x------------x------ SOURCE ----------------x------------x----------------x-----------x
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+
+#endif
@@ -0,0 +1,198 @@
+#define _POSIX_C_SOURCE 199309L
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "stats.h"
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// ------x--------x----------x------------x------ STATISTICS ----------------x------------x----------------x-------x
+
+// Function to recognize the --stats option of the drivers
+int parseStatsOption(const char *arg, int *json) {
+    if (strncmp(arg, "--stats", 7) != 0) return 0;
+    if (!strcmp(arg + 7, "") || !strcmp(arg + 7, "=text")) {
+        *json = 0;
+    } else if (!strcmp(arg + 7, "=json")) {
+        *json = 1;
+    } else {
+        fprintf(stderr, "Error: Unknown statistics format '%s', use --stats=json or --stats=text.\n", arg);
+        return -1;
+    }
+    return 1;
+}
+
+#ifndef SIC_NO_STATS
+
+static const char *const phase_names[STATS_PHASES] = {
+    "read", "tokenize", "layout", "symbol_insert", "opcode_lookup", "resolve", "emit",
+};
+
+static const char *const counter_names[STATS_COUNTERS] = {
+    "lines", "symbol_lookups", "symbol_inserts", "symbol_probes", "opcode_lookups",
+    "opcode_misses", "scan_blocks", "text_records", "bytes_read", "bytes_written", "dropped_samples",
+    "relax_checks", "widened_instructions", "cache_hits", "cache_misses", "macro_calls", "macro_calls_reused",
+};
+
+static const char *const peak_names[STATS_PEAKS] = {
+    "symbol_probe_length", "symbols", "symbol_slots", "symbol_arena_bytes", "lines",
+    "optab_entries", "output_buffer_bytes",
+};
+
+// Function to get the current time in seconds
+static double getSeconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int stats_enabled = 0;
+_Thread_local stats_block *stats_local = NULL;
+
+// Ticks one mark adds by itself, and the longest step of a sampled line
+// (half a millisecond), measured when collecting starts
+uint64_t stats_mark_ticks = 0;
+uint64_t stats_sample_limit = UINT64_MAX;
+
+// Every thread's block, summed when the statistics are printed
+static stats_block *stats_blocks = NULL;
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Clock and time when collecting started, to turn clock ticks into seconds
+static uint64_t start_ticks;
+static double start_seconds;
+
+#if !defined(__x86_64__) && !defined(__i386__)
+// Function to read the clock in nanoseconds where there is no cycle counter
+uint64_t readStatsClock(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+#endif
+
+// Function to give the calling thread its own block on its first use.
+// Blocks stay allocated after their thread exits, so they can be summed.
+stats_block *registerThreadStats(void) {
+    stats_block *stats = calloc(1, sizeof(stats_block));
+    if (!stats) {
+        // Without memory the thread's statistics are simply dropped
+        static _Thread_local stats_block spare;
+        stats_local = &spare;
+        return stats_local;
+    }
+    stats->countdown = 1;
+
+    pthread_mutex_lock(&stats_lock);
+    stats->next = stats_blocks;
+    stats_blocks = stats;
+    pthread_mutex_unlock(&stats_lock);
+
+    stats_local = stats;
+    return stats;
+}
+
+// Function to start collecting
+int enableStats(void) {
+    // The fastest of many back-to-back marks is what a mark costs
+    stats_block probe = {0};
+    uint64_t fastest = UINT64_MAX;
+    stats_local = &probe;
+    for (int i = 0; i < 1000; i++) {
+        probe.sampling = 1;
+        probe.last = readStatsClock();
+        markStatsPhase(PHASE_READ);
+        if (probe.sampled_ticks[PHASE_READ] < fastest) fastest = probe.sampled_ticks[PHASE_READ];
+        probe.sampled_ticks[PHASE_READ] = 0;
+    }
+    stats_local = NULL;
+    stats_mark_ticks = fastest;
+
+    // Count the ticks of a millisecond for the limit
+    double until = getSeconds() + 1e-3;
+    uint64_t ticks = readStatsClock();
+    while (getSeconds() < until) {
+    }
+    stats_sample_limit = (readStatsClock() - ticks) / 2;
+
+    start_seconds = getSeconds();
+    start_ticks = readStatsClock();
+    stats_enabled = 1;
+    return 0;
+}
+
+// Function to print everything collected so far
+void printStats(FILE *out, int json) {
+    if (!stats_enabled) return;
+
+    double wall = getSeconds() - start_seconds;
+    uint64_t ticks = readStatsClock() - start_ticks;
+    double seconds_per_tick = ticks > 0 ? wall / ticks : 0;
+
+    // Sum the threads; sampled phases are scaled by each thread's own sampling rate
+    uint64_t counters[STATS_COUNTERS] = {0};
+    uint64_t peaks[STATS_PEAKS] = {0};
+    double phases[STATS_PHASES] = {0};
+    pthread_mutex_lock(&stats_lock);
+    for (const stats_block *stats = stats_blocks; stats; stats = stats->next) {
+        double scale = stats->lines_sampled ? (double)stats->lines_begun / stats->lines_sampled : 0;
+        for (int i = 0; i < STATS_PHASES; i++) {
+            phases[i] += (stats->ticks[i] + stats->sampled_ticks[i] * scale) * seconds_per_tick;
+        }
+        for (int i = 0; i < STATS_COUNTERS; i++) counters[i] += stats->counters[i];
+        for (int i = 0; i < STATS_PEAKS; i++) {
+            if (stats->peaks[i] > peaks[i]) peaks[i] = stats->peaks[i];
+        }
+    }
+    pthread_mutex_unlock(&stats_lock);
+
+    if (json) {
+        fprintf(out, "{\"wall_seconds\": %.6f, \"sample_interval\": %d,\n", wall, STATS_SAMPLE_INTERVAL);
+        fprintf(out, " \"phase_seconds\": {");
+        for (int i = 0; i < STATS_PHASES; i++) {
+            fprintf(out, "%s\"%s\": %.6f", i ? ", " : "", phase_names[i], phases[i]);
+        }
+        fprintf(out, "},\n \"counters\": {");
+        for (int i = 0; i < STATS_COUNTERS; i++) {
+            fprintf(out, "%s\"%s\": %llu", i ? ", " : "", counter_names[i], (unsigned long long)counters[i]);
+        }
+        fprintf(out, "},\n \"peaks\": {");
+        for (int i = 0; i < STATS_PEAKS; i++) {
+            fprintf(out, "%s\"%s\": %llu", i ? ", " : "", peak_names[i], (unsigned long long)peaks[i]);
+        }
+        fprintf(out, "}}\n");
+        return;
+    }
+
+    fprintf(out, "%-22s %12.3f ms\n", "wall", wall * 1e3);
+    for (int i = 0; i < STATS_PHASES; i++) {
+        fprintf(out, "%-22s %12.3f ms\n", phase_names[i], phases[i] * 1e3);
+    }
+    for (int i = 0; i < STATS_COUNTERS; i++) {
+        fprintf(out, "%-22s %12llu\n", counter_names[i], (unsigned long long)counters[i]);
+    }
+    for (int i = 0; i < STATS_PEAKS; i++) {
+        fprintf(out, "peak %-17s %12llu\n", peak_names[i], (unsigned long long)peaks[i]);
+    }
+}
+
+#else
+
+// Function to refuse to collect when the hooks are compiled out
+int enableStats(void) {
+    fprintf(stderr, "Error: Built without statistics (SIC_NO_STATS).\n");
+    return -1;
+}
+
+void printStats(FILE *out, int json) {
+    (void)out;
+    (void)json;
+}
+
+#endif
+
+// ------x--------x----------x------------x------ STATISTICS ----------------x------------x----------------x-------x
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
@@ -0,0 +1,163 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// ------x--------x----------x------------x------ STATISTICS ----------------x------------x----------------x-------x
+
+// Counters and timers of the assembler, printed with --stats. They cost one
+// predictable branch per hook until enableStats() is called, and nothing
+// at all when compiled with -DSIC_NO_STATS.
+
+// Phases the time is split into
+typedef enum {
+    PHASE_READ,             // Opening and reading (or mapping) input files
+    PHASE_TOKENIZE,         // Splitting lines into fields
+    PHASE_LAYOUT,           // Assigning addresses in pass 1
+    PHASE_SYMBOL_INSERT,    // Defining labels in the SYMTAB
+    PHASE_OPCODE_LOOKUP,    // Looking mnemonics up in the OPTAB
+    PHASE_RESOLVE,          // Resolving operand symbols at the end of pass 1, encoding lines in pass 2
+    PHASE_EMIT,             // Laying code out in records and writing them
+    STATS_PHASES
+} stats_phase;
+
+typedef enum {
+    COUNTER_LINES,
+    COUNTER_SYMBOL_LOOKUPS,
+    COUNTER_SYMBOL_INSERTS,
+    COUNTER_SYMBOL_PROBES,  // Slots visited by SYMTAB lookups and inserts
+    COUNTER_OPCODE_LOOKUPS,
+    COUNTER_OPCODE_MISSES,
+    COUNTER_SCAN_BLOCKS,    // 64-byte blocks classified by the block scanner
+    COUNTER_TEXT_RECORDS,
+    COUNTER_BYTES_READ,
+    COUNTER_BYTES_WRITTEN,
+    COUNTER_DROPPED_SAMPLES, // Sampled lines given up because the thread was switched out
+    COUNTER_RELAX_CHECKS,   // Format 3 reach checks of SIC/XE relaxation
+    COUNTER_WIDENED,        // Instructions relaxation widened to format 4
+    COUNTER_CACHE_HITS,     // Assemblies replayed from the assembly cache
+    COUNTER_CACHE_MISSES,
+    COUNTER_MACRO_CALLS,
+    COUNTER_MACRO_REUSED,   // Macro calls copied from an expansion with the same arguments
+    STATS_COUNTERS
+} stats_counter;
+
+typedef enum {
+    PEAK_SYMBOL_PROBE,      // Longest probe sequence of one SYMTAB access
+    PEAK_SYMBOLS,
+    PEAK_SYMBOL_SLOTS,
+    PEAK_SYMBOL_ARENA,      // Bytes of label names
+    PEAK_LINES,
+    PEAK_OPTAB_ENTRIES,
+    PEAK_OUTPUT_BUFFER,     // Bytes of the largest output buffer
+    STATS_PEAKS
+} stats_peak;
+
+// Per-line phases are timed on one line in this many and scaled up, since
+// reading the clock costs about as much as a short phase
+#define STATS_SAMPLE_INTERVAL 16
+
+// Function to start collecting, returns -1 when built without statistics
+int enableStats(void);
+
+// Function to print everything collected so far, as JSON or as a table
+void printStats(FILE *out, int json);
+
+// Function to recognize --stats, --stats=text and --stats=json, returns 1 for
+// one of them (setting json), 0 for any other argument and -1 for a bad format
+int parseStatsOption(const char *arg, int *json);
+
+#ifndef SIC_NO_STATS
+
+// What one thread collected; every thread has its own, so nothing is shared
+typedef struct stats_block {
+    uint64_t counters[STATS_COUNTERS];
+    uint64_t peaks[STATS_PEAKS];
+    uint64_t ticks[STATS_PHASES];           // Phases timed in full
+    uint64_t sampled_ticks[STATS_PHASES];   // Phases timed on sampled lines only
+    uint64_t lines_begun;
+    uint64_t lines_sampled;
+    uint64_t last;                          // Clock at the last mark of a sampled line
+    int countdown;
+    int sampling;
+    struct stats_block *next;
+} stats_block;
+
+extern int stats_enabled;
+extern _Thread_local stats_block *stats_local;
+extern uint64_t stats_mark_ticks;
+extern uint64_t stats_sample_limit;
+
+stats_block *registerThreadStats(void);
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+static inline uint64_t readStatsClock(void) { return __rdtsc(); }
+#else
+uint64_t readStatsClock(void);
+#endif
+
+// Function to get the statistics of the calling thread
+static inline stats_block *getThreadStats(void) {
+    return stats_local ? stats_local : registerThreadStats();
+}
+
+// Function to start a line, deciding whether its phases are timed
+static inline void beginStatsLine(void) {
+    stats_block *stats = getThreadStats();
+    stats->lines_begun++;
+    stats->sampling = --stats->countdown <= 0;
+    if (stats->sampling) {
+        stats->countdown = STATS_SAMPLE_INTERVAL;
+        stats->lines_sampled++;
+        stats->last = readStatsClock();
+    }
+}
+
+// Function to charge the time since the last mark of a sampled line to phase,
+// less what reading the clock itself took. A step longer than the limit means
+// the thread was switched out, and the rest of the line is not sampled.
+static inline void markStatsPhase(stats_phase phase) {
+    stats_block *stats = getThreadStats();
+    if (!stats->sampling) return;
+    uint64_t now = readStatsClock();
+    uint64_t ticks = now - stats->last;
+    if (ticks > stats_sample_limit) {
+        stats->sampling = 0;
+        stats->lines_sampled--;
+        stats->counters[COUNTER_DROPPED_SAMPLES]++;
+        return;
+    }
+    stats->sampled_ticks[phase] += ticks > stats_mark_ticks ? ticks - stats_mark_ticks : 0;
+    stats->last = now;
+}
+
+static inline void updateStatsPeak(stats_peak peak, uint64_t value) {
+    stats_block *stats = getThreadStats();
+    if (value > stats->peaks[peak]) stats->peaks[peak] = value;
+}
+
+#define STATS_COUNT(counter, n) do { if (__builtin_expect(stats_enabled, 0)) getThreadStats()->counters[counter] += (n); } while (0)
+#define STATS_PEAK(peak, value) do { if (__builtin_expect(stats_enabled, 0)) updateStatsPeak(peak, value); } while (0)
+#define STATS_BEGIN_LINE() do { if (__builtin_expect(stats_enabled, 0)) beginStatsLine(); } while (0)
+#define STATS_MARK(phase) do { if (__builtin_expect(stats_enabled, 0)) markStatsPhase(phase); } while (0)
+#define STATS_START(timer) uint64_t timer = stats_enabled ? readStatsClock() : 0
+#define STATS_STOP(phase, timer) do { if (stats_enabled) getThreadStats()->ticks[phase] += readStatsClock() - (timer); } while (0)
+
+#else
+
+#define STATS_COUNT(counter, n) ((void)0)
+#define STATS_PEAK(peak, value) ((void)0)
+#define STATS_BEGIN_LINE() ((void)0)
+#define STATS_MARK(phase) ((void)0)
+#define STATS_START(timer) ((void)0)
+#define STATS_STOP(phase, timer) ((void)0)
+
+#endif
+
+// ------x--------x----------x------------x------ STATISTICS ----------------x------------x----------------x-------x
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+
+#endif
@@ -0,0 +1,256 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "stats.h"
+#include "symtab.h"
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// ------x--------x----------x------------x------ SYMTAB ----------------x------------x----------------x-----------x
+
+#define SYMTAB_INITIAL_SLOTS 64
+#define SYMTAB_INITIAL_ARENA 1024
+
+// Function to hash a symbol name (FNV-1a)
+unsigned int hashSymbol(const char *symbol, int length) {
+    unsigned int hash = 2166136261u;
+    for (int i = 0; i < length; i++) {
+        hash ^= (unsigned char)symbol[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Function to get the stream errors of a table are reported to
+static FILE *getSymtabDiagnostics(const symtab *table) {
+    return table->diagnostics ? table->diagnostics : stderr;
+}
+
+// Function to initialise an empty symbol table
+void initSymtab(symtab *table) {
+    memset(table, 0, sizeof(*table));
+}
+
+// Function to release the memory held by a symbol table
+void freeSymtab(symtab *table) {
+    if (!table->is_attached) {
+        free(table->entries);
+        free(table->slots);
+        free(table->arena);
+    }
+    initSymtab(table);
+}
+
+// Function to empty a symbol table but keep its memory for reuse
+void resetSymtab(symtab *table) {
+    if (table->is_attached) {
+        FILE *diagnostics = table->diagnostics;
+        initSymtab(table);
+        table->diagnostics = diagnostics;
+        return;
+    }
+    if (table->slots) memset(table->slots, -1, table->slot_count * sizeof(int));
+    table->size = 0;
+    table->arena_size = 0;
+}
+
+// Function to use borrowed entries and names as a read-only table
+void attachSymtab(symtab *table, const symtab_entry *entries, int count, const char *arena, size_t arena_size) {
+    FILE *diagnostics = table->diagnostics;
+    initSymtab(table);
+    table->diagnostics = diagnostics;
+    table->entries = (symtab_entry *)entries;
+    table->size = table->capacity = count;
+    table->arena = (char *)arena;
+    table->arena_size = table->arena_capacity = arena_size;
+    table->is_attached = 1;
+}
+
+// Function to find the slot holding a symbol, or the empty slot where it would go
+static int findSlot(const symtab *table, const char *symbol, int length, unsigned int hash) {
+    unsigned int mask = table->slot_count - 1;
+    unsigned int slot = hash & mask;
+    unsigned int first = slot;
+
+    // Linear probing: walk forward until the symbol or an empty slot is found
+    while (table->slots[slot] != -1) {
+        const symtab_entry *entry = &table->entries[table->slots[slot]];
+        if (entry->hash == hash && entry->name_length == length &&
+            !memcmp(table->arena + entry->name_offset, symbol, length)) {
+            break;
+        }
+        slot = (slot + 1) & mask;
+    }
+    STATS_COUNT(COUNTER_SYMBOL_PROBES, ((slot - first) & mask) + 1);
+    STATS_PEAK(PEAK_SYMBOL_PROBE, ((slot - first) & mask) + 1);
+    (void)first;
+    return slot;
+}
+
+// Function to double the number of slots and re-insert every entry
+static int growSlots(symtab *table) {
+    int new_count = table->slot_count ? table->slot_count * 2 : SYMTAB_INITIAL_SLOTS;
+    int *slots = malloc(new_count * sizeof(int));
+    if (!slots) return -1;
+    memset(slots, -1, new_count * sizeof(int));
+
+    unsigned int mask = new_count - 1;
+    for (int i = 0; i < table->size; i++) {
+        unsigned int slot = table->entries[i].hash & mask;
+        while (slots[slot] != -1) slot = (slot + 1) & mask;
+        slots[slot] = i;
+    }
+
+    free(table->slots);
+    table->slots = slots;
+    table->slot_count = new_count;
+    return 0;
+}
+
+// Function to copy a symbol name into the string arena, returns its offset
+static int internName(symtab *table, const char *symbol, int length, uint32_t *offset) {
+    size_t needed = table->arena_size + length + 1;
+    if (needed > table->arena_capacity) {
+        size_t new_capacity = table->arena_capacity ? table->arena_capacity : SYMTAB_INITIAL_ARENA;
+        while (new_capacity < needed) new_capacity *= 2;
+        char *arena = realloc(table->arena, new_capacity);
+        if (!arena) return -1;
+        table->arena = arena;
+        table->arena_capacity = new_capacity;
+    }
+
+    *offset = table->arena_size;
+    memcpy(table->arena + table->arena_size, symbol, length);
+    table->arena[table->arena_size + length] = 0;
+    table->arena_size = needed;
+    return 0;
+}
+
+// Function to search for a label in the symbol table
+int searchSymtab(const symtab *table, const char *symbol, int length) {
+    return searchHashedSymtab(table, symbol, length, hashSymbol(symbol, length));
+}
+
+// Function to search for a label whose hash was already computed
+int searchHashedSymtab(const symtab *table, const char *symbol, int length, unsigned int hash) {
+    STATS_COUNT(COUNTER_SYMBOL_LOOKUPS, 1);
+    if (table->size == 0) return -1;
+
+    // An attached table has no slots, so its entries are scanned
+    if (table->slot_count == 0) {
+        for (int i = 0; i < table->size; i++) {
+            const symtab_entry *entry = &table->entries[i];
+            if (entry->hash == hash && entry->name_length == length &&
+                !memcmp(table->arena + entry->name_offset, symbol, length)) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    return table->slots[findSlot(table, symbol, length, hash)];
+}
+
+// Function to start loading the first slot a hash probes into the cache
+void prefetchSymbolSlot(const symtab *table, unsigned int hash) {
+    if (table->slot_count) __builtin_prefetch(&table->slots[hash & (table->slot_count - 1)]);
+}
+
+// Function to start loading the entry in the first slot a hash probes into
+// the cache (the slot itself should have been prefetched some time before)
+void prefetchSymbolEntry(const symtab *table, unsigned int hash) {
+    if (!table->slot_count) return;
+    int id = table->slots[hash & (table->slot_count - 1)];
+    if (id != -1) __builtin_prefetch(&table->entries[id]);
+}
+
+// Function to write to the symbol table
+int addToSymtab(symtab *table, const char *symbol, int length, int address) {
+    return addHashedToSymtab(table, symbol, length, hashSymbol(symbol, length), address);
+}
+
+// Function to insert a symbol, or with added to find the one that is already
+// there; without added an existing symbol is a duplicate
+static int insertSymbol(symtab *table, const char *symbol, int length, unsigned int hash, int address,
+                        int *added) {
+    if (table->is_attached) {
+        fprintf(getSymtabDiagnostics(table), "Error: Symbol table is read-only.\n");
+        return -1;
+    }
+
+    // Keep the slots at most half full so probe sequences stay short
+    if ((table->size + 1) * 2 > table->slot_count && growSlots(table) != 0) {
+        fprintf(getSymtabDiagnostics(table), "Error: Out of memory.\n");
+        return -1;
+    }
+
+    int slot = findSlot(table, symbol, length, hash);
+
+    // If the symbol is already in the symbtab, return error
+    if (table->slots[slot] != -1) {
+        if (added) {
+            *added = 0;
+            return table->slots[slot];
+        }
+        fprintf(getSymtabDiagnostics(table), "Error: Duplicate symbol '%.*s'.\n", length, symbol);
+        return -1;
+    }
+
+    // Grow the entry array geometrically
+    if (table->size == table->capacity) {
+        int new_capacity = table->capacity ? table->capacity * 2 : SYMTAB_INITIAL_SLOTS / 2;
+        symtab_entry *entries = realloc(table->entries, new_capacity * sizeof(symtab_entry));
+        if (!entries) {
+            fprintf(getSymtabDiagnostics(table), "Error: Out of memory.\n");
+            return -1;
+        }
+        table->entries = entries;
+        table->capacity = new_capacity;
+    }
+
+    // Insert the symbol into the symtab, along with its address
+    symtab_entry *entry = &table->entries[table->size];
+    if (internName(table, symbol, length, &entry->name_offset) != 0) {
+        fprintf(getSymtabDiagnostics(table), "Error: Out of memory.\n");
+        return -1;
+    }
+    entry->name_length = length;
+    entry->address = address;
+    entry->hash = hash;
+
+    table->slots[slot] = table->size++;
+    STATS_COUNT(COUNTER_SYMBOL_INSERTS, 1);
+    STATS_PEAK(PEAK_SYMBOLS, table->size);
+    STATS_PEAK(PEAK_SYMBOL_SLOTS, table->slot_count);
+    STATS_PEAK(PEAK_SYMBOL_ARENA, table->arena_size);
+    if (added) *added = 1;
+    return table->size - 1;
+}
+
+// Function to write to the symbol table with the hash of the name already known
+int addHashedToSymtab(symtab *table, const char *symbol, int length, unsigned int hash, int address) {
+    return insertSymbol(table, symbol, length, hash, address, NULL);
+}
+
+// Function to find a symbol, or to add it when it is not there yet
+int findOrAddToSymtab(symtab *table, const char *symbol, int length, int address, int *added) {
+    return insertSymbol(table, symbol, length, hashSymbol(symbol, length), address, added);
+}
+
+// Function to get the name of a symbol
+const char *getSymbolName(const symtab *table, int id) {
+    return table->arena + table->entries[id].name_offset;
+}
+
+// Function to get the address of a symbol
+int getSymbolAddress(const symtab *table, int id) {
+    return table->entries[id].address;
+}
+
+// Function to change the address of a symbol
+void setSymbolAddress(symtab *table, int id, int address) {
+    table->entries[id].address = address;
+}
+
+// ------x--------x----------x------------x------ SYMTAB ----------------x------------x----------------x-----------x
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
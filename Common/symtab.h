@@ -0,0 +1,83 @@
+#ifndef SYMTAB_H
+#define SYMTAB_H
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdint.h>
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// ------x--------x----------x------------x------ SYMTAB ----------------x------------x----------------x-----------x
+
+// Structure for each symbol table entry. The name lives in the string arena
+// of the table, so labels of any length are stored without truncation.
+// The index of an entry is its symbol id and never changes. Fields have
+// fixed widths so the entries can be written to and mapped from a file.
+typedef struct {
+    uint32_t name_offset;
+    int32_t name_length;
+    int32_t address;
+    uint32_t hash;
+} symtab_entry;
+
+// Open-addressing hash table over the entries, with linear probing.
+// slots[] holds entry indexes (-1 for an empty slot) and is kept at most
+// half full, so both the entries and the slots grow without a fixed limit.
+typedef struct {
+    symtab_entry *entries;
+    int size;
+    int capacity;
+
+    int *slots;
+    int slot_count;
+
+    char *arena;
+    size_t arena_size;
+    size_t arena_capacity;
+
+    // Set when entries and arena are borrowed (e.g. from a mapped file)
+    int is_attached;
+
+    // Where errors are reported (stderr when NULL)
+    FILE *diagnostics;
+} symtab;
+
+void initSymtab(symtab *table);
+void freeSymtab(symtab *table);
+void resetSymtab(symtab *table);
+
+// Function to use entries and names that live elsewhere (read-only) as the
+// table. Lookups by id are free; lookups by name scan the entries.
+void attachSymtab(symtab *table, const symtab_entry *entries, int count, const char *arena, size_t arena_size);
+
+// Function to find a symbol, returns its id or -1 if it is not defined
+int searchSymtab(const symtab *table, const char *symbol, int length);
+
+// Function to define a symbol, returns its id or -1 if it is a duplicate
+// (or memory runs out)
+int addToSymtab(symtab *table, const char *symbol, int length, int address);
+
+// Function to hash a symbol name, and to define a symbol whose hash was
+// already computed (e.g. by another thread)
+unsigned int hashSymbol(const char *symbol, int length);
+int addHashedToSymtab(symtab *table, const char *symbol, int length, unsigned int hash, int address);
+
+// Function to find a symbol, or to add it with the given address when it is
+// not in the table yet, with a single probe; *added tells which happened
+int findOrAddToSymtab(symtab *table, const char *symbol, int length, int address, int *added);
+
+// Function to find a symbol whose hash was already computed, and to start
+// loading the slot, then the entry, such a search reads first into the
+// cache, so many searches can overlap their cache misses
+int searchHashedSymtab(const symtab *table, const char *symbol, int length, unsigned int hash);
+void prefetchSymbolSlot(const symtab *table, unsigned int hash);
+void prefetchSymbolEntry(const symtab *table, unsigned int hash);
+
+// Accessors for a symbol id
+const char *getSymbolName(const symtab *table, int id);
+int getSymbolAddress(const symtab *table, int id);
+void setSymbolAddress(symtab *table, int id, int address);
+
+// ------x--------x----------x------------x------ SYMTAB ----------------x------------x----------------x-----------x
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+
+#endif
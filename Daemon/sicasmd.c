@@ -0,0 +1,208 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+#include "../Common/pool.h"
+#include "../Common/protocol.h"
+#include "../Common/sic.h"
+
+// Assembly daemon: listens on a Unix domain socket and assembles the
+// programs sent to it (see Common/protocol.h), so editors and build tools
+// pay no process startup or file I/O per program.
+//
+// Every worker thread owns one assembler context for its whole life, so
+// the lines and SYMTAB of each worker stay allocated between requests.
+// Workers take requests, not connections: open connections wait in one
+// epoll set, and each request goes to whichever worker is free, so clients
+// that stay connected between requests hold no worker.
+
+// Seconds a client may take to send the rest of a request (or to take its
+// result) before its connection is closed
+#define REQUEST_TIMEOUT 10
+
+const char *socket_path = DEFAULT_SOCKET_PATH;
+int listen_fd = -1;
+int poll_fd = -1;
+
+// Function to print how the daemon is invoked
+void printUsage(const char *name) {
+    fprintf(stderr, "Usage: %s [options]\n", name);
+    fprintf(stderr, "  -s <path>            Socket to listen on (default: %s)\n", DEFAULT_SOCKET_PATH);
+    fprintf(stderr, "  -j <threads>         Requests served at the same time (default: one per processor)\n");
+    fprintf(stderr, "  -h, --help           Show this message\n");
+}
+
+// Function to remove the socket when the daemon is stopped
+void stopDaemon(int signal_number) {
+    (void)signal_number;
+    unlink(socket_path);
+    _exit(0);
+}
+
+// Function to wait for the next event of fd. EPOLLONESHOT gives every
+// event to a single worker, and fd is left out until it is armed again.
+int watchDescriptor(int fd, int operation) {
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN | EPOLLONESHOT;
+    event.data.fd = fd;
+    return epoll_ctl(poll_fd, operation, fd, &event);
+}
+
+// Function to accept a new connection and wait for its first request
+void acceptConnection(void) {
+    int fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+    if (fd < 0 && errno != EAGAIN && errno != EINTR && errno != ECONNABORTED) perror("accept");
+    if (watchDescriptor(listen_fd, EPOLL_CTL_MOD) != 0) perror("epoll_ctl");
+    if (fd < 0) return;
+
+    // A client that stops halfway through a request only holds its worker for so long
+    struct timeval timeout = {REQUEST_TIMEOUT, 0};
+    if (setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) != 0 ||
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout)) != 0 ||
+        watchDescriptor(fd, EPOLL_CTL_ADD) != 0) {
+        perror("connection");
+        close(fd);
+    }
+}
+
+// Function to serve the next request of a connection, returns -1 when the
+// connection is done (closed by the client, or after an error)
+int serveRequest(sic_context *ctx, int fd) {
+    source_buffer source;
+    sic_options options;
+    sic_result result;
+
+    errno = 0;
+    int status = receiveAssembleRequest(fd, &source, &options);
+    if (status != 0) {
+        if (status < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            fprintf(stderr, "Error: Request timed out, closing the connection.\n");
+        } else if (status < 0) {
+            fprintf(stderr, "Error: Malformed request, closing the connection.\n");
+        }
+        return -1;
+    }
+
+    sic_assemble(ctx, &source, &options, &result);
+    closeSourceBuffer(&source);
+
+    status = sendAssembleResult(fd, &result);
+    sic_free_result(&result);
+    return status;
+}
+
+// Function run by every worker: take the next ready connection and serve
+// one request of it, forever
+void *runWorker(void *argument) {
+    (void)argument;
+    sic_context ctx;
+    sic_init_context(&ctx);
+
+    for (;;) {
+        struct epoll_event event;
+        int count = epoll_wait(poll_fd, &event, 1, -1);
+        if (count < 0 && errno == EINTR) continue;
+        if (count < 0) {
+            perror("epoll_wait");
+            break;
+        }
+        if (count == 0) continue;
+
+        int fd = event.data.fd;
+        if (fd == listen_fd) {
+            acceptConnection();
+        } else if (serveRequest(&ctx, fd) != 0 || watchDescriptor(fd, EPOLL_CTL_MOD) != 0) {
+            close(fd);
+        }
+    }
+
+    sic_free_context(&ctx);
+    return NULL;
+}
+
+int main(int argc, char *argv[]) {
+    int thread_count = getProcessorCount();
+
+    // Parse the command line options
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-s") && i + 1 < argc) {
+            socket_path = argv[++i];
+        } else if (!strcmp(argv[i], "-j") && i + 1 < argc) {
+            thread_count = atoi(argv[++i]);
+            if (thread_count < 1) thread_count = 1;
+        } else if (!strcmp(argv[i], "-h") || !strcmp(argv[i], "--help")) {
+            printUsage(argv[0]);
+            return 0;
+        } else {
+            fprintf(stderr, "Error: Unknown option '%s'.\n", argv[i]);
+            printUsage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "Error: Socket path '%s' is too long.\n", socket_path);
+        return EXIT_FAILURE;
+    }
+    strcpy(address.sun_path, socket_path);
+
+    // A socket left behind by an earlier daemon is replaced. Accepting does
+    // not block, as a connection may be gone by the time a worker takes it.
+    listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0) {
+        perror("socket");
+        return EXIT_FAILURE;
+    }
+    unlink(socket_path);
+    if (bind(listen_fd, (struct sockaddr *)&address, sizeof(address)) != 0 || listen(listen_fd, 64) != 0) {
+        perror(socket_path);
+        close(listen_fd);
+        return EXIT_FAILURE;
+    }
+
+    // New connections and requests on open ones all come from one epoll set
+    poll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (poll_fd < 0 || watchDescriptor(listen_fd, EPOLL_CTL_ADD) != 0) {
+        perror("epoll");
+        unlink(socket_path);
+        close(listen_fd);
+        return EXIT_FAILURE;
+    }
+
+    // A client that goes away must not kill the daemon
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT, stopDaemon);
+    signal(SIGTERM, stopDaemon);
+
+    printf("Listening on %s with %d threads.\n", socket_path, thread_count);
+    fflush(stdout);
+
+    // The main thread is the last worker
+    for (int i = 1; i < thread_count; i++) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, runWorker, NULL) != 0) {
+            perror("pthread_create");
+            break;
+        }
+        pthread_detach(thread);
+    }
+    runWorker(NULL);
+
+    unlink(socket_path);
+    close(poll_fd);
+    close(listen_fd);
+    return EXIT_FAILURE;
+}
@@ -0,0 +1,126 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../Common/handoff.h"
+#include "../Common/linker.h"
+#include "../Common/pool.h"
+#include "../Common/stats.h"
+
+// Linking loader: links the control sections of many object programs (the
+// H / D / R / T / M / E records sicasm writes for CSECT sources) into one
+// program loaded from a single address. External symbols are resolved
+// through an ESTAB built on the thread pool, M records are applied to every
+// section in parallel, and the relocated program is written as one object
+// program that sicsim runs. The link time and ESTAB statistics go to stderr.
+//
+//   gcc -O2 siclink.c ../Common/*.c -o siclink -lpthread
+//   ./siclink [-o output] [-a address] [-j threads] [-m] object_program...
+
+// Function to print how the linker is invoked
+void printUsage(const char *name) {
+    fprintf(stderr, "Usage: %s [options] object_program...\n", name);
+    fprintf(stderr, "  object_program       Object programs to link, loaded in the order given\n");
+    fprintf(stderr, "  -o <file>            Linked program to write, - for stdout (default: object_program.txt)\n");
+    fprintf(stderr, "  -a <address>         Hex address to load the program at (default: the first section's own)\n");
+    fprintf(stderr, "  -j <threads>         Threads to link on (default: one per processor)\n");
+    fprintf(stderr, "  --binary             Write the linked program in binary, as code segments\n");
+    fprintf(stderr, "  --image              Write the linked program as one binary memory image, to be mapped\n");
+    fprintf(stderr, "  -m, --map            Print the load map to stdout\n");
+    fprintf(stderr, "  -q, --quiet          Do not print the link time and ESTAB statistics\n");
+    fprintf(stderr, "  --stats[=json|text]  Print per-phase times, counters and peak sizes to stderr\n");
+    fprintf(stderr, "  -h, --help           Show this message\n");
+}
+
+int main(int argc, char *argv[]) {
+    const char *output_path = "object_program.txt";
+    int path_count = 0;
+    int program_address = -1;
+    int thread_count = 0;
+    char format = 't';
+    int map = 0;
+    int quiet = 0;
+    int stats = 0;
+    int stats_json = 0;
+
+    // Parse the command line options; the object programs are gathered at
+    // the front of argv, which no option is read from again
+    for (int i = 1; i < argc; i++) {
+        int stats_option = parseStatsOption(argv[i], &stats_json);
+        if (stats_option < 0) {
+            return EXIT_FAILURE;
+        } else if (stats_option > 0) {
+            stats = 1;
+        } else if (!strcmp(argv[i], "-o") && i + 1 < argc) {
+            output_path = argv[++i];
+        } else if (!strcmp(argv[i], "-a") && i + 1 < argc) {
+            char *end;
+            long address = strtol(argv[++i], &end, 16);
+            if (*end || end == argv[i] || address < 0 || address >= (1 << 24)) {
+                fprintf(stderr, "Error: Invalid load address '%s'.\n", argv[i]);
+                return EXIT_FAILURE;
+            }
+            program_address = address;
+        } else if (!strcmp(argv[i], "-j") && i + 1 < argc) {
+            thread_count = atoi(argv[++i]);
+            if (thread_count < 1) thread_count = 1;
+        } else if (!strcmp(argv[i], "--binary")) {
+            format = 'b';
+        } else if (!strcmp(argv[i], "--image")) {
+            format = 'i';
+        } else if (!strcmp(argv[i], "-m") || !strcmp(argv[i], "--map")) {
+            map = 1;
+        } else if (!strcmp(argv[i], "-q") || !strcmp(argv[i], "--quiet")) {
+            quiet = 1;
+        } else if (!strcmp(argv[i], "-h") || !strcmp(argv[i], "--help")) {
+            printUsage(argv[0]);
+            return 0;
+        } else if (argv[i][0] == '-' && argv[i][1]) {
+            fprintf(stderr, "Error: Unknown option '%s'.\n", argv[i]);
+            printUsage(argv[0]);
+            return EXIT_FAILURE;
+        } else {
+            argv[path_count++] = argv[i];
+        }
+    }
+    if (path_count == 0) {
+        printUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (stats && enableStats() != 0) {
+        return EXIT_FAILURE;
+    }
+    if (thread_count == 0) thread_count = getProcessorCount();
+
+    linker link;
+    link_stats link_stats;
+    const char *const *paths = (const char *const *)argv;
+    int status = linkObjectFiles(&link, paths, path_count, program_address, thread_count, &link_stats);
+
+    // The output replaces an existing file only once it is complete
+    if (status == 0) {
+        int to_stdout = !strcmp(output_path, "-");
+        atomic_file output;
+        memset(&output, 0, sizeof(output));
+        if (!to_stdout && openAtomicFile(&output, output_path) != 0) {
+            status = -1;
+        } else {
+            FILE *out = to_stdout ? stdout : output.file;
+            status = writeLinkedProgram(&link, format, out);
+            if (to_stdout) {
+                if (fflush(stdout) != 0) status = -1;
+            } else if (status == 0) {
+                status = commitAtomicFile(&output);
+            } else {
+                discardAtomicFile(&output);
+            }
+        }
+    }
+
+    if (status == 0 && map) printLoadMap(&link, stdout);
+    if (status == 0 && !quiet) printLinkStats(&link_stats, thread_count, stderr);
+    if (stats) printStats(stderr, stats_json);
+
+    freeLinker(&link);
+    return status == 0 ? 0 : EXIT_FAILURE;
+}
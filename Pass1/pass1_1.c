@@ -1,343 +1,108 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/stat.h>
-#include <sys/types.h>
-#include <errno.h>
-#include <direct.h>
 
 
-#define MAX_FIELD_LENGTH 20
-#define MAX_LINE_LENGTH 100
-#define MAX_SYMTAB_SIZE 100
-#define MAX_OPTAB_SIZE 100
+#include "../Common/cache.h"
+#include "../Common/handoff.h"
+#include "../Common/intermediate.h"
+#include "../Common/macro.h"
+#include "../Common/program.h"
+#include "../Common/stats.h"
 
-// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
-// ------x--------x----------x------------x------ OPTAB ----------------x------------x----------------x-----------x
-
-// Structure for each opcode entry
-typedef struct {
-    char mnemonic[MAX_FIELD_LENGTH];
-    int opcode;
-} optab_entry;
-
-// Global array for the opcode table
-optab_entry optab[MAX_OPTAB_SIZE];
-int optab_size = 0;
-
-// Structure for the opcode lookup table
-typedef struct {
-    char mnemonic[MAX_FIELD_LENGTH];
-    int opcode;
-} opcode_mapping;
-
-// Predefined opcode mapping table
-opcode_mapping optab_map[] = {
-    // Data Transfer Instructions
-    {"LDA", 0x00},  // Load accumulator
-    {"LDX", 0x04},  // Load index register
-    {"LDL", 0x08},  // Load L register
-    {"STA", 0x0C},  // Store accumulator
-    {"STX", 0x10},  // Store index register
-    {"STL", 0x14},  // Store L register
-    {"TIX", 0x2C},  // Test index register
-    {"LDCH", 0x50}, // Load character to accumulator
-    {"STCH", 0x54}, // Store character from accumulator
-    {"RMO", 0xAC},  // Register to memory operation
-
-    // Arithmetic Instructions
-    {"ADD", 0x18},  // Add
-    {"SUB", 0x1C},  // Subtract
-    {"MUL", 0x20},  // Multiply
-    {"DIV", 0x24},  // Divide
-    {"COMP", 0x28}, // Compare
-    {"TIXR", 0x2C}, // Test index register (register form)
-    {"CLEAR", 0xB4}, // Clear register
-    {"TIX", 0x2C},  // Test index register (SIC)
-    {"INC", 0x14},  // Increment register
-
-    // Control Instructions
-    {"JMP", 0x1F},  // Jump
-    {"JSR", 0x20},  // Jump to subroutine
-    {"JSP", 0x24},  // Jump to subroutine (indirect)
-    {"RET", 0x2C},  // Return
-    {"RSUB", 0x4C}, // Return from subroutine
-    {"BALR", 0x58}, // Branch and link register
-    {"BR", 0x1F},   // Branch (conditional)
-    
-    // Logical Operations
-    {"AND", 0x40},  // Logical AND
-    {"OR", 0x44},   // Logical OR
-    {"NOT", 0x4C},  // Logical NOT
-    {"XOR", 0x60},  // Exclusive OR
-
-    // Input/Output Instructions
-    {"RD", 0xD8},   // Read
-    {"WD", 0xDC},   // Write
-    {"SSK", 0xEC},  // Set switch key
-
-    // Control Flow
-    {"BR", 0x1F},   // Branch
-    {"BCR", 0x2F},  // Branch conditional
-    {"BS", 0x4F},   // Branch and save return address
-
-    // Extended Opcodes (SIC/XE)
-    {"LDX", 0x04},  // Load index register (Extended)
-    {"LDA", 0x00},  // Load accumulator (Extended)
-    {"STA", 0x0C},  // Store accumulator (Extended)
-    {"STX", 0x10},  // Store index (Extended)
-    {"JMP", 0x1F},  // Jump (Extended)
-    {"JSR", 0x20},  // Jump to subroutine (Extended)
-    {"SVC", 0xB4},  // Supervisor call
-    {"RSUB", 0x4C}, // Return from subroutine (Extended)
-    {"TIX", 0x2C},  // Test index register (SIC)
-
-    // Program Control Instructions (SIC/XE)
-    {"CSECT", 0x00}, // Control section
-    {"END", 0x00},   // End of program
-
-    // Miscellaneous Instructions
-    {"NOP", 0x00},   // No operation
-    {"HALT", 0x00},  // Halt
-    {"WAIT", 0x00},  // Wait (halt)
-
-    // More instructions can be added
-};
-
-
-// Function to add an entry to the OPTAB
-void addToOptab(const char *mnemonic, int opcode) {
-    // Check if the mnemonic is already in OPTAB
-    for (int i = 0; i < optab_size; i++) {
-        if (strcmp(optab[i].mnemonic, mnemonic) == 0) {
-            return;  // If it exists, do nothing
-        }
-    }
 
-    // Add new entry to OPTAB if space is available
-    if (optab_size < MAX_OPTAB_SIZE) {
-        strcpy(optab[optab_size].mnemonic, mnemonic);
-        optab[optab_size].opcode = opcode;
-        optab_size++;
-    } else {
-        printf("OPTAB is full, cannot add more entries.\n");
-    }
-}
 
-// Function to write the OPTAB to a file (optab.txt)
-void writeOptabToFile() {
-    FILE *optab_file = fopen("optab.txt", "w");
-    if (!optab_file) {
-        perror("Error opening optab.txt for writing");
-        return;
+// Function to write the files pass 2 reads straight into output_dir. Each is
+// written under a temporary name and renamed into place, so a pass 2 (or
+// another pass 1) working in the same directory never sees a partial file.
+int saveFiles(const program *prog, const char *output_dir) {
+    // Create the output directory (and its parents) if it doesn't exist
+    if (makeDirectories(output_dir) != 0) {
+        return -1;
     }
 
+    // Define the target files in the output directory
+    char *intermediateOutFile = joinPath(output_dir, "intermediate.bin");
+    char *symtabOutFile = joinPath(output_dir, "symtab.txt");
+    char *optabOutFile = joinPath(output_dir, "optab.txt");
+    char *sourceOutFile = joinPath(output_dir, "source.txt");
 
-    for (int i = 0; i < optab_size; i++) {
-        fprintf(optab_file, "%-10s %-10X\n", optab[i].mnemonic, optab[i].opcode);
+    int status = 0;
+    if (!intermediateOutFile || !symtabOutFile || !optabOutFile || !sourceOutFile) {
+        fprintf(stderr, "Error: Out of memory.\n");
+        status = -1;
     }
 
-    fclose(optab_file);
-    printf("Successfully written to the Optab.\n");
-}
-
-// Function to get the opcode for a given mnemonic from the mapping table
-int getOpcode(const char *mnemonic) {
-    // Search through the opcode mapping table
-    for (int i = 0; i < sizeof(optab_map) / sizeof(optab_map[0]); i++) {
-        if (strcmp(optab_map[i].mnemonic, mnemonic) == 0) {
-            return optab_map[i].opcode;  // Return the opcode if found
-        }
+    // Write the binary intermediate file, the symtab to the symtab.txt & optab to optab.txt
+    if (status == 0 &&
+        (writeBinaryIntermediate(prog, intermediateOutFile) != 0 ||
+         writeSymtabToFile(prog, symtabOutFile) != 0 ||
+         writeOptabToFile(prog, optabOutFile) != 0)) {
+        status = -1;
     }
-    return -1;  // Return -1 if mnemonic is not found
-}
-
-// ------x--------x----------x------------x------ OPTAB ----------------x------------x----------------x-----------x
-// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
 
-
-
-// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
-// ------x--------x----------x------------x------ SYMTAB ----------------x------------x----------------x-----------x
-
-// Structure for each symbol table entry to store symbol and it's address
-typedef struct{
-    char symbol[MAX_FIELD_LENGTH];
-    int address;
-}symbtab_entry;
-
-
-// An array of structures for the symbol table
-symbtab_entry symtab[MAX_SYMTAB_SIZE];
-int symtab_size = 0;
-
-
-// Function to search for a label in the symbol table
-int searchSymtab(const char* symbol){
-
-    // Check and compare the current symbol with every symbol in the symtab
-    for(int i=0;i<symtab_size;i++){
-        if(!strcmp(symtab[i].symbol, symbol)) return i; // Return the index if the symbol is found
+    // The source is the one file pass 1 does not write; the kernel copies it
+    if (status == 0 && handOffFile("source.txt", sourceOutFile) != 0) {
+        status = -1;
     }
 
-    // Return -1 if the symbol is not found
-    return -1;
+    free(intermediateOutFile);
+    free(symtabOutFile);
+    free(optabOutFile);
+    free(sourceOutFile);
+    return status;
 }
 
 
-// Function to write to the symbol table
-void addToSymtab(const char* symbol, int address){
-
-    // If the symbol is already in the symbtab, return error
-    if(searchSymtab(symbol) != -1){
-        fprintf(stderr, "Error: Duplicate symbol '%s'.\n", symbol);
-        return;
-    }
-
-    // If the size of the symbtab maxes out
-    if(symtab_size >= MAX_SYMTAB_SIZE){
-        fprintf(stderr, "Error: Symbol table is full.\n");
-        return;
-    }
-
-    // Insert the symbol into the symtab, along with its address
-    strcpy(symtab[symtab_size].symbol, symbol);
-    symtab[symtab_size].address = address;
-    symtab_size++;
-}
 
+// Files pass 1 writes for pass 2, and the parts of a cache entry they are kept in
+static const char *const cached_files[] = {"intermediate.bin", "symtab.txt", "optab.txt"};
+static const cache_part cached_parts[] = {CACHE_INTERMEDIATE, CACHE_SYMTAB, CACHE_OPTAB};
 
-// Fucntion to write the symbol table to a text file
-void writeSymtabToFile() {
-    FILE* symtab_file = fopen("symtab.txt", "w");
-    if (!symtab_file) {
-        perror("Error opening symtab.txt");
-        return;
+// Function to replay a pass 1 found in the cache: its messages and LOCCTR
+// table, and the files for pass 2 written as the pass wrote them
+int replayCachedPass1(const cache_entry *entry, const char *output_dir) {
+    fwrite(entry->parts[CACHE_DIAGNOSTICS], 1, entry->part_sizes[CACHE_DIAGNOSTICS], stderr);
+    fwrite(entry->parts[CACHE_LISTING], 1, entry->part_sizes[CACHE_LISTING], stdout);
+    if (makeDirectories(output_dir) != 0) {
+        return -1;
     }
 
-
-    for (int i = 0; i < symtab_size; i++) {
-        fprintf(symtab_file, "%-10s %04X\n", symtab[i].symbol, symtab[i].address);
+    int status = 0;
+    for (int i = 0; status == 0 && i < 3; i++) {
+        char *path = joinPath(output_dir, cached_files[i]);
+        status = path ? writeCachePart(entry, cached_parts[i], path) : -1;
+        free(path);
     }
 
-    fclose(symtab_file);
-    printf("Successfully written to the Symtab.\n");
-}
-
-// ------x--------x----------x------------x------ SYMTAB ----------------x------------x----------------x-----------x
-// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
-
-
-// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
-// ------x--------x----------x------------x------ INTERMEDIATE ----------------x------------x----------x-----------x
-// Structure for each instruction, to store label, mnemonic and operand
-typedef struct {
-    char label[MAX_FIELD_LENGTH];
-    char mnemonic[MAX_FIELD_LENGTH];
-    char operand[MAX_FIELD_LENGTH];
-} source_line;
-
-
-
-// Function to get the instruction size
-int getInstructionSize(const char *mnemonic, const char *operand) {
-    // WORD -> 3 size
-    // RESW -> 3 * sizeof(operand)
-    // RESB -> sizeof(operand)
-    // Byte: 
-    //     starts with "C" then it's a char -> length of string inside the quotes
-    //     starts with "X" then it's a hexa -> hexadecimal bytes
-    // Default size of instruction for SIC -> 3
-
-    if (!strcmp(mnemonic, "WORD")) return 3;
-    else if (!strcmp(mnemonic, "RESW")) return 3 * atoi(operand);
-    else if (!strcmp(mnemonic, "RESB")) return atoi(operand);
-    else if (!strcmp(mnemonic, "BYTE")) {
-        if (operand[0] == 'C') return strlen(operand) - 3; // Length of string inside quotes
-        else if (operand[0] == 'X') return (strlen(operand) - 3) / 2; // Hexadecimal bytes
+    char *sourceOutFile = joinPath(output_dir, "source.txt");
+    if (status == 0 && (!sourceOutFile || handOffFile("source.txt", sourceOutFile) != 0)) {
+        status = -1;
     }
-    else return 3;
-
-    return 0;
+    free(sourceOutFile);
+    return status;
 }
 
-// ------x--------x----------x------------x------ INTERMEDIATE ----------------x------------x----------------x-----------x
-// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
-
-
-
-void saveFiles() {
-    // Create the "Pass2" directory if it doesn't exist
-    if (_mkdir("E:/SIC-Assembler/Pass2") == -1) {
-        if (errno != EEXIST) {  // If it's not "already exists" error, print error
-            perror("Error creating directory");
-            return;
-        }
-    }
-
-    // Define the source files in the Pass1 folder (relative paths)
-    char sourceFile[] = "source.txt";
-    char intermediateFile[] = "intermediate.txt";
-    char symtabFile[] = "symtab.txt";
-    char optabFile[] = "optab.txt";
-
-    
-
-    // Define the target files in the Pass2 folder (relative paths)
-    char sourceOutFile[] = "E:/SIC-Assembler/Pass2/source.txt";
-    char intermediateOutFile[] = "E:/SIC-Assembler/Pass2/intermediate.txt";
-    char symtabOutFile[] = "E:/SIC-Assembler/Pass2/symtab.txt";
-    char optabOutFile[] = "E:/SIC-Assembler/Pass2/optab.txt";
-
-    // Open the source files for reading
-    FILE *source_in = fopen(sourceFile, "r");
-    FILE *intermediate_in = fopen(intermediateFile, "r");
-    FILE *symtab_in = fopen(symtabFile, "r");
-    FILE *optab_in = fopen(optabFile, "r");
-
-    if (source_in == NULL || intermediate_in == NULL || symtab_in == NULL || optab_in == NULL) {
-        perror("Error opening one or more source files for reading");
-        return;
-    }
-
-    // Open the target files for writing
-    FILE *source_out = fopen(sourceOutFile, "w");
-    FILE *intermediate_out = fopen(intermediateOutFile, "w");
-    FILE *symtab_out = fopen(symtabOutFile, "w");
-    FILE *optab_out = fopen(optabOutFile, "w");
-
-    if (source_out == NULL || intermediate_out == NULL || symtab_out == NULL || optab_out == NULL) {
-        perror("Error opening one or more target files for writing");
-        return;
+// Function to store a finished pass 1 in the cache, with the files for
+// pass 2 read back from output_dir
+void storePass1(assembly_cache *cache, cache_key key, cache_entry *entry, const char *output_dir) {
+    source_buffer files[3];
+    memset(files, 0, sizeof(files));
+    int status = 0;
+    for (int i = 0; status == 0 && i < 3; i++) {
+        char *path = joinPath(output_dir, cached_files[i]);
+        status = path ? openSourceBuffer(&files[i], path) : -1;
+        free(path);
+        entry->parts[cached_parts[i]] = files[i].data;
+        entry->part_sizes[cached_parts[i]] = files[i].size;
     }
 
-    // Example: Copying content from Pass1 files to Pass2 files
-    char ch;
-    while ((ch = fgetc(source_in)) != EOF) {
-        fputc(ch, source_out);
+    if (status == 0) {
+        storeCache(cache, key, entry);
     }
-    while ((ch = fgetc(intermediate_in)) != EOF) {
-        fputc(ch, intermediate_out);
+    for (int i = 0; i < 3; i++) {
+        closeSourceBuffer(&files[i]);
     }
-    while ((ch = fgetc(symtab_in)) != EOF) {
-        fputc(ch, symtab_out);
-    }
-    while ((ch = fgetc(optab_in)) != EOF) {
-        fputc(ch, optab_out);
-    }
-
-    // Close the files
-    fclose(source_in);
-    fclose(intermediate_in);
-    fclose(symtab_in);
-    fclose(optab_in);
-
-    fclose(source_out);
-    fclose(intermediate_out);
-    fclose(symtab_out);
-    fclose(optab_out);
-
-    printf("Files saved in 'Pass2' directory successfully.\n");
 }
 
 
@@ -345,133 +110,152 @@ void saveFiles() {
 // XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
 // ------x--------x----------x------------x------ MAIN ----------------x------------x----------------x-----------x
 
-int main() {
-    // A pointer for the source file
-    // line is a character array for each instruction in the source file
-    // current_line is a structure to store label, mnemonic and operand for the current instruction
-    FILE *source_file, *intermediate_file;
-    char line[MAX_LINE_LENGTH];
-    source_line current_line;
-
-    // Initialising the location counter -> locctr
-    int locctr = 0;
-
-    // We will get the start address based on the start directive
-    // but if start directive is not there, then we'll assume the start address to be 0
-    int start_address = 0, is_start_found = 0;
-
-    // Opening the source file
-    source_file = fopen("source.txt", "r");
-    if (!source_file) {
-        perror("Error opening the file.");
-        return EXIT_FAILURE;
+int main(int argc, char *argv[]) {
+    // With -q / --quiet the LOCCTR table is not printed, with --stats[=json]
+    // the time of every phase and the counters are printed to stderr, and
+    // -o / --output-dir chooses where the files for pass 2 are written, and
+    // --cache (or SICASM_CACHE) names an assembly cache to replay an
+    // unchanged source from
+    int quiet = 0;
+    const char *cache_dir = getenv("SICASM_CACHE");
+    const char *output_dir = "../Pass2";
+    int stats = 0;
+    int stats_json = 0;
+    for (int i = 1; i < argc; i++) {
+        int stats_option = parseStatsOption(argv[i], &stats_json);
+        if (stats_option < 0) {
+            return EXIT_FAILURE;
+        } else if (stats_option > 0) {
+            stats = 1;
+        } else if (!strcmp(argv[i], "-q") || !strcmp(argv[i], "--quiet")) {
+            quiet = 1;
+        } else if ((!strcmp(argv[i], "-o") || !strcmp(argv[i], "--output-dir")) && i + 1 < argc) {
+            output_dir = argv[++i];
+        } else if (!strcmp(argv[i], "--cache") && i + 1 < argc) {
+            cache_dir = argv[++i];
+        } else {
+            fprintf(stderr, "Usage: %s [-q] [-o output-dir] [--cache dir] [--stats[=json|text]]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
     }
-
-    // Opening the intermediate file
-    intermediate_file = fopen("intermediate.txt", "w");
-    if (!intermediate_file) {
-        perror("Error opening the file.");
+    if (stats && enableStats() != 0) {
         return EXIT_FAILURE;
     }
 
-    // Printing table header
-    printf("%-10s %-10s %-10s %-10s\n", "LOCCTR", "Label", "Mnemonic", "Operand");
-    printf("------------------------------------------------------\n");
-
-    // Reading through the source file
-    printf("Reading the source file.\n");
-    while (fgets(line, sizeof(line), source_file)) {
-        // Remove the newline character from the end of the line
-        line[strcspn(line, "\n")] = 0;
-
-        // Initialising label, mnemonic and operand as empty strings
-        // for the current instruction 
-        strcpy(current_line.label, "");
-        strcpy(current_line.mnemonic, "");
-        strcpy(current_line.operand, "");
-
-        // If the instruction does not start with a tab or space then it has all three
-        // label, mnemonic and operand
-        if (line[0] != ' ' && line[0] != '\t') {
-            sscanf(line, "%s %s %s", current_line.label, current_line.mnemonic, current_line.operand);
-        } else {
-            // If the line starts with tab or space it only has mnemonic and operand
-            sscanf(line, "%s %s", current_line.mnemonic, current_line.operand);
-        }
+    // source is the memory-mapped source file
+    // prog is the in-memory program shared by both passes: its lines
+    // (LOCCTR, label, mnemonic, operand), SYMTAB and OPTAB
+    source_buffer source;
+    program prog;
 
+    // Opening the source file
+    if (openSourceBuffer(&source, "source.txt") != 0) {
+        return EXIT_FAILURE;
+    }
 
-        // If the instruction has a label
-        if (strlen(current_line.label) > 0) { 
-            addToSymtab(current_line.label, locctr);
+    // A source pass 1 has already been run on is replayed from the cache;
+    // otherwise the listing and messages are kept to be stored with the files
+    assembly_cache cache;
+    cache_key key;
+    cache_entry entry;
+    char *listing_text = NULL, *diagnostics_text = NULL;
+    size_t listing_size = 0, diagnostics_size = 0;
+    FILE *listing = quiet ? NULL : stdout;
+    FILE *diagnostics = stderr;
+    if (cache_dir && cache_dir[0]) {
+        if (openCache(&cache, cache_dir, 0) != 0) {
+            closeSourceBuffer(&source);
+            return EXIT_FAILURE;
         }
-
-        // Add the mnemonic to the OPTAB if it is not already there
-        if (strlen(current_line.mnemonic) > 0) {
-            // Get the opcode for the mnemonic
-            int opcode = getOpcode(current_line.mnemonic);
-            if (opcode != -1) {
-                addToOptab(current_line.mnemonic, opcode);  // Add to OPTAB if opcode found
+        char options[64];
+        snprintf(options, sizeof(options), "pass1 listing=%d", !quiet);
+        key = getCacheKey(source.data, source.size, options);
+        if (lookupCache(&cache, key, &entry)) {
+            printf("Reading the source file (cached).\n");
+            int status = replayCachedPass1(&entry, output_dir);
+            releaseCacheEntry(&entry);
+            closeCache(&cache);
+            closeSourceBuffer(&source);
+            if (status != 0) {
+                return EXIT_FAILURE;
+            }
+            printf("Successfully written to the Symtab.\n");
+            printf("Successfully written to the Optab.\n");
+            printf("Files saved in '%s' directory successfully.\n", output_dir);
+            if (stats) {
+                printStats(stderr, stats_json);
             }
+            return 0;
         }
-
-        // Handling the start directive
-        if (!strcmp(current_line.mnemonic, "START")) {
-            // Assign the starting address to locctr
-            locctr = strtol(current_line.operand, NULL, 16);
-
-            // If start address is found assign it to start_address
-            // and is_start_found becomes true
-            start_address = locctr;
-            is_start_found = 1;
-
-            // Print the first instruction with LOCCTR
-            printf("%-10X %-10s %-10s %-10s\n", locctr, current_line.label, current_line.mnemonic, current_line.operand);
-            
-            // Write the instruction in the intermediate file
-            fprintf(intermediate_file, "%-10X %-10s %-10s %-10s\n", locctr, current_line.label, current_line.mnemonic, current_line.operand);
-
-            // No further computing needed for starting address
-            continue;
+        diagnostics = open_memstream(&diagnostics_text, &diagnostics_size);
+        if (!quiet) listing = open_memstream(&listing_text, &listing_size);
+        if (!diagnostics || (!quiet && !listing)) {
+            perror("open_memstream");
+            closeCache(&cache);
+            closeSourceBuffer(&source);
+            return EXIT_FAILURE;
         }
+    }
 
-        // Print the LOCCTR and current instruction
-        printf("%-10X %-10s %-10s %-10s\n", locctr, current_line.label, current_line.mnemonic, current_line.operand);
-
-        // Write the instruction in the intermediate file
-        fprintf(intermediate_file, "%-10X %-10s %-10s %-10s\n", locctr, current_line.label, current_line.mnemonic, current_line.operand);
-
-        // Increment the locctr according to the instruction size
-        int increment = getInstructionSize(current_line.mnemonic, current_line.operand);
-
-        // Check for any error in getting the size
-        if (increment == 0) {
-            fprintf(stderr, "Error: Unknown mnemonic '%s' on line: %s\n", current_line.mnemonic, line);
+    // Reading through the source file
+    printf("Reading the source file.\n");
+    initProgram(&prog);
+    setDiagnostics(&prog, diagnostics);
+
+    // Macro calls are expanded in memory, pass 1 reads the expanded source
+    int status = 0;
+    if (hasMacros(source.data, source.size)) {
+        source_buffer expanded;
+        status = expandMacros(source.data, source.size, &expanded, diagnostics);
+        if (status == 0) {
+            closeSourceBuffer(&source);
+            source = expanded;
         }
-
-        locctr += increment;
     }
+    if (status == 0) status = runPass1(&prog, source.data, source.size);
 
-    // Finalize
-    if (!is_start_found) {
-        fprintf(stderr, "Warning: No START directive found. LOCCTR starts from 0.\n");
+    // Print the LOCCTR and every instruction
+    if (status == 0 && listing) {
+        printListing(&prog, listing);
     }
-    printf("------------------------------------------------------\n");
-    printf("Starting Address: %04X\n", start_address);
-    printf("End Address: %04X\n", locctr);
-    printf("Program Length: %04X\n", locctr - start_address);
-
-    // Write the symtab to the symtab.txt & optab to optab.txt
-    writeSymtabToFile();
-    writeOptabToFile();
-
-
-    // Closing the source & intermediate file
-    fclose(source_file);
-    fclose(intermediate_file);
 
+    // Save the files in the output directory, where pass 2 reads them
+    if (status == 0) {
+        status = saveFiles(&prog, output_dir);
+    }
 
-    // Save the files in the Pass2 folder as well
-    saveFiles();
+    // The captured output is printed, and stored with the files on success
+    if (diagnostics != stderr) {
+        if (listing) fclose(listing);
+        fclose(diagnostics);
+        fwrite(diagnostics_text, 1, diagnostics_size, stderr);
+        fwrite(listing_text, 1, listing_size, stdout);
+        if (status == 0) {
+            memset(&entry, 0, sizeof(entry));
+            entry.parts[CACHE_LISTING] = listing_text;
+            entry.part_sizes[CACHE_LISTING] = listing_size;
+            entry.parts[CACHE_DIAGNOSTICS] = diagnostics_text;
+            entry.part_sizes[CACHE_DIAGNOSTICS] = diagnostics_size;
+            entry.line_count = prog.line_count;
+            storePass1(&cache, key, &entry, output_dir);
+        }
+        free(listing_text);
+        free(diagnostics_text);
+        closeCache(&cache);
+    }
+    if (status != 0) {
+        freeProgram(&prog);
+        closeSourceBuffer(&source);
+        return EXIT_FAILURE;
+    }
+    printf("Successfully written to the Symtab.\n");
+    printf("Successfully written to the Optab.\n");
+    printf("Files saved in '%s' directory successfully.\n", output_dir);
+    freeProgram(&prog);
+    closeSourceBuffer(&source);
+    if (stats) {
+        printStats(stderr, stats_json);
+    }
 
     return 0;
 }
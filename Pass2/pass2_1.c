@@ -1,144 +1,116 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <unistd.h>
 
-#define MAX_LINE_LENGTH 100
-#define MAX_SYMBOLS 50
-#define MAX_OPCODES 50
+#include "../Common/handoff.h"
+#include "../Common/intermediate.h"
+#include "../Common/program.h"
+#include "../Common/stats.h"
 
-// Define structures for symbol table and opcode table
-struct Symbol
+// Function to run pass 2 over the mapped intermediate.bin written by pass 1.
+// Its records, SYMTAB and strings are used in place, nothing is parsed.
+int assembleBinary(program *prog, FILE *objectProgramFile)
 {
-    char name[10];
-    char address[10];
-};
-
-struct Opcode
-{
-    char mnemonic[10];
-    char code[10];
-};
-
-// Function to parse the symbol table
-int parseSymbolTable(FILE *symtabFile, struct Symbol symbols[])
-{
-    int count = 0;
-    char line[MAX_LINE_LENGTH];
-    while (fgets(line, sizeof(line), symtabFile))
+    binary_intermediate intermediate;
+    if (openBinaryIntermediate(&intermediate, "intermediate.bin") != 0)
     {
-        sscanf(line, "%s %s", symbols[count].name, symbols[count].address);
-        count++;
+        return -1;
     }
-    return count;
+
+    int status = runBinaryPass2(prog, &intermediate, objectProgramFile);
+
+    // The SYMTAB points into the mapping, so it goes first
+    freeProgram(prog);
+    closeBinaryIntermediate(&intermediate);
+    return status;
 }
 
-// Function to parse the opcode table
-int parseOpcodeTable(FILE *optabFile, struct Opcode opcodes[])
+// Function to run pass 2 over the text intermediate.txt and symtab.txt.
+// Only the SYMTAB is loaded up front, the intermediate file is streamed.
+int assembleText(program *prog, FILE *objectProgramFile)
 {
-    int count = 0;
-    char line[MAX_LINE_LENGTH];
-    while (fgets(line, sizeof(line), optabFile))
+    if (readSymtabFile(prog, "symtab.txt") != 0)
     {
-        sscanf(line, "%s %s", opcodes[count].mnemonic, opcodes[count].code);
-        count++;
+        return -1;
     }
-    return count;
-}
 
-// Function to parse the intermediate file
-int parseIntermediate(FILE *intermediateFile, char intermediate[][3][MAX_LINE_LENGTH])
-{
-    int count = 0;
-    char line[MAX_LINE_LENGTH];
-    while (fgets(line, sizeof(line), intermediateFile))
+    source_buffer intermediate;
+    if (openSourceBuffer(&intermediate, "intermediate.txt") != 0)
     {
-        sscanf(line, "%s %s %s", intermediate[count][0], intermediate[count][1], intermediate[count][2]);
-        count++;
+        freeProgram(prog);
+        return -1;
     }
-    return count;
+
+    int status = runStreamingPass2(prog, intermediate.data, intermediate.size, objectProgramFile);
+
+    freeProgram(prog);
+    closeSourceBuffer(&intermediate);
+    return status;
 }
 
-// Function to look up the symbol address
-char *lookupSymbol(struct Symbol symbols[], int symbolCount, const char *name)
+int main(int argc, char *argv[])
 {
-    for (int i = 0; i < symbolCount; i++)
+    // With --stats[=json] the time of every phase and the counters are printed to stderr
+    int stats = 0;
+    int stats_json = 0;
+    for (int i = 1; i < argc; i++)
     {
-        if (strcmp(symbols[i].name, name) == 0)
+        int stats_option = parseStatsOption(argv[i], &stats_json);
+        if (stats_option < 0)
         {
-            return symbols[i].address;
+            return 1;
         }
+        stats |= stats_option;
     }
-    return NULL;
-}
-
-// Function to look up the opcode machine code
-char *lookupOpcode(struct Opcode opcodes[], int opcodeCount, const char *mnemonic)
-{
-    for (int i = 0; i < opcodeCount; i++)
+    if (stats && enableStats() != 0)
     {
-        if (strcmp(opcodes[i].mnemonic, mnemonic) == 0)
-        {
-            return opcodes[i].code;
-        }
+        return 1;
     }
-    return NULL;
-}
 
-int main()
-{
-    FILE *intermediateFile = fopen("intermediate.txt", "r");
-    FILE *symtabFile = fopen("symtab.txt", "r");
-    FILE *optabFile = fopen("optab.txt", "r");
-    FILE *objectProgramFile = fopen("object_program.txt", "w");
+    // The OPTAB is compiled in, so optab.txt is not read
+    program prog;
+    initProgram(&prog);
 
-    if (!intermediateFile || !symtabFile || !optabFile || !objectProgramFile)
+    // The object program replaces the old one only once it is complete
+    atomic_file objectProgram;
+    if (openAtomicFile(&objectProgram, "object_program.txt") != 0)
     {
         printf("Error opening files.\n");
         return 1;
     }
+    FILE *objectProgramFile = objectProgram.file;
 
-    struct Symbol symbols[MAX_SYMBOLS];
-    struct Opcode opcodes[MAX_OPCODES];
-    char intermediate[MAX_SYMBOLS][3][MAX_LINE_LENGTH]; // To store intermediate records
-
-    int symbolCount = parseSymbolTable(symtabFile, symbols);
-    int opcodeCount = parseOpcodeTable(optabFile, opcodes);
-    int intermediateCount = parseIntermediate(intermediateFile, intermediate);
-
-    // Write the header record
-    fprintf(objectProgramFile, "H^\tFIRST^\t%s\t^%s\n", intermediate[0][0], intermediate[intermediateCount - 1][0]);
+    // Prefer the binary intermediate file, older text files still work
+    int status;
+    if (access("intermediate.bin", R_OK) == 0)
+    {
+        status = assembleBinary(&prog, objectProgramFile);
+    }
+    else
+    {
+        status = assembleText(&prog, objectProgramFile);
+    }
 
-    // Write the text records
-    fprintf(objectProgramFile, "T^\t%s^", intermediate[0][0]);
-    for (int i = 0; i < intermediateCount; i++)
+    // Close all files
+    if (status == 0)
     {
-        char *opcode = lookupOpcode(opcodes, opcodeCount, intermediate[i][1]);
-        if (opcode)
-        {
-            // Lookup the operand in the symbol table if present
-            char *operandAddress = lookupSymbol(symbols, symbolCount, intermediate[i][2]);
-            if (operandAddress)
-            {
-                // Combine opcode with operand address
-                fprintf(objectProgramFile, "\t%s%s\t", opcode, operandAddress);
-            }
-            else
-            {
-                // If operand address not found, handle accordingly (e.g., use 0)
-                fprintf(objectProgramFile, "%s0000", opcode);
-            }
-        }
+        status = commitAtomicFile(&objectProgram);
+    }
+    else
+    {
+        discardAtomicFile(&objectProgram);
     }
-    fprintf(objectProgramFile, "\n");
 
-    // Write the end record
-    fprintf(objectProgramFile, "E^\t%s\n", intermediate[0][0]);
+    if (stats)
+    {
+        printStats(stderr, stats_json);
+    }
 
-    // Close all files
-    fclose(intermediateFile);
-    fclose(symtabFile);
-    fclose(optabFile);
-    fclose(objectProgramFile);
+    if (status != 0)
+    {
+        return 1;
+    }
 
     printf("Object program generated successfully!\n");
     return 0;
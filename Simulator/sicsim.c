@@ -0,0 +1,123 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../Common/objimage.h"
+#include "../Common/simulator.h"
+#include "../Common/source.h"
+
+// SIC simulator: loads an object program (H / T / E records, or the binary
+// form written by sicasm --binary / --image or objconv) and runs it from
+// its entry address. What the program writes with WD goes to stdout;
+// the instruction count and rate go to stderr, so many programs can be run
+// and their outputs compared against expected ones.
+//
+//   gcc -O2 sicsim.c ../Common/*.c -o sicsim -lpthread
+//   ./sicsim [-i input] [-n limit] [-r] [-q] [object_program.txt]
+
+#define DEFAULT_INSTRUCTION_LIMIT 1000000000LL
+
+// Function to print how the simulator is invoked
+void printUsage(const char *name) {
+    fprintf(stderr, "Usage: %s [options] [object_program]\n", name);
+    fprintf(stderr, "  object_program       Object program to run, - for stdin (default: object_program.txt)\n");
+    fprintf(stderr, "  -i <file>            Bytes the program reads with RD (default: none)\n");
+    fprintf(stderr, "  -n <count>           Stop after this many instructions (default: %lld)\n", DEFAULT_INSTRUCTION_LIMIT);
+    fprintf(stderr, "  -r, --registers      Print the registers when the program stops\n");
+    fprintf(stderr, "  -q, --quiet          Do not print the instruction count and rate\n");
+    fprintf(stderr, "  -h, --help           Show this message\n");
+}
+
+// Function to get the current time in seconds
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Function to print the registers as A=000000 X=... SW=...
+void printRegisters(const sic_machine *machine, FILE *out) {
+    static const char *const names[SIM_REGISTER_COUNT] = {"A", "X", "L", "B", "S", "T", NULL, NULL, "PC", "SW"};
+    for (int i = 0; i < SIM_REGISTER_COUNT; i++) {
+        if (names[i]) fprintf(out, "%s=%06X%s", names[i], machine->registers[i], i == SIM_SW ? "\n" : " ");
+    }
+}
+
+int main(int argc, char *argv[]) {
+    const char *object_path = "object_program.txt";
+    const char *input_path = NULL;
+    long long limit = DEFAULT_INSTRUCTION_LIMIT;
+    int registers = 0;
+    int quiet = 0;
+
+    // Parse the command line options
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-i") && i + 1 < argc) {
+            input_path = argv[++i];
+        } else if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+            limit = atoll(argv[++i]);
+            if (limit < 1) limit = 1;
+        } else if (!strcmp(argv[i], "-r") || !strcmp(argv[i], "--registers")) {
+            registers = 1;
+        } else if (!strcmp(argv[i], "-q") || !strcmp(argv[i], "--quiet")) {
+            quiet = 1;
+        } else if (!strcmp(argv[i], "-h") || !strcmp(argv[i], "--help")) {
+            printUsage(argv[0]);
+            return 0;
+        } else if (argv[i][0] == '-' && argv[i][1]) {
+            fprintf(stderr, "Error: Unknown option '%s'.\n", argv[i]);
+            printUsage(argv[0]);
+            return EXIT_FAILURE;
+        } else {
+            object_path = argv[i];
+        }
+    }
+
+    sic_machine machine;
+    if (initMachine(&machine, stdout) != 0) {
+        fprintf(stderr, "Error: Out of memory.\n");
+        return EXIT_FAILURE;
+    }
+
+    source_buffer input;
+    memset(&input, 0, sizeof(input));
+    if (input_path && openSourceBuffer(&input, input_path) != 0) {
+        freeMachine(&machine);
+        return EXIT_FAILURE;
+    }
+    machine.input = (const unsigned char *)input.data;
+    machine.input_size = input.size;
+
+    loaded_program program;
+    if (loadObjectFile(object_path, machine.memory, SIM_MEMORY_SIZE, &program, stderr) != 0) {
+        if (input_path) closeSourceBuffer(&input);
+        freeMachine(&machine);
+        return EXIT_FAILURE;
+    }
+
+    double start = now();
+    sim_stop stop = runMachine(&machine, program.entry_address, limit);
+    double seconds = now() - start;
+    if (flushOutputBuffer(&machine.output) != 0) {
+        perror("stdout");
+    }
+    fflush(stdout);
+
+    if (stop == SIM_LIMIT) {
+        fprintf(stderr, "Warning: Stopped after %lld instructions at %06X.\n", machine.instructions,
+                machine.registers[SIM_PC]);
+    }
+    if (registers) {
+        printRegisters(&machine, stderr);
+    }
+    if (!quiet) {
+        if (seconds <= 0) seconds = 1e-9;
+        fprintf(stderr, "Executed %lld instructions (%lld decoded) in %.3f s, %.1f M instructions/s\n",
+                machine.instructions, machine.decoded_count, seconds, machine.instructions / seconds / 1e6);
+    }
+
+    if (input_path) closeSourceBuffer(&input);
+    freeMachine(&machine);
+    return stop == SIM_FAULT ? EXIT_FAILURE : 0;
+}
@@ -0,0 +1,61 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../Common/intermediate.h"
+#include "../Common/program.h"
+
+// Dumps a binary intermediate file (intermediate.bin) in the layout of the
+// old intermediate.txt, and optionally its SYMTAB in the layout of symtab.txt.
+//
+//   gcc dump_intermediate.c ../Common/*.c -o dump_intermediate -lpthread
+//   ./dump_intermediate [-s] [intermediate.bin]
+
+int main(int argc, char *argv[]) {
+    const char *path = "intermediate.bin";
+    int dump_symtab = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-s")) dump_symtab = 1;
+        else path = argv[i];
+    }
+
+    binary_intermediate file;
+    if (openBinaryIntermediate(&file, path) != 0) {
+        return EXIT_FAILURE;
+    }
+
+    program prog;
+    initProgram(&prog);
+    attachBinaryIntermediate(&prog, &file);
+
+    // Records, as "%-10X %-10s %-10s %-10s"
+    for (uint32_t i = 0; i < file.header->line_count; i++) {
+        source_line line;
+        loadRecord(&file, i, &line);
+
+        const char *mnemonic = prog.text + line.mnemonic.offset;
+        int mnemonic_length = line.mnemonic.length;
+        if (line.opcode_id != -1) {
+            mnemonic = optab[line.opcode_id].mnemonic;
+            mnemonic_length = strlen(mnemonic);
+        }
+
+        // Format 4 instructions in their + form
+        printf("%-10X %-10s %s%-*.*s %-10.*s\n", line.locctr, getLineLabel(&prog, &line),
+               line.format == 4 ? "+" : "", line.format == 4 ? 9 : 10, mnemonic_length, mnemonic,
+               line.operand.length, prog.text + line.operand.offset);
+    }
+
+    // SYMTAB, as "%-10s %04X"
+    if (dump_symtab) {
+        printf("\n");
+        for (int i = 0; i < prog.symtab.size; i++) {
+            printf("%-10s %04X\n", getSymbolName(&prog.symtab, i), getSymbolAddress(&prog.symtab, i));
+        }
+    }
+
+    freeProgram(&prog);
+    closeBinaryIntermediate(&file);
+    return 0;
+}
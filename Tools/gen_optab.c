@@ -0,0 +1,151 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+// Generator for Common/optab_hash.h, the perfect hash over the mnemonics in
+// Common/optab.def. It rejects duplicate mnemonics and instructions that
+// share an opcode, then searches for a multiplier that maps every mnemonic
+// to its own slot.
+//
+//   gcc gen_optab.c -o gen_optab
+//   ./gen_optab ../Common/optab_hash.h
+
+#define MAX_HASH_BITS 10
+#define MAX_TRIES 1000000
+
+// Structure for each mnemonic read from optab.def
+typedef struct {
+    const char *mnemonic;
+    const char *enum_name;
+    int opcode;
+    int is_instruction;
+} definition;
+
+static const definition definitions[] = {
+#define OPCODE(name, opcode, format) {#name, "OP_" #name, opcode, 1},
+#define ALIAS(name, target) {#name, "OP_" #name, -1, 0},
+#define DIRECTIVE(name) {#name, "OP_" #name, -1, 0},
+#include "../Common/optab.def"
+#undef OPCODE
+#undef ALIAS
+#undef DIRECTIVE
+};
+
+#define DEFINITION_COUNT ((int)(sizeof(definitions) / sizeof(definitions[0])))
+
+// Function to pack a mnemonic of up to 8 characters into a key
+// (must match packMnemonic() in Common/optab.c)
+static uint64_t packMnemonic(const char *mnemonic) {
+    uint64_t key = 0;
+    for (int i = 0; mnemonic[i] && i < 8; i++) {
+        key |= (uint64_t)(unsigned char)mnemonic[i] << (8 * i);
+    }
+    return key;
+}
+
+// Function to step a xorshift generator for candidate multipliers
+static uint64_t nextRandom(uint64_t *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+// Function to check the definitions for duplicates and opcode conflicts
+static int checkDefinitions(void) {
+    int errors = 0;
+    for (int i = 0; i < DEFINITION_COUNT; i++) {
+        if (strlen(definitions[i].mnemonic) > 8) {
+            fprintf(stderr, "Error: Mnemonic '%s' is longer than 8 characters.\n", definitions[i].mnemonic);
+            errors++;
+        }
+        for (int j = 0; j < i; j++) {
+            if (!strcmp(definitions[i].mnemonic, definitions[j].mnemonic)) {
+                fprintf(stderr, "Error: Duplicate mnemonic '%s'.\n", definitions[i].mnemonic);
+                errors++;
+            } else if (definitions[i].is_instruction && definitions[j].is_instruction &&
+                       definitions[i].opcode == definitions[j].opcode) {
+                fprintf(stderr, "Error: '%s' and '%s' share opcode %02X.\n",
+                        definitions[j].mnemonic, definitions[i].mnemonic, definitions[i].opcode);
+                errors++;
+            }
+        }
+    }
+    return errors;
+}
+
+// Function to try one multiplier, filling slots[] if it is collision free
+static int tryMultiplier(uint64_t multiplier, int bits, int *slots) {
+    for (int i = 0; i < (1 << bits); i++) slots[i] = -1;
+
+    for (int i = 0; i < DEFINITION_COUNT; i++) {
+        int slot = (int)((packMnemonic(definitions[i].mnemonic) * multiplier) >> (64 - bits));
+        if (slots[slot] != -1) return 0;
+        slots[slot] = i;
+    }
+    return 1;
+}
+
+int main(int argc, char *argv[]) {
+    const char *output_path = argc > 1 ? argv[1] : "../Common/optab_hash.h";
+
+    if (checkDefinitions() != 0) {
+        return EXIT_FAILURE;
+    }
+
+    // Start from the smallest power of two that fits every mnemonic
+    int bits = 1;
+    while ((1 << bits) < DEFINITION_COUNT) bits++;
+
+    static int slots[1 << MAX_HASH_BITS];
+    uint64_t state = 0x9E3779B97F4A7C15ull;
+    uint64_t multiplier = 0;
+    int found = 0;
+    for (; bits <= MAX_HASH_BITS && !found; bits++) {
+        for (int attempt = 0; attempt < MAX_TRIES; attempt++) {
+            multiplier = nextRandom(&state) | 1;
+            if (tryMultiplier(multiplier, bits, slots)) {
+                found = 1;
+                break;
+            }
+        }
+    }
+    bits--;
+
+    if (!found) {
+        fprintf(stderr, "Error: No perfect hash found for %d mnemonics.\n", DEFINITION_COUNT);
+        return EXIT_FAILURE;
+    }
+
+    FILE *out = fopen(output_path, "w");
+    if (!out) {
+        perror("Error opening output file");
+        return EXIT_FAILURE;
+    }
+
+    fprintf(out, "// Generated by Tools/gen_optab from Common/optab.def, do not edit.\n\n");
+    fprintf(out, "#define OPTAB_HASH_ENTRIES %d\n", DEFINITION_COUNT);
+    fprintf(out, "#define OPTAB_HASH_MULTIPLIER 0x%016llXull\n", (unsigned long long)multiplier);
+    fprintf(out, "#define OPTAB_HASH_SHIFT %d\n\n", 64 - bits);
+
+    // Packed key of every mnemonic, to confirm a slot really holds it
+    fprintf(out, "static const uint64_t optab_hash_keys[OPTAB_COUNT] = {\n");
+    for (int i = 0; i < DEFINITION_COUNT; i++) {
+        fprintf(out, "    [%s] = 0x%016llXull,\n", definitions[i].enum_name,
+                (unsigned long long)packMnemonic(definitions[i].mnemonic));
+    }
+    fprintf(out, "};\n\n");
+
+    // Slot -> optab_id, -1 for an empty slot
+    fprintf(out, "static const signed char optab_hash_slots[%d] = {\n", 1 << bits);
+    for (int i = 0; i < (1 << bits); i++) {
+        if (slots[i] == -1) fprintf(out, "    -1,\n");
+        else fprintf(out, "    %s,\n", definitions[slots[i]].enum_name);
+    }
+    fprintf(out, "};\n");
+
+    fclose(out);
+    printf("%d mnemonics hashed into %d slots.\n", DEFINITION_COUNT, 1 << bits);
+    return 0;
+}
@@ -0,0 +1,295 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../Common/output.h"
+
+// Generates a valid synthetic SIC source program for benchmarks: a START
+// line, the given number of instruction and directive lines and an END
+// line. Every operand refers to a label that is defined, either earlier
+// (backward) or later (forward) in the program, at an address a SIC
+// instruction can hold (below 8000). Labels past that address are still
+// defined, so a large program keeps its share of labels, but nothing refers
+// to them. The same seed always gives the same program.
+//
+//   gcc -O2 gen_sic.c ../Common/output.c ../Common/stats.c -o gen_sic -lpthread
+//   ./gen_sic [-n lines] [-l label%] [-f forward%] [-d directive%]
+//             [-m word,resw,resb,byte] [-x indexed%] [-s seed] [-o file]
+
+// Instructions that take a memory operand
+static const char *const instructions[] = {
+    "LDA", "LDX", "LDL", "LDCH", "STA", "STX", "STL", "STCH", "ADD", "SUB", "MUL", "DIV",
+    "COMP", "TIX", "J", "JEQ", "JGT", "JLT", "JSUB", "AND", "OR", "TD", "RD", "WD",
+};
+#define INSTRUCTION_COUNT (int)(sizeof(instructions) / sizeof(instructions[0]))
+
+// Directives, in the order of their weights in -m
+static const char *const directives[] = {"WORD", "RESW", "RESB", "BYTE"};
+#define DIRECTIVE_COUNT 4
+
+// Address the program starts at, and the first one a SIC instruction cannot
+// refer to (its address field has 15 bits)
+#define START_ADDRESS 0x1000
+#define ADDRESS_LIMIT 0x8000
+
+// Layout of a line, decided before any line is written so the address of
+// every label is known: its kind, which fixes its size, and LAYOUT_LABELED
+// for a line that defines a label. RESW, RESB and BYTE add their length - 1.
+#define LAYOUT_LABELED 0x80
+#define LAYOUT_INSTRUCTION 0
+#define LAYOUT_WORD 1
+#define LAYOUT_RESW 2       // 1 to 8 words
+#define LAYOUT_RESB 10      // 1 to 32 bytes
+#define LAYOUT_BYTE_C 42    // 1 to 8 characters
+#define LAYOUT_BYTE_X 50    // 1 to 4 bytes
+
+typedef struct {
+    long lines;
+    int label_percent;      // Lines that define a label
+    int forward_percent;    // Operands that refer to a label defined later
+    int directive_percent;  // Lines that are WORD, RESW, RESB or BYTE
+    int weights[DIRECTIVE_COUNT];
+    int indexed_percent;    // Instructions with ",X"
+    uint64_t seed;
+} generator_options;
+
+// Function to get the next number of a xorshift64* generator
+static uint64_t nextRandom(uint64_t *state) {
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+// Function to get a random number from 0 to limit - 1
+static long randomBelow(uint64_t *state, long limit) {
+    return (long)((nextRandom(state) >> 16) % (uint64_t)limit);
+}
+
+// Function to check whether a random event with the given percentage happens
+static int randomPercent(uint64_t *state, int percent) {
+    return randomBelow(state, 100) < percent;
+}
+
+// Function to append a label name ("L" and its number) in a field of width
+static void appendLabel(output_buffer *out, long number, int width) {
+    char name[24];
+    int length = snprintf(name, sizeof(name), "L%ld", number);
+    appendField(out, name, length, width);
+}
+
+// Function to append the mnemonic column
+static void appendMnemonic(output_buffer *out, const char *mnemonic) {
+    appendChar(out, ' ');
+    appendField(out, mnemonic, strlen(mnemonic), 7);
+    appendChar(out, ' ');
+}
+
+// Function to append a decimal number
+static void appendDecimal(output_buffer *out, long value) {
+    char digits[24];
+    appendBytes(out, digits, snprintf(digits, sizeof(digits), "%ld", value));
+}
+
+// Function to pick a directive by its weight
+static int pickDirective(const generator_options *options, uint64_t *random) {
+    int total = 0;
+    for (int i = 0; i < DIRECTIVE_COUNT; i++) total += options->weights[i];
+    long pick = randomBelow(random, total);
+    for (int i = 0; i < DIRECTIVE_COUNT; i++) {
+        if (pick < options->weights[i]) return i;
+        pick -= options->weights[i];
+    }
+    return 0;
+}
+
+// Function to pick the kind of a line (an instruction, or a directive and its length)
+static int pickLayout(const generator_options *options, uint64_t *random, long line) {
+    if (line == 0 || !randomPercent(random, options->directive_percent)) return LAYOUT_INSTRUCTION;
+
+    switch (pickDirective(options, random)) {
+    case 0: return LAYOUT_WORD;
+    case 1: return LAYOUT_RESW + randomBelow(random, 8);
+    case 2: return LAYOUT_RESB + randomBelow(random, 32);
+    default:
+        if (randomPercent(random, 50)) return LAYOUT_BYTE_C + randomBelow(random, 8);
+        return LAYOUT_BYTE_X + randomBelow(random, 4);
+    }
+}
+
+// Function to get the size in bytes of a line of the given kind
+static long getLayoutSize(int kind) {
+    if (kind >= LAYOUT_BYTE_X) return kind - LAYOUT_BYTE_X + 1;
+    if (kind >= LAYOUT_BYTE_C) return kind - LAYOUT_BYTE_C + 1;
+    if (kind >= LAYOUT_RESB) return kind - LAYOUT_RESB + 1;
+    if (kind >= LAYOUT_RESW) return 3 * (kind - LAYOUT_RESW + 1);
+    return 3;
+}
+
+// Function to append a directive line of the given kind, its constants picked at random
+static void appendDirective(output_buffer *out, int kind, uint64_t *random) {
+    static const char letters[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+    static const char hex[] = "0123456789ABCDEF";
+
+    long length = getLayoutSize(kind);
+    if (kind == LAYOUT_WORD) {
+        appendMnemonic(out, directives[0]);
+        appendDecimal(out, randomBelow(random, 10000));
+    } else if (kind < LAYOUT_RESB) {
+        appendMnemonic(out, directives[1]);
+        appendDecimal(out, length / 3);
+    } else if (kind < LAYOUT_BYTE_C) {
+        appendMnemonic(out, directives[2]);
+        appendDecimal(out, length);
+    } else if (kind < LAYOUT_BYTE_X) {
+        appendMnemonic(out, directives[3]);
+        appendString(out, "C'");
+        for (long i = 0; i < length; i++) appendChar(out, letters[randomBelow(random, 26)]);
+        appendChar(out, '\'');
+    } else {
+        appendMnemonic(out, directives[3]);
+        appendString(out, "X'");
+        for (long i = 0; i < 2 * length; i++) appendChar(out, hex[randomBelow(random, 16)]);
+        appendChar(out, '\'');
+    }
+}
+
+// Function to write the program. The layout of every line is decided
+// first, so a forward reference can name any label that is still to come
+// and every operand can stay below ADDRESS_LIMIT.
+static int generateProgram(const generator_options *options, FILE *file) {
+    unsigned char *layout = malloc(options->lines ? options->lines : 1);
+    if (!layout) {
+        fprintf(stderr, "Error: Out of memory.\n");
+        return -1;
+    }
+
+    // Labels are numbered in address order, so the ones operands may name
+    // are L0 up to L(addressable - 1)
+    uint64_t random = options->seed * 0x9E3779B97F4A7C15ULL + 1;
+    long label_count = 0;
+    long addressable = 0;
+    long locctr = START_ADDRESS;
+    for (long i = 0; i < options->lines; i++) {
+        // The first line is the entry point, so it always has a label
+        layout[i] = pickLayout(options, &random, i);
+        if (i == 0 || randomPercent(&random, options->label_percent)) {
+            layout[i] |= LAYOUT_LABELED;
+            label_count++;
+            if (locctr < ADDRESS_LIMIT) addressable = label_count;
+        }
+        locctr += getLayoutSize(layout[i] & ~LAYOUT_LABELED);
+    }
+
+    output_buffer out;
+    initOutputBuffer(&out, file);
+    appendField(&out, "GEN", 3, 8);
+    appendMnemonic(&out, "START");
+    appendString(&out, "1000\n");
+
+    long defined = 0;
+    for (long i = 0; i < options->lines; i++) {
+        if (layout[i] & LAYOUT_LABELED) appendLabel(&out, defined++, 8);
+        else appendField(&out, "", 0, 8);
+
+        int kind = layout[i] & ~LAYOUT_LABELED;
+        if (kind != LAYOUT_INSTRUCTION) {
+            appendDirective(&out, kind, &random);
+        } else {
+            // Labels from defined on are still to come; only the first
+            // addressable ones can be named
+            long behind = defined < addressable ? defined : addressable;
+            int forward = randomPercent(&random, options->forward_percent);
+            if (forward && defined >= addressable) forward = 0;
+            if (!forward && behind == 0) forward = 1;
+
+            appendMnemonic(&out, instructions[randomBelow(&random, INSTRUCTION_COUNT)]);
+            if (forward) appendLabel(&out, defined + randomBelow(&random, addressable - defined), 0);
+            else appendLabel(&out, randomBelow(&random, behind), 0);
+            if (randomPercent(&random, options->indexed_percent)) appendString(&out, ",X");
+        }
+        appendChar(&out, '\n');
+    }
+
+    appendField(&out, "", 0, 8);
+    appendMnemonic(&out, "END");
+    appendString(&out, options->lines > 0 ? "L0\n" : "\n");
+
+    free(layout);
+    return closeOutputBuffer(&out);
+}
+
+// Function to parse the directive weights of -m ("word,resw,resb,byte")
+static int parseWeights(const char *text, int *weights) {
+    int total = 0;
+    for (int i = 0; i < DIRECTIVE_COUNT; i++) {
+        char *end;
+        long value = strtol(text, &end, 10);
+        if (end == text || value < 0 || (i < DIRECTIVE_COUNT - 1 ? *end != ',' : *end != '\0')) return -1;
+        weights[i] = (int)value;
+        total += weights[i];
+        text = end + 1;
+    }
+    return total > 0 ? 0 : -1;
+}
+
+// Function to parse a percentage
+static int parsePercent(const char *text, int *percent) {
+    char *end;
+    long value = strtol(text, &end, 10);
+    if (end == text || *end != '\0' || value < 0 || value > 100) return -1;
+    *percent = (int)value;
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    generator_options options = {1000, 50, 30, 20, {40, 20, 20, 20}, 10, 1};
+    const char *path = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+        int status = value ? 0 : -1;
+        if (!strcmp(argv[i], "-n") && value) {
+            options.lines = strtol(value, NULL, 10);
+            if (options.lines < 0 || options.lines > 100000000) status = -1;
+        } else if (!strcmp(argv[i], "-l") && value) {
+            status = parsePercent(value, &options.label_percent);
+        } else if (!strcmp(argv[i], "-f") && value) {
+            status = parsePercent(value, &options.forward_percent);
+        } else if (!strcmp(argv[i], "-d") && value) {
+            status = parsePercent(value, &options.directive_percent);
+        } else if (!strcmp(argv[i], "-x") && value) {
+            status = parsePercent(value, &options.indexed_percent);
+        } else if (!strcmp(argv[i], "-m") && value) {
+            status = parseWeights(value, options.weights);
+        } else if (!strcmp(argv[i], "-s") && value) {
+            options.seed = strtoull(value, NULL, 10);
+        } else if (!strcmp(argv[i], "-o") && value) {
+            path = value;
+        } else {
+            status = -1;
+        }
+        if (status != 0) {
+            fprintf(stderr, "Usage: %s [-n lines] [-l label%%] [-f forward%%] [-d directive%%]\n"
+                            "       [-m word,resw,resb,byte] [-x indexed%%] [-s seed] [-o file]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+        i++;
+    }
+
+    FILE *file = path ? fopen(path, "w") : stdout;
+    if (!file) {
+        perror("Error opening output file");
+        return EXIT_FAILURE;
+    }
+    int status = generateProgram(&options, file);
+    if (fclose(file) != 0) status = -1;
+    if (status != 0) {
+        fprintf(stderr, "Error: Could not write the program.\n");
+        return EXIT_FAILURE;
+    }
+    return 0;
+}
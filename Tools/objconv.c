@@ -0,0 +1,81 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../Common/handoff.h"
+#include "../Common/objimage.h"
+#include "../Common/source.h"
+
+// Converts an object program between the H / T / E text records and the
+// binary forms (code segments, or one raw memory image that can be mapped).
+// The form of the input is recognised from its first bytes; both sizes are
+// printed to stderr.
+//
+//   gcc -O2 objconv.c ../Common/*.c -o objconv -lpthread
+//   ./objconv [-t|-b|-i] input output
+
+// Function to print how the converter is invoked
+void printUsage(const char *name) {
+    fprintf(stderr, "Usage: %s [-t|-b|-i] input output\n", name);
+    fprintf(stderr, "  -t                   Write H / T / E text records (default for a binary input)\n");
+    fprintf(stderr, "  -b                   Write binary code segments (default for a text input)\n");
+    fprintf(stderr, "  -i                   Write one binary memory image, to be mapped by a loader\n");
+    fprintf(stderr, "  input, output        Object programs, - for stdin / stdout\n");
+}
+
+int main(int argc, char *argv[]) {
+    const char *paths[2];
+    int path_count = 0;
+    char format = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-t") || !strcmp(argv[i], "-b") || !strcmp(argv[i], "-i")) {
+            format = argv[i][1];
+        } else if (!strcmp(argv[i], "-h") || !strcmp(argv[i], "--help")) {
+            printUsage(argv[0]);
+            return 0;
+        } else if ((argv[i][0] == '-' && argv[i][1]) || path_count == 2) {
+            printUsage(argv[0]);
+            return EXIT_FAILURE;
+        } else {
+            paths[path_count++] = argv[i];
+        }
+    }
+    if (path_count != 2) {
+        printUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    source_buffer input;
+    if (openSourceBuffer(&input, paths[0]) != 0) {
+        return EXIT_FAILURE;
+    }
+    if (!format) format = isBinaryObject(input.data, input.size) ? 't' : 'b';
+
+    // The output replaces an existing file only once it is complete
+    int to_stdout = !strcmp(paths[1], "-");
+    atomic_file output;
+    memset(&output, 0, sizeof(output));
+    if (!to_stdout && openAtomicFile(&output, paths[1]) != 0) {
+        closeSourceBuffer(&input);
+        return EXIT_FAILURE;
+    }
+    FILE *out = to_stdout ? stdout : output.file;
+
+    int status = convertObjectProgram(input.data, input.size, format, out, stderr);
+    long written = to_stdout ? -1 : ftell(out);
+    if (to_stdout) {
+        if (fflush(stdout) != 0) status = -1;
+    } else if (status == 0) {
+        status = commitAtomicFile(&output);
+    } else {
+        discardAtomicFile(&output);
+    }
+
+    if (status == 0 && written >= 0) {
+        fprintf(stderr, "%s: %zu bytes -> %s: %ld bytes (%.1f%%)\n", paths[0], input.size, paths[1], written,
+                input.size ? 100.0 * written / input.size : 0.0);
+    }
+    closeSourceBuffer(&input);
+    return status == 0 ? 0 : EXIT_FAILURE;
+}